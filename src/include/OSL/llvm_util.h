@@ -33,6 +33,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OSL/oslconfig.h>
 
 #include <vector>
+#include <map>
+#include <memory>
 
 #ifdef LLVM_NAMESPACE
 namespace llvm = LLVM_NAMESPACE;
@@ -145,6 +147,59 @@ public:
     /// End the current builder
     void end_builder ();
 
+    /// Choose the CPU that subsequently created JIT engines generate code
+    /// for. The target may be "host" (or empty) to detect the CPU we are
+    /// running on, "generic" for a baseline CPU with no particular
+    /// extensions, one of the ISA names "sse4.2", "avx2", or "avx512", or
+    /// any CPU name LLVM knows (e.g., "skylake"). Unless fma is true, the JIT
+    /// is not allowed to contract separate multiplies and adds into fused
+    /// multiply-adds, so that results don't depend on the target (the
+    /// target keeps its fma feature, and everything that comes with it). Return false (and leave the target as
+    /// "generic") if the target could not be resolved.
+    bool set_jit_target (string_view target, bool fma=false);
+
+    /// The CPU name chosen by set_jit_target ("" for generic).
+    const std::string& jit_cpu () const { return m_jit_cpu; }
+
+    /// The comma-separated feature list chosen by set_jit_target.
+    const std::string& jit_features () const { return m_jit_features; }
+
+    /// Does the current JIT target support all of the comma-separated
+    /// features (in LLVM syntax, e.g. "+avx2,+fma")?
+    bool jit_target_has (string_view features) const;
+
+    /// Mark every function in the current module as compiled for the JIT
+    /// target, replacing whatever target attributes they came with (for
+    /// example, from the precompiled shadeop bitcode). This keeps them
+    /// inlinable into the functions we generate.
+    void retarget_module ();
+
+    /// Trade floating point accuracy for speed in what is generated from
+    /// now on: float ops get LLVM's fast-math flags (all but those that
+    /// assume there are no NaNs or infinities), functions are compiled
+    /// with unsafe FP math, and call_function(name) calls "osl_fast_foo"
+    /// in place of "osl_foo" wherever the module has one.  Set it before
+    /// retarget_module, so that it applies to the shadeop bitcode too.
+    void fast_math (bool on) { m_fast_math = on; }
+    bool fast_math () const { return m_fast_math; }
+
+    /// Make profilers and debuggers able to see the code JITed by the
+    /// engines subsequently made.  If perf_map is true, every JITed
+    /// function is appended to /tmp/perf-<pid>.map (the file Linux perf
+    /// reads for JIT code).  If gdb is true, the code is registered with
+    /// GDB's JIT interface.
+    void jit_listeners (bool perf_map, bool gdb) {
+        m_jit_perf_map = perf_map;
+        m_jit_gdb = gdb;
+    }
+
+    /// Set the name under which profilers should show the JITed function
+    /// funcname (by default they see the LLVM function name).
+    void jit_symbol_label (const std::string &funcname,
+                           const std::string &label) {
+        m_jit_symbol_labels[funcname] = label;
+    }
+
     /// Create a new JITing ExecutionEngine and make it the current one.
     /// Return a pointer to the new engine.  If err is not NULL, put any
     /// errors there.
@@ -162,6 +217,26 @@ public:
     /// current one).
     void execengine (llvm::ExecutionEngine *exec);
 
+    /// Total bytes of machine code JITed by the engines this LLVM_Util
+    /// has made.
+    size_t jit_code_size () const { return m_jit_code_size; }
+
+    /// Should the engines made from now on JIT into memory of their own,
+    /// rather than into the per-thread memory that is kept for the life
+    /// of the process?  Private memory can be freed (see
+    /// take_jit_memory).
+    void private_jit_memory (bool on) { m_private_jit_memory = on; }
+
+    /// Take ownership of the private memory holding the code JITed so
+    /// far, and return a handle that frees it (making all the function
+    /// pointers into it invalid) when the last copy is destroyed.  Return
+    /// an empty handle if private_jit_memory isn't on or nothing has been
+    /// JITed.  Call it only once the engine has been destroyed.  Memory
+    /// that is never taken is kept forever.  Code in it that was
+    /// registered with GDB (see jit_listeners) is unregistered when it's
+    /// freed.
+    std::shared_ptr<void> take_jit_memory ();
+
     /// Change symbols in the module that are marked as having external
     /// linkage to an alternate linkage that allows them to be discarded if
     /// not used within the module. Only do this for functions that start
@@ -171,6 +246,13 @@ public:
                                        const std::vector<std::string> &exceptions,
                                        const std::vector<std::string> &moreexceptions);
 
+    /// Tally the calls that remain in func (typically after optimization,
+    /// to find what didn't get inlined), adding to counts by the name of
+    /// the called function.  LLVM intrinsics are not counted; calls
+    /// through a function pointer are counted as "(indirect)".
+    void count_calls (llvm::Function *func,
+                      std::map<std::string,int> &counts);
+
     /// Setup LLVM optimization passes.
     void setup_optimization_passes (int optlevel);
 
@@ -399,6 +481,13 @@ public:
     void op_branch (llvm::Value *cond, llvm::BasicBlock *trueblock,
                     llvm::BasicBlock *falseblock);
 
+    /// Like op_branch(cond,trueblock,falseblock), but also tell the
+    /// optimizer the relative likelihood of the two directions (for
+    /// example, from a profile of how often each was taken).
+    void op_branch (llvm::Value *cond, llvm::BasicBlock *trueblock,
+                    llvm::BasicBlock *falseblock,
+                    uint32_t trueweight, uint32_t falseweight);
+
     /// Generate code for a memset.
     void op_memset (llvm::Value *ptr, int val, int len, int align=1);
 
@@ -501,9 +590,11 @@ public:
 private:
     class MemoryManager;
     class IRBuilder;
+    class JITListener;
 
     void SetupLLVM ();
     IRBuilder& builder();
+    void set_function_target (llvm::Function *func);
 
     int m_debug;
     PerThreadInfo *m_thread;
@@ -515,6 +606,17 @@ private:
     llvm::legacy::PassManager *m_llvm_module_passes;
     llvm::legacy::FunctionPassManager *m_llvm_func_passes;
     llvm::ExecutionEngine *m_llvm_exec;
+    size_t m_jit_code_size = 0;
+    bool m_private_jit_memory = false;      ///< JIT into freeable memory
+    llvm::SectionMemoryManager *m_private_jitmm = nullptr;
+    std::string m_jit_cpu;                  ///< JIT target CPU ("" = generic)
+    std::string m_jit_features;             ///< JIT target features
+    bool m_jit_fma = false;                 ///< Allow FMA contraction
+    bool m_fast_math = false;               ///< Approximate float math
+    bool m_jit_perf_map = false;            ///< Write perf map entries
+    bool m_jit_gdb = false;                 ///< Register code with GDB
+    JITListener *m_jit_listener = nullptr;
+    std::map<std::string,std::string> m_jit_symbol_labels;
     std::vector<llvm::BasicBlock *> m_return_block;     // stack for func call
     std::vector<llvm::BasicBlock *> m_loop_after_block; // stack for break
     std::vector<llvm::BasicBlock *> m_loop_step_block;  // stack for continue
@@ -89,9 +89,14 @@ public:
     ///    int statistics:level   Automatically print OSL statistics (0).
     ///    string searchpath:shader  Colon-separated path to search for .oso
     ///                                files ("", meaning test "." only)
+    ///    int load_osob          Load the binary .osob written by
+    ///                              "oslc --binary" instead of a .oso
+    ///                              when it's at least as new (1).
     ///    string colorspace      Name of RGB color space ("Rec709")
     ///    int range_checking     Generate extra code for component & array
-    ///                              range checking (1)
+    ///                              range checking, except where the
+    ///                              optimizer proves the index is always
+    ///                              in range (1)
     ///    int debug_nan          Add extra (expensive) code to pinpoint
     ///                              when NaN/Inf happens (0).
     ///    int debug_uninit       Add extra (expensive) code to pinpoint
@@ -107,6 +112,13 @@ public:
     ///    int no_noise           Replace noise with constant value. (0)
     ///    int no_pointcloud      Skip pointcloud lookups. (0)
     ///    int exec_repeat        How many times to run each group (1).
+    ///    int fast_math          Trade accuracy for speed: approximate
+    ///                              transcendentals and gabor noise, give
+    ///                              perlin noise a cheaper (only C1) fade,
+    ///                              and let LLVM reassociate float math
+    ///                              (but still honor NaNs and infinities).
+    ///                              Cell and hash noise are unchanged. The
+    ///                              default for groups made from now on. (0)
     ///    int opt_warnings       Warn on certain failure to runtime-optimize
     ///                              cetain shader constructs. (0)
     ///    int gpu_opt_error      Consider a hard error if certain shader
@@ -134,6 +146,44 @@ public:
     ///    int lazyunconnected    Run layers lazily even if they have no
     ///                              output connections (1). For debugging.
     ///    int lazy_userdata      Retrieve userdata lazily (0).
+    ///    int opt_share_groups   Let groups that are identical (after
+    ///                              optimization) share a single optimized
+    ///                              and JITed copy of their code (0).
+    ///    int opt_share_layers   Let identical layers (after optimization)
+    ///                              of different groups call a single
+    ///                              copy of their JITed code (0).
+    ///    int opt_respecialize   Let ReParameter change parameters whose
+    ///                              values were optimized into the code, by
+    ///                              re-optimizing and re-JITing the changed
+    ///                              layer and those downstream of it with
+    ///                              the new value (0). Costs memory for an
+    ///                              unoptimized copy of each group.
+    ///    int opt_raytype_variants  Compile separate variants of each group
+    ///                              specialized for each combination of the
+    ///                              ray types it queries (up to 16), lazily
+    ///                              on first use, and run the one matching
+    ///                              ShaderGlobals::raytype (0).
+    ///    int opt_noderivs_raytypes Bit mask of ray types (see raytype_bit())
+    ///                              that never need derivatives: points
+    ///                              shaded with any of them run a variant
+    ///                              of the group compiled with all
+    ///                              derivatives stripped, alongside the
+    ///                              normal one.  Their texture lookups take
+    ///                              the filter footprint from the u, v
+    ///                              (texture), P (texture3d) or I
+    ///                              (environment) derivatives supplied in
+    ///                              the ShaderGlobals; Dx() etc. return 0.
+    ///    int opt_uniform_layers Run layers whose results can't differ from
+    ///                              point to point only once per object,
+    ///                              as identified by ShaderGlobals.objdata,
+    ///                              and reuse their results (0). Only
+    ///                              enable if objdata is unique per object
+    ///                              from get_context to release_context.
+    ///    string[] uniform_attributes  Names of attributes (as retrieved
+    ///                              by getattribute) and userdata that are
+    ///                              the same at every point of an object,
+    ///                              so that "opt_uniform_layers" may still
+    ///                              run layers using them once per object.
     ///    int userdata_isconnected  Should lockgeom=0 params (that may
     ///                              receive userdata) return true from
     ///                              isconnected()? (0)
@@ -144,16 +194,31 @@ public:
     ///                              means a param CANNOT be overridden by
     ///                              interpolated geometric parameters.
     ///    int countlayerexecs    Add extra code to count total layers run.
+    ///    int pgo_instrument     Add extra code to groups JITed after it's
+    ///                              set that counts their parameter
+    ///                              accesses and how often each branch is
+    ///                              taken, for a profile that
+    ///                              archive_shadergroup() saves (0).
     ///    int allow_shader_replacement Allow shader to be specified more than
     ///                              once, replacing former definition.
     ///    string archive_groupname  Name of a group to pickle and archive.
     ///    string archive_filename   Name of file to save the group archive.
+    ///    string compile_trace   Name of a file to which to write, when
+    ///                              the ShadingSystem is destroyed, a trace
+    ///                              (in Chrome's trace event JSON format)
+    ///                              of when each thread loaded masters,
+    ///                              waited for group locks, and ran each
+    ///                              phase of optimizing and JITing groups.
+    ///                              No tracing if empty ("").
     /// 3. Attributes that that are intended for developers debugging
     /// liboslexec itself:
     /// These attributes may be helpful for liboslexec developers or
     /// for debugging, but probably not for using OSL in production:
     ///    int debug              Set debug output level (0)
     ///    int clearmemory        Zero out working memory before each shade (0)
+    ///                              -- just the parts that could be read
+    ///                              before they're written.  Takes effect
+    ///                              for groups JITed after it's set.
     ///    int optimize           Runtime optimization level (2)
     ///       And there are several int options that, if set to 0, will turn
     ///       off individual classes of runtime optimizations:
@@ -162,8 +227,23 @@ public:
     ///         opt_peephole, opt_coalesce_temps, opt_assign, opt_mix
     ///         opt_merge_instances, opt_merge_instance_with_userdata,
     ///         opt_fold_getattribute, opt_middleman, opt_texture_handle
-    ///         opt_seed_bblock_aliases
+    ///         opt_seed_bblock_aliases, opt_skip_untouched_ops
     ///    int opt_passes         Number of optimization passes per layer (10)
+    ///    int opt_skip_untouched_ops  After the first optimization pass
+    ///                              over a layer, skip the folding, elision
+    ///                              and peepholes of ops that use no symbol
+    ///                              changed by the previous pass, and stop
+    ///                              as soon as a pass changes nothing (1).
+    ///                              A heuristic to save optimization time,
+    ///                              not a dataflow analysis; the stats
+    ///                              opt_ops_skipped and the "optimize ops"
+    ///                              time show what it saves.
+    ///    int opt_layer_threads  Threads used to optimize the layers of a
+    ///                              group that don't depend on each other
+    ///                              (layers at the same depth of the
+    ///                              connection graph) concurrently; 1
+    ///                              optimizes them one at a time, 0 uses
+    ///                              all hardware threads (1).
     ///    int llvm_optimize      Which of several LLVM optimize strategies (0)
     ///    int llvm_debug         Set LLVM extra debug level (0)
     ///    int llvm_debug_layers  Extra printfs upon entering and leaving
@@ -172,6 +252,45 @@ public:
     ///                              for devs to find crashes)
     ///    int llvm_output_bitcode  Output the full bitcode for each group,
     ///                              for debugging. (0)
+    ///    int llvm_report_calls    After optimizing each group, report the
+    ///                              calls to shadeops that were not
+    ///                              inlined, with counts per function;
+    ///                              the totals appear in the stats. (0)
+    ///    string jit_target      CPU to generate JIT code for: "host" to
+    ///                              detect the running CPU, "generic" for
+    ///                              baseline code, an ISA name ("sse4.2",
+    ///                              "avx2", "avx512"), or an LLVM CPU name.
+    ///                              The best precompiled shadeop bitcode
+    ///                              for that CPU is used too. ("host")
+    ///    int jit_fma            Allow fused multiply-add in JIT code
+    ///                              (if the jit_target has it), which is
+    ///                              faster but changes results in the
+    ///                              last bit, differently from one CPU to
+    ///                              another. (0)
+    ///    int jit_perf_map       If nonzero, append every JITed function,
+    ///                              named "osl:<group>:<layer>(<shader>)",
+    ///                              to /tmp/perf-<pid>.map so that Linux
+    ///                              perf can attribute time to it.  Code
+    ///                              evicted by jit_memory_budget keeps
+    ///                              its (then stale) lines. (0)
+    ///    int jit_gdb            If nonzero, register JITed code with
+    ///                              GDB's JIT interface, and unregister it
+    ///                              if it's evicted. (0)
+    ///    int llvm_jit_partitions  Split the code of big groups into up to
+    ///                              this many modules, which are optimized
+    ///                              and JITed concurrently. (1)
+    ///    int llvm_jit_partition_minops  Only split a group if each module
+    ///                              gets at least this many ops. (2000)
+    ///    int llvm_jit_partitions_compare  Also JIT each split group as a
+    ///                              single module, purely to report the
+    ///                              time it takes in the stats. (0)
+    ///    int jit_memory_budget  If nonzero, when the JITed code of all
+    ///                              groups exceeds this many KB, drop the
+    ///                              code of the least recently executed
+    ///                              groups, which are JITed again if they
+    ///                              run again. Keeps the groups' optimized
+    ///                              instances, and turns off sharing of
+    ///                              code between groups. (0)
     ///    int max_local_mem_KB   Error if shader group needs more than this
     ///                              much local storage to execute (1024K)
     ///    string debug_groupname Name of shader group -- debug only this one
@@ -216,6 +335,15 @@ public:
     ///                                 be elided, but nor will they be
     ///                                 called unconditionally.
     ///    int exec_repeat            How many times to run the group (1).
+    ///    int fast_math              Compile the group with approximate
+    ///                                 math (see the global "fast_math").
+    ///    string pgo_profile         Name of a profile file (as saved by
+    ///                                 archive_shadergroup) to compile the
+    ///                                 group with: its most accessed
+    ///                                 params go first in the group data,
+    ///                                 and its branches are weighted by
+    ///                                 how often they were taken.  Must
+    ///                                 be set before the group is JITed.
     ///
     bool attribute (ShaderGroup *group, string_view name,
                     TypeDesc type, const void *val);
@@ -326,6 +454,17 @@ public:
     ///   int raytype_queries        Bit field of all possible rayquery
     ///   int num_entry_layers       Number of named entry point layers.
     ///   string entry_layers[]      List of entry point layers.
+    ///   int num_uniform_layers     Number of layers that are run only once
+    ///                                per object (see "opt_uniform_layers").
+    ///   int shared_from            ID of the identical group whose optimized
+    ///                                code this group reuses, or -1.
+    ///   int llvm_code_size         Bytes of machine code JITed for the
+    ///                                group (0 until it has been JITed).
+    ///   int num_raytype_variants   Number of raytype variants compiled so
+    ///                                far (see "opt_raytype_variants" and
+    ///                                "opt_noderivs_raytypes").
+    ///   float inst_merge_time      Time (seconds) spent merging identical
+    ///                                instances within this group.
     ///   string pickle              Retrieves a serialized representation
     ///                                 of the shader group declaration.
     /// Note: the attributes referred to as "string" are actually on the app
@@ -449,6 +588,15 @@ public:
     /// indicates that it's a parameter that may be overridden by the
     /// geometric primitive).  This call gives you a way of changing the
     /// instance value, even if it's not a geometric override.
+    ///
+    /// If the "opt_respecialize" option was on when the group was
+    /// optimized, any parameter may be changed afterwards: the layer and
+    /// those downstream of it are re-optimized and re-compiled with the new
+    /// value before this call returns (the upstream layers keep their code
+    /// when they can), and subsequent executions of the group use the new code
+    /// (executions already under way finish with the old, which is freed
+    /// once no context is using it). Symbols found with find_symbol
+    /// remain valid across the change.
     bool ReParameter (ShaderGroup &group,
                       string_view layername, string_view paramname,
                       TypeDesc type, const void *val);
@@ -595,6 +743,18 @@ public:
     ///
     std::string getstats (int level=1) const;
 
+    /// Return the statistics as a JSON object, for tools that track them
+    /// over a render.  It has every "stat:..." attribute (under "stats",
+    /// without the "stat:" prefix), the "jit_target" actually used, the
+    /// counts of "calls_not_inlined" by shadeop (see the
+    /// "llvm_report_calls" option), and for level >= 2 also an array of
+    /// "groups", each with its name, id, and (once it's optimized) its
+    /// layer, op and symbol counts, optimize and LLVM times, code and
+    /// group data sizes, plus its executions and shading time (the latter
+    /// only with the "profile" option).  It's safe to call while other
+    /// threads are shading.
+    std::string getstats_json (int level=1) const;
+
     void register_closure (string_view name, int id, const ClosureParam *params,
                            PrepareClosureFunc prepare, SetupClosureFunc setup);
 
@@ -635,6 +795,23 @@ public:
     void optimize_group (ShaderGroup *group, int raytypes_on,
                          int raytypes_off, ShadingContext *ctx);
 
+    /// Return a variant of the group that computes only the given outputs
+    /// (each named "param" or "layer.param"), for callers such as shadow
+    /// rays that need just one or two of them.  Everything that doesn't
+    /// contribute to those outputs is eliminated, across all layers, and
+    /// the variant is optimized and JITed before returning.  Variants are
+    /// cached with the group, so asking again for the same outputs
+    /// returns the same one.  Execute it like any other group.  Return an
+    /// empty ref if none of the names is an output of the group.
+    ///
+    /// The variant is made from the group's layers as they were before
+    /// optimization, so the first request must come before the group is
+    /// optimized (or with "opt_respecialize" or "opt_raytype_variants"
+    /// turned on).  Changes to lockgeom=0 parameters apply to existing
+    /// variants, but a ReParameter that re-specializes the group makes it
+    /// forget them, so ask again afterwards.
+    ShaderGroupRef output_subset (ShaderGroup *group, cspan<ustring> outputs);
+
     /// If option "greedyjit" was set, this call will trigger all
     /// shader groups that have not yet been compiled to do so with the
     /// specified number of threads (0 means use all available HW cores).
@@ -647,7 +824,11 @@ public:
     RendererServices * renderer () const;
 
     /// Archive the entire shader group so that it can be reconstituted
-    /// later.
+    /// later.  If the group has run code instrumented by the
+    /// "pgo_instrument" option, its profile is also saved next to the
+    /// archive, as "<archive>.profile" (the archive's whole name with
+    /// ".profile" appended, e.g. "group.tgz.profile"), ready for the
+    /// group attribute "pgo_profile".
     bool archive_shadergroup (ShaderGroup &group, string_view filename);
 
     // DEPRECATED(2.0)
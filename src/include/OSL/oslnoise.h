@@ -841,6 +841,30 @@ inline T fade (const T &t) {
    return t * t * t * (t * (t * T(6.0f) - T(15.0f)) + T(10.0f));
 }
 
+// Perlin's original cubic fade. It is cheaper than the quintic one above,
+// but only C1 continuous: the second derivative jumps at the lattice.
+template <typename T> OSL_HOSTDEVICE
+inline T fast_fade (const T &t) {
+   return t * t * (T(3.0f) - T(2.0f) * t);
+}
+
+// A hash that hashes exactly like H, but makes perlin() use fast_fade.
+template <typename H>
+struct FastFadeHash : public H {
+    using H::H;
+};
+
+// The hash the perlin noises use: H, or FastFadeHash<H> if fast.
+template <typename H, bool fast> struct PerlinHash { typedef H type; };
+template <typename H> struct PerlinHash<H,true> { typedef FastFadeHash<H> type; };
+
+// The fade perlin() uses with a given hash.
+template <typename H, typename T> OSL_HOSTDEVICE
+inline T fade (const H &, const T &t) { return fade (t); }
+
+template <typename H, typename T> OSL_HOSTDEVICE
+inline T fade (const FastFadeHash<H> &, const T &t) { return fast_fade (t); }
+
 
 
 // 1,2,3 and 4 dimensional gradient functions - perform a dot product against a
@@ -1245,7 +1269,7 @@ struct HashVectorPeriodic {
 template <typename V, typename H, typename T> OSL_HOSTDEVICE
 inline void perlin (V& result, H& hash, const T &x) {
     int X; T fx = floorfrac(x, &X);
-    T u = fade(fx);
+    T u = fade(hash, fx);
 
     result = OIIO::lerp(grad (hash (X  ), fx     ),
                         grad (hash (X+1), fx-1.0f), u);
@@ -1260,7 +1284,7 @@ inline void perlin (float &result, const H &hash, const float &x, const float &y
 #if OIIO_SIMD
     int4 XY;
     float4 fxy = floorfrac (float4(x,y,0.0f), &XY);
-    float4 uv = fade(fxy);  // Note: will be (fade(fx), fade(fy), 0, 0)
+    float4 uv = fade(hash, fxy);  // Note: will be (fade(fx), fade(fy), 0, 0)
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously.
@@ -1281,8 +1305,8 @@ inline void perlin (float &result, const H &hash, const float &x, const float &y
     int X; float fx = floorfrac(x, &X);
     int Y; float fy = floorfrac(y, &Y);
 
-    float u = fade(fx);
-    float v = fade(fy);
+    float u = fade(hash, fx);
+    float v = fade(hash, fy);
 
     result = OIIO::bilerp (grad (hash (X  , Y  ), fx     , fy     ),
                            grad (hash (X+1, Y  ), fx-1.0f, fy     ),
@@ -1304,7 +1328,7 @@ inline void perlin (float &result, const H &hash,
     // according to my timings, it is not. I don't understand exactly why.
     int4 XYZ;
     float4 fxyz = floorfrac (float4(x,y,z), &XYZ);
-    float4 uvw = fade (fxyz);
+    float4 uvw = fade (hash, fxyz);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1320,7 +1344,7 @@ inline void perlin (float &result, const H &hash,
     int Y; float fy = floorfrac(y, &Y);
     int Z; float fz = floorfrac(z, &Z);
     float4 fxyz (fx, fy, fz); // = floorfrac (xyz, &XYZ);
-    float4 uvw = fade (fxyz);
+    float4 uvw = fade (hash, fxyz);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1350,9 +1374,9 @@ inline void perlin (float &result, const H &hash,
     int X; float fx = floorfrac(x, &X);
     int Y; float fy = floorfrac(y, &Y);
     int Z; float fz = floorfrac(z, &Z);
-    float u = fade(fx);
-    float v = fade(fy);
-    float w = fade(fz);
+    float u = fade(hash, fx);
+    float v = fade(hash, fy);
+    float w = fade(hash, fz);
     result = OIIO::trilerp (grad (hash (X  , Y  , Z  ), fx     , fy     , fz     ),
                             grad (hash (X+1, Y  , Z  ), fx-1.0f, fy     , fz     ),
                             grad (hash (X  , Y+1, Z  ), fx     , fy-1.0f, fz     ),
@@ -1377,7 +1401,7 @@ inline void perlin (float &result, const H &hash,
 
     int4 XYZW;
     float4 fxyzw = floorfrac (float4(x,y,z,w), &XYZW);
-    float4 uvts = fade (fxyzw);
+    float4 uvts = fade (hash, fxyzw);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1421,10 +1445,10 @@ inline void perlin (float &result, const H &hash,
     int Z; float fz = floorfrac(z, &Z);
     int W; float fw = floorfrac(w, &W);
 
-    float u = fade(fx);
-    float v = fade(fy);
-    float t = fade(fz);
-    float s = fade(fw);
+    float u = fade(hash, fx);
+    float v = fade(hash, fy);
+    float t = fade(hash, fz);
+    float s = fade(hash, fw);
 
     result = OIIO::lerp (
                OIIO::trilerp (grad (hash (X  , Y  , Z  , W  ), fx     , fy     , fz     , fw     ),
@@ -1463,7 +1487,7 @@ inline void perlin (Dual2<float> &result, const H &hash,
     Dual2<float4> fxy (float4(fx.val(), fy.val(), 0.0f),
                        float4(fx.dx(), fy.dx(), 0.0f),
                        float4(fx.dy(), fy.dy(), 0.0f));
-    Dual2<float4> uv = fade (fxy);
+    Dual2<float4> uv = fade (hash, fxy);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously.
@@ -1484,8 +1508,8 @@ inline void perlin (Dual2<float> &result, const H &hash,
     // Non-SIMD case
     int X; Dual2<float> fx = floorfrac(x, &X);
     int Y; Dual2<float> fy = floorfrac(y, &Y);
-    Dual2<float> u = fade(fx);
-    Dual2<float> v = fade(fy);
+    Dual2<float> u = fade(hash, fx);
+    Dual2<float> v = fade(hash, fy);
     result = OIIO::bilerp (grad (hash (X  , Y  ), fx     , fy     ),
                            grad (hash (X+1, Y  ), fx-1.0f, fy     ),
                            grad (hash (X  , Y+1), fx     , fy-1.0f),
@@ -1510,7 +1534,7 @@ inline void perlin (Dual2<float> &result, const H &hash,
     Dual2<float4> fxyz (float4(fx.val(), fy.val(), fz.val()),
                         float4(fx.dx(), fy.dx(), fz.dx()),
                         float4(fx.dy(), fy.dy(), fz.dy()));
-    Dual2<float4> uvw = fade (fxyz);
+    Dual2<float4> uvw = fade (hash, fxyz);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1545,9 +1569,9 @@ inline void perlin (Dual2<float> &result, const H &hash,
     int X; Dual2<float> fx = floorfrac(x, &X);
     int Y; Dual2<float> fy = floorfrac(y, &Y);
     int Z; Dual2<float> fz = floorfrac(z, &Z);
-    Dual2<float> u = fade(fx);
-    Dual2<float> v = fade(fy);
-    Dual2<float> w = fade(fz);
+    Dual2<float> u = fade(hash, fx);
+    Dual2<float> v = fade(hash, fy);
+    Dual2<float> w = fade(hash, fz);
     result = OIIO::trilerp (grad (hash (X  , Y  , Z  ), fx     , fy     , fz     ),
                             grad (hash (X+1, Y  , Z  ), fx-1.0f, fy     , fz     ),
                             grad (hash (X  , Y+1, Z  ), fx     , fy-1.0f, fz     ),
@@ -1579,7 +1603,7 @@ inline void perlin (Dual2<float> &result, const H &hash,
     Dual2<float4> fxyzw (float4(fx.val(), fy.val(), fz.val(), fw.val()),
                          float4(fx.dx (), fy.dx (), fz.dx (), fw.dx ()),
                          float4(fx.dy (), fy.dy (), fz.dy (), fw.dy ()));
-    Dual2<float4> uvts = fade (fxyzw);
+    Dual2<float4> uvts = fade (hash, fxyzw);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1628,10 +1652,10 @@ inline void perlin (Dual2<float> &result, const H &hash,
     int Z; Dual2<float> fz = floorfrac(z, &Z);
     int W; Dual2<float> fw = floorfrac(w, &W);
 
-    Dual2<float> u = fade(fx);
-    Dual2<float> v = fade(fy);
-    Dual2<float> t = fade(fz);
-    Dual2<float> s = fade(fw);
+    Dual2<float> u = fade(hash, fx);
+    Dual2<float> v = fade(hash, fy);
+    Dual2<float> t = fade(hash, fz);
+    Dual2<float> s = fade(hash, fw);
 
     result = OIIO::lerp (
                OIIO::trilerp (grad (hash (X  , Y  , Z  , W  ), fx     , fy     , fz     , fw     ),
@@ -1668,7 +1692,7 @@ inline void perlin (Vec3 &result, const H &hash,
     // result.setValue(0,0,0); return;
     int4 XYZ;
     float4 fxyz = floorfrac (float4(x,y,0), &XYZ);
-    float4 uv = fade (fxyz);
+    float4 uv = fade (hash, fxyz);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1700,8 +1724,8 @@ inline void perlin (Vec3 &result, const H &hash,
     typedef float T;
     int X; T fx = floorfrac(x, &X);
     int Y; T fy = floorfrac(y, &Y);
-    T u = fade(fx);
-    T v = fade(fy);
+    T u = fade(hash, fx);
+    T v = fade(hash, fy);
     result = OIIO::bilerp (grad (hash (X  , Y  ), fx     , fy     ),
                            grad (hash (X+1, Y  ), fx-1.0f, fy     ),
                            grad (hash (X  , Y+1), fx     , fy-1.0f),
@@ -1723,7 +1747,7 @@ inline void perlin (Vec3 &result, const H &hash,
     // according to my timings, it is not. Come back and understand why.
     int4 XYZ;
     float4 fxyz = floorfrac (float4(x,y,z), &XYZ);
-    float4 uvw = fade (fxyz);
+    float4 uvw = fade (hash, fxyz);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1737,7 +1761,7 @@ inline void perlin (Vec3 &result, const H &hash,
     int Y; float fy = floorfrac(y, &Y);
     int Z; float fz = floorfrac(z, &Z);
     float4 fxyz (fx, fy, fz); // = floorfrac (xyz, &XYZ);
-    float4 uvw = fade (fxyz);
+    float4 uvw = fade (hash, fxyz);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1778,9 +1802,9 @@ inline void perlin (Vec3 &result, const H &hash,
     int X; float fx = floorfrac(x, &X);
     int Y; float fy = floorfrac(y, &Y);
     int Z; float fz = floorfrac(z, &Z);
-    float u = fade(fx);
-    float v = fade(fy);
-    float w = fade(fz);
+    float u = fade(hash, fx);
+    float v = fade(hash, fy);
+    float w = fade(hash, fz);
     result = OIIO::trilerp (grad (hash (X  , Y  , Z  ), fx     , fy     , fz      ),
                             grad (hash (X+1, Y  , Z  ), fx-1.0f, fy     , fz      ),
                             grad (hash (X  , Y+1, Z  ), fx     , fy-1.0f, fz      ),
@@ -1805,7 +1829,7 @@ inline void perlin (Vec3 &result, const H &hash,
 
     int4 XYZW;
     float4 fxyzw = floorfrac (float4(x,y,z,w), &XYZW);
-    float4 uvts = fade (fxyzw);
+    float4 uvts = fade (hash, fxyzw);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1851,10 +1875,10 @@ inline void perlin (Vec3 &result, const H &hash,
     int Z; float fz = floorfrac(z, &Z);
     int W; float fw = floorfrac(w, &W);
 
-    float u = fade(fx);
-    float v = fade(fy);
-    float t = fade(fz);
-    float s = fade(fw);
+    float u = fade(hash, fx);
+    float v = fade(hash, fy);
+    float t = fade(hash, fz);
+    float s = fade(hash, fw);
 
     result = OIIO::lerp (
                OIIO::trilerp (grad (hash (X  , Y  , Z  , W  ), fx     , fy     , fz     , fw     ),
@@ -1893,7 +1917,7 @@ inline void perlin (Dual2<Vec3> &result, const H &hash,
     Dual2<float4> fxyz (float4(fx.val(), fy.val(), 0.0f),
                         float4(fx.dx(),  fy.dx(),  0.0f),
                         float4(fx.dy(),  fy.dy(),  0.0f));
-    Dual2<float4> uvw = fade (fxyz);
+    Dual2<float4> uvw = fade (hash, fxyz);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1929,8 +1953,8 @@ inline void perlin (Dual2<Vec3> &result, const H &hash,
     // ORIGINAL -- non-SIMD
     int X; Dual2<float> fx = floorfrac(x, &X);
     int Y; Dual2<float> fy = floorfrac(y, &Y);
-    Dual2<float> u = fade(fx);
-    Dual2<float> v = fade(fy);
+    Dual2<float> u = fade(hash, fx);
+    Dual2<float> v = fade(hash, fy);
     result = OIIO::bilerp (grad (hash (X  , Y  ), fx     , fy     ),
                            grad (hash (X+1, Y  ), fx-1.0f, fy     ),
                            grad (hash (X  , Y+1), fx     , fy-1.0f),
@@ -1954,7 +1978,7 @@ inline void perlin (Dual2<Vec3> &result, const H &hash,
     Dual2<float4> fxyz (float4(fx.val(), fy.val(), fz.val()),
                         float4(fx.dx(),  fy.dx(),  fz.dx()),
                         float4(fx.dy(),  fy.dy(),  fz.dy()));
-    Dual2<float4> uvw = fade (fxyz);
+    Dual2<float4> uvw = fade (hash, fxyz);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -1999,9 +2023,9 @@ inline void perlin (Dual2<Vec3> &result, const H &hash,
     int X; Dual2<float> fx = floorfrac(x, &X);
     int Y; Dual2<float> fy = floorfrac(y, &Y);
     int Z; Dual2<float> fz = floorfrac(z, &Z);
-    Dual2<float> u = fade(fx);
-    Dual2<float> v = fade(fy);
-    Dual2<float> w = fade(fz);
+    Dual2<float> u = fade(hash, fx);
+    Dual2<float> v = fade(hash, fy);
+    Dual2<float> w = fade(hash, fz);
     result = OIIO::trilerp (grad (hash (X  , Y  , Z  ), fx     , fy     , fz      ),
                             grad (hash (X+1, Y  , Z  ), fx-1.0f, fy     , fz      ),
                             grad (hash (X  , Y+1, Z  ), fx     , fy-1.0f, fz      ),
@@ -2032,7 +2056,7 @@ inline void perlin (Dual2<Vec3> &result, const H &hash,
     Dual2<float4> fxyzw (float4(fx.val(), fy.val(), fz.val(), fw.val()),
                          float4(fx.dx (), fy.dx (), fz.dx (), fw.dx ()),
                          float4(fx.dy (), fy.dy (), fz.dy (), fw.dy ()));
-    Dual2<float4> uvts = fade (fxyzw);
+    Dual2<float4> uvts = fade (hash, fxyzw);
 
     // We parallelize primarily by computing the hashes and gradients at the
     // integer lattice corners simultaneously. We need 8 total (for 3D), so
@@ -2092,10 +2116,10 @@ inline void perlin (Dual2<Vec3> &result, const H &hash,
     int Z; Dual2<float> fz = floorfrac(z, &Z);
     int W; Dual2<float> fw = floorfrac(w, &W);
 
-    Dual2<float> u = fade(fx);
-    Dual2<float> v = fade(fy);
-    Dual2<float> t = fade(fz);
-    Dual2<float> s = fade(fw);
+    Dual2<float> u = fade(hash, fx);
+    Dual2<float> v = fade(hash, fy);
+    Dual2<float> t = fade(hash, fz);
+    Dual2<float> s = fade(hash, fw);
 
     result = OIIO::lerp (
                OIIO::trilerp (grad (hash (X  , Y  , Z  , W  ), fx     , fy     , fz     , fw     ),
@@ -2123,53 +2147,58 @@ inline void perlin (Dual2<Vec3> &result, const H &hash,
 
 
 
-struct Noise {
-    OSL_HOSTDEVICE Noise () { }
+// Perlin noise in [0,1].  The fast flavour uses fast_fade.
+template <bool fast>
+struct BasicNoise {
+    typedef typename PerlinHash<HashScalar,fast>::type ScalarHash;
+    typedef typename PerlinHash<HashVector,fast>::type VectorHash;
+
+    OSL_HOSTDEVICE BasicNoise () { }
 
     inline OSL_HOSTDEVICE void operator() (float &result, float x) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, x);
         result = 0.5f * (result + 1);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, float x, float y) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, x, y);
         result = 0.5f * (result + 1);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, const Vec3 &p) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, p.x, p.y, p.z);
         result = 0.5f * (result + 1);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, const Vec3 &p, float t) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, p.x, p.y, p.z, t);
         result = 0.5f * (result + 1);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, float x) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, x);
         result = 0.5f * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, float x, float y) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, x, y);
         result = 0.5f * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, const Vec3 &p) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, p.x, p.y, p.z);
         result = 0.5f * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, const Vec3 &p, float t) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, p.x, p.y, p.z, t);
         result = 0.5f * (result + Vec3(1, 1, 1));
     }
@@ -2177,19 +2206,19 @@ struct Noise {
     // dual versions
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<float> &x) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, x);
         result = 0.5f * (result + 1.0f);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<float> &x, const Dual2<float> &y) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, x, y);
         result = 0.5f * (result + 1.0f);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<Vec3> &p) const {
-        HashScalar h;
+        ScalarHash h;
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2198,7 +2227,7 @@ struct Noise {
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<Vec3> &p, const Dual2<float> &t) const {
-        HashScalar h;
+        ScalarHash h;
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2207,19 +2236,19 @@ struct Noise {
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<float> &x) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, x);
         result = Vec3(0.5f, 0.5f, 0.5f) * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<float> &x, const Dual2<float> &y) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, x, y);
         result = Vec3(0.5f, 0.5f, 0.5f) * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<Vec3> &p) const {
-        HashVector h;
+        VectorHash h;
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2228,7 +2257,7 @@ struct Noise {
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<Vec3> &p, const Dual2<float> &t) const {
-        HashVector h;
+        VectorHash h;
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2237,46 +2266,54 @@ struct Noise {
     }
 };
 
-struct SNoise {
-    OSL_HOSTDEVICE SNoise () { }
+typedef BasicNoise<false> Noise;
+typedef BasicNoise<true> FastNoise;
+
+// Signed perlin noise in [-1,1].  The fast flavour uses fast_fade.
+template <bool fast>
+struct BasicSNoise {
+    typedef typename PerlinHash<HashScalar,fast>::type ScalarHash;
+    typedef typename PerlinHash<HashVector,fast>::type VectorHash;
+
+    OSL_HOSTDEVICE BasicSNoise () { }
 
     inline OSL_HOSTDEVICE void operator() (float &result, float x) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, x);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, float x, float y) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, x, y);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, const Vec3 &p) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, p.x, p.y, p.z);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, const Vec3 &p, float t) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, p.x, p.y, p.z, t);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, float x) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, x);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, float x, float y) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, x, y);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, const Vec3 &p) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, p.x, p.y, p.z);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, const Vec3 &p, float t) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, p.x, p.y, p.z, t);
     }
 
@@ -2284,17 +2321,17 @@ struct SNoise {
     // dual versions
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<float> &x) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, x);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<float> &x, const Dual2<float> &y) const {
-        HashScalar h;
+        ScalarHash h;
         perlin(result, h, x, y);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<Vec3> &p) const {
-        HashScalar h;
+        ScalarHash h;
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2302,7 +2339,7 @@ struct SNoise {
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<Vec3> &p, const Dual2<float> &t) const {
-        HashScalar h;
+        ScalarHash h;
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2310,17 +2347,17 @@ struct SNoise {
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<float> &x) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, x);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<float> &x, const Dual2<float> &y) const {
-        HashVector h;
+        VectorHash h;
         perlin(result, h, x, y);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<Vec3> &p) const {
-        HashVector h;
+        VectorHash h;
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2328,7 +2365,7 @@ struct SNoise {
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<Vec3> &p, const Dual2<float> &t) const {
-        HashVector h;
+        VectorHash h;
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2336,55 +2373,63 @@ struct SNoise {
     }
 };
 
+typedef BasicSNoise<false> SNoise;
+typedef BasicSNoise<true> FastSNoise;
+
 
 
-struct PeriodicNoise {
-    OSL_HOSTDEVICE PeriodicNoise () { }
+// Periodic perlin noise in [0,1].  The fast flavour uses fast_fade.
+template <bool fast>
+struct BasicPeriodicNoise {
+    typedef typename PerlinHash<HashScalarPeriodic,fast>::type ScalarHash;
+    typedef typename PerlinHash<HashVectorPeriodic,fast>::type VectorHash;
+
+    OSL_HOSTDEVICE BasicPeriodicNoise () { }
 
     inline OSL_HOSTDEVICE void operator() (float &result, float x, float px) const {
-        HashScalarPeriodic h(px);
+        ScalarHash h(px);
         perlin(result, h, x);
         result = 0.5f * (result + 1);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, float x, float y, float px, float py) const {
-        HashScalarPeriodic h(px, py);
+        ScalarHash h(px, py);
         perlin(result, h, x, y);
         result = 0.5f * (result + 1);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, const Vec3 &p, const Vec3 &pp) const {
-        HashScalarPeriodic h(pp.x, pp.y, pp.z);
+        ScalarHash h(pp.x, pp.y, pp.z);
         perlin(result, h, p.x, p.y, p.z);
         result = 0.5f * (result + 1);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, const Vec3 &p, float t, const Vec3 &pp, float pt) const {
-        HashScalarPeriodic h(pp.x, pp.y, pp.z, pt);
+        ScalarHash h(pp.x, pp.y, pp.z, pt);
         perlin(result, h, p.x, p.y, p.z, t);
         result = 0.5f * (result + 1);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, float x, float px) const {
-        HashVectorPeriodic h(px);
+        VectorHash h(px);
         perlin(result, h, x);
         result = 0.5f * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, float x, float y, float px, float py) const {
-        HashVectorPeriodic h(px, py);
+        VectorHash h(px, py);
         perlin(result, h, x, y);
         result = 0.5f * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, const Vec3 &p, const Vec3 &pp) const {
-        HashVectorPeriodic h(pp.x, pp.y, pp.z);
+        VectorHash h(pp.x, pp.y, pp.z);
         perlin(result, h, p.x, p.y, p.z);
         result = 0.5f * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, const Vec3 &p, float t, const Vec3 &pp, float pt) const {
-        HashVectorPeriodic h(pp.x, pp.y, pp.z, pt);
+        VectorHash h(pp.x, pp.y, pp.z, pt);
         perlin(result, h, p.x, p.y, p.z, t);
         result = 0.5f * (result + Vec3(1, 1, 1));
     }
@@ -2392,20 +2437,20 @@ struct PeriodicNoise {
     // dual versions
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<float> &x, float px) const {
-        HashScalarPeriodic h(px);
+        ScalarHash h(px);
         perlin(result, h, x);
         result = 0.5f * (result + 1.0f);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<float> &x, const Dual2<float> &y,
                                            float px, float py) const {
-        HashScalarPeriodic h(px, py);
+        ScalarHash h(px, py);
         perlin(result, h, x, y);
         result = 0.5f * (result + 1.0f);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<Vec3> &p, const Vec3 &pp) const {
-        HashScalarPeriodic h(pp.x, pp.y, pp.z);
+        ScalarHash h(pp.x, pp.y, pp.z);
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2415,7 +2460,7 @@ struct PeriodicNoise {
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<Vec3> &p, const Dual2<float> &t,
                                            const Vec3 &pp, float pt) const {
-        HashScalarPeriodic h(pp.x, pp.y, pp.z, pt);
+        ScalarHash h(pp.x, pp.y, pp.z, pt);
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2424,20 +2469,20 @@ struct PeriodicNoise {
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<float> &x, float px) const {
-        HashVectorPeriodic h(px);
+        VectorHash h(px);
         perlin(result, h, x);
         result = Vec3(0.5f, 0.5f, 0.5f) * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<float> &x, const Dual2<float> &y,
                                            float px, float py) const {
-        HashVectorPeriodic h(px, py);
+        VectorHash h(px, py);
         perlin(result, h, x, y);
         result = Vec3(0.5f, 0.5f, 0.5f) * (result + Vec3(1, 1, 1));
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<Vec3> &p, const Vec3 &pp) const {
-        HashVectorPeriodic h(pp.x, pp.y, pp.z);
+        VectorHash h(pp.x, pp.y, pp.z);
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2447,7 +2492,7 @@ struct PeriodicNoise {
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<Vec3> &p, const Dual2<float> &t,
                                            const Vec3 &pp, float pt) const {
-        HashVectorPeriodic h(pp.x, pp.y, pp.z, pt);
+        VectorHash h(pp.x, pp.y, pp.z, pt);
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2456,64 +2501,72 @@ struct PeriodicNoise {
     }
 };
 
-struct PeriodicSNoise {
-    OSL_HOSTDEVICE PeriodicSNoise () { }
+typedef BasicPeriodicNoise<false> PeriodicNoise;
+typedef BasicPeriodicNoise<true> FastPeriodicNoise;
+
+// Signed periodic perlin noise in [-1,1].  The fast flavour uses fast_fade.
+template <bool fast>
+struct BasicPeriodicSNoise {
+    typedef typename PerlinHash<HashScalarPeriodic,fast>::type ScalarHash;
+    typedef typename PerlinHash<HashVectorPeriodic,fast>::type VectorHash;
+
+    OSL_HOSTDEVICE BasicPeriodicSNoise () { }
 
     inline OSL_HOSTDEVICE void operator() (float &result, float x, float px) const {
-        HashScalarPeriodic h(px);
+        ScalarHash h(px);
         perlin(result, h, x);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, float x, float y, float px, float py) const {
-        HashScalarPeriodic h(px, py);
+        ScalarHash h(px, py);
         perlin(result, h, x, y);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, const Vec3 &p, const Vec3 &pp) const {
-        HashScalarPeriodic h(pp.x, pp.y, pp.z);
+        ScalarHash h(pp.x, pp.y, pp.z);
         perlin(result, h, p.x, p.y, p.z);
     }
 
     inline OSL_HOSTDEVICE void operator() (float &result, const Vec3 &p, float t, const Vec3 &pp, float pt) const {
-        HashScalarPeriodic h(pp.x, pp.y, pp.z, pt);
+        ScalarHash h(pp.x, pp.y, pp.z, pt);
         perlin(result, h, p.x, p.y, p.z, t);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, float x, float px) const {
-        HashVectorPeriodic h(px);
+        VectorHash h(px);
         perlin(result, h, x);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, float x, float y, float px, float py) const {
-        HashVectorPeriodic h(px, py);
+        VectorHash h(px, py);
         perlin(result, h, x, y);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, const Vec3 &p, const Vec3 &pp) const {
-        HashVectorPeriodic h(pp.x, pp.y, pp.z);
+        VectorHash h(pp.x, pp.y, pp.z);
         perlin(result, h, p.x, p.y, p.z);
     }
 
     inline OSL_HOSTDEVICE void operator() (Vec3 &result, const Vec3 &p, float t, const Vec3 &pp, float pt) const {
-        HashVectorPeriodic h(pp.x, pp.y, pp.z, pt);
+        VectorHash h(pp.x, pp.y, pp.z, pt);
         perlin(result, h, p.x, p.y, p.z, t);
     }
 
     // dual versions
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<float> &x, float px) const {
-        HashScalarPeriodic h(px);
+        ScalarHash h(px);
         perlin(result, h, x);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<float> &x, const Dual2<float> &y,
                                            float px, float py) const {
-        HashScalarPeriodic h(px, py);
+        ScalarHash h(px, py);
         perlin(result, h, x, y);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<Vec3> &p, const Vec3 &pp) const {
-        HashScalarPeriodic h(pp.x, pp.y, pp.z);
+        ScalarHash h(pp.x, pp.y, pp.z);
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2522,7 +2575,7 @@ struct PeriodicSNoise {
 
     inline OSL_HOSTDEVICE void operator() (Dual2<float> &result, const Dual2<Vec3> &p, const Dual2<float> &t,
                                            const Vec3 &pp, float pt) const {
-        HashScalarPeriodic h(pp.x, pp.y, pp.z, pt);
+        ScalarHash h(pp.x, pp.y, pp.z, pt);
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2530,18 +2583,18 @@ struct PeriodicSNoise {
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<float> &x, float px) const {
-        HashVectorPeriodic h(px);
+        VectorHash h(px);
         perlin(result, h, x);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<float> &x, const Dual2<float> &y,
                                            float px, float py) const {
-        HashVectorPeriodic h(px, py);
+        VectorHash h(px, py);
         perlin(result, h, x, y);
     }
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<Vec3> &p, const Vec3 &pp) const {
-        HashVectorPeriodic h(pp.x, pp.y, pp.z);
+        VectorHash h(pp.x, pp.y, pp.z);
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2550,7 +2603,7 @@ struct PeriodicSNoise {
 
     inline OSL_HOSTDEVICE void operator() (Dual2<Vec3> &result, const Dual2<Vec3> &p, const Dual2<float> &t,
                                            const Vec3 &pp, float pt) const {
-        HashVectorPeriodic h(pp.x, pp.y, pp.z, pt);
+        VectorHash h(pp.x, pp.y, pp.z, pt);
         Dual2<float> px(p.val().x, p.dx().x, p.dy().x);
         Dual2<float> py(p.val().y, p.dx().y, p.dy().y);
         Dual2<float> pz(p.val().z, p.dx().z, p.dy().z);
@@ -2558,6 +2611,9 @@ struct PeriodicSNoise {
     }
 };
 
+typedef BasicPeriodicSNoise<false> PeriodicSNoise;
+typedef BasicPeriodicSNoise<true> FastPeriodicSNoise;
+
 
 
 struct SimplexNoise {
@@ -748,6 +748,7 @@ public:
         m_argread = ~1; // Default - all args are read except the first
         m_argwrite = 1; // Default - first arg only is written by the op
         m_argtakesderivs = 0; // Default - doesn't take derivs
+        m_index_in_range = false;
     }
 
     ustring opname () const { return m_op; }
@@ -880,6 +881,12 @@ public:
     /// Replace the m_argtakesderivs entirely. Use with caution!
     void argtakesderivs_all (unsigned int newval) { m_argtakesderivs = newval; }
 
+    /// Has the runtime optimizer proven that the array or component
+    /// indices of this op are always in range, so that no range check
+    /// is needed?
+    bool index_in_range () const { return m_index_in_range; }
+    void index_in_range (bool val) { m_index_in_range = val; }
+
     /// Are two opcodes identical enough to merge their instances?  Note
     /// that this isn't a true 'equal', we don't compare fields that
     /// won't matter for that purpose.
@@ -900,6 +907,7 @@ private:
     unsigned int m_argread;         ///< Bit field - which args are read
     unsigned int m_argwrite;        ///< Bit field - which args are written
     unsigned int m_argtakesderivs;  ///< Bit field - which args take derivs
+    bool m_index_in_range;          ///< Indices proven in range
     // N.B. We only have 32 bits for m_argread and m_argwrite.  We live
     // with this, and it's ok because there are very few ops that allow
     // more than 32 args, and those that do are read-only that far out.
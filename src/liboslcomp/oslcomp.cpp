@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cerrno>
 
 #include "oslcomp_pvt.h"
+#include "../liboslexec/osobinary.h"
 
 #include <OpenImageIO/platform.h>
 #include <OpenImageIO/sysutil.h>
@@ -307,6 +308,8 @@ OSLCompilerImpl::read_compile_options (const std::vector<std::string> &options,
             m_err_on_warning = true;
         } else if (options[i] == "-embed-source" || options[i] == "--embed-source") {
             m_embed_source = true;
+        } else if (options[i] == "-binary" || options[i] == "--binary") {
+            m_write_osob = true;
         } else if (options[i] == "-MD" || options[i] == "--write-dependencies") {
             // write depfile w/ user and system headers
             m_generate_deps = true;
@@ -510,6 +513,9 @@ OSLCompilerImpl::compile (string_view filename,
             write_oso_file (OIIO::Strutil::join(options," "),
                             preprocess_result);
             OSL_DASSERT (m_osofile == nullptr);
+            oso_output.close ();
+            if (m_write_osob)
+                write_osob_file (m_output_filename);
         }
 
         oslcompiler = nullptr;
@@ -605,6 +611,20 @@ OSLCompilerImpl::compile_buffer (string_view sourcecode,
 
 
 
+void
+OSLCompilerImpl::write_osob_file (const std::string &osofilename)
+{
+    // Read back the oso we just wrote and record it in binary form, so
+    // the .osob is guaranteed to describe exactly what the .oso does.
+    std::string osobfilename =
+        OIIO::Filesystem::replace_extension (osofilename, ".osob");
+    OSOBinaryWriter writer (m_errhandler);
+    if (! writer.parse_file (osofilename) || ! writer.write_file (osobfilename))
+        errorf (ustring(), 0, "Could not write \"%s\"", osobfilename);
+}
+
+
+
 void
 OSLCompilerImpl::write_dependency_file (string_view filename)
 {
@@ -406,6 +406,7 @@ private:
     void write_oso_symbol (const Symbol *sym);
     void write_oso_metadata (const ASTNode *metanode) const;
     void write_dependency_file (string_view filename);
+    void write_osob_file (const std::string &osofilename);
 
     template<typename... Args>
     inline void osof(const char* fmt, const Args&... args) const {
@@ -486,6 +487,7 @@ private:
     bool m_generate_deps = false; ///< Generate dependencies? -MD or -MMD?
     bool m_generate_system_deps = false; ///< Generate system header deps? -MD
     bool m_embed_source = false; ///< Embed preprocessed source in oso?
+    bool m_write_osob = false; ///< Also write a binary .osob?
     bool m_err_on_warning;    ///< Treat warnings as errors?
     int m_optimizelevel;      ///< Optimization level
     OpcodeVec m_ircode;       ///< Generated IR code
@@ -0,0 +1,246 @@
+/*
+Copyright (c) 2009-2019 Sony Pictures Imageworks Inc., et al.
+All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+* Neither the name of Sony Pictures Imageworks nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "../liboslexec/osobinary.h"
+
+#include <OpenImageIO/filesystem.h>
+
+
+OSL_NAMESPACE_ENTER
+
+namespace pvt {   // OSL::pvt
+
+// The writing half of the .osob format (see osobinary.h), which only the
+// compiler needs; the reading half is in liboslexec/osobinary.cpp.
+
+
+
+int
+OSOBinaryWriter::string_index (string_view s)
+{
+    std::string str (s);
+    auto found = m_string_index.find (str);
+    if (found != m_string_index.end())
+        return found->second;
+    int index = (int) m_string_offsets.size();
+    m_string_offsets.push_back ((uint32_t) m_strings.size());
+    m_strings.append (str);
+    m_strings.push_back (0);
+    m_string_index[str] = index;
+    return index;
+}
+
+
+
+void
+OSOBinaryWriter::add (OSOBRecord::Kind kind, int a, int b, int c, int d)
+{
+    OSOBRecord r;
+    r.kind = (uint32_t) kind;
+    r.arg[0] = a;
+    r.arg[1] = b;
+    r.arg[2] = c;
+    r.arg[3] = d;
+    m_records.push_back (r);
+}
+
+
+
+void
+OSOBinaryWriter::version (const char *specid, int major, int minor)
+{
+    add (OSOBRecord::Version, string_index(specid), major, minor);
+}
+
+
+
+void
+OSOBinaryWriter::shader (const char *shadertype, const char *name)
+{
+    add (OSOBRecord::Shader, string_index(shadertype), string_index(name));
+}
+
+
+
+void
+OSOBinaryWriter::symbol (SymType symtype, TypeSpec typespec, const char *name)
+{
+    // Encode the type the way the oso grammar builds it: a struct name or
+    // an element type (possibly a closure), then an optional array length.
+    if (typespec.structure() > 0)
+        add (OSOBRecord::StructType,
+             string_index(typespec.structspec()->name()));
+    TypeDesc t = typespec.elementtype().simpletype();
+    int flags = int(symtype) | (typespec.is_closure_based() ? osob_closure_flag : 0);
+    int td = int(t.basetype) | (int(t.aggregate) << 8) | (int(t.vecsemantics) << 16);
+    add (OSOBRecord::SymbolDecl, flags, td, typespec.simpletype().arraylen,
+         string_index(name));
+}
+
+
+
+void
+OSOBinaryWriter::symdefault (int def)
+{
+    add (OSOBRecord::DefaultInt, def);
+}
+
+
+
+void
+OSOBinaryWriter::symdefault (float def)
+{
+    int bits;
+    memcpy (&bits, &def, sizeof(bits));
+    add (OSOBRecord::DefaultFloat, bits);
+}
+
+
+
+void
+OSOBinaryWriter::symdefault (const char *def)
+{
+    add (OSOBRecord::DefaultString, string_index(def));
+}
+
+
+
+void
+OSOBinaryWriter::parameter_done ()
+{
+    add (OSOBRecord::ParameterDone);
+}
+
+
+
+void
+OSOBinaryWriter::hint (string_view hintstring)
+{
+    add (OSOBRecord::Hint, string_index(hintstring));
+}
+
+
+
+void
+OSOBinaryWriter::codemarker (const char *name)
+{
+    add (OSOBRecord::CodeMarker, string_index(name));
+}
+
+
+
+void
+OSOBinaryWriter::codeend ()
+{
+    add (OSOBRecord::CodeEnd);
+}
+
+
+
+void
+OSOBinaryWriter::instruction (int label, const char *opcode)
+{
+    add (OSOBRecord::Instruction, label, string_index(opcode));
+}
+
+
+
+void
+OSOBinaryWriter::instruction_arg (const char *name)
+{
+    add (OSOBRecord::InstructionArg, string_index(name));
+}
+
+
+
+void
+OSOBinaryWriter::instruction_jump (int target)
+{
+    add (OSOBRecord::InstructionJump, target);
+}
+
+
+
+void
+OSOBinaryWriter::instruction_end ()
+{
+    add (OSOBRecord::InstructionEnd);
+}
+
+
+
+std::string
+OSOBinaryWriter::data () const
+{
+    std::string strings = m_strings;
+    while (strings.size() & 3)
+        strings.push_back (0);
+
+    OSOBHeader header;
+    memcpy (header.magic, "OSOB", 4);
+    header.format_version = OSOB_FORMAT_VERSION;
+    header.byte_order = osob_byte_order;
+    header.nstrings = (uint32_t) m_string_offsets.size();
+    header.strings_size = (uint32_t) strings.size();
+    header.nrecords = (uint32_t) m_records.size();
+
+    std::string out;
+    out.reserve (sizeof(header) + m_string_offsets.size()*sizeof(uint32_t)
+                 + strings.size() + m_records.size()*sizeof(OSOBRecord));
+    out.append ((const char *)&header, sizeof(header));
+    if (m_string_offsets.size())
+        out.append ((const char *)&m_string_offsets[0],
+                    m_string_offsets.size()*sizeof(uint32_t));
+    out.append (strings);
+    if (m_records.size())
+        out.append ((const char *)&m_records[0],
+                    m_records.size()*sizeof(OSOBRecord));
+    return out;
+}
+
+
+
+bool
+OSOBinaryWriter::write_file (const std::string &filename) const
+{
+    std::ofstream out;
+    OIIO::Filesystem::open (out, filename, std::ios::out | std::ios::binary);
+    if (! out.good())
+        return false;
+    std::string d = data();
+    out.write (d.data(), d.size());
+    return out.good();
+}
+
+
+}; // namespace pvt
+OSL_NAMESPACE_EXIT
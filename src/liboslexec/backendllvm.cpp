@@ -90,7 +90,8 @@ BackendLLVM::BackendLLVM (ShadingSystemImpl &shadingsys,
       ll(llvm_debug()),
       m_stat_total_llvm_time(0), m_stat_llvm_setup_time(0),
       m_stat_llvm_irgen_time(0), m_stat_llvm_opt_time(0),
-      m_stat_llvm_jit_time(0)
+      m_stat_llvm_jit_time(0), m_llvm_shaderglobals_ptr(NULL),
+      m_llvm_groupdata_ptr(NULL), m_llvm_layerdata_ptr(NULL)
 {
 #ifdef OSL_SPI
     // Temporary (I hope) check to diagnose an intermittent failure of
@@ -261,6 +262,19 @@ BackendLLVM::llvm_global_symbol_ptr (ustring name)
 
 
 
+llvm::Value *
+BackendLLVM::llvm_global_deriv_ptr (ustring name, int deriv)
+{
+    // The globals that have derivs are laid out in the ShaderGlobals as
+    // arrays of [value, d/dx, d/dy].
+    int sg_index = ShaderGlobalNameToIndex (name);
+    OSL_ASSERT (sg_index >= 0 && deriv >= 1 && deriv <= 2);
+    llvm::Value *field = ll.GEP (sg_ptr(), 0, sg_index);
+    return ll.void_ptr (ll.GEP (field, 0, deriv));
+}
+
+
+
 llvm::Value *
 BackendLLVM::getLLVMSymbolBase (const Symbol &sym)
 {
@@ -275,8 +289,29 @@ BackendLLVM::getLLVMSymbolBase (const Symbol &sym)
 
     if (sym.symtype() == SymTypeParam || sym.symtype() == SymTypeOutputParam) {
         // Special case for params -- they live in the group data
+        if (group().kept_layer (sym.layer()) || m_pinned_params.count (&sym)) {
+            // A param of a layer kept from an earlier specialization, or
+            // pinned where such a layer's code writes it: it has no field
+            // of its own (see llvm_type_groupdata), just its offset.
+            OSL_DASSERT (sym.dataoffset() >= 0);
+            llvm::Value *result = ll.GEP (ll.void_ptr (groupdata_ptr()),
+                                          sym.dataoffset());
+            return ll.ptr_to_cast (result, llvm_type(sym.typespec().elementtype().simpletype()));
+        }
         int fieldnum = m_param_order_map[&sym];
-        return groupdata_field_ptr (fieldnum, sym.typespec().elementtype().simpletype());
+        int block = sym.layer() >= 0 && sym.layer() < (int)m_layer_block_field.size()
+                  ? m_layer_block_field[sym.layer()] : -1;
+        if (block < 0)
+            return groupdata_field_ptr (fieldnum, sym.typespec().elementtype().simpletype());
+        // Params of a shared layer live in their own block, which is
+        // passed directly to the shared layer function.
+        llvm::Value *blockptr = m_llvm_layerdata_ptr;
+        if (! blockptr)
+            blockptr = groupdata_field_ref (block);
+        else
+            OSL_DASSERT (sym.layer() == layer());
+        llvm::Value *result = ll.void_ptr (ll.GEP (blockptr, 0, fieldnum));
+        return ll.ptr_to_cast (result, llvm_type(sym.typespec().elementtype().simpletype()));
     }
 
     std::string mangled_name = dealiased->mangled();
@@ -914,9 +949,29 @@ BackendLLVM::groupdata_field_ptr (int fieldnum, TypeDesc type)
 llvm::Value *
 BackendLLVM::layer_run_ref (int layer)
 {
-    int fieldnum = 0; // field 0 is the layer_run array
+    int fieldnum = 0; // field 0 is the layer_run bitset
     llvm::Value *layer_run = groupdata_field_ref (fieldnum);
-    return ll.GEP (layer_run, 0, layer);
+    return ll.GEP (layer_run, 0, layer / 32);
+}
+
+
+
+llvm::Value *
+BackendLLVM::llvm_layer_has_run (int layer)
+{
+    llvm::Value *word = ll.op_load (layer_run_ref (layer));
+    llvm::Value *bit = ll.op_and (word, ll.constant (int(1u << (layer & 31))));
+    return ll.op_ne (bit, ll.constant (0));
+}
+
+
+
+void
+BackendLLVM::llvm_mark_layer_run (int layer)
+{
+    llvm::Value *ref = layer_run_ref (layer);
+    llvm::Value *word = ll.op_load (ref);
+    ll.op_store (ll.op_or (word, ll.constant (int(1u << (layer & 31)))), ref);
 }
 
 
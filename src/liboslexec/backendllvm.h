@@ -65,6 +65,41 @@ public:
     /// and store the llvm::Function* handle to it with the ShaderGroup.
     virtual void run ();
 
+    /// How many modules to split the group's code into, according to the
+    /// "llvm_jit_partitions" and "llvm_jit_partition_minops" options
+    /// (1 means don't split).
+    int jit_partitions ();
+
+    /// Like run(), but split the group's layers into nparts modules that
+    /// are generated, optimized, and JITed concurrently, each on a thread
+    /// of its own.  Calls between layers in different modules go through
+    /// a table of the layer functions kept with the group.
+    void run_partitioned (int nparts);
+
+    /// Only generate code for the layers whose layer_partition entry is
+    /// partition (plus the group init and uniform functions, for
+    /// partition 0).
+    void set_partition (int partition, const std::vector<int> &layer_partition) {
+        m_partition = partition;
+        m_layer_partition = layer_partition;
+    }
+
+    /// Is the layer's code generated by this backend?  (Not if it's in
+    /// another partition, or kept with its code from an earlier
+    /// specialization of the group.)
+    bool in_partition (int layer) const {
+        return ! group().kept_layer (layer) &&
+               (m_layer_partition.empty() || m_layer_partition[layer] == m_partition);
+    }
+
+    /// For a re-specialization that kept some layers' code (see
+    /// ShaderGroup::respecialization), check that it fits with the layers
+    /// made again, and note where in the group data the params must go
+    /// for the kept code to find them: the kept layers' own, and those
+    /// they copy their outputs into.  Return false if they don't fit, in
+    /// which case the group must be made all over again.
+    bool pin_kept_layers ();
+
 
     /// What LLVM debug level are we at?
     int llvm_debug() const;
@@ -75,6 +110,9 @@ public:
 
     int layer_remap (int origlayer) const { return m_layer_remap[origlayer]; }
 
+    /// Set up m_layer_remap and m_num_used_layers.
+    void compute_layer_remap ();
+
     /// Create an llvm function for the current shader instance.
     /// This will end up being the group entry if 'groupentry' is true.
     llvm::Function* build_llvm_instance (bool groupentry);
@@ -82,6 +120,27 @@ public:
     /// Create an llvm function for group initialization code.
     llvm::Function* build_llvm_init ();
 
+    /// Create an llvm function that runs all the uniform layers of the
+    /// group, and record the group data they write.  Return NULL if there
+    /// are no uniform layers.
+    llvm::Function* build_llvm_uniform ();
+
+    /// Return a string describing everything about the current layer
+    /// that determines its generated code, if the layer's code may be
+    /// shared with identical layers in other groups, or an empty string
+    /// if it can't be shared.
+    std::string shared_layer_signature ();
+
+    /// Create the llvm function holding the body of the current layer in
+    /// a form that identical layers of other groups can call:
+    /// void func(ShaderGlobals*, void *layerdata), where layerdata points
+    /// to the layer's own block of params within the group data.
+    llvm::Function* build_llvm_shared_layer ();
+
+    /// Generate the code for the body of the current layer: allocate and
+    /// initialize its symbols and params, and run its ops.
+    void build_llvm_layer_body (bool groupentry);
+
     /// Build up LLVM IR code for the given range [begin,end) or
     /// opcodes, putting them (initially) into basic block bb (or the
     /// current basic block if bb==NULL).
@@ -251,6 +310,11 @@ public:
     /// Retrieve the named global ("P", "N", etc.).
     llvm::Value *llvm_global_symbol_ptr (ustring name);
 
+    /// Retrieve a void pointer to the x (deriv=1) or y (deriv=2)
+    /// derivative of the named global, as the renderer supplied it in the
+    /// ShaderGlobals, whether or not the global's symbol has derivs.
+    llvm::Value *llvm_global_deriv_ptr (ustring name, int deriv);
+
     /// Test whether val is nonzero, return the llvm::Value* that's the
     /// result of a CreateICmpNE or CreateFCmpUNE (depending on the
     /// type).  If test_derivs is true, it it also tests whether the
@@ -304,6 +368,10 @@ public:
     /// data that holds all the shader params.
     llvm::Type *llvm_type_groupdata_ptr ();
 
+    /// Return the LLVM type handle for the structure holding the params of
+    /// a layer whose code is shared, which is nested within the group data.
+    llvm::Type *llvm_type_layerdata (int layer);
+
     /// Return the group data pointer.
     ///
     llvm::Value *groupdata_ptr () const { return m_llvm_groupdata_ptr; }
@@ -322,10 +390,35 @@ public:
     llvm::Value *groupdata_field_ptr (int fieldnum,
                                       TypeDesc type = TypeDesc::UNKNOWN);
 
-    /// Return a ref to the bool where the "layer_run" flag is stored for
-    /// the specified layer.
+    /// Return a ref to the 32-bit word of the "layer_run" bitset that
+    /// holds the flag for the specified layer.
     llvm::Value *layer_run_ref (int layer);
 
+    /// Generate code that tests whether the specified layer's "layer_run"
+    /// flag is set, or sets it.
+    llvm::Value *llvm_layer_has_run (int layer);
+    void llvm_mark_layer_run (int layer);
+
+    /// Is the param given its initial value (or its init ops run) on
+    /// entry to its layer, as opposed to lazily or not at all?
+    bool param_assigned_on_entry (const Symbol &sym) const;
+
+    /// Generate code that adds val (a 64 bit int) to the group's profile
+    /// counter of the given name, making the counter if need be (see the
+    /// "pgo_instrument" option).
+    void llvm_pgo_count (const std::string &name, llvm::Value *val);
+
+    /// Return the count recorded under the given name in the profile the
+    /// group is being compiled with, or 0 if there is no such count.
+    long long pgo_profile_count (const std::string &name) const;
+
+    /// Generate the conditional branch of the if or loop op, counting
+    /// how often it's executed and taken if we are instrumenting, and
+    /// weighting its directions by the group's profile if it has one.
+    void llvm_profiled_branch (const Opcode &op, llvm::Value *cond,
+                               llvm::BasicBlock *trueblock,
+                               llvm::BasicBlock *falseblock);
+
     /// Return a ref to the bool where the "userdata_initialized" flag is
     /// stored for the specified userdata index.
     llvm::Value *userdata_initialized_ref (int userdata_index=0);
@@ -463,12 +556,29 @@ private:
     double m_stat_llvm_irgen_time;        ///<     llvm IR generation time
     double m_stat_llvm_opt_time;          ///<     llvm IR optimization time
     double m_stat_llvm_jit_time;          ///<     llvm JIT time
+    double m_stat_partition_cpu_time = 0; ///< Sum over partitions
+    double m_stat_single_module_time = 0; ///< Unpartitioned, to compare
+    int m_stat_partitions = 0;            ///< Number of partitions, if any
+    size_t m_llvm_code_size = 0;          ///< Bytes of code we JITed
+    std::shared_ptr<void> m_jit_memory;   ///< Memory holding it, if private
+    int m_partition = 0;                  ///< Partition we generate
+    std::vector<int> m_layer_partition;   ///< Partition of each layer
 
     // LLVM stuff
     AllocationMap m_named_values;
     std::map<const Symbol*,int> m_param_order_map;
+    std::map<const Symbol*,int> m_pinned_params; ///< Offsets kept code uses
+    std::map<std::string,int> m_pgo_counter_index; ///< Profile counters
     llvm::Value *m_llvm_shaderglobals_ptr;
     llvm::Value *m_llvm_groupdata_ptr;
+    llvm::Value *m_llvm_layerdata_ptr;  // layer params, in shared layer funcs
+
+    // Per-layer info for layers whose code is shared across groups
+    std::vector<std::string> m_layer_signature; ///< Empty if not shared
+    std::vector<void*> m_layer_shared_func;     ///< Previously JITed code
+    std::vector<llvm::Function*> m_layer_shared_llvm_func; ///< Built here
+    std::vector<int> m_layer_block_field;       ///< Group data field, or -1
+    std::vector<llvm::Type*> m_llvm_type_layerdata;
     llvm::BasicBlock * m_exit_instance_block;  // exit point for the instance
     llvm::Type *m_llvm_type_sg;  // LLVM type of ShaderGlobals struct
     llvm::Type *m_llvm_type_groupdata;  // LLVM type of group data
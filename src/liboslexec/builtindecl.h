@@ -38,6 +38,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #error Do not include this file unless DECL is defined
 #endif
 
+// Functions declared with PUREDECL depend only on their arguments (no
+// ShaderGlobals, context, or renderer) and have no side effects, so the
+// runtime optimizer may constant-fold them by calling them (see
+// constfold_native).  Outer files that don't care about the distinction
+// need only define DECL.
+#ifndef PUREDECL
+#define PUREDECL(name,signature) DECL(name,signature)
+#define OSL_BUILTINDECL_DEFAULT_PUREDECL
+#endif
+
 
 
 #define NOISE_IMPL(name)                           \
@@ -117,17 +127,17 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     DECL (osl_ ## name ## _dvdvdfvf, "xsvvXvfXX")
 
 #define UNARY_OP_IMPL(name)                        \
-    DECL (osl_ ## name ## _ff,  "ff")              \
+    PUREDECL (osl_ ## name ## _ff,  "ff")          \
     DECL (osl_ ## name ## _dfdf, "xXX")            \
-    DECL (osl_ ## name ## _vv,  "xXX")             \
+    PUREDECL (osl_ ## name ## _vv,  "xXX")         \
     DECL (osl_ ## name ## _dvdv, "xXX")
 
 #define BINARY_OP_IMPL(name)                       \
-    DECL (osl_ ## name ## _fff,    "fff")          \
+    PUREDECL (osl_ ## name ## _fff,    "fff")      \
     DECL (osl_ ## name ## _dfdfdf, "xXXX")         \
     DECL (osl_ ## name ## _dffdf,  "xXfX")         \
     DECL (osl_ ## name ## _dfdff,  "xXXf")         \
-    DECL (osl_ ## name ## _vvv,    "xXXX")         \
+    PUREDECL (osl_ ## name ## _vvv,    "xXXX")     \
     DECL (osl_ ## name ## _dvdvdv, "xXXX")         \
     DECL (osl_ ## name ## _dvvdv,  "xXXX")         \
     DECL (osl_ ## name ## _dvdvv,  "xXXX")
@@ -175,11 +185,21 @@ PNOISE_IMPL(psnoise)
 PNOISE_DERIV_IMPL(psnoise)
 GENERIC_PNOISE_DERIV_IMPL(gaborpnoise)
 GENERIC_PNOISE_DERIV_IMPL(genericpnoise)
+// Cheaper perlin noises for groups with the "fast_math" option
+NOISE_IMPL(fast_noise)
+NOISE_DERIV_IMPL(fast_noise)
+NOISE_IMPL(fast_snoise)
+NOISE_DERIV_IMPL(fast_snoise)
+PNOISE_IMPL(fast_pnoise)
+PNOISE_DERIV_IMPL(fast_pnoise)
+PNOISE_IMPL(fast_psnoise)
+PNOISE_DERIV_IMPL(fast_psnoise)
 DECL (osl_noiseparams_set_anisotropic, "xXi")
 DECL (osl_noiseparams_set_do_filter, "xXi")
 DECL (osl_noiseparams_set_direction, "xXv")
 DECL (osl_noiseparams_set_bandwidth, "xXf")
 DECL (osl_noiseparams_set_impulses, "xXf")
+DECL (osl_noiseparams_set_fast_math, "xXi")
 DECL (osl_count_noise, "xX")
 DECL (osl_hash_ii,  "ii")
 DECL (osl_hash_if,  "if")
@@ -242,8 +262,10 @@ DECL (osl_get_trace_options, "XX");
 
 
 // The following are defined inside llvm_ops.cpp. Only include these
-// declarations in the OSL_LLVM_NO_BITCODE case.
-#ifdef OSL_LLVM_NO_BITCODE
+// declarations in the OSL_LLVM_NO_BITCODE case, or when the outer file
+// asks for them with OSL_DECL_NATIVE_LLVM_OPS (llvm_ops.cpp is always
+// also compiled natively, for constant folding).
+#if defined(OSL_LLVM_NO_BITCODE) || defined(OSL_DECL_NATIVE_LLVM_OPS)
 UNARY_OP_IMPL(sin)
 UNARY_OP_IMPL(cos)
 UNARY_OP_IMPL(tan)
@@ -277,7 +299,34 @@ BINARY_OP_IMPL(pow)
 UNARY_OP_IMPL(erf)
 UNARY_OP_IMPL(erfc)
 
-DECL (osl_pow_vvf, "xXXf")
+#if ! OSL_FAST_MATH
+// Approximate variants for groups with the "fast_math" option
+UNARY_OP_IMPL(fast_sin)
+UNARY_OP_IMPL(fast_cos)
+UNARY_OP_IMPL(fast_tan)
+UNARY_OP_IMPL(fast_asin)
+UNARY_OP_IMPL(fast_acos)
+UNARY_OP_IMPL(fast_atan)
+BINARY_OP_IMPL(fast_atan2)
+UNARY_OP_IMPL(fast_sinh)
+UNARY_OP_IMPL(fast_cosh)
+UNARY_OP_IMPL(fast_tanh)
+UNARY_OP_IMPL(fast_log)
+UNARY_OP_IMPL(fast_log2)
+UNARY_OP_IMPL(fast_log10)
+UNARY_OP_IMPL(fast_exp)
+UNARY_OP_IMPL(fast_exp2)
+UNARY_OP_IMPL(fast_expm1)
+BINARY_OP_IMPL(fast_pow)
+PUREDECL (osl_fast_pow_vvf, "xXXf")
+DECL (osl_fast_pow_dvdvdf, "xXXX")
+DECL (osl_fast_pow_dvvdf, "xXXX")
+DECL (osl_fast_pow_dvdvf, "xXXf")
+UNARY_OP_IMPL(fast_erf)
+UNARY_OP_IMPL(fast_erfc)
+#endif
+
+PUREDECL (osl_pow_vvf, "xXXf")
 DECL (osl_pow_dvdvdf, "xXXX")
 DECL (osl_pow_dvvdf, "xXXX")
 DECL (osl_pow_dvdvf, "xXXf")
@@ -285,33 +334,33 @@ DECL (osl_pow_dvdvf, "xXXf")
 UNARY_OP_IMPL(sqrt)
 UNARY_OP_IMPL(inversesqrt)
 
-DECL (osl_logb_ff, "ff")
-DECL (osl_logb_vv, "xXX")
-
-DECL (osl_floor_ff, "ff")
-DECL (osl_floor_vv, "xXX")
-DECL (osl_ceil_ff, "ff")
-DECL (osl_ceil_vv, "xXX")
-DECL (osl_round_ff, "ff")
-DECL (osl_round_vv, "xXX")
-DECL (osl_trunc_ff, "ff")
-DECL (osl_trunc_vv, "xXX")
-DECL (osl_sign_ff, "ff")
-DECL (osl_sign_vv, "xXX")
-DECL (osl_step_fff, "fff")
-DECL (osl_step_vvv, "xXXX")
-
-DECL (osl_isnan_if, "if")
-DECL (osl_isinf_if, "if")
-DECL (osl_isfinite_if, "if")
-DECL (osl_abs_ii, "ii")
-DECL (osl_fabs_ii, "ii")
+PUREDECL (osl_logb_ff, "ff")
+PUREDECL (osl_logb_vv, "xXX")
+
+PUREDECL (osl_floor_ff, "ff")
+PUREDECL (osl_floor_vv, "xXX")
+PUREDECL (osl_ceil_ff, "ff")
+PUREDECL (osl_ceil_vv, "xXX")
+PUREDECL (osl_round_ff, "ff")
+PUREDECL (osl_round_vv, "xXX")
+PUREDECL (osl_trunc_ff, "ff")
+PUREDECL (osl_trunc_vv, "xXX")
+PUREDECL (osl_sign_ff, "ff")
+PUREDECL (osl_sign_vv, "xXX")
+PUREDECL (osl_step_fff, "fff")
+PUREDECL (osl_step_vvv, "xXXX")
+
+PUREDECL (osl_isnan_if, "if")
+PUREDECL (osl_isinf_if, "if")
+PUREDECL (osl_isfinite_if, "if")
+PUREDECL (osl_abs_ii, "ii")
+PUREDECL (osl_fabs_ii, "ii")
 
 UNARY_OP_IMPL(abs)
 UNARY_OP_IMPL(fabs)
 BINARY_OP_IMPL(fmod)
 
-DECL (osl_smoothstep_ffff, "ffff")
+PUREDECL (osl_smoothstep_ffff, "ffff")
 DECL (osl_smoothstep_dfffdf, "xXffX")
 DECL (osl_smoothstep_dffdff, "xXfXf")
 DECL (osl_smoothstep_dffdfdf, "xXfXX")
@@ -320,22 +369,27 @@ DECL (osl_smoothstep_dfdffdf, "xXXfX")
 DECL (osl_smoothstep_dfdfdff, "xXXXf")
 DECL (osl_smoothstep_dfdfdfdf, "xXXXX")
 
-DECL (osl_dot_fvv, "fXX")
+PUREDECL (osl_dot_fvv, "fXX")
 DECL (osl_dot_dfdvdv, "xXXX")
 DECL (osl_dot_dfdvv, "xXXX")
 DECL (osl_dot_dfvdv, "xXXX")
-DECL (osl_cross_vvv, "xXXX")
+PUREDECL (osl_cross_vvv, "xXXX")
 DECL (osl_cross_dvdvdv, "xXXX")
 DECL (osl_cross_dvdvv, "xXXX")
 DECL (osl_cross_dvvdv, "xXXX")
-DECL (osl_length_fv, "fX")
+PUREDECL (osl_length_fv, "fX")
 DECL (osl_length_dfdv, "xXX")
-DECL (osl_distance_fvv, "fXX")
+PUREDECL (osl_distance_fvv, "fXX")
 DECL (osl_distance_dfdvdv, "xXXX")
 DECL (osl_distance_dfdvv, "xXXX")
 DECL (osl_distance_dfvdv, "xXXX")
-DECL (osl_normalize_vv, "xXX")
+PUREDECL (osl_normalize_vv, "xXX")
 DECL (osl_normalize_dvdv, "xXX")
+DECL (osl_dot_fvv_byval, "fffffff")
+DECL (osl_cross_vvv_byval, "xXffffff")
+DECL (osl_length_fv_byval, "ffff")
+DECL (osl_distance_fvv_byval, "fffffff")
+DECL (osl_normalize_vv_byval, "xXfff")
 #endif
 
 DECL (osl_mul_mm, "xXXX")
@@ -346,18 +400,18 @@ DECL (osl_div_mf, "xXXf")
 DECL (osl_div_fm, "xXfX")
 DECL (osl_div_m_ff, "xXff")
 DECL (osl_get_from_to_matrix, "iXXss")
-DECL (osl_transpose_mm, "xXX")
-DECL (osl_determinant_fm, "fX")
-
-DECL (osl_concat_sss, "sss")
-DECL (osl_strlen_is, "is")
-DECL (osl_hash_is, "is")
-DECL (osl_getchar_isi, "isi");
-DECL (osl_startswith_iss, "iss")
-DECL (osl_endswith_iss, "iss")
-DECL (osl_stoi_is, "is")
-DECL (osl_stof_fs, "fs")
-DECL (osl_substr_ssii, "ssii")
+PUREDECL (osl_transpose_mm, "xXX")
+PUREDECL (osl_determinant_fm, "fX")
+
+PUREDECL (osl_concat_sss, "sss")
+PUREDECL (osl_strlen_is, "is")
+PUREDECL (osl_hash_is, "is")
+PUREDECL (osl_getchar_isi, "isi")
+PUREDECL (osl_startswith_iss, "iss")
+PUREDECL (osl_endswith_iss, "iss")
+PUREDECL (osl_stoi_is, "is")
+PUREDECL (osl_stof_fs, "fs")
+PUREDECL (osl_substr_ssii, "ssii")
 DECL (osl_regex_impl, "iXsXisi")
 
 DECL (osl_texture_set_firstchannel, "xXi")
@@ -406,6 +460,10 @@ DECL (osl_raytype_bit, "iXi")
 
 
 // Clean up local definitions
+#ifdef OSL_BUILTINDECL_DEFAULT_PUREDECL
+#undef PUREDECL
+#undef OSL_BUILTINDECL_DEFAULT_PUREDECL
+#endif
 #undef NOISE_IMPL
 #undef NOISE_DERIV_IMPL
 #undef GENERIC_NOISE_DERIV_IMPL
@@ -27,6 +27,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <vector>
+#include <unordered_map>
 #include <cmath>
 #include <cstdlib>
 
@@ -41,6 +42,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 using namespace OSL;
 using namespace OSL::pvt;
 
+// Native declarations of the pure shadeops (see constfold_native)
+#define DECL(name,signature)
+#define PUREDECL(name,signature) extern "C" void name();
+#define OSL_DECL_NATIVE_LLVM_OPS
+#include "builtindecl.h"
+#undef OSL_DECL_NATIVE_LLVM_OPS
+#undef PUREDECL
+#undef DECL
+
 
 // names of ops we'll be using frequently
 static ustring u_nop    ("nop"),
@@ -2996,6 +3006,222 @@ DECLFOLDER(constfold_assign)
 
 
 
+namespace {
+
+// A shadeop declared with PUREDECL in builtindecl.h: its signature codes
+// and the address of its native implementation.
+struct PureShadeop {
+    const char *signature;
+    void (*function)();
+};
+
+typedef std::unordered_map<ustring, PureShadeop, ustringHash> PureShadeopMap;
+
+static const PureShadeopMap &
+pure_shadeops ()
+{
+    static const PureShadeopMap table = [] () {
+        PureShadeopMap t;
+#define DECL(name,signature)
+#define PUREDECL(name,signature) \
+        t[ustring(#name)] = PureShadeop { signature, name };
+#define OSL_DECL_NATIVE_LLVM_OPS
+#include "builtindecl.h"
+#undef OSL_DECL_NATIVE_LLVM_OPS
+#undef PUREDECL
+#undef DECL
+        return t;
+    } ();
+    return table;
+}
+
+
+
+// One argument or return value of a native shadeop call.
+union NativeArg {
+    float f;
+    int i;
+    const char *s;
+    void *p;
+};
+
+
+
+// Call func, whose builtindecl.h signature is sig, with args, storing its
+// return value (if any) in ret.  Only the handful of signatures used by
+// the pure shadeops are supported; return false for any other.
+static bool
+call_native_shadeop (string_view sig, void (*func)(), const NativeArg *a,
+                     NativeArg &ret)
+{
+    typedef void *X;
+    typedef const char *S;
+    if (sig == "ff")
+        ret.f = ((float(*)(float))func) (a[0].f);
+    else if (sig == "fff")
+        ret.f = ((float(*)(float,float))func) (a[0].f, a[1].f);
+    else if (sig == "ffff")
+        ret.f = ((float(*)(float,float,float))func) (a[0].f, a[1].f, a[2].f);
+    else if (sig == "fX")
+        ret.f = ((float(*)(X))func) (a[0].p);
+    else if (sig == "fXX")
+        ret.f = ((float(*)(X,X))func) (a[0].p, a[1].p);
+    else if (sig == "fs")
+        ret.f = ((float(*)(S))func) (a[0].s);
+    else if (sig == "if")
+        ret.i = ((int(*)(float))func) (a[0].f);
+    else if (sig == "ii")
+        ret.i = ((int(*)(int))func) (a[0].i);
+    else if (sig == "is")
+        ret.i = ((int(*)(S))func) (a[0].s);
+    else if (sig == "isi")
+        ret.i = ((int(*)(S,int))func) (a[0].s, a[1].i);
+    else if (sig == "iss")
+        ret.i = ((int(*)(S,S))func) (a[0].s, a[1].s);
+    else if (sig == "sss")
+        ret.s = ((S(*)(S,S))func) (a[0].s, a[1].s);
+    else if (sig == "ssii")
+        ret.s = ((S(*)(S,int,int))func) (a[0].s, a[1].i, a[2].i);
+    else if (sig == "xXX")
+        ((void(*)(X,X))func) (a[0].p, a[1].p);
+    else if (sig == "xXXX")
+        ((void(*)(X,X,X))func) (a[0].p, a[1].p, a[2].p);
+    else if (sig == "xXXf")
+        ((void(*)(X,X,float))func) (a[0].p, a[1].p, a[2].f);
+    else
+        return false;
+    return true;
+}
+
+}  // anon namespace
+
+
+
+// Generic folder for ops whose non-derivative implementation is a pure
+// shadeop (PUREDECL in builtindecl.h): if all the arguments are
+// constant, call the native implementation on them at optimize time --
+// the same code the shader would have run -- and replace the op with
+// an assignment of the result.
+DECLFOLDER(constfold_native)
+{
+    Opcode &op (rop.inst()->ops()[opnum]);
+    int nargs = op.nargs();
+    if (nargs < 2 || nargs > 4)
+        return 0;
+    Symbol &R (*rop.opargsym (op, 0));
+    const TypeSpec &rtype (R.typespec());
+    if (rtype.is_closure_based() || rtype.is_structure_based() ||
+        rtype.is_array())
+        return 0;
+
+    // Name the shadeop the way llvm_gen_generic does, without derivs
+    std::string name = std::string("osl_") + op.opname().string() + "_";
+    for (int i = 0;  i < nargs;  ++i) {
+        Symbol *s (rop.opargsym (op, i));
+        const TypeSpec &t (s->typespec());
+        if (i > 0 && ! s->is_constant())
+            return 0;
+        if (t.is_closure_based() || t.is_structure_based() || t.is_array())
+            return 0;
+        if (t.is_float())
+            name += "f";
+        else if (t.is_triple())
+            name += "v";
+        else if (t.is_matrix())
+            name += "m";
+        else if (t.is_string())
+            name += "s";
+        else if (t.is_int())
+            name += "i";
+        else
+            return 0;
+    }
+
+    // Groups with fast_math call the approximate version, if there is one
+    const PureShadeopMap &pure (pure_shadeops());
+    PureShadeopMap::const_iterator found = pure.end();
+    if (rop.group().fast_math())
+        found = pure.find (ustring (std::string("osl_fast_") + (name.c_str()+4)));
+    if (found == pure.end())
+        found = pure.find (ustring (name));
+    if (found == pure.end())
+        return 0;
+    string_view sig (found->second.signature);
+
+    // Marshal the arguments, checking that each matches its signature
+    // code.  Aggregate results come back through the first pointer.
+    NativeArg args[4], ret;
+    float aggregate_result[16] = { 0.0f };
+    int a = 0;
+    bool aggregate = (sig[0] == 'x');
+    if (aggregate) {
+        if (! (rtype.is_triple() || rtype.is_matrix()))
+            return 0;
+        args[a++].p = aggregate_result;
+    }
+    if (size_t(a + nargs) != sig.size())
+        return 0;
+    for (int i = 1;  i < nargs;  ++i, ++a) {
+        Symbol &S (*rop.opargsym (op, i));
+        const TypeSpec &t (S.typespec());
+        switch (sig[a+1]) {
+        case 'f' :
+            if (! t.is_float())
+                return 0;
+            args[a].f = *(const float *)S.data();
+            break;
+        case 'i' :
+            if (! t.is_int())
+                return 0;
+            args[a].i = *(const int *)S.data();
+            break;
+        case 's' :
+            if (! t.is_string())
+                return 0;
+            args[a].s = ((const ustring *)S.data())->c_str();
+            break;
+        case 'X' :
+            if (! (t.is_triple() || t.is_matrix()))
+                return 0;
+            args[a].p = S.data();
+            break;
+        default:
+            return 0;
+        }
+    }
+    if (! call_native_shadeop (sig, found->second.function, args, ret))
+        return 0;
+
+    int cind;
+    switch (sig[0]) {
+    case 'f' :
+        if (! rtype.is_float())
+            return 0;
+        cind = rop.add_constant (ret.f);
+        break;
+    case 'i' :
+        if (! rtype.is_int())
+            return 0;
+        cind = rop.add_constant (ret.i);
+        break;
+    case 's' :
+        if (! rtype.is_string())
+            return 0;
+        cind = rop.add_constant (ustring (ret.s));
+        break;
+    case 'x' :
+        cind = rop.add_constant (rtype, aggregate_result);
+        break;
+    default:
+        return 0;
+    }
+    rop.turn_into_assign (op, cind, "const fold native");
+    rop.count_native_fold ();
+    return 1;
+}
+
+
+
 DECLFOLDER(constfold_warning)
 {
    if (rop.shadingsys().max_warnings_per_thread() == 0) {
@@ -27,6 +27,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <cstdio>
 
@@ -50,6 +51,8 @@ ShadingContext::ShadingContext (ShadingSystemImpl &shadingsys,
     m_shadingsys.m_stat_contexts += 1;
     m_threadinfo = threadinfo ? threadinfo : shadingsys.get_perthread_info ();
     m_texture_thread_info = NULL;
+    spin_lock lock (m_shadingsys.m_contexts_mutex);
+    m_shadingsys.m_contexts.push_back (this);
 }
 
 
@@ -59,15 +62,49 @@ ShadingContext::~ShadingContext ()
     process_errors ();
     m_shadingsys.m_stat_contexts -= 1;
     free_dict_resources ();
+    spin_lock lock (m_shadingsys.m_contexts_mutex);
+    auto &contexts (m_shadingsys.m_contexts);
+    auto found = std::find (contexts.begin(), contexts.end(), this);
+    if (found != contexts.end()) {
+        *found = contexts.back();
+        contexts.pop_back ();
+    }
 }
 
 
 
 bool
-ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
+ShadingContext::execute_init (ShaderGroup &group, ShaderGlobals &ssg, bool run)
 {
     if (m_group)
         execute_cleanup ();
+    // If the group has been re-specialized, run its latest specialization,
+    // and if we're compiling variants for ray types, the variant for this
+    // one, compiled without derivatives if it's a ray type that doesn't
+    // need them (including any subsequent execute_layer calls, which go
+    // through m_group).
+    //
+    // Say which specialization we're using before making sure it's still
+    // the current one, so that it isn't freed while we use it, or look up
+    // its results afterwards (see free_retired_specializations).  Symbols
+    // translated for another one are no longer of any use.
+    ShaderGroup *prevspec = m_spec_hazard.load (std::memory_order_relaxed);
+    ShaderGroup *spec = nullptr;
+    for (ShaderGroup *s = &group.current_specialization();  s != spec;
+         s = &group.current_specialization()) {
+        if (spec)
+            prevspec = nullptr;   // raced with a re-specialization
+        spec = s;
+        m_spec_hazard.store (spec);
+    }
+    if (spec != prevspec && m_translated_symbols.size())
+        m_translated_symbols.clear ();
+    ShaderGroup *rungroup = spec;
+    bool noderivs = (ssg.raytype & shadingsys().m_opt_noderivs_raytypes) != 0;
+    if (shadingsys().m_opt_raytype_variants || noderivs)
+        rungroup = &shadingsys().raytype_variant (*rungroup, ssg.raytype,
+                                                  noderivs);
+    ShaderGroup &sgroup (*rungroup);
     m_group = &sgroup;
     m_ticks = 0;
 
@@ -83,8 +120,28 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
             }
             shadingsys().release_context(ctx);
         }
-        if (sgroup.does_nothing())
+        // Tell eviction that we may run the group's code from now until
+        // execute_cleanup, then (and only then is it safe to) check
+        // whether it was already evicted and must be JITed again -- even
+        // if the budget has since been turned off, or the group would be
+        // left without code.  See enforce_jit_memory_budget.
+        m_jit_hazard.store (&sgroup);
+        if (shadingsys().m_jit_memory_budget) {
+            // Move up in the LRU order, but only once per JIT epoch, so
+            // that running the same groups over and over doesn't contend.
+            long long epoch = shadingsys().m_jit_epoch.load (std::memory_order_relaxed);
+            if (sgroup.m_jit_last_used.load (std::memory_order_relaxed) != epoch) {
+                sgroup.m_jit_last_used.store (epoch, std::memory_order_relaxed);
+                if (sgroup.m_registry)
+                    sgroup.m_registry->jit_touch (sgroup);
+            }
+        }
+        if (sgroup.m_jit_evicted.load ())
+            shadingsys().rejit_group (sgroup);
+        if (sgroup.does_nothing()) {
+            m_jit_hazard.store (nullptr);
             return false;
+        }
     } else {
        // empty shader - nothing to do!
        return false;
@@ -101,10 +158,6 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
                   this, heap_size_needed);
         m_heap.resize (heap_size_needed);
     }
-    // Zero out the heap memory we will be using
-    if (shadingsys().m_clearmemory)
-        memset (&m_heap[0], 0, heap_size_needed);
-
     // Set up closure storage
     m_closure_pool.clear();
 
@@ -125,6 +178,9 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
         ssg.renderer = renderer();
         ssg.Ci = NULL;
         run_func (&ssg, &m_heap[0]);
+        // Uniform layers only need to run once per object
+        if (sgroup.llvm_compiled_uniform() && ssg.objdata)
+            run_uniform_layers (sgroup, ssg);
     }
 
     if (profile)
@@ -134,6 +190,36 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
 
 
 
+void
+ShadingContext::run_uniform_layers (ShaderGroup &sgroup, ShaderGlobals &ssg)
+{
+    const ShaderGroup::DataRangeVec &ranges (sgroup.uniform_data_ranges());
+    char *heap = &m_heap[0];
+    UniformCacheKey key (sgroup.id(), sgroup.param_generation(), ssg.objdata);
+    auto found = m_uniform_cache.find (key);
+    if (found != m_uniform_cache.end()) {
+        // Seen this object before -- just restore the saved results
+        const char *saved = found->second.data();
+        for (auto&& r : ranges) {
+            memcpy (heap + r.first, saved, r.second);
+            saved += r.second;
+        }
+        ++m_stat_uniform_cache_hits;
+        return;
+    }
+
+    sgroup.llvm_compiled_uniform() (&ssg, heap);
+    ++m_stat_uniform_cache_misses;
+
+    if ((int)m_uniform_cache.size() >= UNIFORM_CACHE_SIZE)
+        m_uniform_cache.clear ();
+    std::vector<char> &saved (m_uniform_cache[key]);
+    for (auto&& r : ranges)
+        saved.insert (saved.end(), heap + r.first, heap + r.first + r.second);
+}
+
+
+
 bool
 ShadingContext::execute_layer (ShaderGlobals &ssg, int layernumber)
 {
@@ -174,7 +260,17 @@ ShadingContext::execute_cleanup ()
         shadingsys().m_stat_total_shading_time_ticks += m_ticks;
         group()->m_stat_total_shading_time_ticks += m_ticks;
     }
+    // The uniform layer cache is counted whether or not we're profiling
+    // (and only once, even if we're cleaned up again).
+    if (m_stat_uniform_cache_hits || m_stat_uniform_cache_misses) {
+        shadingsys().m_stat_uniform_cache_hits += m_stat_uniform_cache_hits;
+        shadingsys().m_stat_uniform_cache_misses += m_stat_uniform_cache_misses;
+        m_stat_uniform_cache_hits = 0;
+        m_stat_uniform_cache_misses = 0;
+    }
 
+    // We're done running the group's code; it may be evicted now.
+    m_jit_hazard.store (nullptr);
     return true;
 }
 
@@ -274,6 +370,31 @@ ShadingContext::symbol (ustring layername, ustring symbolname) const
 
 
 
+const Symbol *
+ShadingContext::translate_symbol (const Symbol &sym) const
+{
+    // The symbol may have been found in the group as the renderer knows
+    // it, rather than in the re-specialization or raytype variant of it
+    // that actually ran (see execute_init), whose data is laid out
+    // differently.  If so, use the equivalent symbol of the one that ran.
+    const ShaderGroup &sgroup (*group());
+    int layer = sym.layer();
+    if (layer < 0 || layer >= sgroup.nlayers())
+        return &sym;
+    const ShaderInstance *inst = sgroup[layer];
+    const SymbolVec &syms (inst->symbols());
+    if (syms.size() && &sym >= syms.data() && &sym < syms.data()+syms.size())
+        return &sym;   // the usual case: it's from the group that ran
+    auto found = m_translated_symbols.find (&sym);
+    if (found != m_translated_symbols.end() && found->second.first == &sgroup)
+        return found->second.second;
+    const Symbol *s = inst->symbol (inst->findsymbol (sym.name()));
+    m_translated_symbols[&sym] = std::make_pair (&sgroup, s);
+    return s;
+}
+
+
+
 const void *
 ShadingContext::symbol_data (const Symbol &sym) const
 {
@@ -281,15 +402,19 @@ ShadingContext::symbol_data (const Symbol &sym) const
     if (! sgroup.optimized())
         return NULL;   // can't retrieve symbol if we didn't optimize it
 
-    if (sym.dataoffset() >= 0 && (int)m_heap.size() > sym.dataoffset()) {
+    const Symbol *s = translate_symbol (sym);
+    if (! s)
+        return NULL;
+
+    if (s->dataoffset() >= 0 && (int)m_heap.size() > s->dataoffset()) {
         // lives on the heap
-        return &m_heap[sym.dataoffset()];
+        return &m_heap[s->dataoffset()];
     }
 
     // doesn't live on the heap
-    if ((sym.symtype() == SymTypeParam || sym.symtype() == SymTypeOutputParam) &&
-        (sym.valuesource() == Symbol::DefaultVal || sym.valuesource() == Symbol::InstanceVal)) {
-        return sym.data();
+    if ((s->symtype() == SymTypeParam || s->symtype() == SymTypeOutputParam) &&
+        (s->valuesource() == Symbol::DefaultVal || s->valuesource() == Symbol::InstanceVal)) {
+        return s->data();
     }
 
     return NULL;  // not something we can retrieve
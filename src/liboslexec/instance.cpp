@@ -58,13 +58,12 @@ ShaderInstance::ShaderInstance (ShaderMaster::ref master,
       m_writes_globals(false),
       m_outgoing_connections(false),
       m_renderer_outputs(false), m_merged_unused(false),
-      m_last_layer(false), m_entry_layer(false),
+      m_last_layer(false), m_entry_layer(false), m_uniform(false),
       m_firstparam(m_master->m_firstparam), m_lastparam(m_master->m_lastparam),
       m_maincodebegin(m_master->m_maincodebegin),
       m_maincodeend(m_master->m_maincodeend)
 {
     m_id = ++(*(atomic_int *)&next_id);
-    shadingsys().m_stat_instances += 1;
 
     // We don't copy the symbol table yet, it stays with the master, but
     // we'll keep track of local override information in m_instoverrides.
@@ -80,6 +79,7 @@ ShaderInstance::ShaderInstance (ShaderMaster::ref master,
     off_t totalmem = (parammem + sizeof(ShaderInstance));
     {
         spin_lock lock (ss.m_stat_mutex);
+        ss.m_stat_instances += 1;
         ss.m_stat_mem_inst_paramvals += parammem;
         ss.m_stat_mem_inst += totalmem;
         ss.m_stat_memory += totalmem;
@@ -90,8 +90,6 @@ ShaderInstance::ShaderInstance (ShaderMaster::ref master,
 
 ShaderInstance::~ShaderInstance ()
 {
-    shadingsys().m_stat_instances -= 1;
-
     OSL_DASSERT (m_instops.size() == 0 && m_instargs.size() == 0);
     ShadingSystemImpl &ss (shadingsys());
     off_t symmem = vectorbytes (m_instsymbols) + vectorbytes(m_instoverrides);
@@ -102,6 +100,7 @@ ShaderInstance::~ShaderInstance ()
                        sizeof(ShaderInstance));
     {
         spin_lock lock (ss.m_stat_mutex);
+        ss.m_stat_instances -= 1;
         ss.m_stat_mem_inst_syms -= symmem;
         ss.m_stat_mem_inst_paramvals -= parammem;
         ss.m_stat_mem_inst_connections -= connectionmem;
@@ -724,6 +723,99 @@ ShaderInstance::mergeable (const ShaderInstance &b, const ShaderGroup& /*g*/) co
 }
 
 
+
+// Fold the bytes of a value into a running merge hash (FNV-1a).
+static inline void
+merge_hash_bytes (size_t &h, const void *data, size_t len)
+{
+    const unsigned char *c = (const unsigned char *)data;
+    for (size_t i = 0;  i < len;  ++i)
+        h = (h ^ c[i]) * size_t(1099511628211ULL);
+}
+
+template<typename T>
+static inline void
+merge_hash_value (size_t &h, const T &val)
+{
+    merge_hash_bytes (h, &val, sizeof(T));
+}
+
+
+
+size_t
+ShaderInstance::merge_hash () const
+{
+    // N.B. Everything hashed here must be something that mergeable()
+    // requires to be identical, so that any two mergeable instances are
+    // guaranteed to hash the same. It needn't be complete -- collisions
+    // merely cost an extra call to mergeable().
+    size_t h = size_t(14695981039346656037ULL);
+    merge_hash_value (h, master());
+    merge_hash_value (h, run_lazily());
+
+    bool optimized = (m_instsymbols.size() != 0 || m_instops.size() != 0);
+    for (int i = firstparam();  i < lastparam();  ++i) {
+        const Symbol *sym = optimized ? symbol(i) : mastersymbol(i);
+        if (! sym->everused_in_group() || sym->typespec().is_closure())
+            continue;
+        if (sym->valuesource() == Symbol::InstanceVal ||
+            sym->valuesource() == Symbol::DefaultVal)
+            merge_hash_bytes (h, param_storage(i),
+                              sym->typespec().simpletype().size());
+    }
+
+    merge_hash_value (h, m_connections.size());
+    for (auto&& c : m_connections) {
+        merge_hash_value (h, c.srclayer);
+        merge_hash_value (h, c.src.param);
+        merge_hash_value (h, c.dst.param);
+    }
+
+    if (optimized) {
+        merge_hash_value (h, m_instops.size());
+        merge_hash_value (h, m_instargs.size());
+        merge_hash_value (h, m_maincodebegin);
+        merge_hash_value (h, m_maincodeend);
+    }
+    return h;
+}
+
+
+
+ShaderInstanceRef
+ShaderInstance::unoptimized_copy () const
+{
+    OSL_DASSERT (m_instsymbols.empty() && m_instops.empty());
+    ShaderInstanceRef copy (new ShaderInstance (m_master, m_layername));
+    off_t oldmem = vectorbytes (copy->m_iparams) + vectorbytes (copy->m_fparams)
+                 + vectorbytes (copy->m_sparams);
+    copy->m_instoverrides = m_instoverrides;
+    copy->m_iparams = m_iparams;
+    copy->m_fparams = m_fparams;
+    copy->m_sparams = m_sparams;
+    copy->m_connections = m_connections;
+    copy->m_userdata_params = m_userdata_params;
+    copy->m_outgoing_connections = m_outgoing_connections;
+    copy->m_merged_unused = m_merged_unused;
+    copy->m_last_layer = m_last_layer;
+    copy->m_entry_layer = m_entry_layer;
+
+    // adjust stats
+    off_t parammem = vectorbytes (m_iparams) + vectorbytes (m_fparams)
+                   + vectorbytes (m_sparams) - oldmem;
+    off_t connectionmem = vectorbytes (m_connections);
+    {
+        ShadingSystemImpl &ss (shadingsys());
+        spin_lock lock (ss.m_stat_mutex);
+        ss.m_stat_mem_inst_paramvals += parammem;
+        ss.m_stat_mem_inst_connections += connectionmem;
+        ss.m_stat_mem_inst += parammem + connectionmem;
+        ss.m_stat_memory += parammem + connectionmem;
+    }
+    return copy;
+}
+
+
 }; // namespace pvt
 
 
@@ -764,6 +856,140 @@ ShaderGroup::~ShaderGroup ()
                   << "executed on " << executions() << " points\n";
     }
 #endif
+    delete m_raytype_variants.load ();
+    if (m_registry) {
+        m_registry->jit_dropped (*this);
+        if (m_registry_index >= 0)
+            m_registry->remove (this);
+    }
+}
+
+
+
+void
+ShaderGroupRegistry::add (const ShaderGroupRef &group)
+{
+    Shard &s (shard (group.get()));
+    spin_lock lock (s.mutex);
+    group->m_registry_index = (int) s.entries.size();
+    s.entries.push_back (Entry { group.get(), group });
+}
+
+
+
+void
+ShaderGroupRegistry::remove (ShaderGroup *group)
+{
+    Shard &s (shard (group));
+    spin_lock lock (s.mutex);
+    int i = group->m_registry_index;
+    OSL_DASSERT (i >= 0 && i < (int)s.entries.size() && s.entries[i].group == group);
+    // Move the last entry into the vacated slot
+    if (i != (int)s.entries.size()-1) {
+        s.entries[i] = std::move (s.entries.back());
+        s.entries[i].group->m_registry_index = i;
+    }
+    s.entries.pop_back ();
+    group->m_registry_index = -1;
+}
+
+
+
+size_t
+ShaderGroupRegistry::size () const
+{
+    size_t n = 0;
+    for (auto&& s : m_shards) {
+        spin_lock lock (s.mutex);
+        n += s.entries.size();
+    }
+    return n;
+}
+
+
+
+std::vector<ShaderGroupRef>
+ShaderGroupRegistry::groups () const
+{
+    // N.B. The references we make here must not be released while a
+    // shard is locked, since dropping the last one would destroy the
+    // group, which removes itself from its shard.  So they are only
+    // released by the caller, after we return.
+    std::vector<ShaderGroupRef> result;
+    for (auto&& s : m_shards) {
+        spin_lock lock (s.mutex);
+        for (auto&& e : s.entries)
+            if (ShaderGroupRef g = e.ref.lock())
+                result.push_back (std::move(g));
+    }
+    return result;
+}
+
+
+
+
+void
+ShaderGroupRegistry::jit_resident (ShaderGroup &group)
+{
+    spin_lock lock (m_jit_lru_mutex);
+    if (group.m_in_jit_lru) {
+        m_jit_lru.splice (m_jit_lru.end(), m_jit_lru, group.m_jit_lru_pos);
+        return;
+    }
+    group.m_jit_lru_pos = m_jit_lru.insert (m_jit_lru.end(),
+                                            group.shared_from_this());
+    group.m_in_jit_lru = true;
+    m_jit_resident_bytes += group.m_jit_resident_bytes.load();
+}
+
+
+
+void
+ShaderGroupRegistry::jit_touch (ShaderGroup &group)
+{
+    spin_lock lock (m_jit_lru_mutex);
+    if (group.m_in_jit_lru)
+        m_jit_lru.splice (m_jit_lru.end(), m_jit_lru, group.m_jit_lru_pos);
+}
+
+
+
+void
+ShaderGroupRegistry::jit_dropped (ShaderGroup &group)
+{
+    spin_lock lock (m_jit_lru_mutex);
+    if (! group.m_in_jit_lru)
+        return;
+    m_jit_lru.erase (group.m_jit_lru_pos);
+    group.m_in_jit_lru = false;
+    m_jit_resident_bytes -= group.m_jit_resident_bytes.load();
+}
+
+
+
+std::vector<ShaderGroupRef>
+ShaderGroupRegistry::jit_least_recent (long long bytes,
+                                       const ShaderGroup *skip) const
+{
+    // As in groups(), no reference may be released while we hold the
+    // lock (so even skip's is only dropped after).
+    std::vector<ShaderGroupRef> result;
+    {
+        spin_lock lock (m_jit_lru_mutex);
+        for (auto&& w : m_jit_lru) {
+            if (bytes <= 0)
+                break;
+            if (ShaderGroupRef g = w.lock()) {
+                if (g.get() != skip)
+                    bytes -= g->m_jit_resident_bytes.load();
+                result.push_back (std::move(g));
+            }
+        }
+    }
+    result.erase (std::remove_if (result.begin(), result.end(),
+                                  [=](const ShaderGroupRef &g){ return g.get() == skip; }),
+                  result.end());
+    return result;
 }
 
 
@@ -782,6 +1008,11 @@ ShaderGroup::find_layer (ustring layername) const
 const Symbol *
 ShaderGroup::find_symbol (ustring layername, ustring symbolname) const
 {
+    // Symbols are those of the group itself, even if it has been
+    // re-specialized: they live as long as the group does, unlike those
+    // of a specialization, which may be freed by a later ReParameter.
+    // ShadingContext::translate_symbol finds the equivalent symbol of
+    // whichever specialization actually ran.
     for (int layer = nlayers()-1;  layer >= 0;  --layer) {
         const ShaderInstance *inst (m_layers[layer].get());
         if (layername.size() && layername != inst->layername())
@@ -895,4 +1126,202 @@ ShaderGroup::serialize () const
 }
 
 
+
+std::string
+ShaderGroup::specialization_signature () const
+{
+    std::string sig = serialize ();
+    lock_guard lock (m_mutex);
+    std::ostringstream out;
+    out.imbue (std::locale::classic());  // force C locale
+    for (int i = 0, nl = nlayers(); i < nl; ++i) {
+        const ShaderInstance *inst = m_layers[i].get();
+        // Interpolated params may be changed by ReParameter after
+        // optimization, which must not affect any other group.
+        for (int p = 0;  p < inst->lastparam(); ++p)
+            if (! inst->instoverride(p)->lockgeom())
+                return std::string();
+        // The same shader name may refer to a replaced master.
+        out << "master " << inst->layername() << ' '
+            << (const void *)inst->master() << " ;\n";
+        if (inst->entry_layer())
+            out << "entry " << inst->layername() << " ;\n";
+    }
+    for (auto&& r : m_renderer_outputs)
+        out << "output " << r << " ;\n";
+    out << "raytypes " << m_raytypes_on << ' ' << m_raytypes_off << " ;\n";
+    if (m_no_derivs)
+        out << "noderivs ;\n";
+    if (m_is_output_subset)
+        out << "outputsubset ;\n";
+    if (m_pgo_profile) {
+        // By its contents, so that groups given equal profiles (each read
+        // from the file anew) may still share.
+        for (auto&& p : *m_pgo_profile)
+            out << "profile " << p.first << " = " << p.second << " ;\n";
+    }
+    if (m_fast_math)
+        out << "fastmath ;\n";
+    out << "use " << m_group_use << " ;\n";
+    sig += out.str();
+    return sig;
+}
+
+
+
+void
+ShaderGroup::share_specialization (const ShaderGroup &src)
+{
+    OSL_DASSERT (src.optimized());
+    m_layers = src.m_layers;
+    m_num_entry_layers = src.m_num_entry_layers;
+    m_does_nothing = src.m_does_nothing;
+    m_llvm_groupdata_size = src.m_llvm_groupdata_size;
+    m_llvm_compiled_version = src.m_llvm_compiled_version;
+    m_llvm_compiled_init = src.m_llvm_compiled_init;
+    m_llvm_compiled_uniform = src.m_llvm_compiled_uniform;
+    m_llvm_compiled_layers = src.m_llvm_compiled_layers;
+    m_llvm_layer_funcs = src.m_llvm_layer_funcs;
+    m_llvm_code_size = src.m_llvm_code_size;
+    m_shared_layer_funcs = src.m_shared_layer_funcs;
+    m_uniform_data_ranges = src.m_uniform_data_ranges;
+    m_num_uniform_layers = src.m_num_uniform_layers;
+    m_globals_read = src.m_globals_read;
+    m_globals_write = src.m_globals_write;
+    m_textures_needed = src.m_textures_needed;
+    m_closures_needed = src.m_closures_needed;
+    m_globals_needed = src.m_globals_needed;
+    m_userdata_names = src.m_userdata_names;
+    m_userdata_types = src.m_userdata_types;
+    m_userdata_offsets = src.m_userdata_offsets;
+    m_userdata_derivs = src.m_userdata_derivs;
+    m_userdata_layers = src.m_userdata_layers;
+    m_userdata_init_vals = src.m_userdata_init_vals;
+    m_attributes_needed = src.m_attributes_needed;
+    m_attribute_scopes = src.m_attribute_scopes;
+    m_unknown_textures_needed = src.m_unknown_textures_needed;
+    m_unknown_closures_needed = src.m_unknown_closures_needed;
+    m_unknown_attributes_needed = src.m_unknown_attributes_needed;
+    m_shared_from = src.m_shared_from >= 0 ? src.m_shared_from : src.id();
+}
+
+
+
+void
+ShaderGroup::add_raytype_variant (int raytypes, bool noderivs,
+                                  const ShaderGroupRef &variant)
+{
+    RaytypeVariants *v = m_raytype_variants.load ();
+    if (! v) {
+        v = new RaytypeVariants;
+        m_raytype_variants.store (v, std::memory_order_release);
+    }
+    int n = v->n.load ();
+    OSL_DASSERT (n < max_raytype_variants);
+    v->raytypes[n] = raytypes;
+    v->noderivs[n] = noderivs;
+    v->groups[n] = variant;
+    v->n.store (n+1, std::memory_order_release);
+}
+
+
+
+ShaderGroupRef
+ShaderGroup::current_respecialization () const
+{
+    // Specializations are only retired under our lock, and never the
+    // current one, so it's sure to be among those we're keeping.
+    lock_guard lock (m_mutex);
+    const ShaderGroup *current = m_current_specialization.load ();
+    for (auto&& spec : m_respecializations)
+        if (spec.get() == current)
+            return spec;
+    return ShaderGroupRef();
+}
+
+
+
+ShaderGroupRef
+ShaderGroup::respecialization (const ShaderGroup *base, int changed) const
+{
+    if (m_pristine_layers.empty())
+        return ShaderGroupRef();
+    int nlayers = (int) m_pristine_layers.size();
+
+    // The layers that must be optimized again are the changed one and
+    // those downstream of it (which always come later in the group), plus
+    // the group entry, whose code runs whichever layers aren't lazy.  The
+    // others are kept as the base specialization optimized and JITed
+    // them, as long as it kept the functions of all its layers.
+    std::vector<char> keep;
+    if (base && base->optimized() && base->nlayers() == nlayers &&
+        (int)base->m_llvm_layer_funcs.size() == nlayers &&
+        changed >= 0 && changed < nlayers) {
+        keep.assign (nlayers, true);
+        keep[changed] = false;
+        if (! m_num_entry_layers)
+            keep[nlayers-1] = false;
+        int nkept = 0;
+        for (int layer = 0;  layer < nlayers;  ++layer) {
+            const ShaderInstance *inst = base->m_layers[layer].get();
+            if (! base->m_llvm_layer_funcs[layer] && ! inst->unused() &&
+                ! inst->empty_instance())
+                keep[layer] = false;
+            for (auto&& c : m_pristine_layers[layer]->connections())
+                if (! keep[c.srclayer])
+                    keep[layer] = false;
+            nkept += keep[layer];
+        }
+        if (! nkept)
+            keep.clear ();
+    }
+
+    ShaderGroupRef spec (new ShaderGroup (m_name));
+    spec->m_is_respecialization = true;
+    // Not part of the census (it's reported as part of this group), but
+    // its code counts against the JIT memory budget all the same.
+    spec->m_registry = m_registry;
+    spec->m_layers.reserve (nlayers);
+    for (int layer = 0;  layer < nlayers;  ++layer)
+        spec->m_layers.push_back (keep.size() && keep[layer]
+                                  ? base->m_layers[layer]
+                                  : m_pristine_layers[layer]->unoptimized_copy());
+    if (keep.size()) {
+        // Connections from the kept layers name their params by index
+        // before optimization, which renumbered them: find them by name.
+        // The kept code only passes along those outputs that were
+        // connected when it was JITed, so anything else means starting
+        // over from the unoptimized layers.
+        for (int layer = 0;  layer < nlayers;  ++layer) {
+            if (keep[layer])
+                continue;
+            for (auto&& c : spec->m_layers[layer]->connections()) {
+                if (! keep[c.srclayer])
+                    continue;
+                const ShaderInstance *up = base->m_layers[c.srclayer].get();
+                int param = up->findsymbol (up->mastersymbol(c.src.param)->name());
+                const Symbol *sym = up->symbol (param);  // none if unused
+                if (! sym || ! sym->connected_down())
+                    return respecialization ();
+                c.src.param = param;
+            }
+        }
+        spec->m_kept_layers = std::move (keep);
+        spec->m_kept_from = base;
+    }
+    spec->m_num_entry_layers = m_num_entry_layers;
+    spec->m_exec_repeat = m_exec_repeat;
+    spec->m_fast_math = m_fast_math;
+    spec->m_raytype_queries = m_raytype_queries;
+    spec->m_raytypes_on = m_raytypes_on;
+    spec->m_raytypes_off = m_raytypes_off;
+    spec->m_renderer_outputs = m_renderer_outputs;
+    spec->m_is_output_subset = m_is_output_subset;
+    spec->m_pgo_profile = m_pgo_profile;
+    spec->m_group_use = m_group_use;
+    spec->m_complete = true;
+    return spec;
+}
+
+
 OSL_NAMESPACE_EXIT
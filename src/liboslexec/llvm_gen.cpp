@@ -26,6 +26,7 @@ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <cmath>
 
 #include <OpenImageIO/fmath.h>
@@ -143,20 +144,30 @@ BackendLLVM::llvm_call_layer (int layer, bool unconditional)
     llvm::Value *args[] = { sg_ptr (), groupdata_ptr () };
 
     ShaderInstance *parent = group()[layer];
-    llvm::Value *trueval = ll.constant_bool(true);
-    llvm::Value *layerfield = layer_run_ref(layer_remap(layer));
     llvm::BasicBlock *then_block = NULL, *after_block = NULL;
     if (! unconditional) {
-        llvm::Value *executed = ll.op_load (layerfield);
-        executed = ll.op_ne (executed, trueval);
+        llvm::Value *notrun = ll.op_not (llvm_layer_has_run (layer_remap(layer)));
         then_block = ll.new_basic_block ("");
         after_block = ll.new_basic_block ("");
-        ll.op_branch (executed, then_block, after_block);
+        ll.op_branch (notrun, then_block, after_block);
         // insert point is now then_block
     }
 
+    llvm::Value *funccall;
+    if (in_partition (layer)) {
+        funccall = ll.call_function (layer_function_name(group(), *parent).c_str(), args);
+    } else {
+        // The layer is in another partition's module (see run_partitioned),
+        // so call it through the group's table of JITed layer functions,
+        // which is complete before the group first runs.
+        llvm::PointerType *functype =
+            ll.type_function_ptr (ll.type_void(), { llvm_type_sg_ptr(),
+                                                    llvm_type_groupdata_ptr() });
+        llvm::Value *slot = ll.constant_ptr (&group().m_llvm_layer_funcs[layer],
+                                (llvm::PointerType *) ll.type_ptr (functype));
+        funccall = ll.call_function (ll.op_load (slot), args);
+    }
     // Mark the call as a fast call
-    llvm::Value *funccall = ll.call_function (layer_function_name(group(), *parent).c_str(), args);
     if (!parent->entry_layer())
         ll.mark_fast_func_call (funccall);
 
@@ -1150,7 +1161,7 @@ LLVMGEN (llvm_gen_compref)
     Symbol& Index = *rop.opargsym (op, 2);
 
     llvm::Value *c = rop.llvm_load_value(Index);
-    if (rop.shadingsys().range_checking()) {
+    if (rop.shadingsys().range_checking() && ! op.index_in_range()) {
         if (! (Index.is_constant() &&  *(int *)Index.data() >= 0 &&
                *(int *)Index.data() < 3)) {
             llvm::Value *args[] = { c, rop.ll.constant(3),
@@ -1193,7 +1204,7 @@ LLVMGEN (llvm_gen_compassign)
     Symbol& Val = *rop.opargsym (op, 2);
 
     llvm::Value *c = rop.llvm_load_value(Index);
-    if (rop.shadingsys().range_checking()) {
+    if (rop.shadingsys().range_checking() && ! op.index_in_range()) {
         if (! (Index.is_constant() &&  *(int *)Index.data() >= 0 &&
                *(int *)Index.data() < 3)) {
             llvm::Value *args[] = { c, rop.ll.constant(3),
@@ -1237,7 +1248,7 @@ LLVMGEN (llvm_gen_mxcompref)
 
     llvm::Value *row = rop.llvm_load_value (Row);
     llvm::Value *col = rop.llvm_load_value (Col);
-    if (rop.shadingsys().range_checking()) {
+    if (rop.shadingsys().range_checking() && ! op.index_in_range()) {
         llvm::Value *args[] = { row, rop.ll.constant(4),
                                 rop.ll.constant(M.name()),
                                 rop.sg_void_ptr(),
@@ -1282,7 +1293,7 @@ LLVMGEN (llvm_gen_mxcompassign)
 
     llvm::Value *row = rop.llvm_load_value (Row);
     llvm::Value *col = rop.llvm_load_value (Col);
-    if (rop.shadingsys().range_checking()) {
+    if (rop.shadingsys().range_checking() && ! op.index_in_range()) {
         llvm::Value *args[] = { row, rop.ll.constant(4),
                                 rop.ll.constant(Result.name()),
                                 rop.sg_void_ptr(),
@@ -1342,7 +1353,7 @@ LLVMGEN (llvm_gen_aref)
     llvm::Value *index = rop.loadLLVMValue (Index);
     if (! index)
         return false;
-    if (rop.shadingsys().range_checking()) {
+    if (rop.shadingsys().range_checking() && ! op.index_in_range()) {
         if (! (Index.is_constant() &&  *(int *)Index.data() >= 0 &&
                *(int *)Index.data() < Src.typespec().arraylength())) {
             llvm::Value *args[] = { index,
@@ -1386,7 +1397,7 @@ LLVMGEN (llvm_gen_aassign)
     llvm::Value *index = rop.loadLLVMValue (Index);
     if (! index)
         return false;
-    if (rop.shadingsys().range_checking()) {
+    if (rop.shadingsys().range_checking() && ! op.index_in_range()) {
         if (! (Index.is_constant() &&  *(int *)Index.data() >= 0 &&
                *(int *)Index.data() < Result.typespec().arraylength())) {
             llvm::Value *args[] = { index,
@@ -1926,6 +1937,49 @@ LLVMGEN (llvm_gen_regex)
 
 
 
+// The most common vector ops have "_byval" shadeop variants that take
+// their triple arguments as three floats each, instead of a pointer to
+// the triple, so the values can stay in registers across the call (or
+// after it's inlined).  Call that variant if the op named 'name' has
+// one, returning false if the caller needs to call the regular version.
+static bool
+llvm_gen_call_byval (BackendLLVM &rop, const std::string &name,
+                     cspan<const Symbol*> args)
+{
+    static const char *byval_ops[] = {
+        "osl_dot_fvv", "osl_cross_vvv", "osl_length_fv",
+        "osl_distance_fvv", "osl_normalize_vv"
+    };
+    // OptiX gets its shadeops from the renderer's library, which need not
+    // have the by-value variants.
+    if (rop.use_optix())
+        return false;
+    if (std::find (std::begin(byval_ops), std::end(byval_ops), name)
+          == std::end(byval_ops))
+        return false;
+
+    const Symbol &Result (*args[0]);
+    bool triple_result = Result.typespec().is_triple();
+    std::vector<llvm::Value*> valargs;
+    if (triple_result)
+        valargs.push_back (rop.llvm_void_ptr (Result));
+    for (size_t i = 1; i < args.size(); ++i) {
+        const Symbol &s (*args[i]);
+        if (s.typespec().is_triple()) {
+            for (int c = 0; c < 3; ++c)
+                valargs.push_back (rop.llvm_load_value (s, 0, c, TypeDesc::TypeFloat));
+        } else {
+            valargs.push_back (rop.llvm_load_value (s));
+        }
+    }
+    llvm::Value *r = rop.ll.call_function ((name + "_byval").c_str(), valargs);
+    if (! triple_result)
+        rop.llvm_store_value (r, Result);
+    return true;
+}
+
+
+
 // Generic llvm code generation.  See the comments in llvm_ops.cpp for
 // the full list of assumptions and conventions.  But in short:
 //   1. All polymorphic and derivative cases implemented as functions in
@@ -1938,7 +1992,8 @@ LLVMGEN (llvm_gen_regex)
 //      must be stored), but "returns" aggregates or duals in the first
 //      argument.
 //   4. Duals and aggregates are passed as void*'s, float/int/string 
-//      passed by value.
+//      passed by value.  (Except that the few hot ops listed in
+//      llvm_gen_call_byval take their triples as three floats.)
 //   5. Note that this only works if triples are all treated identically,
 //      this routine can't be used if it must be polymorphic based on
 //      color, point, vector, normal differences.
@@ -1993,7 +2048,9 @@ LLVMGEN (llvm_gen_generic)
 
     if (! Result.has_derivs() || ! any_deriv_args) {
         // Don't compute derivs -- either not needed or not provided in args
-        if (Result.typespec().aggregate() == TypeDesc::SCALAR) {
+        if (llvm_gen_call_byval (rop, name, cspan<const Symbol*>(args, op.nargs()))) {
+            // done
+        } else if (Result.typespec().aggregate() == TypeDesc::SCALAR) {
             llvm::Value *r = rop.llvm_call_function (name.c_str(), cspan<const Symbol*>(args + 1, op.nargs() - 1));
             rop.llvm_store_value (r, Result);
         } else {
@@ -2104,7 +2161,7 @@ LLVMGEN (llvm_gen_if)
     llvm::BasicBlock* then_block = rop.ll.new_basic_block ("then");
     llvm::BasicBlock* else_block = rop.ll.new_basic_block ("else");
     llvm::BasicBlock* after_block = rop.ll.new_basic_block ("");
-    rop.ll.op_branch (cond_val, then_block, else_block);
+    rop.llvm_profiled_branch (op, cond_val, then_block, else_block);
 
     // Then block
     rop.build_llvm_code (opnum+1, op.jump(0), then_block);
@@ -2145,7 +2202,7 @@ LLVMGEN (llvm_gen_loop_op)
     llvm::Value* cond_val = rop.llvm_test_nonzero (cond);
 
     // Jump to either LoopBody or AfterLoop
-    rop.ll.op_branch (cond_val, body_block, after_block);
+    rop.llvm_profiled_branch (op, cond_val, body_block, after_block);
 
     // Body of loop
     rop.build_llvm_code (op.jump(1), op.jump(2), body_block);
@@ -2423,6 +2480,29 @@ LLVMGEN (llvm_gen_texture)
         texture_handle = rop.renderer()->get_texture_handle (*(ustring *)Filename.data(), rop.shadingcontext());
     }
 
+    // The filter footprint: the user's derivs if given, else those of the
+    // coordinates -- unless the group was compiled without derivatives,
+    // in which case the renderer supplies it as the u and v derivatives
+    // in the ShaderGlobals.
+    llvm::Value *dsdx, *dtdx, *dsdy, *dtdy;
+    if (user_derivs) {
+        dsdx = rop.llvm_load_value (*rop.opargsym (op, 4));
+        dtdx = rop.llvm_load_value (*rop.opargsym (op, 5));
+        dsdy = rop.llvm_load_value (*rop.opargsym (op, 6));
+        dtdy = rop.llvm_load_value (*rop.opargsym (op, 7));
+    } else if (rop.group().no_derivs()) {
+        llvm::Type *floattype = rop.ll.type_float();
+        dsdx = rop.ll.op_load (rop.ll.ptr_to_cast (rop.llvm_global_deriv_ptr (Strings::u, 1), floattype));
+        dtdx = rop.ll.op_load (rop.ll.ptr_to_cast (rop.llvm_global_deriv_ptr (Strings::v, 1), floattype));
+        dsdy = rop.ll.op_load (rop.ll.ptr_to_cast (rop.llvm_global_deriv_ptr (Strings::u, 2), floattype));
+        dtdy = rop.ll.op_load (rop.ll.ptr_to_cast (rop.llvm_global_deriv_ptr (Strings::v, 2), floattype));
+    } else {
+        dsdx = rop.llvm_load_value (S, 1);
+        dtdx = rop.llvm_load_value (T, 1);
+        dsdy = rop.llvm_load_value (S, 2);
+        dtdy = rop.llvm_load_value (T, 2);
+    }
+
     // Now call the osl_texture function, passing the options and all the
     // explicit args like texture coordinates.
     llvm::Value * args[] = {
@@ -2432,10 +2512,7 @@ LLVMGEN (llvm_gen_texture)
         opt,
         rop.llvm_load_value (S),
         rop.llvm_load_value (T),
-        user_derivs ? rop.llvm_load_value (*rop.opargsym (op, 4)) : rop.llvm_load_value (S, 1),
-        user_derivs ? rop.llvm_load_value (*rop.opargsym (op, 5)) : rop.llvm_load_value (T, 1),
-        user_derivs ? rop.llvm_load_value (*rop.opargsym (op, 6)) : rop.llvm_load_value (S, 2),
-        user_derivs ? rop.llvm_load_value (*rop.opargsym (op, 7)) : rop.llvm_load_value (T, 2),
+        dsdx, dtdx, dsdy, dtdy,
         rop.ll.constant (nchans),
         rop.ll.void_ptr (rop.llvm_get_pointer (Result, 0)),
         rop.ll.void_ptr (rop.llvm_get_pointer (Result, 1)),
@@ -2489,9 +2566,14 @@ LLVMGEN (llvm_gen_texture3d)
         rop.ll.constant_ptr (texture_handle),
         opt,
         rop.llvm_void_ptr (P),
-        // Auto derivs of P if !user_derivs
-        user_derivs ? rop.llvm_void_ptr (*rop.opargsym (op, 3)) : rop.llvm_void_ptr (P, 1),
-        user_derivs ? rop.llvm_void_ptr (*rop.opargsym (op, 4)) : rop.llvm_void_ptr (P, 2),
+        // Auto derivs of P if !user_derivs (the renderer's dPdx and dPdy
+        // if the group was compiled without derivatives)
+        user_derivs ? rop.llvm_void_ptr (*rop.opargsym (op, 3))
+            : rop.group().no_derivs() ? rop.llvm_global_deriv_ptr (Strings::P, 1)
+            : rop.llvm_void_ptr (P, 1),
+        user_derivs ? rop.llvm_void_ptr (*rop.opargsym (op, 4))
+            : rop.group().no_derivs() ? rop.llvm_global_deriv_ptr (Strings::P, 2)
+            : rop.llvm_void_ptr (P, 2),
         rop.ll.constant (nchans),
         rop.ll.void_ptr (rop.llvm_void_ptr (Result, 0)),
         rop.ll.void_ptr (rop.llvm_void_ptr (Result, 1)),
@@ -2544,8 +2626,14 @@ LLVMGEN (llvm_gen_environment)
         rop.ll.constant_ptr (texture_handle),
         opt,
         rop.llvm_void_ptr (R),
-        user_derivs ? rop.llvm_void_ptr (*rop.opargsym (op, 3)) : rop.llvm_void_ptr (R, 1),
-        user_derivs ? rop.llvm_void_ptr (*rop.opargsym (op, 4)) : rop.llvm_void_ptr (R, 2),
+        // Auto derivs of R if !user_derivs (the renderer's dIdx and dIdy
+        // if the group was compiled without derivatives)
+        user_derivs ? rop.llvm_void_ptr (*rop.opargsym (op, 3))
+            : rop.group().no_derivs() ? rop.llvm_global_deriv_ptr (Strings::I, 1)
+            : rop.llvm_void_ptr (R, 1),
+        user_derivs ? rop.llvm_void_ptr (*rop.opargsym (op, 4))
+            : rop.group().no_derivs() ? rop.llvm_global_deriv_ptr (Strings::I, 2)
+            : rop.llvm_void_ptr (R, 2),
         rop.ll.constant (nchans),
         rop.llvm_void_ptr (Result, 0),
         rop.llvm_void_ptr (Result, 1),
@@ -2663,6 +2751,9 @@ llvm_gen_noise_options (BackendLLVM &rop, int opnum,
 {
     llvm::Value* opt = rop.ll.call_function ("osl_get_noise_options",
                                              rop.sg_void_ptr());
+    if (rop.group().fast_math() && ! rop.use_optix())
+        rop.ll.call_function ("osl_noiseparams_set_fast_math", opt,
+                              rop.ll.constant(1));
 
     Opcode &op (rop.inst()->ops()[opnum]);
     for (int a = first_optional_arg;  a < op.nargs();  ++a) {
@@ -26,11 +26,14 @@ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <unordered_map>
 #include <unordered_set>
 #include <bitset>
+#include <atomic>
+#include <thread>
 
 #include <OpenImageIO/timer.h>
 #include <OpenImageIO/sysutil.h>
@@ -58,8 +61,8 @@ Schematically, we want to create code that resembles the following:
 
     // Assume 2 layers. 
     struct GroupData_1 {
-        // Array telling if we have already run each layer
-        char layer_run[nlayers];
+        // Bitset telling if we have already run each layer
+        uint32_t layer_run[(nlayers+31)/32];
         // Array telling if we have already initialized each
         // needed user data (0 = haven't checked, 1 = checked and there
         // was no userdata, 2 = checked and there was userdata)
@@ -91,8 +94,8 @@ Schematically, we want to create code that resembles the following:
     {
         // Because we need the outputs of layer 0 now, we call it if it
         // hasn't already run:
-        if (! group->layer_run[0]) {
-            group->layer_run[0] = 1;
+        if (! (group->layer_run[0] & (1<<0))) {
+            group->layer_run[0] |= (1<<0);
             $layer_0 (sg, group);    // because we need its outputs
         }
         *y = sg->u * group->$param_1_bar;
@@ -103,8 +106,8 @@ Schematically, we want to create code that resembles the following:
         group->layer_run[...] = 0;
         // Run just the unconditional layers
 
-        if (! group->layer_run[1]) {
-            group->layer_run[1] = 1;
+        if (! (group->layer_run[0] & (1<<1))) {
+            group->layer_run[0] |= (1<<1);
             $layer_1 (sg, group);
         }
     }
@@ -117,12 +120,55 @@ extern unsigned char osl_llvm_compiled_ops_block[];
 extern int osl_llvm_compiled_ops_cuda_size;
 extern unsigned char osl_llvm_compiled_ops_cuda_block[];
 
+// ISA-specific flavours of the llvm_ops bitcode (see OSL_LLVM_OPS_ISAS
+// in the liboslexec CMakeLists.txt).
+#ifdef OSL_LLVM_OPS_SSE4_2
+extern int osl_llvm_compiled_ops_sse4_2_size;
+extern unsigned char osl_llvm_compiled_ops_sse4_2_block[];
+#endif
+#ifdef OSL_LLVM_OPS_AVX2
+extern int osl_llvm_compiled_ops_avx2_size;
+extern unsigned char osl_llvm_compiled_ops_avx2_block[];
+#endif
+#ifdef OSL_LLVM_OPS_AVX512
+extern int osl_llvm_compiled_ops_avx512_size;
+extern unsigned char osl_llvm_compiled_ops_avx512_block[];
+#endif
+
 using namespace OSL::pvt;
 
 OSL_NAMESPACE_ENTER
 
 namespace pvt {
 
+#ifndef OSL_LLVM_NO_BITCODE
+// The llvm_ops bitcode flavours we were built with, best first, and the
+// CPU features (LLVM syntax) each one needs. The last one is the generic
+// bitcode that runs anywhere.
+struct LLVMOpsFlavor {
+    const char *name;
+    const char *features;
+    unsigned char *block;
+    int *size;
+};
+
+static const LLVMOpsFlavor llvm_ops_flavors[] = {
+#ifdef OSL_LLVM_OPS_AVX512
+    { "avx512", "+avx512f,+avx512dq,+avx512bw,+avx512vl,+avx2,+fma,+f16c",
+      osl_llvm_compiled_ops_avx512_block, &osl_llvm_compiled_ops_avx512_size },
+#endif
+#ifdef OSL_LLVM_OPS_AVX2
+    { "avx2", "+avx2,+fma,+f16c",
+      osl_llvm_compiled_ops_avx2_block, &osl_llvm_compiled_ops_avx2_size },
+#endif
+#ifdef OSL_LLVM_OPS_SSE4_2
+    { "sse4.2", "+sse4.2",
+      osl_llvm_compiled_ops_sse4_2_block, &osl_llvm_compiled_ops_sse4_2_size },
+#endif
+    { "generic", "", osl_llvm_compiled_ops_block, &osl_llvm_compiled_ops_size }
+};
+#endif
+
 static spin_mutex llvm_mutex;
 
 static ustring op_end("end");
@@ -247,14 +293,14 @@ BackendLLVM::llvm_type_groupdata ()
     if (llvm_debug() >= 2)
         std::cout << "Group param struct:\n";
 
-    // First, add the array that tells if each layer has run.  But only make
-    // slots for the layers that may be called/used.
+    // First, add the bitset that tells if each layer has run.  But only
+    // make bits for the layers that may be called/used.
     if (llvm_debug() >= 2)
         std::cout << "  layers run flags: " << m_num_used_layers
                   << " at offset " << offset << "\n";
-    int sz = (m_num_used_layers + 3) & (~3);  // Round up to 32 bit boundary
-    fields.push_back (ll.type_array (ll.type_bool(), sz));
-    offset += sz * sizeof(bool);
+    int nwords = (m_num_used_layers + 31) / 32;
+    fields.push_back (ll.type_array (ll.type_int(), nwords));
+    offset += nwords * sizeof(int);
     ++order;
 
     // Now add the array that tells which userdata have been initialized,
@@ -288,48 +334,138 @@ BackendLLVM::llvm_type_groupdata ()
             if (llvm_debug() >= 2)
                 std::cout << "  userdata " << names[i] << ' ' << type
                           << ", field " << order << ", offset " << offset << "\n";
-            offsets[i] = offset;
+            if (offsets[i] != offset)  // see run_partitioned
+                offsets[i] = offset;
             offset += int(type.size());
             ++order;
         }
     }
 
+    // If we kept some layers' code from an earlier specialization, the
+    // rest of its group data stays as it was, for the params that code
+    // uses (see pin_kept_layers), and the other params go after it.
+    if (group().m_kept_from) {
+        int keptsize = (int) group().m_kept_from->llvm_groupdata_size();
+        if (offset < keptsize) {
+            if (llvm_debug() >= 2)
+                std::cout << "  kept group data: " << keptsize - offset
+                          << " bytes, field " << order << ", offset " << offset << "\n";
+            fields.push_back (ll.type_array (ll.type_char(), keptsize - offset));
+            offset = keptsize;
+            ++order;
+        }
+    }
+
     // For each layer in the group, add entries for all params that are
     // connected or interpolated, and output params.  Also mark those
     // symbols with their offset within the group struct.
     m_param_order_map.clear ();
+    auto add_param = [&](ShaderInstance *inst, Symbol &sym) {
+        TypeSpec ts = sym.typespec();
+        const int arraylen = std::max (1, sym.typespec().arraylength());
+        const int derivSize = (sym.has_derivs() ? 3 : 1);
+        ts.make_array (arraylen * derivSize);
+        fields.push_back (llvm_type (ts));
+
+        // Alignment
+        size_t align = sym.typespec().is_closure_based() ? sizeof(void*) :
+                sym.typespec().simpletype().basesize();
+        if (offset & (align-1))
+            offset += align - (offset & (align-1));
+        if (llvm_debug() >= 2)
+            std::cout << "  " << inst->layername() 
+                      << " (" << inst->id() << ") " << sym.mangled()
+                      << " " << ts.c_str() << ", field " << order 
+                      << ", size " << derivSize * int(sym.size())
+                      << ", offset " << offset << std::endl;
+        if (sym.dataoffset() != (int)offset)  // see run_partitioned
+            sym.dataoffset ((int)offset);
+        offset += derivSize* int(sym.size());
+
+        m_param_order_map[&sym] = order;
+        ++order;
+    };
+
+    // If the group has a profile, the params it accessed go first, most
+    // accessed first, so the hot ones share the leading cache lines.
+    if (group().m_pgo_profile) {
+        std::vector<std::tuple<long long,int,ShaderInstance*,Symbol*>> hot;
+        for (int layer = 0;  layer < group().nlayers();  ++layer) {
+            ShaderInstance *inst = group()[layer];
+            if (inst->unused() || (layer < (int)m_layer_signature.size() &&
+                                   m_layer_signature[layer].size()))
+                continue;
+            FOREACH_PARAM (Symbol &sym, inst) {
+                if (sym.typespec().is_structure())
+                    continue;
+                long long count = pgo_profile_count (
+                        Strutil::sprintf ("sym %d %s", layer, sym.name()));
+                if (count > 0)
+                    hot.emplace_back (-count, (int)hot.size(), inst, &sym);
+            }
+        }
+        std::sort (hot.begin(), hot.end());
+        for (auto&& h : hot)
+            add_param (std::get<2>(h), *std::get<3>(h));
+        shadingsys().m_stat_pgo_hot_params += (int) hot.size();
+    }
+
     for (int layer = 0;  layer < group().nlayers();  ++layer) {
         ShaderInstance *inst = group()[layer];
-        if (inst->unused())
+        if (inst->unused() || group().kept_layer (layer))
             continue;
-        FOREACH_PARAM (Symbol &sym, inst) {
-            TypeSpec ts = sym.typespec();
-            if (ts.is_structure())  // skip the struct symbol itself
-                continue;
-            const int arraylen = std::max (1, sym.typespec().arraylength());
-            const int derivSize = (sym.has_derivs() ? 3 : 1);
-            ts.make_array (arraylen * derivSize);
-            fields.push_back (llvm_type (ts));
-
-            // Alignment
-            size_t align = sym.typespec().is_closure_based() ? sizeof(void*) :
-                    sym.typespec().simpletype().basesize();
-            if (offset & (align-1))
-                offset += align - (offset & (align-1));
+        if (layer < (int)m_layer_signature.size() && m_layer_signature[layer].size()) {
+            // The params of a layer whose code is shared with other groups
+            // go in a nested struct of their own, so that their layout
+            // relative to each other is the same wherever the block lands.
+            int blockalign = 1;
+            FOREACH_PARAM (Symbol &sym, inst) {
+                if (sym.typespec().is_structure())
+                    continue;
+                int align = sym.typespec().is_closure_based() ? (int)sizeof(void*) :
+                        (int)sym.typespec().simpletype().basesize();
+                blockalign = std::max (blockalign, align);
+            }
+            offset = OIIO::round_to_multiple_of_pow2 (offset, blockalign);
+            int blockoffset = offset;
+            int suborder = 0;
+            FOREACH_PARAM (Symbol &sym, inst) {
+                if (sym.typespec().is_structure())
+                    continue;
+                size_t align = sym.typespec().is_closure_based() ? sizeof(void*) :
+                        sym.typespec().simpletype().basesize();
+                if (offset & (align-1))
+                    offset += align - (offset & (align-1));
+                sym.dataoffset ((int)offset);
+                offset += (sym.has_derivs() ? 3 : 1) * int(sym.size());
+                m_param_order_map[&sym] = suborder++;
+            }
+            offset = blockoffset + OIIO::round_to_multiple_of_pow2 (offset-blockoffset, blockalign);
             if (llvm_debug() >= 2)
-                std::cout << "  " << inst->layername() 
-                          << " (" << inst->id() << ") " << sym.mangled()
-                          << " " << ts.c_str() << ", field " << order 
-                          << ", size " << derivSize * int(sym.size())
-                          << ", offset " << offset << std::endl;
-            sym.dataoffset ((int)offset);
-            offset += derivSize* int(sym.size());
-
-            m_param_order_map[&sym] = order;
+                std::cout << "  " << inst->layername() << " (" << inst->id()
+                          << ") shared params, field " << order << ", size "
+                          << offset-blockoffset << ", offset " << blockoffset << std::endl;
+            fields.push_back (llvm_type_layerdata (layer));
+            m_layer_block_field[layer] = order;
             ++order;
+            continue;
+        }
+        FOREACH_PARAM (Symbol &sym, inst) {
+            if (sym.typespec().is_structure())  // skip the struct symbol itself
+                continue;
+            if (m_param_order_map.count (&sym))  // already placed as hot
+                continue;
+            auto pinned = m_pinned_params.find (&sym);
+            if (pinned != m_pinned_params.end()) {
+                if (sym.dataoffset() != pinned->second)
+                    sym.dataoffset (pinned->second);
+                continue;
+            }
+            add_param (inst, sym);
         }
     }
-    group().llvm_groupdata_size (offset);
+    if (group().llvm_groupdata_size() != (size_t)offset)
+        group().llvm_groupdata_size (offset);
     if (llvm_debug() >= 2)
         std::cout << " Group struct had " << order << " fields, total size "
                   << offset << "\n\n";
@@ -351,6 +487,31 @@ BackendLLVM::llvm_type_groupdata_ptr ()
 
 
 
+llvm::Type *
+BackendLLVM::llvm_type_layerdata (int layer)
+{
+    if (m_llvm_type_layerdata[layer])
+        return m_llvm_type_layerdata[layer];
+
+    // Same fields, in the same order, as the params of the layer would
+    // have had directly in the group data.
+    std::vector<llvm::Type*> fields;
+    FOREACH_PARAM (Symbol &sym, group()[layer]) {
+        TypeSpec ts = sym.typespec();
+        if (ts.is_structure())  // skip the struct symbol itself
+            continue;
+        const int arraylen = std::max (1, sym.typespec().arraylength());
+        const int derivSize = (sym.has_derivs() ? 3 : 1);
+        ts.make_array (arraylen * derivSize);
+        fields.push_back (llvm_type (ts));
+    }
+    std::string name = Strutil::sprintf ("Layerdata_%d_%d", group().id(), layer);
+    m_llvm_type_layerdata[layer] = ll.type_struct (fields, name);
+    return m_llvm_type_layerdata[layer];
+}
+
+
+
 llvm::Type *
 BackendLLVM::llvm_type_closure_component ()
 {
@@ -699,6 +860,18 @@ BackendLLVM::build_llvm_code (int beginop, int endop, llvm::BasicBlock *bb)
                 llvm_generate_debug_uninit (op);
             if (shadingsys().llvm_debug_ops())
                 llvm_generate_debug_op_printf (op);
+            if (shadingsys().pgo_instrument()) {
+                // Count the op's accesses of params in the group data
+                for (int a = 0;  a < op.nargs();  ++a) {
+                    const Symbol *s = opargsym (op, a);
+                    if ((s->symtype() == SymTypeParam ||
+                         s->symtype() == SymTypeOutputParam) &&
+                        s->dataoffset() >= 0)
+                        llvm_pgo_count (Strutil::sprintf ("sym %d %s", layer(),
+                                                          s->name()),
+                                        ll.op_int_to_longlong (ll.constant(1)));
+                }
+            }
             bool ok = (*opd->llvmgen) (*this, opnum);
             if (! ok)
                 return false;
@@ -752,9 +925,10 @@ BackendLLVM::build_llvm_init ()
 #endif
 
     // Group init clears all the "layer_run" and "userdata_initialized" flags.
+    // The layer_run flags are a bitset, so that's one store per 32 layers.
     if (m_num_used_layers > 1) {
-        int sz = (m_num_used_layers + 3) & (~3);  // round up to 32 bits
-        ll.op_memset (ll.void_ptr(layer_run_ref(0)), 0, sz, 4 /*align*/);
+        for (int i = 0;  i < m_num_used_layers;  i += 32)
+            ll.op_store (ll.constant(0), layer_run_ref(i));
     }
     int num_userdata = (int) group().m_userdata_names.size();
     if (num_userdata) {
@@ -763,20 +937,41 @@ BackendLLVM::build_llvm_init ()
     }
 
     // Group init also needs to allot space for ALL layers' params
-    // that are closures (to avoid weird order of layer eval problems).
+    // that are closures (to avoid weird order of layer eval problems),
+    // which it does by setting them all to NULL, with or without
+    // clearmemory.
+    //
+    // If asked to clear memory, also zero just the other params that
+    // could be read (by a later layer or by the renderer) before anything
+    // writes them: all those of layers that might not run at all, and
+    // those that a layer that does run doesn't initialize on entry
+    // (connections, which the upstream layer writes only when it's run,
+    // lazy userdata, and params that are never used).  The rest of the
+    // group data is always written first, so there's no point clearing it.
     for (int i = 0;  i < group().nlayers();  ++i) {
         ShaderInstance *gi = group()[i];
         if (gi->unused() || gi->empty_instance())
             continue;
+        bool always_runs = ! group().num_entry_layers() &&
+                           (group().is_last_layer(i) || ! gi->run_lazily());
         FOREACH_PARAM (Symbol &sym, gi) {
-           if (sym.typespec().is_closure_based()) {
+            if (sym.typespec().is_closure_based()) {
                 int arraylen = std::max (1, sym.typespec().arraylength());
                 llvm::Value *val = ll.constant_ptr(NULL, ll.type_void_ptr());
                 for (int a = 0; a < arraylen;  ++a) {
                     llvm::Value *arrind = sym.typespec().is_array() ? ll.constant(a) : NULL;
                     llvm_store_value (val, sym, 0, arrind, 0);
                 }
+                continue;
             }
+            if (! shadingsys().m_clearmemory || sym.typespec().is_structure())
+                continue;
+            if (always_runs && param_assigned_on_entry (sym) &&
+                sym.valuesource() != Symbol::ConnectedVal)
+                continue;
+            int size = (sym.has_derivs() ? 3 : 1) * int(sym.size());
+            ll.op_memset (llvm_void_ptr (sym), 0, size,
+                          (int)sym.typespec().simpletype().basesize());
         }
     }
 
@@ -802,62 +997,273 @@ BackendLLVM::build_llvm_init ()
 
 
 llvm::Function*
-BackendLLVM::build_llvm_instance (bool groupentry)
+BackendLLVM::build_llvm_uniform ()
 {
-    // Make a layer function: void layer_func(ShaderGlobals*, GroupData*)
-    // Note that the GroupData* is passed as a void*.
-    std::string unique_layer_name = layer_function_name();
-    bool is_entry_layer = group().is_entry_layer(layer());
+    // Make a function that runs all the uniform layers of the group:
+    // void group_uniform(ShaderGlobals*, GroupData*)
+    // Along the way, note the ranges of the group data those layers write
+    // (their "run" flags and params, and the downstream params they copy
+    // their outputs into), so that the context can cache them per object.
+    ShaderGroup::DataRangeVec &ranges (group().m_uniform_data_ranges);
+    ranges.clear ();
+    group().m_num_uniform_layers = 0;
+    for (int layer = 0;  layer < group().nlayers();  ++layer) {
+        ShaderInstance *inst = group()[layer];
+        if (! inst->uniform() || layer_remap(layer) == -1)
+            continue;
+        ++group().m_num_uniform_layers;
+        ranges.emplace_back (layer_remap(layer) / 32 * (int)sizeof(int),
+                             (int)sizeof(int));
+        FOREACH_PARAM (Symbol &sym, inst) {
+            if (sym.typespec().is_structure() || sym.dataoffset() < 0)
+                continue;
+            ranges.emplace_back (sym.dataoffset(),
+                                 (sym.has_derivs() ? 3 : 1) * (int)sym.size());
+        }
+        for (int d = layer+1;  d < group().nlayers();  ++d) {
+            ShaderInstance *child = group()[d];
+            if (child->unused())
+                continue;
+            for (auto&& con : child->connections()) {
+                if (con.srclayer != layer)
+                    continue;
+                Symbol *sym = child->symbol (con.dst.param);
+                if (sym->dataoffset() >= 0)
+                    ranges.emplace_back (sym->dataoffset(),
+                                 (sym->has_derivs() ? 3 : 1) * (int)sym->size());
+            }
+        }
+    }
+    if (! group().m_num_uniform_layers)
+        return NULL;
+
+    // Sort and coalesce the ranges so the cache copies as few, and as
+    // large, chunks as possible.
+    std::sort (ranges.begin(), ranges.end());
+    size_t n = 0;
+    for (size_t i = 1;  i < ranges.size();  ++i) {
+        if (ranges[i].first <= ranges[n].first + ranges[n].second)
+            ranges[n].second = std::max (ranges[n].second,
+                                         ranges[i].first + ranges[i].second - ranges[n].first);
+        else
+            ranges[++n] = ranges[i];
+    }
+    ranges.resize (n+1);
+
+    std::string unique_name = Strutil::sprintf ("group_%d_uniform", group().id());
     ll.current_function (
-           ll.make_function (unique_layer_name,
-                             !is_entry_layer, // fastcall for non-entry layer functions
+           ll.make_function (unique_name, false,
                              ll.type_void(), // return type
                              llvm_type_sg_ptr(), llvm_type_groupdata_ptr()));
+    m_llvm_shaderglobals_ptr = ll.current_function_arg(0);
+    m_llvm_groupdata_ptr = ll.current_function_arg(1);
+    llvm::BasicBlock *entry_bb = ll.new_basic_block (unique_name);
+    ll.new_builder (entry_bb);
 
-    // Get shader globals and groupdata pointers
-    m_llvm_shaderglobals_ptr = ll.current_function_arg(0); //arg_it++;
-    m_llvm_groupdata_ptr = ll.current_function_arg(1); //arg_it++;
+    // Uniform layers only read from other uniform layers, so calling them
+    // in order runs all of them exactly once.
+    for (int layer = 0;  layer < group().nlayers();  ++layer) {
+        ShaderInstance *inst = group()[layer];
+        if (inst->uniform() && layer_remap(layer) != -1)
+            llvm_call_layer (layer);
+    }
+    ll.op_return();
 
-    llvm::BasicBlock *entry_bb = ll.new_basic_block (unique_layer_name);
-    m_exit_instance_block = NULL;
+    if (llvm_debug())
+        std::cout << "group uniform func (" << unique_name << ") "
+                  << " after llvm  = "
+                  << ll.bitcode_string(ll.current_function()) << "\n";
 
-    // Set up a new IR builder
+    ll.end_builder();  // clear the builder
+
+    return ll.current_function();
+}
+
+
+
+std::string
+BackendLLVM::shared_layer_signature ()
+{
+    // Only layers whose code touches nothing in the group data other than
+    // their own params may be shared: no upstream layers to run lazily,
+    // no userdata, and no "run" flag checks of their own.
+    ShaderInstance *in = inst();
+    if (in->unused() || in->empty_instance() || in->entry_layer() ||
+        group().is_last_layer(layer()) || in->nconnections() ||
+        in->userdata_params())
+        return std::string();
+    FOREACH_PARAM (Symbol &s, in)
+        if (! s.lockgeom())
+            return std::string();
+
+    std::ostringstream out;
+    out.imbue (std::locale::classic());  // force C locale
+    out << shadingsys().codegen_signature ();
+    if (group().fast_math())
+        out << "fastmath ;\n";
+    out << in->shadername() << ' ' << in->maincodebegin() << ' '
+        << in->maincodeend() << '\n';
+    const Symbol *firstsym = in->symbols().data();
+    for (auto&& s : in->symbols()) {
+        out << s.mangled() << ' ' << int(s.symtype()) << ' '
+            << s.typespec().c_str() << ' ' << s.has_derivs()
+            << s.connected_down() << s.renderer_output() << s.lockgeom()
+            << int(s.valuesource()) << ' ' << s.initbegin() << ' '
+            << s.initend() << ' ' << s.firstread() << ' ' << s.lastread()
+            << ' ' << s.firstwrite() << ' ' << s.lastwrite() << ' '
+            << int(s.dealias() - firstsym);
+        // Constant and param values get baked into the code (strings by
+        // their unique ustring address).
+        if ((s.symtype() == SymTypeConst || s.symtype() == SymTypeParam ||
+             s.symtype() == SymTypeOutputParam) && s.data() &&
+            ! s.typespec().is_structure() && ! s.typespec().is_closure_based()) {
+            out << " =";
+            const unsigned char *bytes = (const unsigned char *)s.data();
+            for (size_t b = 0, e = s.size();  b < e;  ++b)
+                out << ' ' << int(bytes[b]);
+        }
+        out << '\n';
+    }
+    for (auto&& op : in->ops()) {
+        out << op.opname() << ' ' << op.method() << ' ' << op.sourcefile()
+            << ':' << op.sourceline() << ' ' << op.firstarg() << ' '
+            << op.nargs() << ' ' << op.argread_bits() << ' '
+            << op.argwrite_bits() << ' ' << op.argtakesderivs_all();
+        for (int j = 0;  j < (int)Opcode::max_jumps;  ++j)
+            out << ' ' << op.jump(j);
+        out << '\n';
+    }
+    for (auto&& a : in->args())
+        out << a << ' ';
+    return out.str();
+}
+
+
+
+llvm::Function*
+BackendLLVM::build_llvm_shared_layer ()
+{
+    // Make a function: void func(ShaderGlobals*, void *layerdata), that
+    // other groups may call directly after it's been JITed.
+    std::string unique_name = Strutil::sprintf ("shared_layer_%d_%d",
+                                                group().id(), layer());
+    ll.current_function (
+           ll.make_function (unique_name, false,
+                             ll.type_void(), // return type
+                             llvm_type_sg_ptr(), ll.type_void_ptr()));
+    m_llvm_shaderglobals_ptr = ll.current_function_arg(0);
+    m_llvm_groupdata_ptr = NULL;  // Nothing else of the group is available
+    llvm::BasicBlock *entry_bb = ll.new_basic_block (unique_name);
+    m_exit_instance_block = NULL;
     ll.new_builder (entry_bb);
+    m_llvm_layerdata_ptr = ll.ptr_cast (ll.current_function_arg(1),
+                                        ll.type_ptr (llvm_type_layerdata (layer())));
 
-    llvm::Value *layerfield = layer_run_ref(layer_remap(layer()));
-    if (is_entry_layer && ! group().is_last_layer(layer())) {
-        // For entry layers, we need an extra check to see if it already
-        // ran. If it has, do an early return. Otherwise, set the 'ran' flag
-        // and then run the layer.
-        if (shadingsys().llvm_debug_layers())
-            llvm_gen_debug_printf (Strutil::sprintf("checking for already-run layer %d %s %s",
-                                   this->layer(), inst()->layername(), inst()->shadername()));
-        llvm::Value *executed = ll.op_eq (ll.op_load (layerfield), ll.constant_bool(true));
-        llvm::BasicBlock *then_block = ll.new_basic_block();
-        llvm::BasicBlock *after_block = ll.new_basic_block();
-        ll.op_branch (executed, then_block, after_block);
-        // insert point is now then_block
-        // we've already executed, so return early
-        if (shadingsys().llvm_debug_layers())
-            llvm_gen_debug_printf (Strutil::sprintf("  taking early exit, already executed layer %d %s %s",
-                                   this->layer(), inst()->layername(), inst()->shadername()));
-        ll.op_return ();
-        ll.set_insert_point (after_block);
+    m_named_values.clear ();
+    m_layers_already_run.clear ();
+    build_llvm_layer_body (false);
+    ll.op_return();
+
+    if (llvm_debug())
+        std::cout << "shared layer func (" << unique_name << ") "
+                  << " after llvm  = "
+                  << ll.bitcode_string(ll.current_function()) << "\n";
+
+    ll.end_builder();  // clear the builder
+    m_llvm_layerdata_ptr = NULL;
+
+    return ll.current_function();
+}
+
+
+
+bool
+BackendLLVM::param_assigned_on_entry (const Symbol &s) const
+{
+    // Skip if it's never read and isn't connected
+    if (! s.everread() && ! s.connected_down() && ! s.connected()
+          && ! s.renderer_output())
+        return false;
+    // Skip if it's an interpolated (userdata) parameter and we're
+    // initializing them lazily.
+    if (s.symtype() == SymTypeParam
+            && ! s.lockgeom() && ! s.typespec().is_closure()
+            && ! s.connected() && ! s.connected_down()
+            && shadingsys().lazy_userdata())
+        return false;
+    return true;
+}
+
+
+
+void
+BackendLLVM::llvm_pgo_count (const std::string &name, llvm::Value *val)
+{
+    // The counters live in a deque so that the addresses we bake into
+    // the code don't move as more are added.  Threads running the group
+    // may race on them, which only makes the counts approximate.
+    int index;
+    auto found = m_pgo_counter_index.find (name);
+    if (found != m_pgo_counter_index.end()) {
+        index = found->second;
+    } else {
+        index = (int) group().m_pgo_counters.size();
+        group().m_pgo_counters.push_back (0);
+        group().m_pgo_counter_names.push_back (name);
+        m_pgo_counter_index[name] = index;
     }
+    llvm::Value *ptr = ll.constant_ptr (&group().m_pgo_counters[index],
+                                        ll.type_longlong_ptr());
+    ll.op_store (ll.op_add (ll.op_load (ptr), val), ptr);
+}
 
-    if (shadingsys().llvm_debug_layers())
-        llvm_gen_debug_printf (Strutil::sprintf("enter layer %d %s %s",
-                               this->layer(), inst()->layername(), inst()->shadername()));
-    // Mark this layer as executed
-    if (! group().is_last_layer(layer())) {
-        ll.op_store (ll.constant_bool(true), layerfield);
-        if (shadingsys().countlayerexecs())
-            ll.call_function ("osl_incr_layers_executed", sg_void_ptr());
+
+
+long long
+BackendLLVM::pgo_profile_count (const std::string &name) const
+{
+    const ShaderGroup::Profile *profile = group().m_pgo_profile.get();
+    if (! profile)
+        return 0;
+    auto found = profile->find (name);
+    return found != profile->end() ? found->second : 0;
+}
+
+
+
+void
+BackendLLVM::llvm_profiled_branch (const Opcode &op, llvm::Value *cond,
+                                   llvm::BasicBlock *trueblock,
+                                   llvm::BasicBlock *falseblock)
+{
+    // Key the counts on the source line rather than the op number, which
+    // differs between differently specialized versions of the group.
+    std::string key = Strutil::sprintf ("%d %s %d", layer(), op.opname(),
+                                        op.sourceline());
+    if (shadingsys().pgo_instrument()) {
+        llvm_pgo_count ("branch " + key, ll.op_int_to_longlong (ll.constant(1)));
+        llvm_pgo_count ("taken " + key,
+                        ll.op_int_to_longlong (ll.op_bool_to_int (cond)));
+    }
+    long long total = pgo_profile_count ("branch " + key);
+    if (total > 0) {
+        long long taken = std::min (pgo_profile_count ("taken " + key), total);
+        // Branch weights are 32 bits, so scale down big counts.
+        long long scale = total / std::numeric_limits<uint32_t>::max() + 1;
+        ll.op_branch (cond, trueblock, falseblock, uint32_t(taken / scale),
+                      uint32_t((total - taken) / scale));
+        shadingsys().m_stat_pgo_weighted_branches += 1;
+    } else {
+        ll.op_branch (cond, trueblock, falseblock);
     }
+}
+
+
 
+void
+BackendLLVM::build_llvm_layer_body (bool groupentry)
+{
     // Setup the symbols
-    m_named_values.clear ();
-    m_layers_already_run.clear ();
     for (auto&& s : inst()->symbols()) {
         // Skip constants -- we always inline scalar constants, and for
         // array constants we will just use the pointers to the copy of
@@ -902,19 +1308,9 @@ BackendLLVM::build_llvm_instance (bool groupentry)
         // Skip structure placeholders
         if (s.typespec().is_structure())
             continue;
-        // Skip if it's never read and isn't connected
-        if (! s.everread() && ! s.connected_down() && ! s.connected()
-              && ! s.renderer_output())
-            continue;
-        // Skip if it's an interpolated (userdata) parameter and we're
-        // initializing them lazily.
-        if (s.symtype() == SymTypeParam
-                && ! s.lockgeom() && ! s.typespec().is_closure()
-                && ! s.connected() && ! s.connected_down()
-                && shadingsys().lazy_userdata())
-            continue;
         // Set initial value for params (may contain init ops)
-        llvm_assign_initial_value (s);
+        if (param_assigned_on_entry (s))
+            llvm_assign_initial_value (s);
     }
 
     // All the symbols are stack allocated now.
@@ -925,8 +1321,10 @@ BackendLLVM::build_llvm_instance (bool groupentry)
         // parameter initialization for this layer.
         for (int i = 0;  i < group().nlayers()-1;  ++i) {
             ShaderInstance *gi = group()[i];
+            // Uniform layers may already have been filled in from the
+            // context's per-object cache, so only run them if needed.
             if (!gi->unused() && !gi->empty_instance() && !gi->run_lazily())
-                llvm_call_layer (i, true /* unconditionally run */);
+                llvm_call_layer (i, ! gi->uniform() /* unconditionally run */);
         }
     }
 
@@ -939,6 +1337,81 @@ BackendLLVM::build_llvm_instance (bool groupentry)
 
     if (llvm_has_exit_instance_block())
         ll.op_branch (m_exit_instance_block); // also sets insert point
+}
+
+
+
+llvm::Function*
+BackendLLVM::build_llvm_instance (bool groupentry)
+{
+    // Make a layer function: void layer_func(ShaderGlobals*, GroupData*)
+    // Note that the GroupData* is passed as a void*.
+    std::string unique_layer_name = layer_function_name();
+    bool is_entry_layer = group().is_entry_layer(layer());
+    ll.current_function (
+           ll.make_function (unique_layer_name,
+                             !is_entry_layer, // fastcall for non-entry layer functions
+                             ll.type_void(), // return type
+                             llvm_type_sg_ptr(), llvm_type_groupdata_ptr()));
+
+    // Get shader globals and groupdata pointers
+    m_llvm_shaderglobals_ptr = ll.current_function_arg(0); //arg_it++;
+    m_llvm_groupdata_ptr = ll.current_function_arg(1); //arg_it++;
+
+    llvm::BasicBlock *entry_bb = ll.new_basic_block (unique_layer_name);
+    m_exit_instance_block = NULL;
+
+    // Set up a new IR builder
+    ll.new_builder (entry_bb);
+
+    if (is_entry_layer && ! group().is_last_layer(layer())) {
+        // For entry layers, we need an extra check to see if it already
+        // ran. If it has, do an early return. Otherwise, set the 'ran' flag
+        // and then run the layer.
+        if (shadingsys().llvm_debug_layers())
+            llvm_gen_debug_printf (Strutil::sprintf("checking for already-run layer %d %s %s",
+                                   this->layer(), inst()->layername(), inst()->shadername()));
+        llvm::Value *executed = llvm_layer_has_run (layer_remap(layer()));
+        llvm::BasicBlock *then_block = ll.new_basic_block();
+        llvm::BasicBlock *after_block = ll.new_basic_block();
+        ll.op_branch (executed, then_block, after_block);
+        // insert point is now then_block
+        // we've already executed, so return early
+        if (shadingsys().llvm_debug_layers())
+            llvm_gen_debug_printf (Strutil::sprintf("  taking early exit, already executed layer %d %s %s",
+                                   this->layer(), inst()->layername(), inst()->shadername()));
+        ll.op_return ();
+        ll.set_insert_point (after_block);
+    }
+
+    if (shadingsys().llvm_debug_layers())
+        llvm_gen_debug_printf (Strutil::sprintf("enter layer %d %s %s",
+                               this->layer(), inst()->layername(), inst()->shadername()));
+    // Mark this layer as executed
+    if (! group().is_last_layer(layer())) {
+        llvm_mark_layer_run (layer_remap(layer()));
+        if (shadingsys().countlayerexecs())
+            ll.call_function ("osl_incr_layers_executed", sg_void_ptr());
+    }
+
+    m_named_values.clear ();
+    m_layers_already_run.clear ();
+    if (m_layer_signature[layer()].size()) {
+        // The body of this layer is shared with identical layers in other
+        // groups -- just call it on our own block of params.
+        llvm::Value *args[] = { sg_ptr(),
+                ll.void_ptr (groupdata_field_ref (m_layer_block_field[layer()])) };
+        if (llvm::Function *f = m_layer_shared_llvm_func[layer()]) {
+            ll.call_function (f, args);
+        } else {
+            llvm::PointerType *functype = ll.type_function_ptr (ll.type_void(),
+                                        { llvm_type_sg_ptr(), ll.type_void_ptr() });
+            ll.call_function (ll.constant_ptr (m_layer_shared_func[layer()], functype),
+                              args);
+        }
+    } else {
+        build_llvm_layer_body (groupentry);
+    }
 
     // Track all symbols who needed 'partial' initialization
     std::unordered_set<Symbol*> initedsyms;
@@ -1100,6 +1573,7 @@ BackendLLVM::run ()
     // At this point, we already hold the lock for this group, by virtue
     // of ShadingSystemImpl::optimize_group.
     OIIO::Timer timer;
+    CompileTraceSpan trace (shadingsys(), "llvm_setup", group().name());
     std::string err;
 
     {
@@ -1112,13 +1586,37 @@ BackendLLVM::run ()
     OIIO::spin_lock lock (mutex);
 #endif
 
+    // Pick the CPU to generate code for. An unknown target name falls
+    // back to generic code, which always works.
+    const char *ops_flavor = "native";
+    if (! use_optix()) {
+        ustring target = shadingsys().jit_target();
+        if (! ll.set_jit_target (target, shadingsys().jit_fma())
+              && target != "host" && target != "generic") {
+            static std::atomic<bool> warned (false);
+            if (! warned.exchange (true))
+                shadingcontext()->warningf ("Unknown jit_target \"%s\", using generic code", target);
+        }
+        // Under a JIT memory budget, the group's code must be freeable.
+        ll.private_jit_memory (shadingsys().jit_memory_budget() > 0);
+        ll.fast_math (group().fast_math());
+    }
+
 #ifdef OSL_LLVM_NO_BITCODE
     ll.module (ll.new_module ("llvm_ops"));
 #else
     if (! use_optix()) {
-        ll.module (ll.module_from_bitcode ((char*)osl_llvm_compiled_ops_block,
-                                           osl_llvm_compiled_ops_size,
+        // Use the best shadeop bitcode the JIT target can run, so that
+        // inlined shadeops are as well compiled as the shader code.
+        const LLVMOpsFlavor *flavor = &llvm_ops_flavors[0];
+        while (! ll.jit_target_has (flavor->features))
+            ++flavor;   // terminates: "generic" has no requirements
+        ops_flavor = flavor->name;
+        ll.module (ll.module_from_bitcode ((char*)flavor->block,
+                                           *flavor->size,
                                            "llvm_ops", &err));
+        if (ll.module())
+            ll.retarget_module ();
     } else {
 #ifdef OSL_LLVM_CUDA_BITCODE
         ll.module (ll.module_from_bitcode ((char*)osl_llvm_compiled_ops_cuda_block,
@@ -1135,6 +1633,7 @@ BackendLLVM::run ()
 
     // Create the ExecutionEngine. We don't create an ExecutionEngine in the
     // OptiX case, because we are using the NVPTX backend and not MCJIT
+    ll.jit_listeners (shadingsys().jit_perf_map(), shadingsys().jit_gdb());
     if (! use_optix() && ! ll.make_jit_execengine (&err)) {
         shadingcontext()->errorf("Failed to create engine: %s\n", err);
         OSL_ASSERT (0);
@@ -1144,48 +1643,96 @@ BackendLLVM::run ()
     // End of mutex lock, for the OSL_LLVM_NO_BITCODE case
     }
 
+    if (! use_optix())
+        shadingsys().set_jit_target_used (Strutil::sprintf ("%s (llvm_ops %s%s)",
+                    ll.jit_cpu().size() ? ll.jit_cpu() : std::string("generic"),
+                    ops_flavor, shadingsys().jit_fma() ? "" : ", no fma"));
+
     m_stat_llvm_setup_time += timer.lap();
+    trace.next ("llvm_irgen");
 
-    // Set up m_num_used_layers to be the number of layers that are
-    // actually used, and m_layer_remap[] to map original layer numbers
-    // to the shorter list of actually-called layers. We also note that
-    // if m_layer_remap[i] is < 0, it's not a layer that's used.
     int nlayers = group().nlayers();
-    m_layer_remap.resize (nlayers, -1);
-    m_num_used_layers = 0;
-    if (debug() >= 1)
-        std::cout << "\nLayers used: (group " << group().name() << ")\n";
-    for (int layer = 0;  layer < nlayers;  ++layer) {
-        // Skip unused or empty layers, unless they are callable entry
-        // points.
-        ShaderInstance *inst = group()[layer];
-        bool is_single_entry = (layer == (nlayers-1) && group().num_entry_layers() == 0);
-        if (inst->entry_layer() || is_single_entry ||
-            (! inst->unused() && !inst->empty_instance())) {
-            if (debug() >= 1)
-                std::cout << "  " << layer << ' ' << inst->layername() << "\n";
-            m_layer_remap[layer] = m_num_used_layers++;
+    compute_layer_remap ();
+    if (m_partition == 0)
+        shadingsys().m_stat_empty_instances += nlayers - m_num_used_layers;
+
+    // Find the layers whose code may be shared with identical layers of
+    // other groups, and which of those have already been JITed.  (Not
+    // if groups may drop their code to stay within the JIT memory
+    // budget, since other groups would be left calling it.)
+    m_layer_signature.assign (nlayers, std::string());
+    m_layer_shared_func.assign (nlayers, nullptr);
+    m_layer_shared_llvm_func.assign (nlayers, nullptr);
+    m_layer_block_field.assign (nlayers, -1);
+    m_llvm_type_layerdata.assign (nlayers, nullptr);
+    if (shadingsys().m_opt_share_layers && ! use_optix() && ! debug() &&
+        m_layer_partition.empty() && ! shadingsys().jit_memory_budget() &&
+        ! llvm_debug() && ! shadingsys().llvm_debug_layers() &&
+        ! shadingsys().llvm_debug_ops() && ! shadingsys().debug_nan() &&
+        ! shadingsys().debug_uninit() && ! shadingsys().pgo_instrument() &&
+        ! group().m_pgo_profile) {
+        for (int layer = 0;  layer < nlayers;  ++layer) {
+            if (m_layer_remap[layer] == -1 || group().kept_layer (layer))
+                continue;
+            set_inst (layer);
+            m_layer_signature[layer] = shared_layer_signature ();
+            if (m_layer_signature[layer].size())
+                m_layer_shared_func[layer] =
+                    shadingsys().find_shared_layer_func (m_layer_signature[layer],
+                                                         group());
         }
     }
-    shadingsys().m_stat_empty_instances += nlayers - m_num_used_layers;
+
+    // A group that may be re-specialized keeps the functions of all its
+    // layers, for later specializations to call those they keep.  If
+    // this is one of those, its kept layers are called where they are.
+    bool keep_layer_funcs = m_layer_partition.empty() &&
+        (shadingsys().reusable_layers (group()) || group().has_kept_layers());
+    if (keep_layer_funcs) {
+        group().m_llvm_layer_funcs.assign (nlayers, nullptr);
+        for (int layer = 0;  layer < nlayers;  ++layer)
+            if (group().kept_layer (layer))
+                group().m_llvm_layer_funcs[layer] =
+                    group().m_kept_from->m_llvm_layer_funcs[layer];
+    }
 
     initialize_llvm_group ();
 
     // Generate the LLVM IR for each layer.  Skip unused layers.
     m_llvm_local_mem = 0;
-    llvm::Function* init_func = build_llvm_init ();
+    llvm::Function* init_func = m_partition == 0 ? build_llvm_init () : NULL;
     std::vector<llvm::Function*> funcs (nlayers, NULL);
     for (int layer = 0; layer < nlayers; ++layer) {
         set_inst (layer);
-        if (m_layer_remap[layer] != -1) {
+        if (m_layer_remap[layer] != -1 && in_partition (layer)) {
             // If no entry points were specified, the last layer is special,
             // it's the single entry point for the whole group.
             bool is_single_entry = (layer == (nlayers-1) && group().num_entry_layers() == 0);
+            if (m_layer_signature[layer].size() && ! m_layer_shared_func[layer]) {
+                // Not JITed by any other group yet, but maybe by an
+                // earlier layer of this one.
+                for (int prev = 0;  prev < layer;  ++prev)
+                    if (m_layer_shared_llvm_func[prev] &&
+                        m_layer_signature[prev] == m_layer_signature[layer]) {
+                        m_layer_shared_llvm_func[layer] = m_layer_shared_llvm_func[prev];
+                        shadingsys().m_stat_layers_shared += 1;
+                        break;
+                    }
+                if (! m_layer_shared_llvm_func[layer])
+                    m_layer_shared_llvm_func[layer] = build_llvm_shared_layer ();
+            } else if (m_layer_shared_func[layer]) {
+                shadingsys().m_stat_layers_shared += 1;
+            }
             funcs[layer] = build_llvm_instance (is_single_entry);
         }
     }
+    // The uniform layers' function calls the layer functions by name, so
+    // it must come after them.
+    llvm::Function* uniform_func = (use_optix() || m_partition != 0) ? NULL
+                                 : build_llvm_uniform ();
     // llvm::Function* entry_func = group().num_entry_layers() ? NULL : funcs[m_num_used_layers-1];
     m_stat_llvm_irgen_time += timer.lap();
+    trace.next ("llvm_opt");
 
     if (shadingsys().m_max_local_mem_KB &&
         m_llvm_local_mem/1024 > shadingsys().m_max_local_mem_KB) {
@@ -1202,15 +1749,44 @@ BackendLLVM::run ()
     // just declarations (not definitions) in the module (which we have
     // conveniently stashed in external_function_names).
     std::vector<std::string> entry_function_names;
-    entry_function_names.push_back (ll.func_name(init_func));
+    if (init_func)
+        entry_function_names.push_back (ll.func_name(init_func));
+    if (uniform_func)
+        entry_function_names.push_back (ll.func_name(uniform_func));
+    for (auto f : m_layer_shared_llvm_func)
+        if (f)
+            entry_function_names.push_back (ll.func_name(f));
     for (int layer = 0; layer < nlayers; ++layer) {
         // set_inst (layer);
         llvm::Function* f = funcs[layer];
-        if (f && group().is_entry_layer(layer))
+        // Other partitions (or specializations) may call any of our layers.
+        if (f && (group().is_entry_layer(layer) || m_layer_partition.size() ||
+                  keep_layer_funcs))
             entry_function_names.push_back (ll.func_name(f));
     }
     ll.internalize_module_functions ("osl_", external_function_names, entry_function_names);
 
+    // Name the functions after their group and layer for profilers, which
+    // otherwise only see the mangled LLVM names.
+    if (shadingsys().jit_perf_map()) {
+        if (init_func)
+            ll.jit_symbol_label (ll.func_name(init_func),
+                                 Strutil::sprintf ("osl:%s:init", group().name()));
+        if (uniform_func)
+            ll.jit_symbol_label (ll.func_name(uniform_func),
+                                 Strutil::sprintf ("osl:%s:uniform", group().name()));
+        for (int layer = 0; layer < nlayers; ++layer) {
+            ShaderInstance *inst = group()[layer];
+            std::string label = Strutil::sprintf ("osl:%s:%s(%s)", group().name(),
+                                                  inst->layername(), inst->shadername());
+            if (funcs[layer])
+                ll.jit_symbol_label (ll.func_name(funcs[layer]), label);
+            if (m_layer_shared_llvm_func[layer])
+                ll.jit_symbol_label (ll.func_name(m_layer_shared_llvm_func[layer]),
+                                     label + ":shared");
+        }
+    }
+
     // Debug code to dump the pre-optimized bitcode to a file
     if (llvm_debug() >= 2 || shadingsys().llvm_output_bitcode()) {
         // Make a safe group name that doesn't have "/" in it! Also beware
@@ -1218,6 +1794,8 @@ BackendLLVM::run ()
         std::string safegroup = Strutil::replace (group().name(), "/", ".", true);
         if (safegroup.size() > 235)
             safegroup = Strutil::sprintf ("TRUNC_%s_%d", safegroup.substr(safegroup.size()-235), group().id());
+        if (m_layer_partition.size())
+            safegroup += Strutil::sprintf ("_part%d", m_partition);
         std::string name = Strutil::sprintf ("%s.ll", safegroup);
         std::ofstream out (name, std::ios_base::out | std::ios_base::trunc);
         if (out.good()) {
@@ -1231,7 +1809,38 @@ BackendLLVM::run ()
     if (! group().does_nothing())
         ll.do_optimize();
 
+    // Report the calls that the optimizer couldn't inline, by callee.
+    // Calls from one layer to another are expected and not counted.
+    if (shadingsys().llvm_report_calls()) {
+        std::map<std::string,int> calls;
+        for (auto f : entry_function_names)
+            if (llvm::Function *func = ll.module()->getFunction (f))
+                ll.count_calls (func, calls);
+        for (int layer = 0; layer < nlayers; ++layer)
+            if (funcs[layer] && ! group().is_entry_layer(layer)
+                  && m_layer_partition.empty())
+                ll.count_calls (funcs[layer], calls);
+        for (int layer = 0; layer < nlayers; ++layer) {
+            if (funcs[layer])
+                calls.erase (ll.func_name (funcs[layer]));
+            if (m_layer_shared_llvm_func[layer])
+                calls.erase (ll.func_name (m_layer_shared_llvm_func[layer]));
+        }
+        int total = 0;
+        for (auto &c : calls)
+            total += c.second;
+        std::string where = m_layer_partition.size()
+                          ? Strutil::sprintf (" (partition %d)", m_partition)
+                          : std::string();
+        shadingcontext()->infof("Shader group %s%s: %d calls not inlined",
+                                group().name(), where, total);
+        for (auto &c : calls)
+            shadingcontext()->infof("    %s %d", c.first, c.second);
+        shadingsys().record_calls_not_inlined (calls);
+    }
+
     m_stat_llvm_opt_time += timer.lap();
+    trace.next ("llvm_jit");
 
     if (llvm_debug()) {
         for (int layer = 0; layer < nlayers; ++layer)
@@ -1247,6 +1856,8 @@ BackendLLVM::run ()
         std::string safegroup = Strutil::replace (group().name(), "/", ".", true);
         if (safegroup.size() > 235)
             safegroup = Strutil::sprintf ("TRUNC_%s_%d", safegroup.substr(safegroup.size()-235), group().id());
+        if (m_layer_partition.size())
+            safegroup += Strutil::sprintf ("_part%d", m_partition);
         std::string name = Strutil::sprintf ("%s_opt.ll", safegroup);
         std::ofstream out (name, std::ios_base::out | std::ios_base::trunc);
         if (out.good()) {
@@ -1273,14 +1884,44 @@ BackendLLVM::run ()
              OSL_ASSERT (0 && "Unable to generate PTX");
         }
     }
+    else if (m_layer_partition.size()) {
+        // One partition of a group: publish every layer we JITed in the
+        // group's table, where the other partitions' code finds them.
+        // run_partitioned hooks up the entry points once all are done.
+        if (init_func)
+            group().llvm_compiled_init ((RunLLVMGroupFunc) ll.getPointerToFunction(init_func));
+        if (uniform_func)
+            group().llvm_compiled_uniform ((RunLLVMGroupFunc) ll.getPointerToFunction(uniform_func));
+        for (int layer = 0; layer < nlayers; ++layer)
+            if (funcs[layer])
+                group().m_llvm_layer_funcs[layer] =
+                    (RunLLVMGroupFunc) ll.getPointerToFunction(funcs[layer]);
+    }
     else {
         // Force the JIT to happen now and retrieve the JITed function pointers
         // for the initialization and all public entry points.
         group().llvm_compiled_init ((RunLLVMGroupFunc) ll.getPointerToFunction(init_func));
+        if (uniform_func)
+            group().llvm_compiled_uniform ((RunLLVMGroupFunc) ll.getPointerToFunction(uniform_func));
+        // Offer the newly JITed shared layer functions to other groups.
+        for (int layer = 0; layer < nlayers; ++layer) {
+            llvm::Function* f = m_layer_shared_llvm_func[layer];
+            auto begin = m_layer_shared_llvm_func.begin();
+            if (f && std::find (begin, begin+layer, f) == begin+layer)
+                shadingsys().add_shared_layer_func (m_layer_signature[layer],
+                                                    ll.getPointerToFunction(f),
+                                                    group().m_layers[layer],
+                                                    group());
+        }
         for (int layer = 0; layer < nlayers; ++layer) {
             llvm::Function* f = funcs[layer];
+            if (f && keep_layer_funcs)
+                group().m_llvm_layer_funcs[layer] =
+                    (RunLLVMGroupFunc) ll.getPointerToFunction(f);
             if (f && group().is_entry_layer (layer))
                 group().llvm_compiled_layer (layer, (RunLLVMGroupFunc) ll.getPointerToFunction(f));
+            else if (group().kept_layer (layer) && group().is_entry_layer (layer))
+                group().llvm_compiled_layer (layer, group().m_llvm_layer_funcs[layer]);
         }
         if (group().num_entry_layers())
             group().llvm_compiled_version (NULL);
@@ -1296,7 +1937,20 @@ BackendLLVM::run ()
         if (funcs[i])
             ll.delete_func_body (funcs[i]);
     }
-    ll.delete_func_body (init_func);
+    if (init_func)
+        ll.delete_func_body (init_func);
+    if (uniform_func)
+        ll.delete_func_body (uniform_func);
+    for (int i = 0; i < nlayers; ++i) {
+        llvm::Function* f = m_layer_shared_llvm_func[i];
+        auto begin = m_layer_shared_llvm_func.begin();
+        if (f && std::find (begin, begin+i, f) == begin+i)
+            ll.delete_func_body (f);
+    }
+
+    m_llvm_code_size = ll.jit_code_size();
+    if (m_layer_partition.empty())
+        group().m_llvm_code_size = m_llvm_code_size;
 
     // Free the exec and module to reclaim all the memory.  This definitely
     // saves memory, and has almost no effect on runtime.
@@ -1305,16 +1959,283 @@ BackendLLVM::run ()
     // N.B. Destroying the EE should have destroyed the module as well.
     ll.module (NULL);
 
+    // If the code is in memory of its own, the group holds on to it, so
+    // that it may drop it later to stay within the JIT memory budget.
+    m_jit_memory = ll.take_jit_memory ();
+    if (m_layer_partition.empty()) {
+        group().m_jit_memory.clear ();
+        if (m_jit_memory)
+            group().m_jit_memory.push_back (m_jit_memory);
+    }
+
     m_stat_llvm_jit_time += timer.lap();
+    trace.end ();
 
     m_stat_total_llvm_time = timer();
 
-    if (shadingsys().m_compile_report) {
+    if (shadingsys().m_compile_report && m_layer_partition.empty()) {
         shadingcontext()->infof("JITed shader group %s:", group().name());
         shadingcontext()->infof("    (%1.2fs = %1.2f setup, %1.2f ir, %1.2f opt, %1.2f jit; local mem %dKB)",
                                 m_stat_total_llvm_time, m_stat_llvm_setup_time,
                                 m_stat_llvm_irgen_time, m_stat_llvm_opt_time,
                                 m_stat_llvm_jit_time, m_llvm_local_mem/1024);
+        shadingcontext()->infof("    (%d bytes of code)",
+                                (int)group().m_llvm_code_size);
+    }
+}
+
+
+
+// Is the layer of the group called at all (by the renderer, or by other
+// layers)?  Not if it's unused or empty, unless it's a callable entry
+// point.
+static bool
+layer_is_used (const ShaderGroup &group, int layer)
+{
+    const ShaderInstance *inst = group[layer];
+    bool is_single_entry = (layer == (group.nlayers()-1) && group.num_entry_layers() == 0);
+    return inst->entry_layer() || is_single_entry ||
+           (! inst->unused() && ! inst->empty_instance());
+}
+
+
+
+void
+BackendLLVM::compute_layer_remap ()
+{
+    // Set up m_num_used_layers to be the number of layers that are
+    // actually used, and m_layer_remap[] to map original layer numbers
+    // to the shorter list of actually-called layers. We also note that
+    // if m_layer_remap[i] is < 0, it's not a layer that's used.
+    int nlayers = group().nlayers();
+    m_layer_remap.assign (nlayers, -1);
+    m_num_used_layers = 0;
+    if (debug() >= 1)
+        std::cout << "\nLayers used: (group " << group().name() << ")\n";
+    for (int layer = 0;  layer < nlayers;  ++layer) {
+        // Skip unused or empty layers, unless they are callable entry
+        // points.
+        ShaderInstance *inst = group()[layer];
+        if (layer_is_used (group(), layer)) {
+            if (debug() >= 1)
+                std::cout << "  " << layer << ' ' << inst->layername() << "\n";
+            m_layer_remap[layer] = m_num_used_layers++;
+        }
+    }
+}
+
+
+
+bool
+BackendLLVM::pin_kept_layers ()
+{
+    const ShaderGroup &base (*group().m_kept_from);
+    int nlayers = group().nlayers();
+
+    // The kept code finds the layers' "run" flags, and the userdata,
+    // where the base put them, so those must come out the same.
+    for (int layer = 0;  layer < nlayers;  ++layer)
+        if (layer_is_used (group(), layer) != layer_is_used (base, layer))
+            return false;
+    if (group().m_userdata_names != base.m_userdata_names ||
+        group().m_userdata_types != base.m_userdata_types ||
+        group().m_userdata_derivs != base.m_userdata_derivs ||
+        group().m_userdata_layers != base.m_userdata_layers)
+        return false;
+
+    // The kept layers copy their outputs into the params they were
+    // connected to in the base, with derivatives if those had them.  So
+    // each connection from a kept layer must be one the base had, into
+    // the same param, and it mustn't need derivatives the kept code
+    // doesn't provide.
+    m_pinned_params.clear ();
+    for (int layer = 0;  layer < nlayers;  ++layer) {
+        ShaderInstance *inst = group()[layer];
+        if (group().kept_layer (layer) || inst->unused())
+            continue;
+        const ShaderInstance *old = base[layer];
+        for (auto&& c : inst->connections()) {
+            if (! group().kept_layer (c.srclayer))
+                continue;
+            const Symbol *src = group()[c.srclayer]->symbol (c.src.param);
+            const Symbol *dst = inst->symbol (c.dst.param);
+            const Symbol *olddst = nullptr;
+            for (auto&& oc : old->connections()) {
+                const Symbol *d = old->symbol (oc.dst.param);
+                if (oc.srclayer == c.srclayer && oc.src == c.src && d &&
+                    d->name() == dst->name() &&
+                    oc.dst.arrayindex == c.dst.arrayindex &&
+                    oc.dst.channel == c.dst.channel) {
+                    olddst = d;
+                    break;
+                }
+            }
+            if (! olddst || olddst->dataoffset() < 0)
+                return false;
+            bool srcderivs = src->has_derivs() ||
+                             src->typespec().is_closure_based() ||
+                             ! src->typespec().elementtype().is_floatbased();
+            if (dst->has_derivs() && ! (olddst->has_derivs() && srcderivs))
+                return false;
+            auto pinned = m_pinned_params.find (dst);
+            if (pinned != m_pinned_params.end() &&
+                pinned->second != olddst->dataoffset())
+                return false;
+            m_pinned_params[dst] = olddst->dataoffset();
+        }
+    }
+    return true;
+}
+
+
+
+int
+BackendLLVM::jit_partitions ()
+{
+    int maxparts = shadingsys().llvm_jit_partitions();
+    if (maxparts <= 1 || use_optix() || group().does_nothing() ||
+        llvm_debug() || shadingsys().pgo_instrument() ||
+        group().has_kept_layers())
+        return 1;
+    compute_layer_remap ();
+    size_t ops = 0;
+    for (int layer = 0;  layer < group().nlayers();  ++layer)
+        if (m_layer_remap[layer] != -1)
+            ops += group()[layer]->ops().size();
+    int minops = std::max (1, shadingsys().llvm_jit_partition_minops());
+    return std::max (1, std::min ({ maxparts, m_num_used_layers,
+                                    int(ops / minops) }));
+}
+
+
+
+void
+BackendLLVM::run_partitioned (int nparts)
+{
+    if (shadingsys().llvm_jit_partitions_compare()) {
+        // Also compile the group the usual way, purely to time it against
+        // the partitioned compile, whose code then replaces it.
+        BackendLLVM single (shadingsys(), group(), shadingcontext());
+        single.run ();
+        m_stat_single_module_time = single.m_stat_total_llvm_time;
+    }
+
+    OIIO::Timer timer;
+    CompileTraceSpan trace (shadingsys(), "llvm_partition", group().name());
+
+    // Split the used layers, in order, into runs of roughly equal op
+    // counts.  Downstream layers call upstream ones, so keeping runs of
+    // neighbors together keeps most calls within a module.
+    compute_layer_remap ();
+    int nlayers = group().nlayers();
+    size_t totalops = 0, sofar = 0;
+    for (int layer = 0;  layer < nlayers;  ++layer)
+        if (m_layer_remap[layer] != -1)
+            totalops += group()[layer]->ops().size();
+    std::vector<int> layer_partition (nlayers, -1);
+    int part = 0;
+    for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (m_layer_remap[layer] == -1)
+            continue;
+        if (part < nparts-1 && sofar >= totalops * (part+1) / nparts)
+            ++part;
+        layer_partition[layer] = part;
+        sofar += group()[layer]->ops().size();
+    }
+    nparts = part + 1;
+
+    // Lay out the group data once, up front.  Each partition computes
+    // the same layout, but then finds the symbols' offsets already set,
+    // so the threads only ever read them.
+    m_layer_signature.assign (nlayers, std::string());
+    m_llvm_type_groupdata = NULL;
+    llvm_type_groupdata ();
+    group().m_llvm_layer_funcs.assign (nlayers, nullptr);
+
+    // Each partition needs its own thread: LLVM contexts and our JIT
+    // memory managers are per-thread.  We do partition 0 ourselves.
+    struct PartitionStats {
+        double total = 0, setup = 0, irgen = 0, opt = 0, jit = 0;
+        int local_mem = 0;
+        size_t code_size = 0;
+        std::shared_ptr<void> jit_memory;
+    };
+    std::vector<PartitionStats> stats (nparts);
+    auto save_stats = [&](BackendLLVM &b, int p) {
+        stats[p].total = b.m_stat_total_llvm_time;
+        stats[p].setup = b.m_stat_llvm_setup_time;
+        stats[p].irgen = b.m_stat_llvm_irgen_time;
+        stats[p].opt = b.m_stat_llvm_opt_time;
+        stats[p].jit = b.m_stat_llvm_jit_time;
+        stats[p].local_mem = b.m_llvm_local_mem;
+        stats[p].code_size = b.m_llvm_code_size;
+        stats[p].jit_memory = b.m_jit_memory;
+    };
+    OIIO::thread_group threads;
+    for (int p = 1;  p < nparts;  ++p) {
+        threads.add_thread (new std::thread ([&,p](){
+            PerThreadInfo *thread_info = shadingsys().create_thread_info();
+            ShadingContext *ctx = shadingsys().get_context (thread_info);
+            {
+                BackendLLVM partition (shadingsys(), group(), ctx);
+                partition.set_partition (p, layer_partition);
+                partition.run ();
+                save_stats (partition, p);
+            }
+            shadingsys().release_context (ctx);
+            shadingsys().destroy_thread_info (thread_info);
+        }));
+    }
+    set_partition (0, layer_partition);
+    run ();
+    save_stats (*this, 0);
+    threads.join_all ();
+
+    // Now that every layer is JITed, hook up the group's entry points.
+    for (int layer = 0;  layer < nlayers;  ++layer)
+        if (layer_partition[layer] >= 0 && group().is_entry_layer (layer))
+            group().llvm_compiled_layer (layer, group().m_llvm_layer_funcs[layer]);
+    if (group().num_entry_layers())
+        group().llvm_compiled_version (NULL);
+    else
+        group().llvm_compiled_version (group().llvm_compiled_layer(nlayers-1));
+
+    // The per-phase times are summed over the partitions (so they are
+    // comparable with single-module compiles), the total is wall time.
+    m_stat_llvm_setup_time = m_stat_llvm_irgen_time = 0;
+    m_stat_llvm_opt_time = m_stat_llvm_jit_time = 0;
+    m_stat_partition_cpu_time = 0;
+    m_llvm_local_mem = 0;
+    group().m_llvm_code_size = 0;
+    group().m_jit_memory.clear ();
+    for (auto&& s : stats) {
+        m_stat_llvm_setup_time += s.setup;
+        m_stat_llvm_irgen_time += s.irgen;
+        m_stat_llvm_opt_time += s.opt;
+        m_stat_llvm_jit_time += s.jit;
+        m_stat_partition_cpu_time += s.total;
+        m_llvm_local_mem = std::max (m_llvm_local_mem, s.local_mem);
+        group().m_llvm_code_size += s.code_size;
+        if (s.jit_memory)
+            group().m_jit_memory.push_back (s.jit_memory);
+    }
+    m_stat_partitions = nparts;
+    trace.end ();
+    m_stat_total_llvm_time = timer();
+
+    if (shadingsys().m_compile_report) {
+        shadingcontext()->infof("JITed shader group %s in %d partitions:",
+                                group().name(), nparts);
+        shadingcontext()->infof("    (%1.2fs wall, %1.2fs total = %1.2f setup, %1.2f ir, %1.2f opt, %1.2f jit; local mem %dKB)",
+                                m_stat_total_llvm_time, m_stat_partition_cpu_time,
+                                m_stat_llvm_setup_time, m_stat_llvm_irgen_time,
+                                m_stat_llvm_opt_time, m_stat_llvm_jit_time,
+                                m_llvm_local_mem/1024);
+        if (m_stat_single_module_time > 0)
+            shadingcontext()->infof("    (%1.2fs as a single module)",
+                                    m_stat_single_module_time);
+        shadingcontext()->infof("    (%d bytes of code)",
+                                (int)group().m_llvm_code_size);
     }
 }
 
@@ -55,6 +55,9 @@ examples), as you are just coding in C++, but there are some rules:
   unique.  See the handy USTR, MAT, VEC, DFLOAT, DVEC macros for
   handy/cheap casting of those void*'s to references to ustring&,
   Matrix44&, Vec3&, Dual2<float>&, and Dual2<Vec3>, respectively.
+  The exception are the few hot ops with a "_byval" suffix, which take
+  each triple argument as three floats (llvm_gen_generic uses them when
+  there are no derivatives involved).
 
 * You must provide all allowable polymorphic and derivative combinations!
   Remember that string, int, and matrix can't have a derivative, so
@@ -468,6 +471,33 @@ MAKE_UNARY_PERCOMPONENT_OP     (erf        , erff                 , erf)
 MAKE_UNARY_PERCOMPONENT_OP     (erfc       , erfcf                , erfc)
 #endif
 
+#if ! OSL_FAST_MATH
+// Approximate versions of the above, for groups that ask for them with
+// the "fast_math" option: when it's on, calls to osl_foo go to
+// osl_fast_foo wherever there is one (see LLVM_Util::fast_math).  With
+// OSL_FAST_MATH, the standard versions are already the approximations.
+MAKE_UNARY_PERCOMPONENT_OP     (fast_sin   , OIIO::fast_sin       , fast_sin )
+MAKE_UNARY_PERCOMPONENT_OP     (fast_cos   , OIIO::fast_cos       , fast_cos )
+MAKE_UNARY_PERCOMPONENT_OP     (fast_tan   , OIIO::fast_tan       , fast_tan )
+MAKE_UNARY_PERCOMPONENT_OP     (fast_asin  , OIIO::fast_asin      , fast_asin)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_acos  , OIIO::fast_acos      , fast_acos)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_atan  , OIIO::fast_atan      , fast_atan)
+MAKE_BINARY_PERCOMPONENT_OP    (fast_atan2 , OIIO::fast_atan2     , fast_atan2)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_sinh  , OIIO::fast_sinh      , fast_sinh)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_cosh  , OIIO::fast_cosh      , fast_cosh)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_tanh  , OIIO::fast_tanh      , fast_tanh)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_log   , OIIO::fast_log       , fast_log)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_log2  , OIIO::fast_log2      , fast_log2)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_log10 , OIIO::fast_log10     , fast_log10)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_exp   , OIIO::fast_exp       , fast_exp)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_exp2  , OIIO::fast_exp2      , fast_exp2)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_expm1 , OIIO::fast_expm1     , fast_expm1)
+MAKE_BINARY_PERCOMPONENT_OP    (fast_pow   , OIIO::fast_safe_pow  , fast_safe_pow)
+MAKE_BINARY_PERCOMPONENT_VF_OP (fast_pow   , OIIO::fast_safe_pow  , fast_safe_pow)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_erf   , OIIO::fast_erf       , fast_erf)
+MAKE_UNARY_PERCOMPONENT_OP     (fast_erfc  , OIIO::fast_erfc      , fast_erfc)
+#endif
+
 MAKE_UNARY_PERCOMPONENT_OP     (sqrt       , OIIO::safe_sqrt      , sqrt)
 MAKE_UNARY_PERCOMPONENT_OP     (inversesqrt, OIIO::safe_inversesqrt, inversesqrt)
 
@@ -739,6 +769,49 @@ osl_normalize_dvdv (void *result, void *a)
 }
 
 
+// By-value variants of the most common vector ops without derivatives:
+// the triple arguments are passed as three floats each, so the caller can
+// keep them in registers instead of spilling them to memory to make the
+// call, and SROA has nothing to undo once the call is inlined.  Triple
+// results are still returned through the first argument.
+
+OSL_SHADEOP float
+osl_dot_fvv_byval (float ax, float ay, float az, float bx, float by, float bz)
+{
+    return Vec3(ax, ay, az).dot (Vec3(bx, by, bz));
+}
+
+OSL_SHADEOP void
+osl_cross_vvv_byval (void *result, float ax, float ay, float az,
+                     float bx, float by, float bz)
+{
+    VEC(result) = Vec3(ax, ay, az).cross (Vec3(bx, by, bz));
+}
+
+OSL_SHADEOP float
+osl_length_fv_byval (float x, float y, float z)
+{
+    return Vec3(x, y, z).length();
+}
+
+OSL_SHADEOP float
+osl_distance_fvv_byval (float ax, float ay, float az,
+                        float bx, float by, float bz)
+{
+    float x = ax - bx;
+    float y = ay - by;
+    float z = az - bz;
+    return sqrtf (x*x + y*y + z*z);
+}
+
+OSL_SHADEOP void
+osl_normalize_vv_byval (void *result, float x, float y, float z)
+{
+    Vec3 v (x, y, z);
+    osl_normalize_vv (result, &v);
+}
+
+
 
 OSL_HOSTDEVICE inline Vec3 calculatenormal(void *P_, bool flipHandedness)
 {
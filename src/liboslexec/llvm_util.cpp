@@ -28,9 +28,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include <memory>
+#include <mutex>
+#include <algorithm>
 #include <cinttypes>
+#include <cstdio>
 #include <OpenImageIO/thread.h>
 #include <boost/thread/tss.hpp>   /* for thread_specific_ptr */
+#ifndef _WIN32
+#include <unistd.h>               /* for getpid */
+#endif
 
 #include <OSL/oslconfig.h>
 #include <OSL/llvm_util.h>
@@ -46,12 +52,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <llvm/IR/Module.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/Linker/Linker.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/ErrorOr.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/Host.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/MC/MCSubtargetInfo.h>
 
 #include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
@@ -71,6 +81,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <llvm/Transforms/Utils/UnifyFunctionExitNodes.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/Object/SymbolSize.h>
 #include <llvm/Transforms/Scalar/GVN.h>
 
 #if OSL_LLVM_VERSION >= 70
@@ -166,13 +177,16 @@ LLVM_Util::total_jit_memory_held ()
 
 /// MemoryManager - Create a shell that passes on requests
 /// to a real LLVMMemoryManager underneath, but can be retained after the
-/// dummy is destroyed.  Also, we don't pass along any deallocations.
+/// dummy is destroyed.  Also, we don't pass along any deallocations, but
+/// we do tally the size of the code sections allocated.
 class LLVM_Util::MemoryManager : public LLVMMemoryManager {
 protected:
     LLVMMemoryManager *mm;  // the real one
+    size_t *codesize;       // where to tally code section bytes
 public:
 
-    MemoryManager(LLVMMemoryManager *realmm) : mm(realmm) {}
+    MemoryManager(LLVMMemoryManager *realmm, size_t *codesize)
+        : mm(realmm), codesize(codesize) {}
     
     virtual void notifyObjectLoaded(llvm::ExecutionEngine *EE, const llvm::object::ObjectFile &oi) {
         mm->notifyObjectLoaded (EE, oi);
@@ -203,6 +217,7 @@ public:
     }
     virtual uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
                              unsigned SectionID, llvm::StringRef SectionName) {
+        *codesize += Size;
         return mm->allocateCodeSection(Size, Alignment, SectionID, SectionName);
     }
     virtual uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment,
@@ -228,6 +243,151 @@ public:
 
 
 
+// SymbolRef::getType returns an Expected in newer LLVM versions and a
+// plain Type in older ones.
+inline bool
+is_function_symbol (llvm::object::SymbolRef::Type type)
+{
+    return type == llvm::object::SymbolRef::ST_Function;
+}
+
+inline bool
+is_function_symbol (llvm::Expected<llvm::object::SymbolRef::Type> type)
+{
+    if (! type) {
+        llvm::consumeError (type.takeError());
+        return false;
+    }
+    return *type == llvm::object::SymbolRef::ST_Function;
+}
+
+
+
+// Append lines to /tmp/perf-<pid>.map, which perf (and other Linux
+// profilers) read to symbolize JIT code.  One file per process, shared by
+// all LLVM_Util instances.
+static void
+append_perf_map (const std::string &lines)
+{
+#ifndef _WIN32
+    static std::mutex perf_map_mutex;
+    static FILE *perf_map = nullptr;
+    std::lock_guard<std::mutex> lock (perf_map_mutex);
+    if (! perf_map) {
+        std::string filename = OIIO::Strutil::sprintf ("/tmp/perf-%d.map",
+                                                       int(getpid()));
+        perf_map = fopen (filename.c_str(), "a");
+        if (! perf_map)
+            return;
+    }
+    fputs (lines.c_str(), perf_map);
+    fflush (perf_map);
+#endif
+}
+
+
+
+/// JITListener - Tell profilers and debuggers about newly JITed code, as
+/// requested by LLVM_Util::jit_listeners().  We don't tell them the code
+/// went away when the engine is destroyed, because the code outlives the
+/// engine (see MemoryManager).  Code in the per-thread memory is kept for
+/// the life of the process, but code in private JIT memory is freed when
+/// the last handle from take_jit_memory goes away (e.g., when a group's
+/// code is evicted), so GDB is told then (see gdb_unregister).  There is
+/// no way to take lines back out of a perf map, so those stay, and perf
+/// may attribute samples in memory since reused to the old function.
+class LLVM_Util::JITListener : public llvm::JITEventListener {
+public:
+    JITListener (const LLVM_Util &ll) : m_ll(ll) {}
+
+#if OSL_LLVM_VERSION >= 80
+    void notifyObjectLoaded (ObjectKey key, const llvm::object::ObjectFile &obj,
+                             const llvm::RuntimeDyld::LoadedObjectInfo &info) override {
+        if (m_ll.m_jit_gdb) {
+            gdb_listener()->notifyObjectLoaded (key, obj, info);
+            if (m_ll.m_private_jit_memory)
+                m_gdb_objects.push_back (key);
+        }
+        if (m_ll.m_jit_perf_map)
+            write_perf_map (obj, info);
+    }
+#else
+    void NotifyObjectEmitted (const llvm::object::ObjectFile &obj,
+                              const llvm::RuntimeDyld::LoadedObjectInfo &info) override {
+        if (m_ll.m_jit_gdb)
+            gdb_listener()->NotifyObjectEmitted (obj, info);
+        if (m_ll.m_jit_perf_map)
+            write_perf_map (obj, info);
+    }
+#endif
+
+    /// Return the objects registered with GDB whose code is in private
+    /// JIT memory, and forget them.
+    std::vector<uint64_t> take_gdb_objects () {
+        std::vector<uint64_t> objects;
+        objects.swap (m_gdb_objects);
+        return objects;
+    }
+
+    /// Tell GDB that the code of objects (from take_gdb_objects) has been
+    /// freed.  LLVM before 8 only identifies objects by their ObjectFile,
+    /// which is gone by then, so with it they stay registered.
+    static void gdb_unregister (const std::vector<uint64_t> &objects) {
+#if OSL_LLVM_VERSION >= 80
+        for (auto key : objects)
+            gdb_listener()->notifyFreeingObject (key);
+#endif
+    }
+
+private:
+    const LLVM_Util &m_ll;
+    std::vector<uint64_t> m_gdb_objects;
+
+    static llvm::JITEventListener *gdb_listener () {
+        // LLVM owns this one; it's a process-wide singleton.
+        static llvm::JITEventListener *gdb =
+            llvm::JITEventListener::createGDBRegistrationListener();
+        return gdb;
+    }
+
+    void write_perf_map (const llvm::object::ObjectFile &obj,
+                         const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+        // The "debug" object has the symbols relocated to where the code
+        // actually got loaded.
+        llvm::object::OwningBinary<llvm::object::ObjectFile> debugobj =
+            info.getObjectForDebug (obj);
+        const llvm::object::ObjectFile &o (debugobj.getBinary()
+                                           ? *debugobj.getBinary() : obj);
+        std::string lines;
+        for (const auto &symsize : llvm::object::computeSymbolSizes (o)) {
+            const llvm::object::SymbolRef &sym (symsize.first);
+            if (! symsize.second || ! is_function_symbol (sym.getType()))
+                continue;
+            auto name = sym.getName();
+            if (! name) {
+                llvm::consumeError (name.takeError());
+                continue;
+            }
+            auto addr = sym.getAddress();
+            if (! addr) {
+                llvm::consumeError (addr.takeError());
+                continue;
+            }
+            std::string symname = name->str();
+            auto label = m_ll.m_jit_symbol_labels.find (symname);
+            if (label != m_ll.m_jit_symbol_labels.end())
+                symname = label->second;
+            lines += OIIO::Strutil::sprintf ("%llx %llx %s\n",
+                                             (unsigned long long)*addr,
+                                             (unsigned long long)symsize.second,
+                                             symname);
+        }
+        append_perf_map (lines);
+    }
+};
+
+
+
 class LLVM_Util::IRBuilder : public llvm::IRBuilder<llvm::ConstantFolder,
                                                llvm::IRBuilderDefaultInserter> {
     typedef llvm::IRBuilder<llvm::ConstantFolder,
@@ -301,6 +461,13 @@ LLVM_Util::LLVM_Util (int debuglevel)
 LLVM_Util::~LLVM_Util ()
 {
     execengine (NULL);
+    if (m_private_jitmm) {
+        // Nobody took the private memory, so somebody may still be
+        // using the code: keep it, like the per-thread memory.
+        OIIO::spin_lock lock (llvm_global_mutex);
+        jitmm_hold.emplace_back (m_private_jitmm);
+    }
+    delete m_jit_listener;
     delete m_llvm_module_passes;
     delete m_llvm_func_passes;
     delete m_builder;
@@ -409,6 +576,15 @@ LLVM_Util::new_builder (llvm::BasicBlock *block)
     if (! block)
         block = new_basic_block ();
     m_builder = new IRBuilder (block);
+    if (m_fast_math) {
+        llvm::FastMathFlags fmf;
+        fmf.setAllowReassoc ();
+        fmf.setNoSignedZeros ();
+        fmf.setAllowReciprocal ();
+        fmf.setAllowContract (m_jit_fma);
+        fmf.setApproxFunc ();
+        m_builder->setFastMathFlags (fmf);
+    }
 }
 
 
@@ -431,6 +607,116 @@ LLVM_Util::end_builder ()
 
 
 
+// Short ISA names accepted by set_jit_target, and the LLVM CPU each
+// one stands for.
+static const char *jit_isa_cpus[][2] = {
+    { "sse4.2", "nehalem" },
+    { "avx2",   "haswell" },
+    { "avx512", "skylake-avx512" },
+};
+
+
+
+bool
+LLVM_Util::set_jit_target (string_view target, bool fma)
+{
+    m_jit_cpu.clear ();
+    m_jit_features.clear ();
+    m_jit_fma = fma;
+    std::vector<std::string> features;
+    bool ok = true;
+    if (target.empty() || target == "host") {
+        // Host detection is not free, and the answer never changes, so
+        // do it only once per process.
+        static std::string host_cpu, host_features;
+        static std::once_flag host_once;
+        std::call_once (host_once, [](){
+            host_cpu = llvm::sys::getHostCPUName().str();
+            llvm::StringMap<bool> hostfeatures;
+            if (llvm::sys::getHostCPUFeatures (hostfeatures)) {
+                std::vector<std::string> f;
+                for (auto& h : hostfeatures)
+                    f.push_back ((h.second ? "+" : "-") + h.first().str());
+                std::sort (f.begin(), f.end());
+                host_features = OIIO::Strutil::join (f, ",");
+            }
+        });
+        if (host_cpu.empty() || host_cpu == "generic")
+            ok = false;
+        else {
+            m_jit_cpu = host_cpu;
+            if (host_features.size())
+                features.push_back (host_features);
+        }
+    } else if (target != "generic") {
+        m_jit_cpu = target;
+        for (auto& isa : jit_isa_cpus)
+            if (target == isa[0])
+                m_jit_cpu = isa[1];
+        // Make sure LLVM knows this CPU; an unknown name would otherwise
+        // only produce a warning on stderr from deep inside the JIT.
+        std::string triple = llvm::sys::getProcessTriple(), err;
+        const llvm::Target *t = llvm::TargetRegistry::lookupTarget (triple, err);
+        std::unique_ptr<llvm::MCSubtargetInfo> sti;
+        if (t)
+            sti.reset (t->createMCSubtargetInfo (triple, m_jit_cpu, ""));
+        if (! sti || ! sti->isCPUStringValid (m_jit_cpu)) {
+            m_jit_cpu.clear ();
+            ok = false;
+        }
+    }
+    // N.B. fma is not taken out of the features when it's off: LLVM would
+    // drop the features that imply it too (avx512f, for one).  The engine's
+    // Strict FP op fusion is what keeps multiplies and adds apart.
+    m_jit_features = OIIO::Strutil::join (features, ",");
+    return ok;
+}
+
+
+
+bool
+LLVM_Util::jit_target_has (string_view features) const
+{
+    if (features.empty())
+        return true;
+    std::string triple = llvm::sys::getProcessTriple(), err;
+    const llvm::Target *t = llvm::TargetRegistry::lookupTarget (triple, err);
+    if (! t)
+        return false;
+    std::unique_ptr<llvm::MCSubtargetInfo> sti (
+        t->createMCSubtargetInfo (triple, m_jit_cpu, m_jit_features));
+    return sti && sti->checkFeatures (llvm::StringRef (features.data(),
+                                                       features.size()));
+}
+
+
+
+void
+LLVM_Util::set_function_target (llvm::Function *func)
+{
+    if (m_jit_cpu.size())
+        func->addFnAttr ("target-cpu", m_jit_cpu);
+    if (m_jit_features.size())
+        func->addFnAttr ("target-features", m_jit_features);
+    if (m_fast_math) {
+        func->addFnAttr ("unsafe-fp-math", "true");
+        func->addFnAttr ("no-signed-zeros-fp-math", "true");
+    }
+}
+
+
+
+void
+LLVM_Util::retarget_module ()
+{
+    if (m_jit_cpu.empty() && ! m_fast_math)
+        return;
+    for (llvm::Function& func : module()->getFunctionList())
+        set_function_target (&func);
+}
+
+
+
 llvm::ExecutionEngine *
 LLVM_Util::make_jit_execengine (std::string *err)
 {
@@ -443,11 +729,34 @@ LLVM_Util::make_jit_execengine (std::string *err)
     engine_builder.setErrorStr (err);
 
     // We are actually holding a LLVMMemoryManager
+    LLVMMemoryManager *jitmm = m_llvm_jitmm;
+    if (m_private_jit_memory) {
+        if (! m_private_jitmm)
+            m_private_jitmm = new LLVMMemoryManager(&llvm_default_mapper);
+        jitmm = m_private_jitmm;
+    }
     engine_builder.setMCJITMemoryManager (std::unique_ptr<llvm::RTDyldMemoryManager>
-        (new MemoryManager(m_llvm_jitmm)));
+        (new MemoryManager(jitmm, &m_jit_code_size)));
 
     engine_builder.setOptLevel (llvm::CodeGenOpt::Default);
 
+    // Generate code for the chosen JIT target rather than LLVM's generic
+    // baseline (see set_jit_target). Unless FMA was asked for, we also
+    // forbid the backend from contracting separate multiplies and adds
+    // (even those the bitcode says it may), so that results are the same
+    // whatever the target.
+    if (m_jit_cpu.size()) {
+        engine_builder.setMCPU (m_jit_cpu);
+        std::vector<std::string> attrs;
+        if (m_jit_features.size())
+            OIIO::Strutil::split (m_jit_features, attrs, ",");
+        engine_builder.setMAttrs (attrs);
+    }
+    llvm::TargetOptions options;
+    options.AllowFPOpFusion = m_jit_fma ? llvm::FPOpFusion::Fast
+                                        : llvm::FPOpFusion::Strict;
+    engine_builder.setTargetOptions (options);
+
     m_llvm_exec = engine_builder.create();
     if (! m_llvm_exec)
         return NULL;
@@ -463,6 +772,14 @@ LLVM_Util::make_jit_execengine (std::string *err)
     if (vtuneProfiler)
         m_llvm_exec->RegisterJITEventListener (vtuneProfiler);
 
+    // Optionally also make the code visible to perf and GDB, with
+    // readable names (see jit_listeners and jit_symbol_label).
+    if (m_jit_perf_map || m_jit_gdb) {
+        if (! m_jit_listener)
+            m_jit_listener = new JITListener (*this);
+        m_llvm_exec->RegisterJITEventListener (m_jit_listener);
+    }
+
     // Force it to JIT as soon as we ask it for the code pointer,
     // don't take any chances that it might JIT lazily, since we
     // will be stealing the JIT code memory from under its nose and
@@ -482,6 +799,26 @@ LLVM_Util::execengine (llvm::ExecutionEngine *exec)
 
 
 
+std::shared_ptr<void>
+LLVM_Util::take_jit_memory ()
+{
+    LLVMMemoryManager *jitmm = m_private_jitmm;
+    m_private_jitmm = nullptr;
+    if (! jitmm)
+        return std::shared_ptr<void>();
+    std::vector<uint64_t> gdb_objects;
+    if (m_jit_listener)
+        gdb_objects = m_jit_listener->take_gdb_objects ();
+    return std::shared_ptr<void> (jitmm, [gdb_objects](void *p) {
+        LLVMMemoryManager *mm = (LLVMMemoryManager *)p;
+        JITListener::gdb_unregister (gdb_objects);
+        mm->deregisterEHFrames ();
+        delete mm;
+    });
+}
+
+
+
 void *
 LLVM_Util::getPointerToFunction (llvm::Function *func)
 {
@@ -581,6 +918,26 @@ LLVM_Util::do_optimize (std::string *out_err)
 
 
 
+void
+LLVM_Util::count_calls (llvm::Function *func,
+                        std::map<std::string,int> &counts)
+{
+    for (llvm::BasicBlock &bb : *func) {
+        for (llvm::Instruction &inst : bb) {
+            llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+            if (! call)
+                continue;
+            llvm::Function *callee = call->getCalledFunction();
+            if (! callee)
+                ++counts["(indirect)"];
+            else if (! callee->isIntrinsic())
+                ++counts[callee->getName().str()];
+        }
+    }
+}
+
+
+
 void
 LLVM_Util::internalize_module_functions (const std::string &prefix,
                                          const std::vector<std::string> &exceptions,
@@ -689,6 +1046,7 @@ LLVM_Util::make_function (const std::string &name, bool fastcall,
     llvm::Function *func = llvm::cast<llvm::Function>(c);
     if (fastcall)
         func->setCallingConv(llvm::CallingConv::Fast);
+    set_function_target (func);
     return func;
 }
 
@@ -1092,7 +1450,11 @@ LLVM_Util::call_function (llvm::Value *func, cspan<llvm::Value *> args)
 llvm::Value *
 LLVM_Util::call_function (const char *name, cspan<llvm::Value *> args)
 {
-    llvm::Function *func = module()->getFunction (name);
+    llvm::Function *func = nullptr;
+    if (m_fast_math && OIIO::Strutil::starts_with (name, "osl_"))
+        func = module()->getFunction (std::string("osl_fast_") + (name+4));
+    if (! func)
+        func = module()->getFunction (name);
     return call_function (func, args);
 }
 
@@ -1126,6 +1488,20 @@ LLVM_Util::op_branch (llvm::Value *cond, llvm::BasicBlock *trueblock,
 
 
 
+void
+LLVM_Util::op_branch (llvm::Value *cond, llvm::BasicBlock *trueblock,
+                      llvm::BasicBlock *falseblock,
+                      uint32_t trueweight, uint32_t falseweight)
+{
+    llvm::MDBuilder mdbuilder (context());
+    builder().CreateCondBr (cond, trueblock, falseblock,
+                            mdbuilder.createBranchWeights (trueweight,
+                                                           falseweight));
+    set_insert_point (trueblock);
+}
+
+
+
 void
 LLVM_Util::set_insert_point (llvm::BasicBlock *block)
 {
@@ -1233,6 +1609,8 @@ LLVM_Util::op_add (llvm::Value *a, llvm::Value *b)
         return builder().CreateFAdd (a, b);
     if (a->getType() == type_int() && b->getType() == type_int())
         return builder().CreateAdd (a, b);
+    if (a->getType() == type_longlong() && b->getType() == type_longlong())
+        return builder().CreateAdd (a, b);
     OSL_ASSERT (0 && "Op has bad value type combination");
     return nullptr;
 }
@@ -33,6 +33,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "oslexec_pvt.h"
 #include "osoreader.h"
+#include "osobinary.h"
 
 #include <OpenImageIO/strutil.h>
 #include <OpenImageIO/timer.h>
@@ -60,6 +61,7 @@ public:
     virtual ~OSOReaderToMaster () { }
     virtual bool parse_file (const std::string &filename);
     virtual bool parse_memory (const std::string &oso);
+    bool parse_osob_file (const std::string &filename);
     virtual void version (const char *specid, int major, int minor);
     virtual void shader (const char *shadertype, const char *name);
     virtual void symbol (SymType symtype, TypeSpec typespec, const char *name);
@@ -126,6 +128,19 @@ OSOReaderToMaster::parse_memory (const std::string &oso)
 
 
 
+bool
+OSOReaderToMaster::parse_osob_file (const std::string &filename)
+{
+    m_master->m_osofilename = filename;
+    m_master->m_maincodebegin = 0;
+    m_master->m_maincodeend = 0;
+    m_codesection.clear ();
+    m_codesym = -1;
+    return read_osob_file (filename, *this) && ! m_errors;
+}
+
+
+
 
 void
 OSOReaderToMaster::version (const char* /*specid*/, int major, int minor)
@@ -348,6 +363,7 @@ OSOReaderToMaster::hint (string_view hintstring)
     }
     if (Strutil::parse_prefix (h, "%structfields{") && m_master->m_symbols.size()) {
         Symbol &sym (m_master->m_symbols.back());
+        std::lock_guard<std::mutex> lock (struct_mutex);
         StructSpec *structspec = sym.typespec().structspec();
         if (structspec->numfields() == 0) {
             while (1) {
@@ -550,35 +566,149 @@ ShadingSystemImpl::loadshader (string_view cname)
 {
     if (Strutil::ends_with (cname, ".oso"))
         cname.remove_suffix (4);   // strip superfluous .oso
+    else if (Strutil::ends_with (cname, ".osob"))
+        cname.remove_suffix (5);   // strip superfluous .osob
     if (! cname.size()) {
         error ("Attempt to load shader with empty name \"\".");
         return NULL;
     }
     ++m_stat_shaders_requested;
     ustring name (cname);
-    lock_guard guard (m_mutex);  // Thread safety
-    ShaderNameMap::const_iterator found = m_shader_masters.find (name);
-    if (found != m_shader_masters.end()) {
-        // if (debug())
-        //     infof("Found %s in shader_masters", name);
-        // Already loaded this shader, return its reference
-        return (*found).second;
-    }
-
-    // Not found in the map
-    OSOReaderToMaster oso (*this);
-    bool testcwd = m_searchpath_dirs.empty();  // test "." if there's no searchpath
+
+    // Each master is loaded only once. The first thread to ask for a name
+    // registers a future for it and does the loading without holding any
+    // lock, so different masters load concurrently. Other threads asking
+    // for the same name just wait on that future.
+    std::promise<ShaderMaster::ref> promise;
+    ShaderMasterFuture pending;
+    {
+        lock_guard guard (m_shader_masters_mutex);
+        ShaderNameMap::const_iterator found = m_shader_masters.find (name);
+        if (found != m_shader_masters.end())
+            pending = found->second;
+        else
+            m_shader_masters[name] = promise.get_future().share();
+    }
+    if (pending.valid()) {
+        // Already loaded (or being loaded by another thread), return its
+        // reference
+        if (compile_trace() && pending.wait_for (std::chrono::seconds(0))
+                                   != std::future_status::ready) {
+            CompileTraceSpan trace (*this, "master_load_wait", name);
+            return pending.get();
+        }
+        return pending.get();
+    }
+
+    ShaderMaster::ref r;
+    try {
+        r = load_master_file (name);
+    } catch (...) {
+        abandon_master_load (name, promise);
+        throw;
+    }
+    if (! r) {
+        // Not found, or couldn't be read: don't remember that, so that a
+        // later request (after a searchpath change, or once the .oso has
+        // been written) tries again.
+        abandon_master_load (name, promise);
+        return NULL;
+    }
+    promise.set_value (r);
+    return r;
+}
+
+
+
+void
+ShadingSystemImpl::abandon_master_load (ustring name,
+                                        std::promise<ShaderMaster::ref> &promise)
+{
+    std::exception_ptr exc = std::current_exception();
+    if (exc)
+        promise.set_exception (exc);
+    else
+        promise.set_value (nullptr);
+    // The name may have been re-registered in the meantime (by
+    // LoadMemoryCompiledShader, with allow_shader_replacement), so only
+    // drop it if what's registered now is a load that failed.
+    lock_guard guard (m_shader_masters_mutex);
+    ShaderNameMap::iterator found = m_shader_masters.find (name);
+    if (found == m_shader_masters.end() ||
+        found->second.wait_for (std::chrono::seconds(0))
+            != std::future_status::ready)
+        return;
+    bool failed = false;
+    try {
+        failed = ! found->second.get ();
+    } catch (...) {
+        failed = true;
+    }
+    if (failed)
+        m_shader_masters.erase (found);
+}
+
+
+
+ShaderMaster::ref
+ShadingSystemImpl::load_master_file (ustring name)
+{
+    std::vector<std::string> searchpath_dirs;
+    {
+        lock_guard guard (m_mutex);  // searchpath may be changed by attribute()
+        searchpath_dirs = m_searchpath_dirs;
+    }
+    bool testcwd = searchpath_dirs.empty();  // test "." if there's no searchpath
     std::string filename = OIIO::Filesystem::searchpath_find (name.string() + ".oso",
-                                                        m_searchpath_dirs,
+                                                        searchpath_dirs,
                                                         testcwd);
-    if (filename.empty ()) {
+    // Prefer a binary .osob that oslc wrote alongside the .oso (or one
+    // found on its own), as long as it isn't stale and is of a format
+    // version we can read.
+    std::string osobfile;
+    if (m_load_osob) {
+        if (filename.size())
+            osobfile = OIIO::Filesystem::replace_extension (filename, ".osob");
+        else
+            osobfile = OIIO::Filesystem::searchpath_find (name.string() + ".osob",
+                                                          searchpath_dirs,
+                                                          testcwd);
+        if (osobfile.size() &&
+            (! OIIO::Filesystem::exists (osobfile) ||
+             (filename.size() && OIIO::Filesystem::last_write_time (osobfile)
+                                 < OIIO::Filesystem::last_write_time (filename)) ||
+             ! is_osob_file (osobfile)))
+            osobfile.clear ();
+    }
+    if (filename.empty () && osobfile.empty ()) {
         errorf("No .oso file could be found for shader \"%s\"", name);
         return NULL;
     }
+    CompileTraceSpan trace (*this, "master_load", name);
     OIIO::Timer timer;
-    bool ok = oso.parse_file (filename);
-    ShaderMaster::ref r = ok ? oso.master() : nullptr;
-    m_shader_masters[name] = r;
+    bool ok = false;
+    ShaderMaster::ref r;
+    if (osobfile.size()) {
+        OSOReaderToMaster osob (*this);
+        ok = osob.parse_osob_file (osobfile);
+        if (ok) {
+            r = osob.master();
+            ++m_stat_shaders_loaded_osob;
+            filename = osobfile;
+        } else if (filename.empty()) {
+            // Nothing to fall back on
+            errorf("\"%s\" is not a valid .osob file", osobfile);
+            filename = osobfile;
+        } else {
+            warningf("\"%s\" could not be read, loading \"%s\" instead",
+                     osobfile, filename);
+        }
+    }
+    if (! ok && filename != osobfile) {
+        OSOReaderToMaster oso (*this);
+        ok = oso.parse_file (filename);
+        r = ok ? oso.master() : nullptr;
+    }
     double loadtime = timer();
     {
         spin_lock lock (m_stat_mutex);
@@ -618,20 +748,30 @@ ShadingSystemImpl::LoadMemoryCompiledShader (string_view shadername,
     }
 
     ustring name (shadername);
-    lock_guard guard (m_mutex);  // Thread safety
-    ShaderNameMap::const_iterator found = m_shader_masters.find (name);
-    if (found != m_shader_masters.end() && ! allow_shader_replacement()) {
-        if (debug())
-            infof("Preload shader %s already exists in shader_masters", name);
-        return false;
+    std::promise<ShaderMaster::ref> promise;
+    {
+        lock_guard guard (m_shader_masters_mutex);
+        ShaderNameMap::const_iterator found = m_shader_masters.find (name);
+        if (found != m_shader_masters.end() && ! allow_shader_replacement()) {
+            if (debug())
+                infof("Preload shader %s already exists in shader_masters", name);
+            return false;
+        }
+        // Anybody asking for this name while we parse will wait for us.
+        m_shader_masters[name] = promise.get_future().share();
     }
 
-    // Not found in the map
     OSOReaderToMaster reader (*this);
+    CompileTraceSpan trace (*this, "master_load", name);
     OIIO::Timer timer;
-    bool ok = reader.parse_memory (buffer);
+    bool ok = false;
+    try {
+        ok = reader.parse_memory (buffer);
+    } catch (...) {
+        abandon_master_load (name, promise);
+        throw;
+    }
     ShaderMaster::ref r = ok ? reader.master() : nullptr;
-    m_shader_masters[name] = r;
     double loadtime = timer();
     {
         spin_lock lock (m_stat_mutex);
@@ -651,6 +791,7 @@ ShadingSystemImpl::LoadMemoryCompiledShader (string_view shadername,
     } else {
         errorf("Unable to parse preloaded shader \"%s\"", shadername);
     }
+    promise.set_value (r);
 
     return true;
 }
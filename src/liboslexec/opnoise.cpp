@@ -286,6 +286,15 @@ NOISE_IMPL_DERIV (simplexnoise, SimplexNoise)
 NOISE_IMPL (usimplexnoise, USimplexNoise)
 NOISE_IMPL_DERIV (usimplexnoise, USimplexNoise)
 
+// The perlin noises with the cheaper fade, for groups with the "fast_math"
+// option (LLVM_Util::call_function picks osl_fast_foo over osl_foo).  Cell
+// and hash noise are nothing but integer hashing, so there is nothing to
+// approximate in them and they have no fast versions.
+NOISE_IMPL (fast_noise, FastNoise)
+NOISE_IMPL_DERIV (fast_noise, FastNoise)
+NOISE_IMPL (fast_snoise, FastSNoise)
+NOISE_IMPL_DERIV (fast_snoise, FastSNoise)
+
 
 
 #define PNOISE_IMPL(opname,implname)                                    \
@@ -478,6 +487,10 @@ PNOISE_IMPL (pnoise, PeriodicNoise)
 PNOISE_IMPL_DERIV (pnoise, PeriodicNoise)
 PNOISE_IMPL (psnoise, PeriodicSNoise)
 PNOISE_IMPL_DERIV (psnoise, PeriodicSNoise)
+PNOISE_IMPL (fast_pnoise, FastPeriodicNoise)
+PNOISE_IMPL_DERIV (fast_pnoise, FastPeriodicNoise)
+PNOISE_IMPL (fast_psnoise, FastPeriodicSNoise)
+PNOISE_IMPL_DERIV (fast_psnoise, FastPeriodicSNoise)
 
 
 
@@ -701,11 +714,21 @@ struct GenericNoise {
     inline void operator() (StringParam name, Dual2<R> &result, const Dual2<S> &s,
                             ShaderGlobals *sg, const NoiseParams *opt) const {
         if (name == StringParams::uperlin || name == StringParams::noise) {
-            Noise noise;
-            noise(result, s);
+            if (opt->fast_math) {
+                FastNoise noise;
+                noise(result, s);
+            } else {
+                Noise noise;
+                noise(result, s);
+            }
         } else if (name == StringParams::perlin || name == StringParams::snoise) {
-            SNoise snoise;
-            snoise(result, s);
+            if (opt->fast_math) {
+                FastSNoise snoise;
+                snoise(result, s);
+            } else {
+                SNoise snoise;
+                snoise(result, s);
+            }
         } else if (name == StringParams::simplexnoise || name == StringParams::simplex) {
             SimplexNoise simplexnoise;
             simplexnoise(result, s);
@@ -743,11 +766,21 @@ struct GenericNoise {
                             ShaderGlobals *sg, const NoiseParams *opt) const {
 
         if (name == StringParams::uperlin || name == StringParams::noise) {
-            Noise noise;
-            noise(result, s, t);
+            if (opt->fast_math) {
+                FastNoise noise;
+                noise(result, s, t);
+            } else {
+                Noise noise;
+                noise(result, s, t);
+            }
         } else if (name == StringParams::perlin || name == StringParams::snoise) {
-            SNoise snoise;
-            snoise(result, s, t);
+            if (opt->fast_math) {
+                FastSNoise snoise;
+                snoise(result, s, t);
+            } else {
+                SNoise snoise;
+                snoise(result, s, t);
+            }
         } else if (name == StringParams::simplexnoise || name == StringParams::simplex) {
             SimplexNoise simplexnoise;
             simplexnoise(result, s, t);
@@ -796,11 +829,21 @@ struct GenericPNoise {
                             const S &sp,
                             ShaderGlobals *sg, const NoiseParams *opt) const {
         if (name == StringParams::uperlin || name == StringParams::noise) {
-            PeriodicNoise noise;
-            noise(result, s, sp);
+            if (opt->fast_math) {
+                FastPeriodicNoise noise;
+                noise(result, s, sp);
+            } else {
+                PeriodicNoise noise;
+                noise(result, s, sp);
+            }
         } else if (name == StringParams::perlin || name == StringParams::snoise) {
-            PeriodicSNoise snoise;
-            snoise(result, s, sp);
+            if (opt->fast_math) {
+                FastPeriodicSNoise snoise;
+                snoise(result, s, sp);
+            } else {
+                PeriodicSNoise snoise;
+                snoise(result, s, sp);
+            }
         } else if (name == StringParams::cell) {
             PeriodicCellNoise cellnoise;
             cellnoise(result.val(), s.val(), sp);
@@ -828,11 +871,21 @@ struct GenericPNoise {
                             const S &sp, const T &tp,
                             ShaderGlobals *sg, const NoiseParams *opt) const {
         if (name == StringParams::uperlin || name == StringParams::noise) {
-            PeriodicNoise noise;
-            noise(result, s, t, sp, tp);
+            if (opt->fast_math) {
+                FastPeriodicNoise noise;
+                noise(result, s, t, sp, tp);
+            } else {
+                PeriodicNoise noise;
+                noise(result, s, t, sp, tp);
+            }
         } else if (name == StringParams::perlin || name == StringParams::snoise) {
-            PeriodicSNoise snoise;
-            snoise(result, s, t, sp, tp);
+            if (opt->fast_math) {
+                FastPeriodicSNoise snoise;
+                snoise(result, s, t, sp, tp);
+            } else {
+                PeriodicSNoise snoise;
+                snoise(result, s, t, sp, tp);
+            }
         } else if (name == StringParams::cell) {
             PeriodicCellNoise cellnoise;
             cellnoise(result.val(), s.val(), t.val(), sp, tp);
@@ -865,8 +918,8 @@ OSL_SHADEOP void *
 osl_get_noise_options (void *sg_)
 {
     ShaderGlobals *sg = (ShaderGlobals *)sg_;
-    RendererServices::NoiseOpt *opt = sg->context->noise_options_ptr ();
-    new (opt) RendererServices::NoiseOpt;
+    NoiseParams *opt = sg->context->noise_options_ptr ();
+    new (opt) NoiseParams;
     return opt;
 }
 
@@ -912,6 +965,14 @@ osl_noiseparams_set_impulses (void *opt, float i)
 
 
 
+OSL_SHADEOP OSL_HOSTDEVICE void
+osl_noiseparams_set_fast_math (void *opt, int f)
+{
+    ((NoiseParams *)opt)->fast_math = f;
+}
+
+
+
 OSL_SHADEOP void
 osl_count_noise (void *sg_)
 {
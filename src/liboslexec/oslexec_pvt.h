@@ -28,14 +28,20 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <stack>
 #include <map>
 #include <memory>
 #include <list>
+#include <deque>
 #include <set>
+#include <tuple>
 #include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <future>
 
 #include <boost/thread/tss.hpp>   /* for thread_specific_ptr */
 
@@ -112,6 +118,10 @@ struct PerThreadInfo
 
 
 
+class ShaderGroupRegistry;
+
+
+
 namespace pvt {
 
 // forward definitions
@@ -148,7 +158,10 @@ struct OpDescriptor {
         : name(n), llvmgen(ll), folder(fold), simple_assign(simple), flags(flags)
     {}
 
-    enum FlagValues { None=0, Tex=1, SideEffects=2 };
+    enum FlagValues { None=0, Tex=1, SideEffects=2, Varying=4 };
+    // N.B. "Varying" marks ops whose results may depend on per-point
+    // state (ShaderGlobals, messages, closures, the renderer) beyond what
+    // is passed in their arguments.
 };
 
 
@@ -534,9 +547,28 @@ public:
     void message (const std::string &message) const;
 
     std::string getstats (int level=1) const;
+    std::string getstats_json (int level=1) const;
+
+    /// Is the compile pipeline being traced (see the "compile_trace"
+    /// option)?
+    bool compile_trace () const { return ! m_compile_trace.empty(); }
+
+    /// Microseconds since the ShadingSystem was created, the clock of
+    /// the compile trace.
+    long long trace_now () const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - m_trace_start).count();
+    }
+
+    /// Record a span of the compile pipeline, from begin to end (see
+    /// trace_now()), about the named group, layer or shader.
+    void trace_event (const char *name, ustring arg,
+                      long long begin, long long end);
 
     ErrorHandler &errhandler () const { return *m_err; }
 
+    /// Return the master for the named shader, loading it if this is the
+    /// first request for it.  Safe to call from many threads at once.
     ShaderMaster::ref loadshader (string_view name);
 
     PerThreadInfo * create_thread_info();
@@ -585,11 +617,50 @@ public:
     int llvm_debug_layers () const { return m_llvm_debug_layers; }
     int llvm_debug_ops () const { return m_llvm_debug_ops; }
     int llvm_output_bitcode () const { return m_llvm_output_bitcode; }
+    bool llvm_report_calls () const { return m_llvm_report_calls; }
+    ustring jit_target () const { return m_jit_target; }
+    bool jit_fma () const { return m_jit_fma; }
+    bool jit_perf_map () const { return m_jit_perf_map; }
+    bool jit_gdb () const { return m_jit_gdb; }
+    int llvm_jit_partitions () const { return m_llvm_jit_partitions; }
+    int llvm_jit_partition_minops () const { return m_llvm_jit_partition_minops; }
+    bool llvm_jit_partitions_compare () const { return m_llvm_jit_partitions_compare; }
+    int jit_memory_budget () const { return m_jit_memory_budget; }
+    bool fast_math () const { return m_fast_math; }
+
+    /// Has the renderer said that the named attribute (or userdata) is
+    /// the same at every point of an object (see "uniform_attributes")?
+    bool uniform_attribute (ustring name) const {
+        return std::find (m_uniform_attributes.begin(),
+                          m_uniform_attributes.end(), name)
+               != m_uniform_attributes.end();
+    }
+
+    /// Describe the global settings that change how groups are optimized
+    /// or the code generated for them, for the signatures by which groups
+    /// and layers share code, so that code is only reused under the same
+    /// settings it was made with.
+    std::string codegen_signature () const;
+
+    /// Record the JIT target and llvm_ops flavour that were actually
+    /// used (reported in the stats).
+    void set_jit_target_used (const std::string &desc) {
+        spin_lock lock (m_stat_mutex);
+        m_stat_jit_target = desc;
+    }
+    /// Add a group's tally of shadeop calls that were not inlined (see
+    /// the llvm_report_calls option) to the totals reported in the stats.
+    void record_calls_not_inlined (const std::map<std::string,int> &counts) {
+        spin_lock lock (m_stat_mutex);
+        for (auto &c : counts)
+            m_stat_calls_not_inlined[c.first] += c.second;
+    }
     bool fold_getattribute () const { return m_opt_fold_getattribute; }
     bool opt_texture_handle () const { return m_opt_texture_handle; }
     int opt_passes() const { return m_opt_passes; }
     int max_warnings_per_thread() const { return m_max_warnings_per_thread; }
     bool countlayerexecs() const { return m_countlayerexecs; }
+    bool pgo_instrument() const { return m_pgo_instrument; }
     bool lazy_userdata () const { return m_lazy_userdata; }
     bool userdata_isconnected () const { return m_userdata_isconnected; }
     int profile() const { return m_profile; }
@@ -607,16 +678,83 @@ public:
     /// instances that were eliminated.
     int merge_instances (ShaderGroup &group, bool post_opt = false);
 
+    /// Return the JITed function for a layer with the given signature (see
+    /// BackendLLVM::shared_layer_signature) if one was already compiled
+    /// for some group still around, or NULL.  If found, the user group
+    /// holds on to it for as long as the group lives.
+    void *find_shared_layer_func (const std::string &signature,
+                                  ShaderGroup &user);
+
+    /// Record the JITed function for a layer of the owner group with the
+    /// given signature so that identical layers of other groups can call
+    /// it.  The instance that it was compiled from is kept alive, since
+    /// the code may refer to its constant data, until neither the owner
+    /// nor any group that uses the function is left.
+    void add_shared_layer_func (const std::string &signature, void *func,
+                                const ShaderInstanceRef &inst,
+                                ShaderGroup &owner);
+
     /// The group is set and won't be changed again; take advantage of
     /// this by optimizing the code knowing all our instance parameters
     /// (at least the ones that can't be overridden by the geometry).
     void optimize_group (ShaderGroup &group, ShadingContext *ctx);
 
+    /// Change the value of a parameter whose value was baked into the
+    /// optimized code of the group, by optimizing and compiling a new
+    /// specialization of the group with the new value, which replaces
+    /// the old one for all subsequent executions.  Return false if the
+    /// group can't be re-specialized.
+    bool respecialize (ShaderGroup &group, int layer, ustring paramname,
+                       TypeDesc type, const void *val);
+
+    /// Return the variant of the group specialized for the ray types of
+    /// the given ShaderGlobals::raytype bits that the group queries (if
+    /// opt_raytype_variants is on), and compiled without derivatives if
+    /// noderivs is true, optimizing and compiling it first if this is
+    /// the first time that combination has been seen.  Return the group
+    /// itself if it needs no variants or can't have any more of them.
+    ShaderGroup & raytype_variant (ShaderGroup &group, int raytype,
+                                   bool noderivs = false);
+
+    /// Return the variant of the group that computes only the named
+    /// outputs ("param" or "layer.param"), making and compiling it the
+    /// first time that subset is requested.  Return an empty ref if none
+    /// of the names is an output of the group, or if the group was
+    /// optimized without keeping its unoptimized layers.
+    ShaderGroupRef output_subset (ShaderGroup &group, cspan<ustring> outputs);
+
+    /// May re-specializations of the group keep some of its layers as
+    /// they are, optimized and JITed (see respecialize)?  If so, its JIT
+    /// keeps the function of every layer, where they can find it.
+    bool reusable_layers (const ShaderGroup &group) const;
+
+    /// Keep unoptimized copies of the group's layers, from which to make
+    /// re-specializations or raytype variants of it (if we don't have
+    /// them already).  The caller must hold the group's lock.
+    void keep_pristine_layers (ShaderGroup &group);
+
     /// After doing all optimization and code JIT, we can clean up by
     /// deleting the instances' code and arguments, and paring their
     /// symbol tables down to just parameters.
     void group_post_jit_cleanup (ShaderGroup &group);
 
+    /// JIT the group's code again after it was evicted to stay within
+    /// the "jit_memory_budget" (its optimized instances are kept for
+    /// this).  Does nothing if another thread already did it.
+    void rejit_group (ShaderGroup &group);
+
+    /// If the JITed code of all the groups exceeds the
+    /// "jit_memory_budget", drop the code of the groups executed least
+    /// recently (never that of keep, or of any group some context is
+    /// executing) until it doesn't.
+    void enforce_jit_memory_budget (const ShaderGroup *keep);
+
+    /// Free the group's re-specializations other than the current one
+    /// that no context may still be using (see
+    /// ShadingContext::using_specialization).  Call with the group's
+    /// mutex held.
+    void free_retired_specializations (ShaderGroup &group);
+
     int *alloc_int_constants (size_t n) { return m_int_pool.alloc (n); }
     float *alloc_float_constants (size_t n) { return m_float_pool.alloc (n); }
     ustring *alloc_string_constants (size_t n) { return m_string_pool.alloc (n); }
@@ -661,6 +799,15 @@ public:
     /// archive.
     bool archive_shadergroup (ShaderGroup& group, string_view filename);
 
+    /// Write the access and branch counts gathered by the instrumented
+    /// code of the group (and its variants) to a profile file, which the
+    /// group attribute "pgo_profile" can later read back.
+    bool write_group_profile (ShaderGroup& group, string_view filename);
+
+    /// Read a profile file written by write_group_profile().
+    bool read_group_profile (std::map<std::string,long long> &profile,
+                             string_view filename);
+
     void count_noise () { m_stat_noise_calls += 1; }
 
     ColorSystem& colorsystem() { return m_colorsystem; }
@@ -713,8 +860,23 @@ private:
     static const int m_errseenmax = 32;
     mutable mutex m_errmutex;
 
-    typedef std::map<ustring,ShaderMaster::ref> ShaderNameMap;
+    /// Find and read the .oso (or .osob) for the named master.
+    ShaderMaster::ref load_master_file (ustring name);
+
+    // A master is registered as a future as soon as somebody starts
+    // loading it, so concurrent requests for the same name wait for the
+    // one load rather than all taking the big m_mutex.
+    typedef std::shared_future<ShaderMaster::ref> ShaderMasterFuture;
+    typedef std::unordered_map<ustring,ShaderMasterFuture,ustringHash> ShaderNameMap;
     ShaderNameMap m_shader_masters;       ///< name -> shader masters map
+    mutable mutex m_shader_masters_mutex; ///< Guards m_shader_masters
+
+    /// Loading master name, registered with promise's future, threw (or,
+    /// called outside of a catch, found nothing): hand the exception (or
+    /// a null master) to anybody already waiting on it, and unregister
+    /// the name so that later requests try again.
+    void abandon_master_load (ustring name,
+                              std::promise<ShaderMaster::ref> &promise);
 
     ConstantPool<int> m_int_pool;
     ConstantPool<Float> m_float_pool;
@@ -733,6 +895,7 @@ private:
     bool m_lazy_userdata;                 ///< Retrieve userdata lazily?
     bool m_userdata_isconnected;          ///< Userdata params isconnected()?
     bool m_clearmemory;                   ///< Zero mem before running shader?
+    bool m_load_osob;                     ///< Load binary .osob when present?
     bool m_debugnan;                      ///< Root out NaN's?
     bool m_debug_uninit;                  ///< Find use of uninitialized vars?
     bool m_lockgeom_default;              ///< Default value of lockgeom
@@ -743,6 +906,7 @@ private:
     bool m_connection_error;              ///< Error for ConnectShaders to fail?
     bool m_greedyjit;                     ///< JIT as much as we can?
     bool m_countlayerexecs;               ///< Count number of layer execs?
+    bool m_pgo_instrument;                ///< Instrument JIT for a profile?
     bool m_relaxed_param_typecheck;       ///< Allow parameters to be set from isomorphic types (same data layout)
     int m_max_warnings_per_thread;        ///< How many warnings to display per thread before giving up?
     int m_profile;                        ///< Level of profiling of shader execution
@@ -760,8 +924,16 @@ private:
     bool m_opt_merge_instances_with_userdata; ///< Merge identical instances if they have userdata?
     bool m_opt_fold_getattribute;         ///< Constant-fold getattribute()?
     bool m_opt_middleman;                 ///< Middle-man optimization?
+    bool m_opt_uniform_layers;            ///< Cache uniform layers per object?
+    bool m_opt_share_groups;              ///< Share identical groups' JIT?
+    bool m_opt_share_layers;              ///< Share identical layers' JIT?
+    bool m_opt_respecialize;              ///< Re-specialize on ReParameter?
+    bool m_opt_raytype_variants;          ///< Compile variants per raytype?
+    int m_opt_noderivs_raytypes;          ///< Raytypes run without derivs
     bool m_opt_texture_handle;            ///< Use texture handles?
     bool m_opt_seed_bblock_aliases;       ///< Turn on basic block alias seeds
+    bool m_opt_skip_untouched_ops;        ///< Skip ops of untouched syms?
+    int m_opt_layer_threads;              ///< Threads optimizing layers
     bool m_optimize_nondebug;             ///< Fully optimize non-debug!
     int m_opt_passes;                     ///< Opt passes per layer
     int m_llvm_optimize;                  ///< OSL optimization strategy
@@ -770,17 +942,28 @@ private:
     int m_llvm_debug_layers;              ///< Add layer enter/exit printfs
     int m_llvm_debug_ops;                 ///< Add printfs to every op
     int m_llvm_output_bitcode;            ///< Output bitcode for each group
+    int m_llvm_report_calls;              ///< Report calls left after inlining
+    ustring m_jit_target;                 ///< CPU/ISA to JIT for
+    int m_jit_fma;                        ///< Allow FMA in JITed code
+    int m_jit_perf_map;                   ///< Write /tmp/perf-<pid>.map
+    int m_jit_gdb;                        ///< Register JIT code with GDB
+    int m_llvm_jit_partitions;            ///< Max modules to JIT a group in
+    int m_llvm_jit_partition_minops;      ///< Min ops per module
+    int m_llvm_jit_partitions_compare;    ///< Also time single-module JIT
+    int m_jit_memory_budget;              ///< Max KB of JITed code (0 = any)
     ustring m_debug_groupname;            ///< Name of sole group to debug
     ustring m_debug_layername;            ///< Name of sole layer to debug
     ustring m_opt_layername;              ///< Name of sole layer to optimize
     ustring m_only_groupname;             ///< Name of sole group to compile
     ustring m_archive_groupname;          ///< Name of group to pickle/archive
     ustring m_archive_filename;           ///< Name of filename for group archive
+    ustring m_compile_trace;              ///< File to write compile trace to
     std::string m_searchpath;             ///< Shader search path
     std::vector<std::string> m_searchpath_dirs; ///< All searchpath dirs
     ustring m_commonspace_synonym;        ///< Synonym for "common" space
     std::vector<ustring> m_raytypes;      ///< Names of ray types
     std::vector<ustring> m_renderer_outputs; ///< Names of renderer outputs
+    std::vector<ustring> m_uniform_attributes; ///< Per-object attributes
     int m_max_local_mem_KB;               ///< Local storage can a shader use
     bool m_compile_report;                ///< Print compilation report?
     bool m_buffer_printf;                 ///< Buffer/batch printf output?
@@ -789,6 +972,7 @@ private:
     bool m_force_derivs;                  ///< Force derivs on everything
     bool m_allow_shader_replacement;      ///< Allow shader masters to replace
     int m_exec_repeat;                    ///< How many times to execute group
+    int m_fast_math;                      ///< Default for groups' fast_math
     int m_opt_warnings;                   ///< Warn on inability to optimize
     int m_gpu_opt_error;                  ///< Error on inability to optimize
                                           ///<   away things that can't GPU.
@@ -803,6 +987,7 @@ private:
 
     // Stats
     atomic_int m_stat_shaders_loaded;     ///< Stat: shaders loaded
+    atomic_int m_stat_shaders_loaded_osob; ///< Stat: ... from binary .osob
     atomic_int m_stat_shaders_requested;  ///< Stat: shaders requested
     PeakCounter<int> m_stat_instances;    ///< Stat: instances
     PeakCounter<int> m_stat_contexts;     ///< Stat: shading contexts
@@ -821,20 +1006,53 @@ private:
     atomic_int m_stat_preopt_ops;         ///< Stat: pre-optimization ops
     atomic_int m_stat_postopt_ops;        ///< Stat: post-optimization ops
     atomic_int m_stat_middlemen_eliminated; ///< Stat: middlemen eliminated
+    atomic_int m_stat_range_checks_eliminated; ///< Stat: range checks proven unneeded
     atomic_int m_stat_const_connections;  ///< Stat: const connections elim'd
     atomic_int m_stat_global_connections; ///< Stat: global connections elim'd
     atomic_int m_stat_tex_calls_codegened;///< Stat: total texture calls
     atomic_int m_stat_tex_calls_as_handles;///< Stat: texture calls with handles
+    atomic_int m_stat_uniform_layers;     ///< Stat: layers found uniform
+    atomic_int m_stat_groups_shared;      ///< Stat: groups reusing another's JIT
+    atomic_int m_stat_layers_shared;      ///< Stat: layers calling shared code
+    atomic_int m_stat_shared_layer_funcs; ///< Stat: shared layer funcs JITed
+    atomic_int m_stat_respecializations;  ///< Stat: groups re-specialized
+    atomic_int m_stat_respecialize_kept;  ///< Stat: ... layers not redone
+    atomic_int m_stat_raytype_variants;   ///< Stat: raytype variants compiled
+    atomic_int m_stat_noderivs_variants;  ///< Stat: ... of which without derivs
+    atomic_int m_stat_pgo_hot_params;     ///< Stat: params laid out by profile
+    atomic_int m_stat_pgo_weighted_branches; ///< Stat: branches given weights
+    atomic_int m_stat_output_subsets;     ///< Stat: output subsets compiled
     double m_stat_master_load_time;       ///< Stat: time loading masters
     double m_stat_optimization_time;      ///< Stat: time spent optimizing
     double m_stat_opt_locking_time;       ///<   locking time
     double m_stat_specialization_time;    ///<   runtime specialization time
+    double m_stat_opt_bblock_time;        ///<     finding basic blocks
+    double m_stat_opt_fold_time;          ///<     optimizing ops
+    double m_stat_opt_lifetime_time;      ///<     tracking lifetimes
+    double m_stat_opt_cleanup_time;       ///<     middleman, unused params
+    long long m_stat_opt_passes;          ///< Stat: layer optimization passes
+    long long m_stat_opt_ops_visited;     ///< Stat: ops optimized, all passes
+    long long m_stat_opt_ops_skipped;     ///< Stat: ops skipped as untouched
+    long long m_stat_opt_parallel_layers; ///< Stat: layers optimized concurrently
+    long long m_stat_opt_native_folds;    ///< Stat: ops folded by native shadeops
+    double m_stat_respecialize_time;      ///< Stat: time re-specializing
     double m_stat_total_llvm_time;        ///<   total time spent on LLVM
     double m_stat_llvm_setup_time;        ///<     llvm setup time
     double m_stat_llvm_irgen_time;        ///<     llvm IR generation time
     double m_stat_llvm_opt_time;          ///<     llvm IR optimization time
     double m_stat_llvm_jit_time;          ///<     llvm JIT time
+    std::string m_stat_jit_target;        ///< JIT target actually used
+    std::map<std::string,int> m_stat_calls_not_inlined; ///< Calls left after opt
+    int m_stat_groups_partitioned;        ///< Groups JITed in partitions
+    double m_stat_partitioned_wall_time;  ///<   their LLVM wall time
+    double m_stat_partitioned_cpu_time;   ///<   summed over partitions
+    double m_stat_single_module_time;     ///<   unpartitioned (to compare)
+    atomic_int m_stat_jit_evictions;      ///< Stat: groups whose code was dropped
+    atomic_int m_stat_jit_rejits;         ///< Stat: groups JITed again
+    double m_stat_rejit_time;             ///< Stat: time re-JITing
     double m_stat_inst_merge_time;        ///< Stat: time merging instances
+    double m_stat_max_group_merge_time;   ///< Stat: slowest group merge time
+    ustring m_stat_max_group_merge_name;  ///< Stat: slowest merging group
     double m_stat_getattribute_time;      ///< Stat: time spent in getattribute
     double m_stat_getattribute_fail_time; ///< Stat: time spent in getattribute
     atomic_ll m_stat_getattribute_calls;  ///< Stat: Number of getattribute
@@ -847,9 +1065,12 @@ private:
     long long m_stat_pointcloud_gets;
     long long m_stat_pointcloud_writes;
     atomic_ll m_stat_layers_executed;     ///< Total layers executed
+    atomic_ll m_stat_uniform_cache_hits;  ///< Uniform layers reused per object
+    atomic_ll m_stat_uniform_cache_misses;///< Uniform layers run per object
     atomic_ll m_stat_total_shading_time_ticks; ///< Total shading time (ticks)
 
     int m_stat_max_llvm_local_mem;        ///< Stat: max LLVM local mem
+    long long m_stat_llvm_code_size;      ///< Stat: bytes of JITed code
     PeakCounter<off_t> m_stat_memory;     ///< Stat: all shading system memory
 
     PeakCounter<off_t> m_stat_mem_master; ///< Stat: master-related mem
@@ -865,12 +1086,38 @@ private:
 
     mutable spin_mutex m_stat_mutex;     ///< Mutex for non-atomic stats
     ClosureRegistry m_closure_registry;
-    std::vector<std::weak_ptr<ShaderGroup> > m_all_shader_groups;
-    mutable spin_mutex m_all_shader_groups_mutex;
+    std::shared_ptr<ShaderGroupRegistry> m_group_registry; ///< All extant groups
+
+    // For the "jit_memory_budget": the JIT "clock" by which we tell which
+    // groups ran least recently, and all the live contexts, whose
+    // m_jit_hazard says which group each may be executing (and whose
+    // m_spec_hazard says which re-specialization each may still use).
+    std::atomic<long long> m_jit_epoch {0};
+    std::vector<ShadingContext*> m_contexts;
+    mutable spin_mutex m_contexts_mutex;
+
+    // Optimized groups, by hash of their specialization_signature(), that
+    // later identical groups may share.
+    typedef std::unordered_multimap<size_t, std::pair<std::string,std::weak_ptr<ShaderGroup> > > SpecializationMap;
+    SpecializationMap m_specializations;
+    mutable spin_mutex m_specializations_mutex;
+
+    // JITed functions of layers that identical layers of other groups may
+    // call, by hash of their signature.  The groups that own or call
+    // each one hold it (see ShaderGroup::m_shared_layer_funcs), and
+    // entries whose groups are all gone are pruned.
+    struct SharedLayerFunc {
+        std::string signature;
+        void *func;
+        ShaderInstanceRef inst;     // keeps constants the code refers to
+    };
+    std::unordered_multimap<size_t, std::weak_ptr<SharedLayerFunc>> m_shared_layer_funcs;
+    mutable spin_mutex m_shared_layer_funcs_mutex;
 
     // State for entering shader groups -- this is only for the
     // non-threadsafe calls to Parameter/etc that don't take a group
-    // reference.
+    // reference. It's only accessed with std::atomic_load/store, since
+    // ShaderGroupBegin sets it even when building groups in parallel.
     ShaderGroupRef m_curgroup;
 
     atomic_int m_groups_to_compile_count;
@@ -878,6 +1125,19 @@ private:
     mutable std::map<ustring,long long> m_group_profile_times;
     // N.B. group_profile_times is protected by m_stat_mutex.
 
+    // Spans recorded for the compile trace, written out as a Chrome trace
+    // when the ShadingSystem is destroyed.
+    struct TraceEvent {
+        const char *name;       ///< What was happening (a static string)
+        ustring arg;            ///< Group, layer or shader it was for
+        int tid;                ///< Small integer ID of the thread
+        long long begin, end;   ///< Microseconds since m_trace_start
+    };
+    std::chrono::steady_clock::time_point m_trace_start;
+    std::vector<TraceEvent> m_trace_events;
+    spin_mutex m_trace_mutex;
+    void write_compile_trace ();
+
     friend class OSL::ShadingContext;
     friend class ShaderMaster;
     friend class ShaderInstance;
@@ -887,6 +1147,47 @@ private:
 
 
 
+/// Records a span of the compile pipeline for the compile trace, from
+/// when it's constructed until it's ended or destroyed.  If tracing is
+/// off, it costs no more than checking that.
+class CompileTraceSpan {
+public:
+    CompileTraceSpan (ShadingSystemImpl &ss, const char *name,
+                      ustring arg = ustring())
+        : m_ss(ss.compile_trace() ? &ss : nullptr), m_name(name), m_arg(arg)
+    {
+        if (m_ss)
+            m_begin = m_ss->trace_now();
+    }
+    ~CompileTraceSpan () { end(); }
+
+    /// End the span now.
+    void end () {
+        if (m_ss) {
+            m_ss->trace_event (m_name, m_arg, m_begin, m_ss->trace_now());
+            m_ss = nullptr;
+        }
+    }
+
+    /// End the span and start another, right where it left off.
+    void next (const char *name) {
+        if (m_ss) {
+            long long now = m_ss->trace_now();
+            m_ss->trace_event (m_name, m_arg, m_begin, now);
+            m_begin = now;
+        }
+        m_name = name;
+    }
+
+private:
+    ShadingSystemImpl *m_ss;
+    const char *m_name;
+    ustring m_arg;
+    long long m_begin = 0;
+};
+
+
+
 /// Describe one end of a parameter connetion: the parameter number, and
 /// optinally an array index and/or channel number within that parameter.
 struct ConnectedParam {
@@ -1107,6 +1408,12 @@ public:
     bool entry_layer () const { return m_entry_layer; }
     void entry_layer (bool val) { m_entry_layer = val; }
 
+    /// Does this instance depend only on per-object values (instance
+    /// parameters and uniform upstream layers), not on anything that
+    /// varies from one shading point to the next?
+    bool uniform () const { return m_uniform; }
+    void uniform (bool val) { m_uniform = val; }
+
     /// Was this instance merged away and now no longer needed?
     bool merged_unused () const { return m_merged_unused; }
 
@@ -1250,6 +1557,17 @@ public:
     /// equivalent, in that they may be merged into a single instance?
     bool mergeable (const ShaderInstance &b, const ShaderGroup &g) const;
 
+    /// Hash of the properties that mergeable() requires to match (master,
+    /// parameter values, connections, and post-optimization code size).
+    /// Any two mergeable instances have the same merge_hash, so only
+    /// instances with equal hashes need to be compared.
+    size_t merge_hash () const;
+
+    /// Return a new instance of the same master, with the same instance
+    /// values, overrides, and connections as this one (which must not
+    /// have been optimized yet), that may be optimized independently.
+    ShaderInstanceRef unoptimized_copy () const;
+
 private:
     ShaderMaster::ref m_master;         ///< Reference to the master
     SymOverrideInfoVec m_instoverrides; ///< Instance parameter info
@@ -1268,6 +1586,7 @@ private:
     bool m_merged_unused;               ///< Unused because of a merge
     bool m_last_layer;                  ///< Is it the group's last layer?
     bool m_entry_layer;                 ///< Is it an entry layer?
+    bool m_uniform;                     ///< Same results for a whole object?
     ConnectionVec m_connections;        ///< Connected input params
     int m_firstparam, m_lastparam;      ///< Subset of symbols that are params
     int m_maincodebegin, m_maincodeend; ///< Main shader code range
@@ -1398,7 +1717,7 @@ private:
 
 /// A ShaderGroup consists of one or more layers (each of which is a
 /// ShaderInstance), and the connections among them.
-class ShaderGroup {
+class ShaderGroup : public std::enable_shared_from_this<ShaderGroup> {
 public:
     ShaderGroup (string_view name);
     ShaderGroup (const ShaderGroup &g, string_view name);
@@ -1406,7 +1725,7 @@ public:
 
     /// Clear the layers
     ///
-    void clear () { m_layers.clear ();  m_optimized = 0;  m_executions = 0; }
+    void clear () { m_layers.clear ();  optimized (0);  m_executions = 0; }
 
     /// Append a new shader instance on to the end of this group
     ///
@@ -1424,12 +1743,18 @@ public:
     /// Array indexing returns the i-th layer of the group
     ShaderInstance * operator[] (int i) const { return layer(i); }
 
-    int optimized () const { return m_optimized; }
-    void optimized (int opt) { m_optimized = opt; }
+    /// Is the group done optimizing and JITing?  The store releases (and
+    /// the load acquires) everything the optimizer wrote into the group,
+    /// so a thread that sees it set may run the code without the lock.
+    int optimized () const { return m_optimized.load (std::memory_order_acquire); }
+    void optimized (int opt) { m_optimized.store (opt, std::memory_order_release); }
 
     size_t llvm_groupdata_size () const { return m_llvm_groupdata_size; }
     void llvm_groupdata_size (size_t size) { m_llvm_groupdata_size = size; }
 
+    /// Bytes of machine code JITed for the group.
+    size_t llvm_code_size () const { return m_llvm_code_size; }
+
     RunLLVMGroupFunc llvm_compiled_version() const {
         return m_llvm_compiled_version;
     }
@@ -1451,6 +1776,25 @@ public:
         if (layer < nlayers())
             m_llvm_compiled_layers[layer] = func;
     }
+    /// The function that runs all the uniform layers (those that yield
+    /// the same results for every point on an object), or NULL if there
+    /// are none.
+    RunLLVMGroupFunc llvm_compiled_uniform() const {
+        return m_llvm_compiled_uniform;
+    }
+    void llvm_compiled_uniform (RunLLVMGroupFunc func) {
+        m_llvm_compiled_uniform = func;
+    }
+
+    /// Byte ranges (offset, size) of the group data that are written by
+    /// the uniform layers, including their "run" flags.
+    typedef std::vector<std::pair<int,int> > DataRangeVec;
+    const DataRangeVec & uniform_data_ranges () const {
+        return m_uniform_data_ranges;
+    }
+
+    /// Number of layers that were found to be uniform.
+    int num_uniform_layers () const { return m_num_uniform_layers; }
 
     /// Is this shader group equivalent to ret void?
     bool does_nothing() const {
@@ -1473,6 +1817,107 @@ public:
 
     std::string serialize () const;
 
+    /// Return a string that fully describes everything about the group
+    /// that influences its runtime specialization and JIT (masters,
+    /// instance values, connections, entry layers, renderer outputs, and
+    /// raytype assumptions), so that groups with identical signatures
+    /// may share a single optimized and compiled version.  Return an
+    /// empty string if the group should never be shared (for example,
+    /// if it has interpolated parameters that could be ReParameter'ed).
+    std::string specialization_signature () const;
+
+    /// Adopt the optimized and compiled state of an identical group,
+    /// which must already be optimized.
+    void share_specialization (const ShaderGroup &src);
+
+    /// If this group's optimized state was adopted from another group,
+    /// return the ID of that group, otherwise -1.
+    int shared_from () const { return m_shared_from; }
+
+    /// If the group has been re-specialized since it was optimized (see
+    /// the "opt_respecialize" option), return the group holding its most
+    /// recent specialization, which is what actually runs when this group
+    /// is executed.  Otherwise, return the group itself.  (The load is
+    /// sequentially consistent for the sake of ShadingContext::execute_init.)
+    ShaderGroup & current_specialization () {
+        ShaderGroup *g = m_current_specialization.load ();
+        return g ? *g : *this;
+    }
+    const ShaderGroup & current_specialization () const {
+        const ShaderGroup *g = m_current_specialization.load ();
+        return g ? *g : *this;
+    }
+
+    /// If the group has been re-specialized, return a reference to its
+    /// current specialization, which keeps it alive while the caller
+    /// holds it even if a later ReParameter retires it.  Otherwise
+    /// return an empty ref.  Use this, rather than
+    /// current_specialization(), to read a specialization from outside
+    /// of a shading context.
+    ShaderGroupRef current_respecialization () const;
+
+    /// Maximum number of raytype variants of a group (see the
+    /// "opt_raytype_variants" and "opt_noderivs_raytypes" options).
+    enum { max_raytype_variants = 16 };
+
+    /// Return the variant of this group compiled for the given raytype
+    /// bits (only those it queries), with or without derivatives, or
+    /// NULL if there isn't one yet.  Safe to call while another thread is
+    /// adding variants.
+    ShaderGroup * find_raytype_variant (int raytypes, bool noderivs) const {
+        const RaytypeVariants *v = m_raytype_variants.load (std::memory_order_acquire);
+        if (v) {
+            for (int i = 0, n = v->n.load (std::memory_order_acquire);  i < n;  ++i)
+                if (v->raytypes[i] == raytypes && v->noderivs[i] == noderivs)
+                    return v->groups[i].get();
+        }
+        return nullptr;
+    }
+
+    /// Number of raytype variants of this group, and the i-th of them.
+    int num_raytype_variants () const {
+        const RaytypeVariants *v = m_raytype_variants.load (std::memory_order_acquire);
+        return v ? v->n.load (std::memory_order_acquire) : 0;
+    }
+    ShaderGroup * raytype_variant (int i) const {
+        return m_raytype_variants.load (std::memory_order_acquire)->groups[i].get();
+    }
+
+    /// Add a compiled variant for the given raytype bits.  The caller
+    /// must hold the group's lock, and there must be room for it.
+    void add_raytype_variant (int raytypes, bool noderivs,
+                              const ShaderGroupRef &variant);
+
+    /// Is this group compiled without any derivatives (a variant for
+    /// rays that don't need them)?
+    bool no_derivs () const { return m_no_derivs; }
+
+    /// Return a new, unoptimized group made of copies of this group's
+    /// layers as they were before it was optimized (with any parameter
+    /// changes since), ready to be optimized as a re-specialization.
+    /// Return an empty ref if the unoptimized layers weren't kept.
+    ///
+    /// Given the specialization of the group now in use, and the layer
+    /// whose parameter changed, only that layer and those downstream of it
+    /// are copied; the others are kept as the specialization optimized and
+    /// JITed them, if they can be.
+    ShaderGroupRef respecialization (const ShaderGroup *base = nullptr,
+                                     int changed = -1) const;
+
+    /// Was the layer kept from the specialization this one was made from,
+    /// rather than optimized and JITed again (see respecialization())?
+    bool kept_layer (int layer) const {
+        return layer >= 0 && layer < (int)m_kept_layers.size() && m_kept_layers[layer];
+    }
+    bool has_kept_layers () const { return m_kept_layers.size() != 0; }
+
+    /// Counts, by name, of param accesses and branch executions gathered
+    /// by running instrumented code (see the "pgo_instrument" option).
+    typedef std::map<std::string,long long> Profile;
+
+    /// Total time spent merging identical instances within this group.
+    double inst_merge_time () const { return m_stat_inst_merge_time; }
+
     void lock () const { m_mutex.lock(); }
     void unlock () const { m_mutex.unlock(); }
 
@@ -1488,6 +1933,13 @@ public:
     ///
     int id () const { return m_id; }
 
+    /// Return the number of times ReParameter has changed (or
+    /// re-specialized) a parameter of this group.  Together with id(),
+    /// it tells whether results computed from the parameters earlier, such
+    /// as a context's cached uniform layers, are still good.
+    int param_generation () const { return m_param_generation.load (std::memory_order_acquire); }
+    void bump_param_generation () { m_param_generation.fetch_add (1, std::memory_order_acq_rel); }
+
     /// Mark all layers as not entry points and set m_num_entry_layers to 0.
     void clear_entry_layers ();
 
@@ -1524,21 +1976,34 @@ public:
     int raytypes_on ()  const { return m_raytypes_on; }
     int raytypes_off () const { return m_raytypes_off; }
 
+    /// Is the group compiled with approximate float math (see the
+    /// "fast_math" option)?
+    bool fast_math () const { return m_fast_math; }
+
 private:
     // Put all the things that are read-only (after optimization) and
     // needed on every shade execution at the front of the struct, as much
     // together on one cache line as possible.
-    volatile int m_optimized = 0;    ///< Is it already optimized?
+    std::atomic<int> m_optimized {0}; ///< Is it already optimized?
+    std::atomic<ShaderGroup*> m_current_specialization {nullptr};
     bool m_does_nothing = false;     ///< Is the shading group just func() { return; }
     size_t m_llvm_groupdata_size = 0;///< Heap size needed for its groupdata
     int m_id;                        ///< Unique ID for the group
+    std::atomic<int> m_param_generation {0}; ///< Bumped by ReParameter
     int m_num_entry_layers = 0;      ///< Number of marked entry layers
     RunLLVMGroupFunc m_llvm_compiled_version = nullptr;
     RunLLVMGroupFunc m_llvm_compiled_init = nullptr;
+    RunLLVMGroupFunc m_llvm_compiled_uniform = nullptr;
     std::vector<RunLLVMGroupFunc> m_llvm_compiled_layers;
+    std::vector<RunLLVMGroupFunc> m_llvm_layer_funcs; ///< All layers, if JITed in partitions
+                                     ///< or if reusable_layers()
+    DataRangeVec m_uniform_data_ranges; ///< Group data set by uniform layers
+    int m_num_uniform_layers = 0;    ///< Number of uniform layers
+    int m_shared_from = -1;          ///< ID of group whose specialization we use
     std::vector<ShaderInstanceRef> m_layers;
     ustring m_name;
     int m_exec_repeat = 1;           ///< How many times to execute group
+    int m_fast_math = 0;             ///< Approximate float math?
     int m_raytype_queries = -1;      ///< Bitmask of raytypes queried
     int m_raytypes_on = 0;           ///< Bitmask of raytypes we assume to be on
     int m_raytypes_off = 0;          ///< Bitmask of raytypes we assume to be off
@@ -1562,19 +2027,169 @@ private:
     bool m_unknown_attributes_needed;
     atomic_ll m_executions {0};       ///< Number of times the group executed
     atomic_ll m_stat_total_shading_time_ticks {0}; ///< Total shading time (ticks)
+    double m_stat_inst_merge_time = 0;    ///< Time merging instances (secs)
+    double m_stat_optimize_time = 0;      ///< Time to optimize & JIT (secs)
+    double m_stat_llvm_time = 0;          ///< ... of which in LLVM (secs)
 
     // PTX assembly for compiled ShaderGroup
     std::string m_llvm_ptx_compiled_version;
+    size_t m_llvm_code_size = 0;          ///< Bytes of JITed machine code
 
     ParamValueList m_pending_params;      ///< Pending Parameter() values
     ustring m_group_use;                  ///< "Usage" of group
     bool m_complete = false;              ///< Successfully ShaderGroupEnd?
+    std::shared_ptr<ShaderGroupRegistry> m_registry; ///< Census we're in
+    int m_registry_index = -1;            ///< Our slot in m_registry's shard
+                                          ///< (-1 for variants, which are
+                                          ///< only on its JIT LRU list)
+
+    // Re-specialization: the layers as they were before optimization, and
+    // the specializations made from them since that may still be in use:
+    // the current one, and any older one some context may still be
+    // running or reading the results of (see free_retired_specializations).
+    std::vector<ShaderInstanceRef> m_pristine_layers;
+    std::vector<ShaderGroupRef> m_respecializations;
+    int m_respecialize_seq = 0;           ///< Number of the last one begun
+    int m_respecialize_published = 0;     ///< ... and of the one current
+    bool m_is_respecialization = false;   ///< Made by respecialization()?
+    std::vector<char> m_kept_layers;      ///< Layers kept from m_kept_from
+    const ShaderGroup *m_kept_from = nullptr; ///< ... until we're JITed
+
+    // Variants of the group specialized for particular ray types.  The
+    // table is allocated the first time it's needed, and entries are
+    // only ever appended (under m_mutex) and published by incrementing
+    // n, so that they can be looked up without locking.
+    struct RaytypeVariants {
+        std::atomic<int> n {0};
+        int raytypes[max_raytype_variants];
+        bool noderivs[max_raytype_variants];
+        ShaderGroupRef groups[max_raytype_variants];
+    };
+    std::atomic<RaytypeVariants*> m_raytype_variants {nullptr};
+    bool m_is_raytype_variant = false;    ///< Is this a raytype variant?
+    bool m_no_derivs = false;             ///< Compiled without derivs?
+
+    // Variants of the group that compute only a subset of its outputs,
+    // keyed on the sorted output names (guarded by m_mutex).
+    std::vector<std::pair<std::vector<ustring>,ShaderGroupRef>> m_output_subsets;
+    bool m_is_output_subset = false;      ///< Made by output_subset()?
+
+    // Profile-guided compilation.  Instrumented code (see the
+    // "pgo_instrument" option) adds to the named counters, which are in a
+    // deque so that their addresses never move.  A profile read back from
+    // such counts lays out the group data and weights the branches.
+    std::vector<std::string> m_pgo_counter_names;
+    std::deque<long long> m_pgo_counters;
+    std::shared_ptr<const Profile> m_pgo_profile;
+
+    // JIT memory budget (see "jit_memory_budget"): the memory holding
+    // the group's machine code (one per module it was JITed in) and its
+    // size while it's there, whether that code was dropped and must be
+    // JITed again before the next run, the JIT epoch of the last
+    // execution, and our place in the registry's LRU list of groups whose
+    // code is resident.
+    std::vector<std::shared_ptr<void>> m_jit_memory;
+    std::vector<std::shared_ptr<void>> m_shared_layer_funcs; ///< Shared layer code we own or call
+    std::atomic<long long> m_jit_resident_bytes {0};
+    std::atomic<bool> m_jit_evicted {false};
+    std::atomic<long long> m_jit_last_used {0};
+    std::list<std::weak_ptr<ShaderGroup>>::iterator m_jit_lru_pos;
+    bool m_in_jit_lru = false;
 
     friend class OSL::pvt::ShadingSystemImpl;
     friend class OSL::pvt::BackendLLVM;
     friend class ShadingContext;
+    friend class ShaderGroupRegistry;
 };
 
+
+
+/// The census of all extant ShaderGroups of a ShadingSystem.  Groups are
+/// spread by id across independently locked shards, so that threads
+/// building or destroying different groups at the same time almost never
+/// touch the same lock, and each group remembers its slot in its shard so
+/// that it can remove itself in O(1) when it's destroyed.
+class ShaderGroupRegistry {
+public:
+    /// Add the group to the census.  The group keeps the registry alive
+    /// and removes itself when it's destroyed.
+    void add (const ShaderGroupRef &group);
+
+    /// Remove the group (called by ~ShaderGroup).
+    void remove (ShaderGroup *group);
+
+    /// Number of groups currently registered.
+    size_t size () const;
+
+    /// Return references to all the registered groups that are still
+    /// alive.  Groups created or destroyed while this runs may or may not
+    /// be included.
+    std::vector<ShaderGroupRef> groups () const;
+
+    /// Note that the group's JITed code (of m_jit_resident_bytes) is in
+    /// memory, and that it is the most recently run of the groups whose
+    /// code is.
+    void jit_resident (ShaderGroup &group);
+
+    /// If the group's JITed code is in memory, make it the most recently
+    /// run of the groups whose code is.
+    void jit_touch (ShaderGroup &group);
+
+    /// Note that the group's JITed code is no longer in memory (called
+    /// when it's evicted, and by ~ShaderGroup).
+    void jit_dropped (ShaderGroup &group);
+
+    /// Total bytes of the JITed code in memory of all the groups.
+    long long jit_resident_bytes () const { return m_jit_resident_bytes.load(); }
+
+    /// Return the least recently run groups whose JITed code is in memory,
+    /// oldest first, except for skip, as many as it takes for their code
+    /// to total at least the given bytes.
+    std::vector<ShaderGroupRef> jit_least_recent (long long bytes,
+                                                  const ShaderGroup *skip) const;
+
+private:
+    struct Entry {
+        ShaderGroup *group;
+        std::weak_ptr<ShaderGroup> ref;
+    };
+    struct Shard {
+        mutable spin_mutex mutex;
+        std::vector<Entry> entries;
+        char pad[64];   // Keep neighboring shards' locks off the same line
+    };
+    enum { nshards = 64 };
+    Shard m_shards[nshards];
+
+    // Groups whose JITed code is in memory, least recently run first.
+    mutable spin_mutex m_jit_lru_mutex;
+    std::list<std::weak_ptr<ShaderGroup>> m_jit_lru;
+    std::atomic<long long> m_jit_resident_bytes {0};
+
+    Shard & shard (const ShaderGroup *group) {
+        return m_shards[unsigned(group->id()) % nshards];
+    }
+};
+
+// Layout of structure we use to pass noise parameters.  It starts out
+// like RendererServices::NoiseOpt, and adds what only OSL itself sets.
+struct NoiseParams {
+    int anisotropic;
+    int do_filter;
+    Vec3 direction;
+    float bandwidth;
+    float impulses;
+    int fast_math;      ///< Use approximate math (see "fast_math")
+
+    NoiseParams ()
+        : anisotropic(0), do_filter(true), direction(1.0f,0.0f,0.0f),
+          bandwidth(1.0f), impulses(16.0f), fast_math(0)
+    {
+    }
+};
+
+
+
 /// The full context for executing a shader group.
 ///
 class OSLEXECPUBLIC ShadingContext {
@@ -1653,6 +2268,10 @@ public:
     /// Return a pointer to where the symbol's data lives.
     const void *symbol_data (const Symbol &sym) const;
 
+    /// Return the symbol of the group that ran that is equivalent to sym,
+    /// which may have come from another specialization of it, or NULL.
+    const Symbol *translate_symbol (const Symbol &sym) const;
+
     /// Return a reference to a compiled regular expression for the
     /// given string, being careful to cache already-created ones so we
     /// aren't constantly compiling new ones.
@@ -1663,6 +2282,26 @@ public:
     ShaderGroup *group () { return m_group; }
     const ShaderGroup *group () const { return m_group; }
 
+    /// Is the context between execute_init and execute_cleanup of the
+    /// group, and thus possibly running its code?
+    bool executing (const ShaderGroup *group) const {
+        return m_jit_hazard.load () == group;
+    }
+
+    /// May the context be running, or have just run, the given
+    /// re-specialization (and so still need its code and symbols)?
+    bool using_specialization (const ShaderGroup *spec) const {
+        return m_spec_hazard.load () == spec;
+    }
+
+    /// Note that the context is done with the group it last ran, even to
+    /// look up its results (called when it's released).
+    void forget_specialization () {
+        m_group = nullptr;
+        m_spec_hazard.store (nullptr);
+        m_translated_symbols.clear ();
+    }
+
     /// Return a reference to the MessageList containing messages.
     ///
     MessageList & messages () { return m_messages; }
@@ -1700,7 +2339,7 @@ public:
 
     TextureOpt *texture_options_ptr () { return &m_textureopt; }
 
-    RendererServices::NoiseOpt *noise_options_ptr () { return &m_noiseopt; }
+    NoiseParams *noise_options_ptr () { return &m_noiseopt; }
 
     RendererServices::TraceOpt *trace_options_ptr () { return &m_traceopt; }
 
@@ -1716,6 +2355,8 @@ public:
     void clear_runtime_stats () {
         m_stat_get_userdata_calls = 0;
         m_stat_layers_executed = 0;
+        m_stat_uniform_cache_hits = 0;
+        m_stat_uniform_cache_misses = 0;
     }
 
     // Transfer the per-execution stats from this context to the shading
@@ -1725,6 +2366,11 @@ public:
         shadingsys().m_stat_layers_executed += m_stat_layers_executed;
     }
 
+    /// Discard all the per-object results of uniform layers that this
+    /// context has cached (done when it's released, since the renderer
+    /// may reuse the memory of an object's data after a batch of shades).
+    void clear_uniform_cache () { m_uniform_cache.clear (); }
+
     bool allow_warnings() {
         if (m_max_warnings > 0) {
             // at least one more to go
@@ -1765,11 +2411,18 @@ private:
 
     void free_dict_resources ();
 
+    /// Fill in the group data written by the group's uniform layers,
+    /// either by copying the results cached for sg.objdata or by running
+    /// the layers (and caching their results).
+    void run_uniform_layers (ShaderGroup &group, ShaderGlobals &sg);
+
     ShadingSystemImpl &m_shadingsys;    ///< Backpointer to shadingsys
     RendererServices *m_renderer;       ///< Ptr to renderer services
     PerThreadInfo *m_threadinfo;        ///< Ptr to our thread's info
     mutable TextureSystem::Perthread *m_texture_thread_info; ///< Ptr to texture thread info
     ShaderGroup *m_group;               ///< Ptr to shader group
+    std::atomic<ShaderGroup*> m_jit_hazard {nullptr}; ///< Group whose code we may run
+    std::atomic<ShaderGroup*> m_spec_hazard {nullptr}; ///< Specialization we last ran
     std::vector<char> m_heap;           ///< Heap memory
     typedef std::unordered_map<ustring, std::unique_ptr<regex>, ustringHash> RegexMap;
     RegexMap m_regex_map;               ///< Compiled regex's
@@ -1777,10 +2430,12 @@ private:
     int m_max_warnings;                 ///< To avoid processing too many warnings
     int m_stat_get_userdata_calls;      ///< Number of calls to get_userdata
     int m_stat_layers_executed;         ///< Number of layers executed
+    int m_stat_uniform_cache_hits;      ///< Uniform layers reused
+    int m_stat_uniform_cache_misses;    ///< Uniform layers run
     long long m_ticks;                  ///< Time executing the shader
 
     TextureOpt m_textureopt;            ///< texture call options
-    RendererServices::NoiseOpt m_noiseopt; ///< noise call options
+    NoiseParams m_noiseopt;             ///< noise call options
     RendererServices::TraceOpt m_traceopt; ///< trace call options
 
     SimplePool<20 * 1024> m_closure_pool;
@@ -1801,6 +2456,20 @@ private:
     GetAttribQuery m_failed_attribs[FAILED_ATTRIBS];
     int m_next_failed_attrib;
 
+    // Results of uniform layers, keyed by group ID, the group's
+    // param_generation() (lockgeom=0 params named in "uniform_attributes"
+    // may feed them, and ReParameter may change those), and objdata,
+    // holding the bytes of the group's uniform_data_ranges() back to back.
+    typedef std::tuple<int,int,void*> UniformCacheKey;
+    std::map<UniformCacheKey, std::vector<char> > m_uniform_cache;
+    static const int UNIFORM_CACHE_SIZE = 1024;
+
+    // Symbols of other specializations of a group, and the equivalent
+    // symbols of the specialization that ran (see translate_symbol).
+    // Only ever holds those of the specialization we last ran, since any
+    // other may have been freed.
+    mutable std::unordered_map<const Symbol*, std::pair<const ShaderGroup*,const Symbol*> > m_translated_symbols;
+
     // Buffering of error messages and printfs
     typedef std::pair<ErrorHandler::ErrCode, std::string> ErrorItem;
     mutable std::vector<ErrorItem> m_buffered_errors;
@@ -1826,23 +2495,6 @@ tex_interp_to_code (ustring modename)
 
 
 
-// Layout of structure we use to pass noise parameters
-struct NoiseParams {
-    int anisotropic;
-    int do_filter;
-    Vec3 direction;
-    float bandwidth;
-    float impulses;
-
-    NoiseParams ()
-        : anisotropic(0), do_filter(true), direction(1.0f,0.0f,0.0f),
-          bandwidth(1.0f), impulses(16.0f)
-    {
-    }
-};
-
-
-
 
 namespace pvt {
 
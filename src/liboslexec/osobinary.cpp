@@ -0,0 +1,268 @@
+/*
+Copyright (c) 2009-2019 Sony Pictures Imageworks Inc., et al.
+All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+* Neither the name of Sony Pictures Imageworks nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "osobinary.h"
+
+#include <OpenImageIO/filesystem.h>
+
+
+OSL_NAMESPACE_ENTER
+
+namespace pvt {   // OSL::pvt
+
+
+static bool
+valid_header (const OSOBHeader &header)
+{
+    return ! memcmp (header.magic, "OSOB", 4)
+        && header.format_version == OSOB_FORMAT_VERSION
+        && header.byte_order == osob_byte_order;
+}
+
+
+
+/// Is [data, data+size) a well-formed .osob for this version and
+/// machine, whose records all refer to strings that exist?  On success,
+/// fill in header.  Reports nothing: the caller decides whether a bad
+/// .osob matters (usually it doesn't, since the .oso can be read).
+static bool
+valid_osob (const char *data, size_t size, OSOBHeader &header)
+{
+    if (size < sizeof(header))
+        return false;
+    memcpy (&header, data, sizeof(header));
+    if (! valid_header (header))
+        return false;
+    size_t offsets_begin = sizeof(header);
+    size_t strings_begin = offsets_begin + size_t(header.nstrings) * sizeof(uint32_t);
+    size_t records_begin = strings_begin + header.strings_size;
+    size_t records_end = records_begin + size_t(header.nrecords) * sizeof(OSOBRecord);
+    if (records_end > size || (header.strings_size & 3) ||
+        (header.strings_size && data[records_begin-1] != 0))
+        return false;
+    const uint32_t *offsets = (const uint32_t *)(data + offsets_begin);
+    for (uint32_t i = 0;  i < header.nstrings;  ++i)
+        if (offsets[i] >= header.strings_size)
+            return false;
+    auto str_ok = [&](int32_t i) { return i >= 0 && uint32_t(i) < header.nstrings; };
+    const OSOBRecord *records = (const OSOBRecord *)(data + records_begin);
+    for (uint32_t r = 0;  r < header.nrecords;  ++r) {
+        const int32_t *arg = records[r].arg;
+        switch (records[r].kind) {
+        case OSOBRecord::Shader :
+            if (! str_ok (arg[0]) || ! str_ok (arg[1]))
+                return false;
+            break;
+        case OSOBRecord::Version :
+        case OSOBRecord::StructType :
+        case OSOBRecord::DefaultString :
+        case OSOBRecord::Hint :
+        case OSOBRecord::CodeMarker :
+        case OSOBRecord::InstructionArg :
+            if (! str_ok (arg[0]))
+                return false;
+            break;
+        case OSOBRecord::SymbolDecl :
+            if (! str_ok (arg[3]))
+                return false;
+            break;
+        case OSOBRecord::Instruction :
+            if (! str_ok (arg[1]))
+                return false;
+            break;
+        case OSOBRecord::DefaultInt :
+        case OSOBRecord::DefaultFloat :
+        case OSOBRecord::ParameterDone :
+        case OSOBRecord::CodeEnd :
+        case OSOBRecord::InstructionJump :
+        case OSOBRecord::InstructionEnd :
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+bool
+read_osob (const char *data, size_t size, OSOReader &reader)
+{
+    // Check the whole thing before replaying any of it, so that a bad
+    // .osob leaves the reader untouched for the .oso to be read instead.
+    OSOBHeader header;
+    if (! valid_osob (data, size, header))
+        return false;
+    // Everything past the header is 4-byte aligned relative to the start
+    // of the data, which is at least that aligned whether it's mapped or
+    // was read into an allocated buffer.
+    size_t offsets_begin = sizeof(header);
+    size_t strings_begin = offsets_begin + size_t(header.nstrings) * sizeof(uint32_t);
+    size_t records_begin = strings_begin + header.strings_size;
+    const uint32_t *offsets = (const uint32_t *)(data + offsets_begin);
+    const char *strings = data + strings_begin;
+    const OSOBRecord *records = (const OSOBRecord *)(data + records_begin);
+
+    // Strings point directly into the data. The last byte of the string
+    // data is known to be 0, so any valid offset is nul-terminated.
+    auto str = [&](int i) -> const char * { return strings + offsets[i]; };
+
+    const char *structname = nullptr;
+    for (uint32_t r = 0;  r < header.nrecords;  ++r) {
+        const int32_t *arg = records[r].arg;
+        switch (records[r].kind) {
+        case OSOBRecord::Version :
+            reader.version (str(arg[0]), arg[1], arg[2]);
+            break;
+        case OSOBRecord::Shader :
+            reader.shader (str(arg[0]), str(arg[1]));
+            break;
+        case OSOBRecord::StructType :
+            structname = str(arg[0]);
+            break;
+        case OSOBRecord::SymbolDecl : {
+            SymType symtype = SymType (arg[0] & 0xff);
+            if (symtype == SymTypeTemp && reader.stop_parsing_at_temp_symbols())
+                return true;
+            TypeSpec typespec;
+            if (structname) {
+                std::lock_guard<std::mutex> lock (OSOReader::struct_mutex);
+                typespec = TypeSpec (structname, 0);
+                structname = nullptr;
+            } else {
+                TypeDesc t (TypeDesc::BASETYPE(arg[1] & 0xff),
+                            TypeDesc::AGGREGATE((arg[1] >> 8) & 0xff),
+                            TypeDesc::VECSEMANTICS((arg[1] >> 16) & 0xff));
+                typespec = TypeSpec (t, (arg[0] & osob_closure_flag) != 0);
+            }
+            if (arg[2])
+                typespec.make_array (arg[2]);
+            reader.symbol (symtype, typespec, str(arg[3]));
+            break;
+        }
+        case OSOBRecord::DefaultInt :
+            reader.symdefault (int(arg[0]));
+            break;
+        case OSOBRecord::DefaultFloat : {
+            float f;
+            memcpy (&f, &arg[0], sizeof(f));
+            reader.symdefault (f);
+            break;
+        }
+        case OSOBRecord::DefaultString :
+            reader.symdefault (str(arg[0]));
+            break;
+        case OSOBRecord::ParameterDone :
+            reader.parameter_done ();
+            break;
+        case OSOBRecord::Hint :
+            reader.hint (string_view (str(arg[0])));
+            break;
+        case OSOBRecord::CodeMarker :
+            if (! reader.parse_code_section())
+                return true;
+            reader.codemarker (str(arg[0]));
+            break;
+        case OSOBRecord::CodeEnd :
+            reader.codeend ();
+            break;
+        case OSOBRecord::Instruction :
+            reader.instruction (arg[0], str(arg[1]));
+            break;
+        case OSOBRecord::InstructionArg :
+            reader.instruction_arg (str(arg[0]));
+            break;
+        case OSOBRecord::InstructionJump :
+            reader.instruction_jump (arg[0]);
+            break;
+        case OSOBRecord::InstructionEnd :
+            reader.instruction_end ();
+            break;
+        default:   // can't happen, valid_osob checked the kinds
+            break;
+        }
+    }
+    return true;
+}
+
+
+
+bool
+read_osob_file (const std::string &filename, OSOReader &reader)
+{
+#ifdef _WIN32
+    std::string contents;
+    size_t size = OIIO::Filesystem::file_size (filename);
+    contents.resize (size);
+    if (! size || OIIO::Filesystem::read_bytes (filename, &contents[0], size) != size)
+        return false;
+    return read_osob (contents.data(), size, reader);
+#else
+    int fd = ::open (filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat (fd, &st) == 0 && st.st_size > 0)
+        map = mmap (NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close (fd);   // The mapping keeps its own reference to the file
+    if (map == MAP_FAILED)
+        return false;
+    bool ok = read_osob ((const char *)map, size_t(st.st_size), reader);
+    munmap (map, size_t(st.st_size));
+    return ok;
+#endif
+}
+
+
+
+bool
+is_osob_file (const std::string &filename)
+{
+    OSOBHeader header;
+    return OIIO::Filesystem::read_bytes (filename, &header, sizeof(header))
+               == sizeof(header)
+        && valid_header (header);
+}
+
+
+}; // namespace pvt
+OSL_NAMESPACE_EXIT
@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2009-2019 Sony Pictures Imageworks Inc., et al.
+All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+* Neither the name of Sony Pictures Imageworks nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "osoreader.h"
+
+
+OSL_NAMESPACE_ENTER
+
+namespace pvt {
+
+// The binary object format (.osob) is a direct encoding of the stream of
+// OSOReader callbacks that parsing the equivalent .oso text would make,
+// so that anything that can consume a .oso through an OSOReader can
+// consume a .osob without going through the lexer and parser (and the
+// global lock that serializes them).  The layout is:
+//
+//     OSOBHeader
+//     uint32_t  string_offsets[nstrings]   (offsets into the string data)
+//     char      strings[strings_size]      (nul-terminated, padded to 4)
+//     OSOBRecord records[nrecords]
+//
+// All strings referenced by records are indices into the string table,
+// and each distinct string is stored only once.  Because the strings are
+// nul-terminated in place, a reader can hand pointers straight into a
+// memory-mapped file to the OSOReader callbacks without copying.
+//
+// The .osob is strictly a cache of the .oso -- it's tied to the exact
+// format version below and to the byte order of the machine that wrote
+// it, and should simply be regenerated (and is ignored) if either
+// doesn't match.
+
+/// Bump whenever the binary layout or record encoding changes.
+#define OSOB_FORMAT_VERSION 1
+
+/// The byte order marker, as the machine writing the .osob sees it.
+static const uint32_t osob_byte_order = 0x01020304;
+
+/// Bit set in a SymbolDecl's first arg for closure types.
+static const int osob_closure_flag = 0x100;
+
+struct OSOBHeader {
+    char magic[4];            ///< "OSOB"
+    uint32_t format_version;  ///< OSOB_FORMAT_VERSION
+    uint32_t byte_order;      ///< 0x01020304 as written by the creator
+    uint32_t nstrings;        ///< Number of entries in the string table
+    uint32_t strings_size;    ///< Bytes of string data (padded to 4)
+    uint32_t nrecords;        ///< Number of records
+};
+
+struct OSOBRecord {
+    enum Kind {
+        Version,          ///< str specid, int major, int minor
+        Shader,           ///< str shadertype, str name
+        StructType,       ///< str structname (for the next SymbolDecl)
+        SymbolDecl,       ///< int symtype|closure, int typedesc, int arraylen, str name
+        DefaultInt,       ///< int value
+        DefaultFloat,     ///< float value (bits)
+        DefaultString,    ///< str value
+        ParameterDone,
+        Hint,             ///< str hint
+        CodeMarker,       ///< str name
+        CodeEnd,
+        Instruction,      ///< int label, str opcode
+        InstructionArg,   ///< str name
+        InstructionJump,  ///< int target
+        InstructionEnd,
+    };
+    uint32_t kind;
+    int32_t arg[4];
+};
+
+
+
+/// OSOReader subclass that records all the callbacks resulting from
+/// parsing a .oso, and can then write them out in .osob form.  (This is
+/// part of liboslcomp, which writes the .osob next to each .oso.)
+class OSOBinaryWriter : public OSOReader {
+public:
+    OSOBinaryWriter (ErrorHandler *errhandler = NULL)
+        : OSOReader (errhandler) { }
+    virtual ~OSOBinaryWriter () { }
+
+    virtual void version (const char *specid, int major, int minor);
+    virtual void shader (const char *shadertype, const char *name);
+    virtual void symbol (SymType symtype, TypeSpec typespec, const char *name);
+    virtual void symdefault (int def);
+    virtual void symdefault (float def);
+    virtual void symdefault (const char *def);
+    virtual void parameter_done ();
+    virtual void hint (string_view hintstring);
+    virtual void codemarker (const char *name);
+    virtual void codeend ();
+    virtual void instruction (int label, const char *opcode);
+    virtual void instruction_arg (const char *name);
+    virtual void instruction_jump (int target);
+    virtual void instruction_end ();
+
+    /// Return the binary image of everything recorded so far.
+    std::string data () const;
+
+    /// Write the binary image to the named file, returning true on
+    /// success.
+    bool write_file (const std::string &filename) const;
+
+private:
+    int string_index (string_view s);
+    void add (OSOBRecord::Kind kind, int a = 0, int b = 0, int c = 0, int d = 0);
+
+    std::vector<OSOBRecord> m_records;
+    std::vector<uint32_t> m_string_offsets;
+    std::string m_strings;
+    std::unordered_map<std::string,int> m_string_index;
+};
+
+
+
+/// Replay the .osob image in [data, data+size) into the callbacks of
+/// reader, as if it had parsed the equivalent .oso.  Return false, without
+/// reporting anything or calling any of reader's callbacks, if the data is
+/// not a valid .osob for this version and machine (it's up to the caller
+/// whether that's an error, since the .oso can usually be read instead).
+/// The memory must remain valid until this returns.  (The reading
+/// functions are part of liboslexec.)
+bool read_osob (const char *data, size_t size, OSOReader &reader);
+
+/// Map the named .osob file into memory and replay it into reader.
+/// Return false, reporting nothing, if the file can't be read or isn't a
+/// valid .osob.
+bool read_osob_file (const std::string &filename, OSOReader &reader);
+
+/// Is the named file a .osob of the format this build can read?  (Cheap:
+/// only looks at the header.)
+bool is_osob_file (const std::string &filename);
+
+
+}; // namespace pvt
+OSL_NAMESPACE_EXIT
@@ -212,6 +212,7 @@ typespec
                 }
         | STRUCT IDENTIFIER
                 {
+                    std::lock_guard<std::mutex> lock (OSOReader::struct_mutex);
                     current_typespec = TypeSpec ($2, 0);
                     $$ = 0;
                 }
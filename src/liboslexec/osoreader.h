@@ -28,6 +28,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <mutex>
+
 #include <OSL/platform.h>
 #include "osl_pvt.h"
 
@@ -147,6 +149,11 @@ public:
 
     static OSOReader *osoreader;
 
+    /// Binary .osob readers run concurrently with each other and with the
+    /// (serialized) oso parser, so anything that adds to the global struct
+    /// table while reading must hold this.
+    static std::mutex struct_mutex;
+
 private:
     ErrorHandler &m_err;
     int m_lineno;
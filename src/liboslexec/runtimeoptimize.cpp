@@ -29,6 +29,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <cstdio>
 #include <cmath>
+#include <limits>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 #include <OpenImageIO/sysutil.h>
 #include <OpenImageIO/timer.h>
@@ -62,7 +66,14 @@ static ustring u_nop    ("nop"),
                u_isconnected ("isconnected"),
                u_setmessage ("setmessage"),
                u_getmessage ("getmessage"),
-               u_getattribute ("getattribute");
+               u_getattribute ("getattribute"),
+               u_lt ("lt"), u_le ("le"), u_gt ("gt"), u_ge ("ge"),
+               u_min ("min"), u_max ("max"), u_clamp ("clamp"),
+               u_arraylength ("arraylength"),
+               u_aref ("aref"), u_aassign ("aassign"),
+               u_compref ("compref"), u_compassign ("compassign"),
+               u_mxcompref ("mxcompref"), u_mxcompassign ("mxcompassign"),
+               u_mix ("mix");
 
 
 OSL_NAMESPACE_ENTER
@@ -87,6 +98,44 @@ void erase_if (Container &c, const Predicate &p)
 
 
 
+/// Hold the connections mutex, if there is one (i.e., if layers are
+/// being optimized concurrently), for the life of the object.
+class ConnectionsLock {
+public:
+    ConnectionsLock (spin_mutex *mutex) : m_mutex(mutex) {
+        if (m_mutex)
+            m_mutex->lock ();
+    }
+    ~ConnectionsLock () {
+        if (m_mutex)
+            m_mutex->unlock ();
+    }
+private:
+    spin_mutex *m_mutex;
+};
+
+
+
+/// Add the names of the messages that inst's setmessage ops set to
+/// names, and set unknown if any of them sets a message whose name is
+/// not constant.
+static void
+messages_set_by (const ShaderInstance &inst, std::vector<ustring> &names,
+                 bool &unknown)
+{
+    for (auto& op : inst.ops()) {
+        if (op.opname() == u_setmessage) {
+            const Symbol &Name (*inst.argsymbol(op.firstarg()+0));
+            if (Name.is_constant())
+                names.push_back (*(ustring *)Name.data());
+            else
+                unknown = true;
+        }
+    }
+}
+
+
+
 OSOProcessorBase::OSOProcessorBase (ShadingSystemImpl &shadingsys,
                                     ShaderGroup &group, ShadingContext *ctx)
     : m_shadingsys(shadingsys),
@@ -120,9 +169,15 @@ RuntimeOptimizer::RuntimeOptimizer (ShadingSystemImpl &shadingsys,
       m_opt_assign(shadingsys.m_opt_assign),
       m_opt_mix(shadingsys.m_opt_mix),
       m_opt_middleman(shadingsys.m_opt_middleman),
-      m_pass(0),
+      m_opt_skip_untouched_ops(shadingsys.m_opt_skip_untouched_ops),
+      m_pass(0), m_all_touched(-1), m_pass_sensitive(false),
       m_next_newconst(0), m_next_newtemp(0),
       m_stat_opt_locking_time(0), m_stat_specialization_time(0),
+      m_stat_opt_bblock_time(0), m_stat_opt_fold_time(0),
+      m_stat_opt_lifetime_time(0), m_stat_opt_cleanup_time(0),
+      m_stat_opt_passes(0), m_stat_opt_ops_visited(0),
+      m_stat_opt_ops_skipped(0), m_stat_opt_parallel_layers(0),
+      m_stat_opt_native_folds(0),
       m_stop_optimizing(false),
       m_raytypes_on(group.raytypes_on()), m_raytypes_off(group.raytypes_off())
 {
@@ -211,6 +266,7 @@ RuntimeOptimizer::set_debug ()
             m_opt_assign = true;
             m_opt_mix = true;
             m_opt_middleman = true;
+            m_opt_skip_untouched_ops = true;
         }
     }
 }
@@ -392,6 +448,7 @@ RuntimeOptimizer::turn_into_new_op (Opcode &op, ustring newop, int newarg0,
     OSL_DASSERT(opnum >= 0 && opnum < (int)inst()->ops().size());
     if (debug() > 1)
         debug_turn_into (op, 1, newop, newarg0, newarg1, newarg2, why);
+    touch_op_args (op);
     op.reset (newop, newarg2<0 ? 2 : 3);
     inst()->args()[op.firstarg()+0] = newarg0;
     op.argwriteonly (0);
@@ -404,6 +461,7 @@ RuntimeOptimizer::turn_into_new_op (Opcode &op, ustring newop, int newarg0,
         op.argreadonly (2);
         opargsym(op, 2)->mark_rw (opnum, true, false);
     }
+    touch_op_args (op);
 }
 
 
@@ -415,6 +473,8 @@ RuntimeOptimizer::turn_into_assign (Opcode &op, int newarg, string_view why)
     int opnum = &op - &(inst()->ops()[0]);
     if (debug() > 1)
         debug_turn_into (op, 1, "assign", oparg(op,0), newarg, -1, why);
+    touch_op_args (op);
+    touch_symbol (newarg);
     op.reset (u_assign, 2);
     inst()->args()[op.firstarg()+1] = newarg;
     op.argwriteonly (0);
@@ -468,6 +528,7 @@ RuntimeOptimizer::turn_into_nop (Opcode &op, string_view why)
     if (op.opname() != u_nop) {
         if (debug() > 1)
             debug_turn_into (op, 1, "nop", -1, -1, -1, why);
+        touch_op_args (op);
         op.reset (u_nop, 0);
         return 1;
     }
@@ -483,6 +544,7 @@ RuntimeOptimizer::turn_into_nop (int begin, int end, string_view why)
     for (int i = begin;  i < end;  ++i) {
         Opcode &op (inst()->ops()[i]);
         if (op.opname() != u_nop) {
+            touch_op_args (op);
             op.reset (u_nop, 0);
             ++changed;
         }
@@ -591,6 +653,8 @@ RuntimeOptimizer::insert_code (int opnum, ustring opname,
         for (int a = 0;  a < nargs;  ++a)
             inst()->symbol(args_to_add[a])->mark_rw (opnum, a>0, a==0);
     }
+    for (int a = 0;  a < nargs;  ++a)
+        touch_symbol (args_to_add[a]);
 }
 
 void
@@ -1374,7 +1438,10 @@ RuntimeOptimizer::make_param_use_instanceval (Symbol *R, string_view why)
         R->initend (0);
     }
     // Erase R's incoming connections
-    erase_if (inst()->connections(), ConnectionDestIs(*inst(),R));
+    {
+        ConnectionsLock lock (m_connections_mutex);
+        erase_if (inst()->connections(), ConnectionDestIs(*inst(),R));
+    }
 }
 
 
@@ -1786,6 +1853,7 @@ RuntimeOptimizer::mark_outgoing_connections ()
     inst()->outgoing_connections (false);
     FOREACH_PARAM (auto&& s, inst())
         s.connected_down (false);
+    ConnectionsLock lock (m_connections_mutex);
     for (int lay = layer()+1;  lay < group().nlayers();  ++lay) {
         for (auto&& c : group()[lay]->m_connections)
             if (c.srclayer == layer()) {
@@ -1822,7 +1890,10 @@ RuntimeOptimizer::remove_unused_params ()
     }
 
     // Get rid of the Connections themselves
-    erase_if (inst()->connections(), param_never_used);
+    {
+        ConnectionsLock lock (m_connections_mutex);
+        erase_if (inst()->connections(), param_never_used);
+    }
 
     return alterations;
 }
@@ -1902,6 +1973,8 @@ RuntimeOptimizer::eliminate_middleman ()
         }
         if (upstream_layer < 0 || upstream_symbol < 0)
             continue;  // not a complete connection, forget it
+        if (group().kept_layer (upstream_layer))
+            continue;  // its code only writes the connections it had
             
         ShaderInstance *upinst = group()[upstream_layer];
         if (debug() > 1)
@@ -2052,6 +2125,44 @@ RuntimeOptimizer::copy_block_aliases (const FastIntMap &old_block_aliases,
 
 
 
+bool
+RuntimeOptimizer::op_touched (int opnum)
+{
+    if (! m_opt_skip_untouched_ops || m_pass == 0 || m_all_touched >= m_pass-1)
+        return true;
+    const Opcode &op (inst()->ops()[opnum]);
+    // Control flow, side effects, and ops whose folders depend on state
+    // gathered along the way (messages set) or on the pass number (mix)
+    // are always revisited.
+    ustring opname = op.opname();
+    if (op.jump(0) >= 0 || opname == u_setmessage ||
+        opname == u_getmessage || opname == u_mix)
+        return true;
+    const OpDescriptor *opd = shadingsys().op_descriptor (opname);
+    if (opd && (opd->flags & OpDescriptor::SideEffects))
+        return true;
+    auto uses_touched = [&](const Opcode &o) {
+        for (int i = 0, e = o.nargs();  i < e;  ++i) {
+            int sym = inst()->arg(o.firstarg()+i);
+            if (sym >= 0 && sym < (int)m_sym_touched.size() &&
+                  m_sym_touched[sym] >= m_pass-1)
+                return true;
+        }
+        return false;
+    };
+    if (uses_touched (op))
+        return true;
+    // peephole2 looks at this op together with the next one in its block
+    if (optimize() >= 2 && m_opt_peephole) {
+        int op2num = next_block_instruction (opnum);
+        if (op2num && uses_touched (inst()->ops()[op2num]))
+            return true;
+    }
+    return false;
+}
+
+
+
 int
 RuntimeOptimizer::optimize_ops (int beginop, int endop,
                                 FastIntMap *seed_block_aliases)
@@ -2125,7 +2236,12 @@ RuntimeOptimizer::optimize_ops (int beginop, int endop,
         for (int i = 0, e = op->nargs();  i < e;  ++i) {
             if (! op->argwrite(i)) { // Don't de-alias args that are written
                 int argindex = op->firstarg() + i;
-                int argsymindex = dealias_symbol (inst()->arg(argindex), opnum);
+                int oldsymindex = inst()->arg(argindex);
+                int argsymindex = dealias_symbol (oldsymindex, opnum);
+                if (argsymindex != oldsymindex) {
+                    touch_symbol (oldsymindex);
+                    touch_symbol (argsymindex);
+                }
                 inst()->args()[argindex] = argsymindex;
             }
             if (op->argread(i))
@@ -2141,9 +2257,17 @@ RuntimeOptimizer::optimize_ops (int beginop, int endop,
         // can add a few consts if we need to, without worrying about
         // the addresses of symbols changing when we add a new one below.
         make_symbol_room (max_new_consts_per_fold);
+        // With opt_skip_untouched_ops, ops whose args were untouched by
+        // the last pass get only the bookkeeping above and the
+        // assignment handling below (which records block aliases).
+        bool revisit = op_touched (opnum);
+        if (revisit)
+            ++m_stat_opt_ops_visited;
+        else
+            ++m_stat_opt_ops_skipped;
         // For various ops that we know how to effectively
         // constant-fold, dispatch to the appropriate routine.
-        if (optimize() >= 2 && m_opt_constant_fold) {
+        if (revisit && optimize() >= 2 && m_opt_constant_fold) {
             if (opd && opd->folder) {
                 int c = (*opd->folder) (*this, opnum);
                 if (c) {
@@ -2154,6 +2278,7 @@ RuntimeOptimizer::optimize_ops (int beginop, int endop,
                     endop += num_ops - old_num_ops; // adjust how far we loop
                     old_num_ops = num_ops;
                     op = &inst()->ops()[opnum];  // in case ops resized
+                    touch_op_args (*op);
                 }
             }
         }
@@ -2162,16 +2287,21 @@ RuntimeOptimizer::optimize_ops (int beginop, int endop,
         block_unalias_written_args (*op);
 
         // Now we handle assignments.
-        if (optimize() >= 2 && op->opname() == u_assign && m_opt_assign)
-            changed += optimize_assignment (*op, opnum);
-        if (optimize() >= 2 && m_opt_elide_useless_ops && opd
+        if (optimize() >= 2 && op->opname() == u_assign && m_opt_assign) {
+            int c = optimize_assignment (*op, opnum);
+            if (c)
+                touch_op_args (*op);
+            changed += c;
+        }
+        if (revisit && optimize() >= 2 && m_opt_elide_useless_ops && opd
             && !(opd->flags & OpDescriptor::SideEffects))
             changed += useless_op_elision (*op, opnum);
         if (m_stop_optimizing)
             break;
         // Peephole optimization involving pair of instructions (the second
         // instruction will be in the same basic block.
-        if (optimize() >= 2 && m_opt_peephole && op->opname() != u_nop) {
+        if (revisit && optimize() >= 2 && m_opt_peephole &&
+              op->opname() != u_nop) {
             // Find the next instruction in the same basic block
             int op2num = next_block_instruction (opnum);
             if (op2num) {
@@ -2184,6 +2314,8 @@ RuntimeOptimizer::optimize_ops (int beginop, int endop,
                     endop += num_ops - old_num_ops; // adjust how far we loop
                     old_num_ops = num_ops;
                     op = &inst()->ops()[opnum];  // in case ops resized
+                    touch_op_args (*op);
+                    touch_op_args (inst()->ops()[op2num]);
                 }
             }
         }
@@ -2287,9 +2419,24 @@ RuntimeOptimizer::optimize_instance ()
     // passes, but we have a hard cutoff just to be sure we don't
     // ever get into an infinite loop from an unforseen cycle where we
     // end up inadvertently transforming A => B => A => etc.
+    //
+    // With opt_skip_untouched_ops, every change to the code (and every
+    // change of a symbol's lifetime) "touches" the symbols involved, and
+    // after the first pass only the ops using touched symbols are
+    // optimized again.
+    // We stop as soon as a pass touches nothing, rather than making
+    // several extra passes over unchanged code to be sure.
     int totalchanged = 0;
     int reallydone = 0;   // Force a few passes after we think we're done
     int npasses = shadingsys().opt_passes();
+    m_sym_touched.assign (inst()->symbols().size(), -1);
+    m_all_touched = -1;
+    m_pass_sensitive = false;
+    if (m_opt_mix)
+        for (auto&& op : inst()->ops())
+            if (op.opname() == u_mix)
+                m_pass_sensitive = true;
+    std::vector<int> lifetimes;
     for (m_pass = 0;  m_pass < npasses;  ++m_pass) {
 
         // Once we've made one pass (and therefore called
@@ -2304,10 +2451,16 @@ RuntimeOptimizer::optimize_instance ()
         if (debug() > 1)
             debug_optf("layer %d \"%s\", pass %d:\n",
                        layer(), inst()->layername(), m_pass);
+        Timer pass_timer;
+        long long visited = m_stat_opt_ops_visited;
+        long long skipped = m_stat_opt_ops_skipped;
+        ++m_stat_opt_passes;
 
         // Track basic blocks and conditional states
+        Timer phase_timer;
         find_conditionals ();
         find_basic_blocks ();
+        m_stat_opt_bblock_time += phase_timer.lap();
 
         // Clear local messages for this instance
         m_local_unknown_message_sent = false;
@@ -2321,34 +2474,81 @@ RuntimeOptimizer::optimize_instance ()
         // Here is the meat of the optimization, where we pass over the
         // code for this instance and make various transformations.
         int changed = optimize_ops (0, (int)inst()->ops().size());
+        m_stat_opt_fold_time += phase_timer.lap();
 
         // Now that we've rewritten the code, we need to re-track the
-        // variable lifetimes.
+        // variable lifetimes.  Symbols whose lifetimes change are
+        // touched, since that may enable new optimizations of their ops.
+        if (m_opt_skip_untouched_ops) {
+            lifetimes.clear ();
+            for (auto&& s : inst()->symbols()) {
+                lifetimes.push_back (s.firstread());
+                lifetimes.push_back (s.lastread());
+                lifetimes.push_back (s.firstwrite());
+                lifetimes.push_back (s.lastwrite());
+            }
+        }
         track_variable_lifetimes ();
+        if (m_opt_skip_untouched_ops) {
+            for (int i = 0, e = (int)inst()->symbols().size();  i < e;  ++i) {
+                const Symbol &s (*inst()->symbol(i));
+                if (s.firstread() != lifetimes[4*i+0] ||
+                    s.lastread() != lifetimes[4*i+1] ||
+                    s.firstwrite() != lifetimes[4*i+2] ||
+                    s.lastwrite() != lifetimes[4*i+3])
+                    touch_symbol (i);
+            }
+        }
 
         // Recompute which of our params have downstream connections.
         mark_outgoing_connections ();
+        m_stat_opt_lifetime_time += phase_timer.lap();
 
         // Find situations where an output is simply a copy of a connected
         // input, and eliminate the middleman.
+        int cleanups = 0;
         if (optimize() >= 2 && m_opt_middleman) {
             int c = eliminate_middleman ();
             if (c)
                 mark_outgoing_connections ();
-            changed += c;
+            cleanups += c;
         }
 
         // Elide unconnected parameters that are never read.
         if (optimize() >= 1)
-            changed += remove_unused_params ();
+            cleanups += remove_unused_params ();
+        m_stat_opt_cleanup_time += phase_timer.lap();
+
+        // Changes to connections and params can affect any op.
+        if (cleanups)
+            m_all_touched = m_pass;
+        changed += cleanups;
 
         // FIXME -- we should re-evaluate whether writes_globals() is still
         // true for this layer.
 
+        if (debug() > 1)
+            debug_optf("layer %d \"%s\", pass %d: %d changes, %lld ops optimized, %lld skipped, %1.2fms\n",
+                       layer(), inst()->layername(), m_pass, changed,
+                       m_stat_opt_ops_visited - visited,
+                       m_stat_opt_ops_skipped - skipped,
+                       pass_timer() * 1000.0);
+
+        totalchanged += changed;
+        if (m_opt_skip_untouched_ops) {
+            // Nothing touched this pass means nothing to revisit in the
+            // next, except that mix folds differently in the first few.
+            bool touched = (m_all_touched == m_pass);
+            for (int t : m_sym_touched)
+                touched |= (t == m_pass);
+            if (! touched && changed < 1 && (! m_pass_sensitive || m_pass >= 3))
+                break;
+            continue;
+        }
+
         // If nothing changed, we're done optimizing.  But wait, it may be
         // that after re-tracking variable lifetimes, we can notice new
         // optimizations!  So force another pass, then we're really done.
-        totalchanged += changed;
         if (changed < 1) {
             if (++reallydone > 3)
                 break;
@@ -2362,7 +2562,10 @@ RuntimeOptimizer::optimize_instance ()
     // longer needed at all.
     if (inst()->unused()) {
         // Not needed.  Remove all its connections and ops.
-        inst()->connections().clear ();
+        {
+            ConnectionsLock lock (m_connections_mutex);
+            inst()->connections().clear ();
+        }
         turn_into_nop (0, (int)inst()->ops().size()-1,
                        debug() > 1 ? Strutil::sprintf("eliminate layer %s with no outward connections", inst()->layername().c_str()).c_str() : "");
         for (auto&& s : inst()->symbols())
@@ -2372,15 +2575,149 @@ RuntimeOptimizer::optimize_instance ()
     // Now that we've optimized this layer, walk through the ops and
     // note which messages may have been sent, so subsequent layers will
     // know.
-    for (auto& op : inst()->ops()) {
-        if (op.opname() == u_setmessage) {
-            Symbol &Name (*inst()->argsymbol(op.firstarg()+0));
-            if (Name.is_constant())
-                m_messages_sent.push_back (*(ustring *)Name.data());
-            else
-                m_unknown_message_sent = true;
-        }
-    }
+    messages_set_by (*inst(), m_messages_sent, m_unknown_message_sent);
+}
+
+
+
+void
+RuntimeOptimizer::optimize_layers_parallel (int nthreads)
+{
+    int nlayers = (int) group().nlayers ();
+
+    // A layer's level in the connection DAG is one more than the highest
+    // level of the layers it reads from.  The layers of one level don't
+    // depend on each other, so once the lower levels are done they can
+    // all be optimized at once.
+    std::vector<int> level (nlayers, 0);
+    int nlevels = 0;
+    for (int layer = 0;  layer < nlayers;  ++layer) {
+        for (auto&& c : group()[layer]->connections())
+            level[layer] = std::max (level[layer], level[c.srclayer] + 1);
+        nlevels = std::max (nlevels, level[layer] + 1);
+    }
+
+    spin_mutex connections_mutex;
+    std::vector<char> done (nlayers, false);
+    std::vector<int> todo;
+    std::vector<std::unique_ptr<RuntimeOptimizer>> rops;
+    for (int lev = 0;  lev < nlevels;  ++lev) {
+        todo.clear ();
+        for (int layer = 0;  layer < nlayers;  ++layer)
+            if (level[layer] == lev && ! group().kept_layer (layer))
+                todo.push_back (layer);
+        int ntodo = (int) todo.size();
+        rops.clear ();
+        rops.resize (ntodo);
+
+        // The other layers of this level are being rewritten by other
+        // threads while we optimize, so take note of the messages they
+        // set before any thread starts, and consult only the notes.
+        std::vector<std::vector<ustring>> level_messages (ntodo);
+        std::vector<char> level_unknown (ntodo, false);
+        for (int i = 0;  i < ntodo;  ++i) {
+            bool unknown = false;
+            messages_set_by (*group()[todo[i]], level_messages[i], unknown);
+            level_unknown[i] = unknown;
+        }
+
+        // Each layer gets an optimizer of its own, seeded with what the
+        // finished layers have told us.  A layer may only count on a
+        // message not being set if no earlier layer could set it, so it
+        // also gets the messages that earlier, unfinished layers might set.
+        // Middleman elimination changes downstream layers' connections,
+        // so it is left for the backward pass when a level has several
+        // layers.
+        auto optimize_layer = [&](int i, ShadingContext *ctx) {
+            int layer = todo[i];
+            rops[i].reset (new RuntimeOptimizer (shadingsys(), group(), ctx));
+            RuntimeOptimizer &rop (*rops[i]);
+            rop.m_opt_middleman = m_opt_middleman && ntodo == 1;
+            rop.m_connections_mutex = &connections_mutex;
+            rop.m_params_holding_globals = m_params_holding_globals;
+            rop.m_next_newconst = m_next_newconst;
+            rop.m_next_newtemp = m_next_newtemp;
+            rop.m_messages_sent = m_messages_sent;
+            rop.m_unknown_message_sent = m_unknown_message_sent;
+            for (int up = 0;  up < layer;  ++up) {
+                if (group().kept_layer (up)) {
+                    // Its ops are gone, so we can't tell what it sets
+                    rop.m_unknown_message_sent |= ! group()[up]->unused();
+                    continue;
+                }
+                if (done[up])
+                    continue;
+                if (level[up] == lev) {
+                    int j = int (std::find (todo.begin(), todo.end(), up)
+                                 - todo.begin());
+                    rop.m_messages_sent.insert (rop.m_messages_sent.end(),
+                                                level_messages[j].begin(),
+                                                level_messages[j].end());
+                    rop.m_unknown_message_sent |= bool (level_unknown[j]);
+                } else {
+                    // Later levels aren't touched until this one is done
+                    messages_set_by (*group()[up], rop.m_messages_sent,
+                                     rop.m_unknown_message_sent);
+                }
+            }
+            rop.set_inst (layer);
+            if (rop.inst()->unused())
+                return;
+            CompileTraceSpan layer_trace (shadingsys(), "optimize_layer",
+                                          rop.inst()->layername());
+            rop.resolve_isconnected ();
+            rop.optimize_instance ();
+        };
+
+        // Like the partitioned JIT, each extra thread needs a context of
+        // its own; we take part ourselves.
+        std::atomic<int> next (0);
+        auto worker = [&](ShadingContext *ctx) {
+            for (int i = next++;  i < ntodo;  i = next++)
+                optimize_layer (i, ctx);
+        };
+        OIIO::thread_group threads;
+        for (int t = 1;  t < std::min (nthreads, ntodo);  ++t) {
+            threads.add_thread (new std::thread ([&](){
+                PerThreadInfo *thread_info = shadingsys().create_thread_info();
+                ShadingContext *ctx = shadingsys().get_context (thread_info);
+                worker (ctx);
+                shadingsys().release_context (ctx);
+                shadingsys().destroy_thread_info (thread_info);
+            }));
+        }
+        worker (shadingcontext());
+        threads.join_all ();
+
+        // Gather what the finished layers tell the later ones
+        for (int i = 0;  i < ntodo;  ++i) {
+            int layer = todo[i];
+            RuntimeOptimizer &rop (*rops[i]);
+            m_params_holding_globals[layer].swap (rop.m_params_holding_globals[layer]);
+            m_next_newconst = std::max (m_next_newconst, rop.m_next_newconst);
+            m_next_newtemp = std::max (m_next_newtemp, rop.m_next_newtemp);
+            if (! group()[layer]->unused())
+                messages_set_by (*group()[layer], m_messages_sent,
+                                 m_unknown_message_sent);
+            m_stat_opt_bblock_time += rop.m_stat_opt_bblock_time;
+            m_stat_opt_fold_time += rop.m_stat_opt_fold_time;
+            m_stat_opt_lifetime_time += rop.m_stat_opt_lifetime_time;
+            m_stat_opt_cleanup_time += rop.m_stat_opt_cleanup_time;
+            m_stat_opt_passes += rop.m_stat_opt_passes;
+            m_stat_opt_ops_visited += rop.m_stat_opt_ops_visited;
+            m_stat_opt_ops_skipped += rop.m_stat_opt_ops_skipped;
+            m_stat_opt_native_folds += rop.m_stat_opt_native_folds;
+            done[layer] = true;
+        }
+        if (ntodo > 1)
+            m_stat_opt_parallel_layers += ntodo;
+    }
+    rops.clear ();
+
+    // Kept layers' ops are gone, so we can't tell what messages they set
+    for (int layer = 0;  layer < nlayers;  ++layer)
+        if (group().kept_layer (layer) && ! group()[layer]->unused())
+            m_unknown_message_sent = true;
 }
 
 
@@ -2546,6 +2883,16 @@ RuntimeOptimizer::track_variable_dependencies ()
     // cause them to be reassigned in exactly the way that confuses this
     // analysis).
 
+    // A group compiled for rays that don't need differentials carries no
+    // derivatives at all, no matter what its ops would like -- they all
+    // get zero derivs (except texture lookups, which get their filter
+    // widths from the ShaderGlobals; see llvm_gen_texture).
+    if (group().no_derivs()) {
+        for (auto&& s : inst()->symbols())
+            s.has_derivs (false);
+        return;
+    }
+
     symdeps.clear ();
 
     std::vector<int> read, written;
@@ -2919,6 +3266,318 @@ RuntimeOptimizer::collapse_ops ()
 
 
 
+bool
+RuntimeOptimizer::uniform_getattribute (const Opcode &op)
+{
+    // Same flavors as in constfold_getattribute: an optional object name
+    // and array index around the attribute name and destination.
+    int nargs = op.nargs();
+    bool array_lookup = opargsym(op,nargs-2)->typespec().is_int();
+    bool object_lookup = opargsym(op,2)->typespec().is_string() && nargs >= 4;
+    const Symbol &ObjectName (*opargsym (op, 1));
+    const Symbol &Attribute (*opargsym (op, 1 + (int)object_lookup));
+    const Symbol &Index (*opargsym (op, nargs-2));
+    const Symbol &Destination (*opargsym (op, nargs-1));
+    if (! Attribute.is_constant() ||
+        (object_lookup && ! ObjectName.is_constant()) ||
+        (array_lookup && ! Index.is_constant()))
+        return false;
+    // Derivatives are inherently per point.
+    if (Destination.has_derivs())
+        return false;
+    return shadingsys().uniform_attribute (*(const ustring *)Attribute.data());
+}
+
+
+
+int
+RuntimeOptimizer::classify_uniform_layers ()
+{
+    int nlayers = (int) group().nlayers ();
+    int nuniform = 0;
+    for (int layer = 0;  layer < nlayers;  ++layer) {
+        set_inst (layer);
+        ShaderInstance *in = inst();
+        if (group().kept_layer (layer)) {
+            // As it was classified when it was JITed
+            nuniform += in->uniform();
+            continue;
+        }
+        in->uniform (false);
+        // The last layer is run for every point no matter what, and
+        // there's nothing to be gained for layers that don't run at all.
+        if (in->unused() || in->empty_instance() || in->last_layer())
+            continue;
+        bool uniform = true;
+        // All upstream layers it reads from must themselves be uniform.
+        for (auto&& c : in->connections()) {
+            if (! group()[c.srclayer]->uniform()) {
+                uniform = false;
+                break;
+            }
+        }
+        // Anything that touches the shader globals, interpolated
+        // parameters (other than userdata the renderer says is the same
+        // over each object), or closures (which live in the per-execution
+        // pools) can differ from point to point.  (The lockgeom=0 params
+        // that are let through may still be changed by ReParameter, which
+        // bumps the group's param_generation, part of the key under which
+        // contexts cache the results.)
+        FOREACH_SYM (Symbol &s, in) {
+            if (! uniform)
+                break;
+            if (s.symtype() == SymTypeGlobal && s.everused())
+                uniform = false;
+            else if ((s.symtype() == SymTypeParam || s.symtype() == SymTypeOutputParam)
+                     && ! s.lockgeom() && ! shadingsys().uniform_attribute (s.name()))
+                uniform = false;
+            else if (s.typespec().is_closure_based())
+                uniform = false;
+        }
+        // Every op must be free of side effects and computed only from
+        // its arguments, or be a getattribute of per-object data.
+        for (auto&& op : in->ops()) {
+            if (! uniform)
+                break;
+            if (op.opname() == u_getattribute) {
+                uniform = uniform_getattribute (op);
+                continue;
+            }
+            const OpDescriptor *opd = shadingsys().op_descriptor (op.opname());
+            if (! opd || (opd->flags & (OpDescriptor::SideEffects |
+                                        OpDescriptor::Varying)))
+                uniform = false;
+        }
+        in->uniform (uniform);
+        nuniform += uniform;
+    }
+    return nuniform;
+}
+
+
+
+
+void
+RuntimeOptimizer::int_value_range (int opnum, int sym, int &lo, int &hi,
+                                   int depth)
+{
+    lo = std::numeric_limits<int>::min();
+    hi = std::numeric_limits<int>::max();
+    const Symbol &S (*symbol(sym));
+    if (! S.typespec().is_int() || depth > 8)
+        return;
+    if (S.is_constant()) {
+        lo = hi = *(const int *)S.data();
+        return;
+    }
+    // Loop induction variables, inside the body of their loop
+    for (auto&& r : m_induction_ranges) {
+        if (r.sym == sym && opnum >= r.bodybegin && opnum < r.bodyend) {
+            lo = r.lo;
+            hi = r.hi;
+            return;
+        }
+    }
+    // Otherwise, we can only reason about a local whose value was set
+    // earlier in the same basic block.  (Temps may be coalesced, so
+    // there may be other writes elsewhere.)
+    if (S.symtype() != SymTypeLocal && S.symtype() != SymTypeTemp)
+        return;
+    OpcodeVec &code (inst()->ops());
+    int w = -1;
+    for (int i = opnum-1;  i >= 0 && w < 0 && bblockid(i) == bblockid(opnum);  --i)
+        for (int a = 0;  a < code[i].nargs();  ++a)
+            if (code[i].argwrite(a) && oparg(code[i],a) == sym)
+                w = i;
+    if (w < 0)
+        return;
+    Opcode &op (code[w]);
+    ustring opname = op.opname();
+    int alo, ahi, blo, bhi;
+    if (opname == u_assign) {
+        int_value_range (w, oparg(op,1), lo, hi, depth+1);
+    } else if (opname == u_arraylength) {
+        int len = opargsym(op,1)->typespec().arraylength();
+        if (len > 0)
+            lo = hi = len;
+    } else if (opname == u_add || opname == u_sub) {
+        int_value_range (w, oparg(op,1), alo, ahi, depth+1);
+        int_value_range (w, oparg(op,2), blo, bhi, depth+1);
+        long long l = opname == u_add ? (long long)alo + blo : (long long)alo - bhi;
+        long long h = opname == u_add ? (long long)ahi + bhi : (long long)ahi - blo;
+        if (l >= std::numeric_limits<int>::min() && h <= std::numeric_limits<int>::max()) {
+            lo = int(l);
+            hi = int(h);
+        }
+    } else if (opname == u_min || opname == u_max) {
+        int_value_range (w, oparg(op,1), alo, ahi, depth+1);
+        int_value_range (w, oparg(op,2), blo, bhi, depth+1);
+        if (opname == u_min) {
+            lo = std::min (alo, blo);
+            hi = std::min (ahi, bhi);
+        } else {
+            lo = std::max (alo, blo);
+            hi = std::max (ahi, bhi);
+        }
+    } else if (opname == u_clamp) {
+        // clamp(x,a,b) == min(max(x,a),b)
+        int xlo, xhi;
+        int_value_range (w, oparg(op,1), xlo, xhi, depth+1);
+        int_value_range (w, oparg(op,2), alo, ahi, depth+1);
+        int_value_range (w, oparg(op,3), blo, bhi, depth+1);
+        lo = std::min (std::max (xlo, alo), blo);
+        hi = std::min (std::max (xhi, ahi), bhi);
+    }
+}
+
+
+
+void
+RuntimeOptimizer::find_induction_range (int opnum)
+{
+    OpcodeVec &code (inst()->ops());
+    Opcode &loop (code[opnum]);
+    int condbegin = loop.jump(0), bodybegin = loop.jump(1);
+    int iterbegin = loop.jump(2), loopend = loop.jump(3);
+    if (condbegin < 0 || bodybegin < 0 || iterbegin < 0 || loopend < 0)
+        return;
+
+    // The init, condition, and iteration code must be straight-line code
+    // (no short-circuited conditions, etc.).
+    for (int i = opnum+1;  i < bodybegin;  ++i)
+        if (code[i].jump(0) >= 0)
+            return;
+    for (int i = iterbegin;  i < loopend;  ++i)
+        if (code[i].jump(0) >= 0)
+            return;
+
+    // The condition must be a comparison of a local int and a bound.
+    int cond = oparg (loop, 0);
+    int cmpop = -1;
+    for (int i = condbegin;  i < bodybegin;  ++i)
+        if (code[i].nargs() && code[i].argwrite(0) && oparg(code[i],0) == cond)
+            cmpop = i;
+    if (cmpop < 0)
+        return;
+    Opcode &cmp (code[cmpop]);
+    ustring cmpname = cmp.opname();
+    if (cmpname != u_lt && cmpname != u_le && cmpname != u_gt && cmpname != u_ge)
+        return;
+    int var = oparg (cmp, 1);
+    const Symbol &V (*symbol(var));
+    if (! V.typespec().is_int() || V.typespec().is_array() ||
+        (V.symtype() != SymTypeLocal && V.symtype() != SymTypeTemp))
+        return;
+
+    // It must be set in the init code, then only modified by adding or
+    // subtracting a constant in the iteration code.
+    int initop = -1, stepop = -1;
+    for (int i = opnum+1;  i < loopend;  ++i) {
+        Opcode &op (code[i]);
+        for (int a = 0;  a < op.nargs();  ++a) {
+            if (! op.argwrite(a) || oparg(op,a) != var)
+                continue;
+            if (i < condbegin)
+                initop = i;
+            else if (i >= iterbegin && stepop < 0)
+                stepop = i;
+            else
+                return;   // written in the condition or body, or twice
+        }
+    }
+    if (initop < 0 || stepop < 0 || code[initop].opname() != u_assign)
+        return;
+    Opcode &stepo (code[stepop]);
+    if ((stepo.opname() != u_add && stepo.opname() != u_sub) ||
+        oparg(stepo,1) != var || ! opargsym(stepo,2)->is_constant() ||
+        ! opargsym(stepo,2)->typespec().is_int())
+        return;
+    long long step = *(const int *)opargsym(stepo,2)->data();
+    if (stepo.opname() == u_sub)
+        step = -step;
+
+    int initlo, inithi, boundlo, boundhi;
+    int_value_range (initop, oparg(code[initop],1), initlo, inithi);
+    int_value_range (cmpop, oparg(cmp,2), boundlo, boundhi);
+    long long lo, hi;
+    if (step > 0 && (cmpname == u_lt || cmpname == u_le)) {
+        lo = initlo;
+        hi = cmpname == u_lt ? (long long)boundhi - 1 : (long long)boundhi;
+    } else if (step < 0 && (cmpname == u_gt || cmpname == u_ge)) {
+        lo = cmpname == u_gt ? (long long)boundlo + 1 : (long long)boundlo;
+        hi = inithi;
+    } else {
+        return;
+    }
+    // The step past the bound must not wrap around.
+    if (hi + step > std::numeric_limits<int>::max() ||
+        lo + step < std::numeric_limits<int>::min() || lo > hi)
+        return;
+    m_induction_ranges.push_back ({ var, bodybegin, iterbegin, int(lo), int(hi) });
+}
+
+
+
+int
+RuntimeOptimizer::eliminate_range_checks ()
+{
+    OpcodeVec &code (inst()->ops());
+    find_basic_blocks ();
+    // Outer loops come first, so their ranges are known when looking
+    // at the loops nested inside them.
+    m_induction_ranges.clear ();
+    for (int opnum = 0, e = (int)code.size();  opnum < e;  ++opnum)
+        if (code[opnum].opname() == u_for || code[opnum].opname() == u_while)
+            find_induction_range (opnum);
+
+    int neliminated = 0;
+    for (int opnum = 0, e = (int)code.size();  opnum < e;  ++opnum) {
+        Opcode &op (code[opnum]);
+        ustring opname = op.opname();
+        int index[2] = { -1, -1 };
+        int len = 0;
+        if (opname == u_aref) {
+            index[0] = oparg (op, 2);
+            len = opargsym(op,1)->typespec().arraylength();
+        } else if (opname == u_aassign) {
+            index[0] = oparg (op, 1);
+            len = opargsym(op,0)->typespec().arraylength();
+        } else if (opname == u_compref) {
+            index[0] = oparg (op, 2);
+            len = 3;
+        } else if (opname == u_compassign) {
+            index[0] = oparg (op, 1);
+            len = 3;
+        } else if (opname == u_mxcompref) {
+            index[0] = oparg (op, 2);
+            index[1] = oparg (op, 3);
+            len = 4;
+        } else if (opname == u_mxcompassign) {
+            index[0] = oparg (op, 1);
+            index[1] = oparg (op, 2);
+            len = 4;
+        }
+        if (len <= 0)
+            continue;
+        bool inrange = true, allconst = true;
+        for (int i : index) {
+            if (i < 0)
+                continue;
+            int lo, hi;
+            int_value_range (opnum, i, lo, hi);
+            inrange &= (lo >= 0 && hi < len);
+            allconst &= symbol(i)->is_constant();
+        }
+        op.index_in_range (inrange);
+        // Constant indices in range were never checked at runtime
+        // (except by the matrix ops), so don't count them.
+        if (inrange && (! allconst || index[1] >= 0))
+            ++neliminated;
+    }
+    return neliminated;
+}
+
+
 std::ostream &
 RuntimeOptimizer::printinst (std::ostream &out) const
 {
@@ -2933,6 +3592,7 @@ RuntimeOptimizer::printinst (std::ostream &out) const
     out << (inst()->renderer_outputs() ? " renderer_outputs" : "");
     out << (inst()->writes_globals() ? " writes_globals" : "");
     out << (inst()->entry_layer() ? " entry_layer" : "");
+    out << (inst()->uniform() ? " uniform" : "");
     out << (inst()->last_layer() ? " last_layer" : "");
     out << "\n";
     out << "  symbols:\n";
@@ -3017,6 +3677,7 @@ void
 RuntimeOptimizer::run ()
 {
     Timer rop_timer;
+    CompileTraceSpan trace (shadingsys(), "rop_setup", group().name());
     int nlayers = (int) group().nlayers ();
     if (debug())
         shadingcontext()->infof("About to optimize shader group %s (%d layers):",
@@ -3024,7 +3685,13 @@ RuntimeOptimizer::run ()
     if (debug())
         std::cout << "About to optimize shader group " << group().name() << "\n";
 
+    // Layers kept, already optimized and JITed, from an earlier
+    // specialization of the group are left exactly as they are (see
+    // ShaderGroup::respecialization); only the others are optimized.
+    bool partial = group().has_kept_layers();
     for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (group().kept_layer (layer))
+            continue;
         set_inst (layer);
         // These need to happen before merge_instances
         inst()->copy_code_from_master (group());
@@ -3034,6 +3701,8 @@ RuntimeOptimizer::run ()
     // Inventory the network and print pre-optimized debug info
     size_t old_nsyms = 0, old_nops = 0;
     for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (group().kept_layer (layer))
+            continue;
         set_inst (layer);
         if (debug() /* && optimize() >= 1*/) {
             find_basic_blocks ();
@@ -3047,45 +3716,78 @@ RuntimeOptimizer::run ()
         old_nops += inst()->ops().size();
     }
 
-    if (shadingsys().m_opt_merge_instances == 1)
+    if (shadingsys().m_opt_merge_instances == 1 && ! partial) {
+        trace.next ("rop_merge_instances");
         shadingsys().merge_instances (group());
+    }
 
     m_params_holding_globals.resize (nlayers);
 
-    // Optimize each layer, from first to last
-    for (int layer = 0;  layer < nlayers;  ++layer) {
-        set_inst (layer);
-        if (inst()->unused())
-            continue;
-        // N.B. we need to resolve isconnected() calls before the instance
-        // is otherwise optimized, or else isconnected() may not reflect
-        // the original connectivity after substitutions are made.
-        resolve_isconnected ();
-        optimize_instance ();
+    // Optimize each layer, from first to last -- or, with
+    // opt_layer_threads, independent layers concurrently.  (Debugging
+    // output needs the layers in order.)
+    trace.next ("rop_forward_pass");
+    int nthreads = shadingsys().m_opt_layer_threads;
+    if (nthreads < 1)
+        nthreads = std::max (1, (int)std::thread::hardware_concurrency());
+    if (nthreads > 1 && nlayers > 1 && ! shadingsys().debug() &&
+          shadingsys().debug_groupname().empty() &&
+          shadingsys().debug_layername().empty()) {
+        optimize_layers_parallel (nthreads);
+    } else {
+        for (int layer = 0;  layer < nlayers;  ++layer) {
+            set_inst (layer);
+            if (group().kept_layer (layer)) {
+                // Its ops are gone, so we can't tell what messages it sets
+                m_unknown_message_sent |= ! inst()->unused();
+                continue;
+            }
+            if (inst()->unused())
+                continue;
+            CompileTraceSpan layer_trace (shadingsys(), "optimize_layer",
+                                          inst()->layername());
+            // N.B. we need to resolve isconnected() calls before the
+            // instance is otherwise optimized, or else isconnected() may
+            // not reflect the original connectivity after substitutions
+            // are made.
+            resolve_isconnected ();
+            optimize_instance ();
+        }
     }
 
     // Optimize each layer again, from last to first (because some
     // optimizations are only apparent when the subsequent shaders have
     // been simplified).
+    trace.next ("rop_backward_pass");
     for (int layer = nlayers-1;  layer >= 0;  --layer) {
         set_inst (layer);
-        if (! inst()->unused())
-            optimize_instance ();
+        if (inst()->unused() || group().kept_layer (layer))
+            continue;
+        CompileTraceSpan layer_trace (shadingsys(), "optimize_layer",
+                                      inst()->layername());
+        optimize_instance ();
     }
 
     // Try merging instances again, now that we've optimized
-    shadingsys().merge_instances (group(), true);
+    trace.next ("rop_merge_instances");
+    if (! partial)
+        shadingsys().merge_instances (group(), true);
 
+    trace.next ("rop_dependencies");
     for (int layer = nlayers-1;  layer >= 0;  --layer) {
         set_inst (layer);
-        if (inst()->unused())
+        if (inst()->unused() || group().kept_layer (layer))
             continue;
         find_basic_blocks ();
         track_variable_dependencies ();
 
         // For our parameters that require derivatives, mark their
-        // upstream connections as also needing derivatives.
+        // upstream connections as also needing derivatives.  (A kept
+        // layer has the derivatives it was JITed with, which
+        // BackendLLVM::pin_kept_layers checks are enough.)
         for (auto&& c : inst()->m_connections) {
+            if (group().kept_layer (c.srclayer))
+                continue;
             if (inst()->symbol(c.dst.param)->has_derivs()) {
                 Symbol *source = group()[c.srclayer]->symbol(c.src.param);
                 if (! source->typespec().is_closure_based() &&
@@ -3097,23 +3799,31 @@ RuntimeOptimizer::run ()
     }
 
     // Post-opt cleanup: add useparam, coalesce temporaries, etc.
+    trace.next ("rop_post_optimize");
     for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (group().kept_layer (layer))
+            continue;
         set_inst (layer);
         post_optimize_instance ();
     }
 
     // Last chance to eliminate duplicate instances
-    shadingsys().merge_instances (group(), true);
+    if (! partial)
+        shadingsys().merge_instances (group(), true);
 
     // Get rid of nop instructions and unused symbols.
+    trace.next ("rop_collapse");
     size_t new_nsyms = 0, new_nops = 0, new_deriv_syms = 0;
+    int nrangechecks = 0;
     for (int layer = 0;  layer < nlayers;  ++layer) {
         set_inst (layer);
-        if (inst()->unused())
+        if (inst()->unused() || group().kept_layer (layer))
             continue;  // no need to print or gather stats for unused layers
         if (optimize() >= 1) {
             collapse_syms ();
             collapse_ops ();
+            if (shadingsys().range_checking())
+                nrangechecks += eliminate_range_checks ();
         }
         if (debug() && !inst()->unused()) {
             track_variable_lifetimes ();
@@ -3126,6 +3836,7 @@ RuntimeOptimizer::run ()
         new_nops += inst()->ops().size();
     }
 
+    trace.next ("rop_inventory");
     m_unknown_textures_needed = false;
     m_unknown_closures_needed = false;
     m_unknown_attributes_needed = false;
@@ -3141,9 +3852,15 @@ RuntimeOptimizer::run ()
         set_inst (layer);
         if (inst()->unused())
             continue;  // no need to print or gather stats for unused layers
+        // A kept layer (whose ops are gone) needs what it needed before
+        // (optimize_group adds that), and so does something.
+        bool kept = group().kept_layer (layer);
+        if (kept && ! inst()->empty_instance())
+            does_nothing = false;
         FOREACH_SYM (Symbol &s, inst()) {
             // set the layer numbers
-            s.layer (layer);
+            if (! kept)
+                s.layer (layer);
             // Find interpolated parameters
             if ((s.symtype() == SymTypeParam || s.symtype() == SymTypeOutputParam)
                 && ! s.lockgeom()) {
@@ -3232,7 +3949,14 @@ RuntimeOptimizer::run ()
     }
     group().does_nothing (does_nothing);
 
+    // Find the layers whose results are the same for every point on an
+    // object, so that the back end can cache them per object.
+    int nuniform = 0;
+    if (shadingsys().m_opt_uniform_layers && optimize() >= 1)
+        nuniform = classify_uniform_layers ();
+
     m_stat_specialization_time = rop_timer();
+    trace.end ();
     {
         // adjust memory stats
         ShadingSystemImpl &ss (shadingsys());
@@ -3244,6 +3968,8 @@ RuntimeOptimizer::run ()
         ss.m_stat_syms_with_derivs += new_deriv_syms;
         if (does_nothing)
             ss.m_stat_empty_groups += 1;
+        ss.m_stat_uniform_layers += nuniform;
+        ss.m_stat_range_checks_eliminated += nrangechecks;
     }
     if (shadingsys().m_compile_report) {
         shadingcontext()->infof("Optimized shader group %s:", group().name());
@@ -3254,6 +3980,11 @@ RuntimeOptimizer::run ()
               100.0*double((long long)new_nops-(long long)old_nops)/double(old_nops));
         if (does_nothing)
             shadingcontext()->infof("Group does nothing");
+        if (nuniform)
+            shadingcontext()->infof("Group has %d uniform layers", nuniform);
+        if (group().inst_merge_time() > 0)
+            shadingcontext()->infof(" instance merging %1.2fs",
+                                    group().inst_merge_time());
         if (m_textures_needed.size()) {
             shadingcontext()->infof("Group needs textures:");
             for (auto&& f : m_textures_needed)
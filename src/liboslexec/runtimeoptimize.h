@@ -82,12 +82,42 @@ public:
     /// instance variables and connections.
     void optimize_instance ();
 
+    /// The first (forward) optimization pass over all the layers, with
+    /// the layers of each level of the connection DAG optimized
+    /// concurrently, on up to nthreads threads.
+    void optimize_layers_parallel (int nthreads);
+
     /// One optimization pass over a range of instructions [begin, end).
     /// Return the number of changes made. If seed_block_aliases is not
     /// NULL, use that as the initial set of block_aliases.
     int optimize_ops (int beginop, int endop,
                       FastIntMap *seed_block_aliases = NULL);
 
+    /// Note that symbol sym was involved in a change to the code during
+    /// this pass, so that with opt_skip_untouched_ops the next pass
+    /// revisits the ops that use it.
+    void touch_symbol (int sym) {
+        if (sym < 0)
+            return;
+        if (sym >= (int)m_sym_touched.size())
+            m_sym_touched.resize (sym+1, -1);
+        m_sym_touched[sym] = m_pass;
+    }
+
+    /// touch_symbol() all the arguments of op.
+    void touch_op_args (const Opcode &op) {
+        for (int i = 0, e = op.nargs();  i < e;  ++i)
+            touch_symbol (inst()->arg(op.firstarg()+i));
+    }
+
+    /// Does the op at opnum get the full set of optimizations this pass?
+    /// Always true without opt_skip_untouched_ops; with it, only for ops
+    /// that (or whose peephole partner) use a symbol touched during the
+    /// previous or current pass, plus ops that must always be seen.  This
+    /// is a heuristic, not sparse dataflow propagation: an op whose
+    /// folding depends on something other than its args could be missed.
+    bool op_touched (int opnum);
+
     /// Post-optimization cleanup of a layer: add 'useparam' instructions,
     /// track variable lifetimes, coalesce temporaries.
     void post_optimize_instance ();
@@ -137,6 +167,10 @@ public:
     /// into "assign arg0 one".
     void turn_into_assign_one (Opcode &op, string_view why=NULL);
 
+    /// Count an op folded by running its native shadeop (see
+    /// constfold_native).
+    void count_native_fold () { ++m_stat_opt_native_folds; }
+
     /// Turn the op into a new simple unary or binary op with arguments
     /// newarg0 (the result, newarg1, and newarg2.  If newarg2 < 0, then
     /// it's a unary op, otherwise a binary op.  The original arg list must
@@ -337,6 +371,30 @@ public:
     /// optimized.
     void collapse_ops ();
 
+    /// With range checking on, find the array and component accesses of
+    /// the current (already collapsed) instance whose indices are always
+    /// in range, and mark their ops so the back end leaves out the
+    /// runtime check.  Return how many checks were eliminated.
+    int eliminate_range_checks ();
+
+    /// Find the range of values [lo,hi] that the int symbol sym may hold
+    /// when read by op opnum.  If nothing is known it's [INT_MIN,INT_MAX].
+    void int_value_range (int opnum, int sym, int &lo, int &hi, int depth = 0);
+
+    /// If the loop op at opnum counts an int variable up (or down) by a
+    /// constant step from a known start to a known bound, record the
+    /// range of that variable within the loop body.
+    void find_induction_range (int opnum);
+
+    /// Is the getattribute op certain to yield the same result for every
+    /// shading point of an object (see the "uniform_attributes" option)?
+    bool uniform_getattribute (const Opcode &op);
+
+    /// Mark which layers of the group compute the same results for every
+    /// shading point of an object (see ShaderInstance::uniform()), and
+    /// return how many there are.
+    int classify_uniform_layers ();
+
     /// Let the optimizer know that this (known, constant) message was
     /// set by the current instance.
     void register_message (ustring name);
@@ -421,6 +479,7 @@ private:
     bool m_opt_assign;                    ///< Do various assign optimizations?
     bool m_opt_mix;                       ///< Do mix optimizations?
     bool m_opt_middleman;                 ///< Do middleman optimizations?
+    bool m_opt_skip_untouched_ops;        ///< Skip ops of untouched syms?
     ShaderGlobals m_shaderglobals;        ///< Dummy ShaderGlobals
 
     // Keep track of some things for the whole shader group:
@@ -430,6 +489,9 @@ private:
 
     // All below is just for the one inst we're optimizing at the moment:
     int m_pass;                       ///< Optimization pass we're on now
+    std::vector<int> m_sym_touched;   ///< Last pass that touched each sym
+    int m_all_touched;                ///< Last pass that touched everything
+    bool m_pass_sensitive;            ///< Folders depend on pass number?
     std::vector<int> m_all_consts;    ///< All const symbol indices for inst
     int m_next_newconst;              ///< Unique ID for next new const we add
     int m_next_newtemp;               ///< Unique ID for next new temp we add
@@ -452,10 +514,30 @@ private:
     std::set<UserDataNeeded> m_userdata_needed;
     double m_stat_opt_locking_time;       ///<   locking time
     double m_stat_specialization_time;    ///<   specialization time
+    double m_stat_opt_bblock_time;        ///<   finding basic blocks
+    double m_stat_opt_fold_time;          ///<   optimize_ops passes
+    double m_stat_opt_lifetime_time;      ///<   tracking lifetimes
+    double m_stat_opt_cleanup_time;       ///<   middleman, unused params
+    int m_stat_opt_passes;                ///< Optimization passes run
+    long long m_stat_opt_ops_visited;     ///< Ops fully optimized, all passes
+    long long m_stat_opt_ops_skipped;     ///< Ops skipped as untouched
+    int m_stat_opt_parallel_layers;       ///< Layers optimized concurrently
+    long long m_stat_opt_native_folds;    ///< Ops folded by native shadeops
     bool m_stop_optimizing;           ///< for debugging
+    OIIO::spin_mutex *m_connections_mutex = nullptr;
+                  ///< Guards the layers' connections while several layers
+                  ///< are optimized at once (optimize_layers_parallel)
     int m_raytypes_on;                ///< Ray types known to be on
     int m_raytypes_off;               ///< Ray types known to be off
 
+    // For eliminate_range_checks:
+    struct InductionRange {
+        int sym;                      ///< The loop's induction variable
+        int bodybegin, bodyend;       ///< Ops of the loop body
+        int lo, hi;                   ///< Range of sym in the body
+    };
+    std::vector<InductionRange> m_induction_ranges;
+
     // Persistant data shared between layers
     bool m_unknown_message_sent;      ///< Somebody did a non-const setmessage
     std::vector<ustring> m_messages_sent;  ///< Names of messages set
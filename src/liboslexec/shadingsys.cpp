@@ -27,11 +27,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <vector>
+#include <cmath>
+#include <type_traits>
 #include <string>
 #include <cstdio>
 #include <fstream>
 #include <cstdlib>
 #include <mutex>
+#include <algorithm>
 
 #include "oslexec_pvt.h"
 #include <OSL/genclosure.h>
@@ -424,6 +427,14 @@ ShadingSystem::getstats (int level) const
 
 
 
+std::string
+ShadingSystem::getstats_json (int level) const
+{
+    return m_impl->getstats_json (level);
+}
+
+
+
 void
 ShadingSystem::register_closure (string_view name, int id,
                                  const ClosureParam *params,
@@ -570,6 +581,16 @@ ShadingSystem::optimize_group (ShaderGroup *group,
 
 
 
+ShaderGroupRef
+ShadingSystem::output_subset (ShaderGroup *group, cspan<ustring> outputs)
+{
+    if (! group)
+        return ShaderGroupRef();
+    return m_impl->output_subset (*group, outputs);
+}
+
+
+
 static TypeDesc TypeFloatArray2 (TypeDesc::FLOAT, 2);
 static TypeDesc TypeFloatArray3 (TypeDesc::FLOAT, 3);
 static TypeDesc TypeFloatArray4 (TypeDesc::FLOAT, 4);
@@ -720,12 +741,13 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_statslevel (0), m_lazylayers (true),
       m_lazyglobals (true), m_lazyunconnected(true),
       m_lazy_userdata(false), m_userdata_isconnected(false),
-      m_clearmemory (false), m_debugnan (false), m_debug_uninit(false),
+      m_clearmemory (false), m_load_osob (true),
+      m_debugnan (false), m_debug_uninit(false),
       m_lockgeom_default (true), m_strict_messages(true),
       m_error_repeats(false),
       m_range_checking(true),
       m_unknown_coordsys_error(true), m_connection_error(true),
-      m_greedyjit(false), m_countlayerexecs(false),
+      m_greedyjit(false), m_countlayerexecs(false), m_pgo_instrument(false),
       m_relaxed_param_typecheck(false),
       m_max_warnings_per_thread(100),
       m_profile(0),
@@ -737,14 +759,24 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_opt_assign(true), m_opt_mix(true),
       m_opt_merge_instances(1), m_opt_merge_instances_with_userdata(true),
       m_opt_fold_getattribute(true),
-      m_opt_middleman(true), m_opt_texture_handle(true),
+      m_opt_middleman(true), m_opt_uniform_layers(false),
+      m_opt_share_groups(false), m_opt_share_layers(false),
+      m_opt_respecialize(false), m_opt_raytype_variants(false),
+      m_opt_noderivs_raytypes(0),
+      m_opt_texture_handle(true),
       m_opt_seed_bblock_aliases(true),
+      m_opt_skip_untouched_ops(true), m_opt_layer_threads(1),
       m_optimize_nondebug(false),
       m_opt_passes(10),
       m_llvm_optimize(0),
       m_debug(0), m_llvm_debug(0),
       m_llvm_debug_layers(0), m_llvm_debug_ops(0),
-      m_llvm_output_bitcode(0),
+      m_llvm_output_bitcode(0), m_llvm_report_calls(0),
+      m_jit_target("host"), m_jit_fma(0),
+      m_jit_perf_map(0), m_jit_gdb(0),
+      m_llvm_jit_partitions(1), m_llvm_jit_partition_minops(2000),
+      m_llvm_jit_partitions_compare(0),
+      m_jit_memory_budget(0),
       m_commonspace_synonym("world"),
       m_max_local_mem_KB(2048),
       m_compile_report(false),
@@ -754,17 +786,28 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_force_derivs(false),
       m_allow_shader_replacement(false),
       m_exec_repeat(1),
+      m_fast_math(0),
       m_opt_warnings(0),
       m_gpu_opt_error(0),
       m_colorspace("Rec709"),
       m_stat_opt_locking_time(0), m_stat_specialization_time(0),
+      m_stat_opt_bblock_time(0), m_stat_opt_fold_time(0),
+      m_stat_opt_lifetime_time(0), m_stat_opt_cleanup_time(0),
+      m_stat_opt_passes(0), m_stat_opt_ops_visited(0),
+      m_stat_opt_ops_skipped(0), m_stat_opt_parallel_layers(0),
+      m_stat_opt_native_folds(0),
+      m_stat_respecialize_time(0),
       m_stat_total_llvm_time(0),
       m_stat_llvm_setup_time(0), m_stat_llvm_irgen_time(0),
       m_stat_llvm_opt_time(0), m_stat_llvm_jit_time(0),
-      m_stat_inst_merge_time(0),
-      m_stat_max_llvm_local_mem(0)
+      m_stat_inst_merge_time(0), m_stat_max_group_merge_time(0),
+      m_stat_max_llvm_local_mem(0), m_stat_llvm_code_size(0),
+      m_stat_groups_partitioned(0), m_stat_partitioned_wall_time(0),
+      m_stat_partitioned_cpu_time(0), m_stat_single_module_time(0),
+      m_stat_rejit_time(0)
 {
     m_stat_shaders_loaded = 0;
+    m_stat_shaders_loaded_osob = 0;
     m_stat_shaders_requested = 0;
     m_stat_groups = 0;
     m_stat_groupinstances = 0;
@@ -781,10 +824,24 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
     m_stat_preopt_ops = 0;
     m_stat_postopt_ops = 0;
     m_stat_middlemen_eliminated = 0;
+    m_stat_range_checks_eliminated = 0;
     m_stat_const_connections = 0;
     m_stat_global_connections = 0;
     m_stat_tex_calls_codegened = 0;
     m_stat_tex_calls_as_handles = 0;
+    m_stat_uniform_layers = 0;
+    m_stat_groups_shared = 0;
+    m_stat_layers_shared = 0;
+    m_stat_shared_layer_funcs = 0;
+    m_stat_respecializations = 0;
+    m_stat_respecialize_kept = 0;
+    m_stat_raytype_variants = 0;
+    m_stat_noderivs_variants = 0;
+    m_stat_pgo_hot_params = 0;
+    m_stat_pgo_weighted_branches = 0;
+    m_stat_output_subsets = 0;
+    m_stat_jit_evictions = 0;
+    m_stat_jit_rejits = 0;
     m_stat_master_load_time = 0;
     m_stat_optimization_time = 0;
     m_stat_getattribute_time = 0;
@@ -799,10 +856,14 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
     m_stat_pointcloud_gets = 0;
     m_stat_pointcloud_writes = 0;
     m_stat_layers_executed = 0;
+    m_stat_uniform_cache_hits = 0;
+    m_stat_uniform_cache_misses = 0;
     m_stat_total_shading_time_ticks = 0;
 
     m_groups_to_compile_count = 0;
     m_threads_currently_compiling = 0;
+    m_trace_start = std::chrono::steady_clock::now();
+    m_group_registry = std::make_shared<ShaderGroupRegistry>();
 
     // If client didn't supply an error handler, just use the default
     // one that echoes to the terminal.
@@ -870,6 +931,7 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
 #define OP(name,ll,fold,simp,flag) OP2(name,name,ll,fold,simp,flag)
 #define TEX OpDescriptor::Tex
 #define SIDE OpDescriptor::SideEffects
+#define VARY OpDescriptor::Varying
 
     // name          llvmgen              folder         simple     flags
     OP (aassign,     aassign,             aassign,       false,     0);
@@ -883,9 +945,9 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (arraylength, arraylength,         arraylength,   true,      0);
     OP (asin,        generic,             asin,          true,      0);
     OP (assign,      assign,              none,          true,      0);
-    OP (atan,        generic,             none,          true,      0);
-    OP (atan2,       generic,             none,          true,      0);
-    OP (backfacing,  get_simple_SG_field, none,          true,      0);
+    OP (atan,        generic,             native,        true,      0);
+    OP (atan2,       generic,             native,        true,      0);
+    OP (backfacing,  get_simple_SG_field, none,          true,      VARY);
     OP (bitand,      bitwise_binary_op,   bitand,        true,      0);
     OP (bitor,       bitwise_binary_op,   bitor,         true,      0);
     OP (blackbody,   blackbody,           none,          true,      0);
@@ -894,7 +956,7 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (ceil,        generic,             ceil,          true,      0);
     OP (cellnoise,   noise,               noise,         true,      0);
     OP (clamp,       clamp,               clamp,         true,      0);
-    OP (closure,     closure,             none,          true,      0);
+    OP (closure,     closure,             none,          true,      VARY);
     OP (color,       construct_color,     triple,        true,      0);
     OP (compassign,  compassign,          compassign,    false,     0);
     OP (compl,       unary_op,            compl,         true,      0);
@@ -902,14 +964,14 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (concat,      generic,             concat,        true,      0);
     OP (continue,    loopmod_op,          none,          false,     0);
     OP (cos,         generic,             cos,           true,      0);
-    OP (cosh,        generic,             none,          true,      0);
-    OP (cross,       generic,             none,          true,      0);
+    OP (cosh,        generic,             native,        true,      0);
+    OP (cross,       generic,             native,        true,      0);
     OP (degrees,     generic,             degrees,       true,      0);
-    OP (determinant, generic,             none,          true,      0);
-    OP (dict_find,   dict_find,           none,          false,     0);
-    OP (dict_next,   dict_next,           none,          false,     0);
-    OP (dict_value,  dict_value,          none,          false,     0);
-    OP (distance,    generic,             none,          true,      0);
+    OP (determinant, generic,             native,        true,      0);
+    OP (dict_find,   dict_find,           none,          false,     VARY);
+    OP (dict_next,   dict_next,           none,          false,     VARY);
+    OP (dict_value,  dict_value,          none,          false,     VARY);
+    OP (distance,    generic,             native,        true,      0);
     OP (div,         div,                 div,           true,      0);
     OP (dot,         generic,             dot,           true,      0);
     OP (Dx,          DxDy,                deriv,         true,      0);
@@ -936,10 +998,10 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (fprintf,     printf,              none,          false,     SIDE);
     OP (functioncall, functioncall,       functioncall,  false,     0);
     OP (ge,          compare_op,          ge,            true,      0);
-    OP (getattribute, getattribute,       getattribute,  false,     0);
+    OP (getattribute, getattribute,       getattribute,  false,     VARY);
     OP (getchar,      generic,            getchar,       true,      0);
-    OP (getmatrix,   getmatrix,           getmatrix,     false,     0);
-    OP (getmessage,  getmessage,          getmessage,    false,     0);
+    OP (getmatrix,   getmatrix,           getmatrix,     false,     VARY);
+    OP (getmessage,  getmessage,          getmessage,    false,     VARY);
     OP (gettextureinfo, gettextureinfo,   gettextureinfo,false,     TEX);
     OP (gt,          compare_op,          gt,            true,      0);
     OP (hash,        generic,             hash,          true,      0);
@@ -948,18 +1010,18 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (inversesqrt, generic,             inversesqrt,   true,      0);
     OP (isconnected, generic,             none,          true,      0);
     OP (isconstant,  isconstant,          isconstant,    true,      0);
-    OP (isfinite,    generic,             none,          true,      0);
-    OP (isinf,       generic,             none,          true,      0);
-    OP (isnan,       generic,             none,          true,      0);
+    OP (isfinite,    generic,             native,        true,      0);
+    OP (isinf,       generic,             native,        true,      0);
+    OP (isnan,       generic,             native,        true,      0);
     OP (le,          compare_op,          le,            true,      0);
-    OP (length,      generic,             none,          true,      0);
+    OP (length,      generic,             native,        true,      0);
     OP (log,         generic,             log,           true,      0);
     OP (log10,       generic,             log10,         true,      0);
     OP (log2,        generic,             log2,          true,      0);
     OP (logb,        generic,             logb,          true,      0);
     OP (lt,          compare_op,          lt,            true,      0);
     OP (luminance,   luminance,           none,          true,      0);
-    OP (matrix,      matrix,              matrix,        true,      0);
+    OP (matrix,      matrix,              matrix,        true,      VARY);
     OP (max,         minmax,              max,           true,      0);
     OP (mxcompassign, mxcompassign,       mxcompassign,  false,     0);
     OP (mxcompref,   mxcompref,           none,          true,      0);
@@ -977,34 +1039,34 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (pnoise,      noise,               noise,         true,      0);
     OP (point,       construct_triple,    triple,        true,      0);
     OP (pointcloud_search, pointcloud_search, pointcloud_search,
-                                                         false,     TEX);
-    OP (pointcloud_get, pointcloud_get,   pointcloud_get,false,     TEX);
+                                                         false,     TEX|VARY);
+    OP (pointcloud_get, pointcloud_get,   pointcloud_get,false,     TEX|VARY);
     OP (pointcloud_write, pointcloud_write, none,        false,     SIDE);
     OP (pow,         generic,             pow,           true,      0);
     OP (printf,      printf,              none,          false,     SIDE);
     OP (psnoise,     noise,               noise,         true,      0);
     OP (radians,     generic,             radians,       true,      0);
-    OP (raytype,     raytype,             raytype,       true,      0);
+    OP (raytype,     raytype,             raytype,       true,      VARY);
     OP (regex_match, regex,               none,          false,     0);
     OP (regex_search, regex,              regex_search,  false,     0);
     OP (return,      return,              none,          false,     0);
-    OP (round,       generic,             none,          true,      0);
+    OP (round,       generic,             native,        true,      0);
     OP (select,      select,              select,        true,      0);
     OP (setmessage,  setmessage,          setmessage,    false,     SIDE);
     OP (shl,         bitwise_binary_op,   none,          true,      0);
     OP (shr,         bitwise_binary_op,   none,          true,      0);
-    OP (sign,        generic,             none,          true,      0);
+    OP (sign,        generic,             native,        true,      0);
     OP (sin,         generic,             sin,           true,      0);
     OP (sincos,      sincos,              sincos,        false,     0);
-    OP (sinh,        generic,             none,          true,      0);
-    OP (smoothstep,  generic,             none,          true,      0);
+    OP (sinh,        generic,             native,        true,      0);
+    OP (smoothstep,  generic,             native,        true,      0);
     OP (snoise,      noise,               noise,         true,      0);
     OP (spline,      spline,              none,          true,      0);
     OP (splineinverse, spline,            none,          true,      0);
     OP (split,       split,               split,         false,     0);
     OP (sqrt,        generic,             sqrt,          true,      0);
-    OP (startswith,  generic,             none,          true,      0);
-    OP (step,        generic,             none,          true,      0);
+    OP (startswith,  generic,             native,        true,      0);
+    OP (step,        generic,             native,        true,      0);
     OP (stof,        generic,             stof,          true,      0);
     OP (stoi,        generic,             stoi,          true,      0);
     OP (strlen,      generic,             strlen,        true,      0);
@@ -1012,18 +1074,18 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP2(strtoi,stoi, generic,             stoi,          true,      0);
     OP (sub,         sub,                 sub,           true,      0);
     OP (substr,      generic,             substr,        true,      0);
-    OP (surfacearea, get_simple_SG_field, none,          true,      0);
-    OP (tan,         generic,             none,          true,      0);
-    OP (tanh,        generic,             none,          true,      0);
+    OP (surfacearea, get_simple_SG_field, none,          true,      VARY);
+    OP (tan,         generic,             native,        true,      0);
+    OP (tanh,        generic,             native,        true,      0);
     OP (texture,     texture,             texture,       true,      TEX);
     OP (texture3d,   texture3d,           none,          true,      TEX);
     OP (trace,       trace,               none,          false,     SIDE);
-    OP (transform,   transform,           transform,     true,      0);
+    OP (transform,   transform,           transform,     true,      VARY);
     OP (transformc,  transformc,          transformc,    true,      0);
-    OP (transformn,  transform,           transform,     true,      0);
-    OP (transformv,  transform,           transform,     true,      0);
-    OP (transpose,   generic,             none,          true,      0);
-    OP (trunc,       generic,             none,          true,      0);
+    OP (transformn,  transform,           transform,     true,      VARY);
+    OP (transformv,  transform,           transform,     true,      VARY);
+    OP (transpose,   generic,             native,        true,      0);
+    OP (trunc,       generic,             native,        true,      0);
     OP (useparam,    useparam,            useparam,      false,     0);
     OP (vector,      construct_triple,    triple,        true,      0);
     OP (warning,     printf,              warning,       false,     SIDE);
@@ -1033,6 +1095,7 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
 #undef OP
 #undef TEX
 #undef SIDE
+#undef VARY
 }
 
 
@@ -1092,6 +1155,8 @@ ShadingSystemImpl::query_closure(const char **name, int *id,
 ShadingSystemImpl::~ShadingSystemImpl ()
 {
     printstats ();
+    if (compile_trace())
+        write_compile_trace ();
     // N.B. just let m_texsys go -- if we asked for one to be created,
     // we asked for a shared one.
 
@@ -1134,6 +1199,7 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("lazy_userdata", int, m_lazy_userdata);
     ATTR_SET ("userdata_isconnected", int, m_userdata_isconnected);
     ATTR_SET ("clearmemory", int, m_clearmemory);
+    ATTR_SET ("load_osob", int, m_load_osob);
     ATTR_SET ("debug_nan", int, m_debugnan);
     ATTR_SET ("debugnan", int, m_debugnan);  // back-compatible alias
     ATTR_SET ("debug_uninit", int, m_debug_uninit);
@@ -1153,8 +1219,16 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("opt_merge_instances_with_userdata", int, m_opt_merge_instances_with_userdata);
     ATTR_SET ("opt_fold_getattribute", int, m_opt_fold_getattribute);
     ATTR_SET ("opt_middleman", int, m_opt_middleman);
+    ATTR_SET ("opt_uniform_layers", int, m_opt_uniform_layers);
+    ATTR_SET ("opt_share_groups", int, m_opt_share_groups);
+    ATTR_SET ("opt_share_layers", int, m_opt_share_layers);
+    ATTR_SET ("opt_respecialize", int, m_opt_respecialize);
+    ATTR_SET ("opt_raytype_variants", int, m_opt_raytype_variants);
+    ATTR_SET ("opt_noderivs_raytypes", int, m_opt_noderivs_raytypes);
     ATTR_SET ("opt_texture_handle", int, m_opt_texture_handle);
     ATTR_SET ("opt_seed_bblock_aliases", int, m_opt_seed_bblock_aliases);
+    ATTR_SET ("opt_skip_untouched_ops", int, m_opt_skip_untouched_ops);
+    ATTR_SET ("opt_layer_threads", int, m_opt_layer_threads);
     ATTR_SET ("opt_passes", int, m_opt_passes);
     ATTR_SET ("optimize_nondebug", int, m_optimize_nondebug);
     ATTR_SET ("llvm_optimize", int, m_llvm_optimize);
@@ -1162,6 +1236,14 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("llvm_debug_layers", int, m_llvm_debug_layers);
     ATTR_SET ("llvm_debug_ops", int, m_llvm_debug_ops);
     ATTR_SET ("llvm_output_bitcode", int, m_llvm_output_bitcode);
+    ATTR_SET ("llvm_report_calls", int, m_llvm_report_calls);
+    ATTR_SET ("jit_fma", int, m_jit_fma);
+    ATTR_SET ("jit_perf_map", int, m_jit_perf_map);
+    ATTR_SET ("jit_gdb", int, m_jit_gdb);
+    ATTR_SET ("llvm_jit_partitions", int, m_llvm_jit_partitions);
+    ATTR_SET ("llvm_jit_partition_minops", int, m_llvm_jit_partition_minops);
+    ATTR_SET ("llvm_jit_partitions_compare", int, m_llvm_jit_partitions_compare);
+    ATTR_SET ("jit_memory_budget", int, m_jit_memory_budget);
     ATTR_SET ("strict_messages", int, m_strict_messages);
     ATTR_SET ("range_checking", int, m_range_checking);
     ATTR_SET ("unknown_coordsys_error", int, m_unknown_coordsys_error);
@@ -1169,6 +1251,7 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("greedyjit", int, m_greedyjit);
     ATTR_SET ("relaxed_param_typecheck", int, m_relaxed_param_typecheck);
     ATTR_SET ("countlayerexecs", int, m_countlayerexecs);
+    ATTR_SET ("pgo_instrument", int, m_pgo_instrument);
     ATTR_SET ("max_warnings_per_thread", int, m_max_warnings_per_thread);
     ATTR_SET ("max_local_mem_KB", int, m_max_local_mem_KB);
     ATTR_SET ("compile_report", int, m_compile_report);
@@ -1178,6 +1261,7 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("force_derivs", int, m_force_derivs);
     ATTR_SET ("allow_shader_replacement", int, m_allow_shader_replacement);
     ATTR_SET ("exec_repeat", int, m_exec_repeat);
+    ATTR_SET ("fast_math", int, m_fast_math);
     ATTR_SET ("opt_warnings", int, m_opt_warnings);
     ATTR_SET ("gpu_opt_error", int, m_gpu_opt_error);
     ATTR_SET_STRING ("commonspace", m_commonspace_synonym);
@@ -1187,6 +1271,8 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET_STRING ("only_groupname", m_only_groupname);
     ATTR_SET_STRING ("archive_groupname", m_archive_groupname);
     ATTR_SET_STRING ("archive_filename", m_archive_filename);
+    ATTR_SET_STRING ("compile_trace", m_compile_trace);
+    ATTR_SET_STRING ("jit_target", m_jit_target);
 
     // cases for special handling
     if (name == "searchpath:shader" && type == TypeDesc::STRING) {
@@ -1216,6 +1302,12 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
             m_renderer_outputs.emplace_back(((const char **)val)[i]);
         return true;
     }
+    if (name == "uniform_attributes" && type.basetype == TypeDesc::STRING) {
+        m_uniform_attributes.clear ();
+        for (size_t i = 0;  i < type.numelements();  ++i)
+            m_uniform_attributes.emplace_back(((const char **)val)[i]);
+        return true;
+    }
     if (name == "lib_bitcode" && type.basetype == TypeDesc::UINT8) {
         if (type.arraylen < 0) {
             errorf("Invalid bitcode size: %d", type.arraylen);
@@ -1244,6 +1336,118 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
 
 
 
+// All the "stat:..." attributes: the name (without "stat:"), the C type
+// it is retrieved as, and the value.  Used both by getattribute() and
+// by getstats_json(), so that the two always agree.
+#define OSL_SHADINGSYS_STATS(STAT)                                                                  \
+    STAT ("masters", int, m_stat_shaders_loaded)                                                    \
+    STAT ("masters_osob", int, m_stat_shaders_loaded_osob)                                          \
+    STAT ("shaders_requested", int, m_stat_shaders_requested)                                       \
+    STAT ("groups", int, m_stat_groups)                                                             \
+    STAT ("instances_compiled", int, m_stat_instances_compiled)                                     \
+    STAT ("groups_compiled", int, m_stat_groups_compiled)                                           \
+    STAT ("empty_instances", int, m_stat_empty_instances)                                           \
+    STAT ("merged_inst", int, m_stat_merged_inst)                                                   \
+    STAT ("merged_inst_opt", int, m_stat_merged_inst_opt)                                           \
+    STAT ("empty_groups", int, m_stat_empty_groups)                                                 \
+    STAT ("instances", int, m_stat_groupinstances)                                                  \
+    STAT ("live_instances", int, m_stat_instances.current())                                        \
+    STAT ("live_instances_peak", int, m_stat_instances.peak())                                      \
+    STAT ("contexts", int, m_stat_contexts.current())                                               \
+    STAT ("contexts_peak", int, m_stat_contexts.peak())                                             \
+    STAT ("regexes", int, m_stat_regexes)                                                           \
+    STAT ("preopt_syms", int, m_stat_preopt_syms)                                                   \
+    STAT ("postopt_syms", int, m_stat_postopt_syms)                                                 \
+    STAT ("syms_with_derivs", int, m_stat_syms_with_derivs)                                         \
+    STAT ("preopt_ops", int, m_stat_preopt_ops)                                                     \
+    STAT ("postopt_ops", int, m_stat_postopt_ops)                                                   \
+    STAT ("middlemen_eliminated", int, m_stat_middlemen_eliminated)                                 \
+    STAT ("range_checks_eliminated", int, m_stat_range_checks_eliminated)                           \
+    STAT ("const_connections", int, m_stat_const_connections)                                       \
+    STAT ("global_connections", int, m_stat_global_connections)                                     \
+    STAT ("tex_calls_codegened", int, m_stat_tex_calls_codegened)                                   \
+    STAT ("tex_calls_as_handles", int, m_stat_tex_calls_as_handles)                                 \
+    STAT ("uniform_layers", int, m_stat_uniform_layers)                                             \
+    STAT ("groups_shared", int, m_stat_groups_shared)                                               \
+    STAT ("layers_shared", int, m_stat_layers_shared)                                               \
+    STAT ("shared_layer_funcs", int, m_stat_shared_layer_funcs)                                     \
+    STAT ("respecializations", int, m_stat_respecializations)                                       \
+    STAT ("respecialize_layers_kept", int, m_stat_respecialize_kept)                                \
+    STAT ("respecialize_time", float, m_stat_respecialize_time)                                     \
+    STAT ("raytype_variants", int, m_stat_raytype_variants)                                         \
+    STAT ("noderivs_variants", int, m_stat_noderivs_variants)                                       \
+    STAT ("pgo_hot_params", int, m_stat_pgo_hot_params)                                             \
+    STAT ("pgo_weighted_branches", int, m_stat_pgo_weighted_branches)                               \
+    STAT ("output_subsets", int, m_stat_output_subsets)                                             \
+    STAT ("uniform_cache_hits", long long, m_stat_uniform_cache_hits)                               \
+    STAT ("uniform_cache_misses", long long, m_stat_uniform_cache_misses)                           \
+    STAT ("layers_executed", long long, m_stat_layers_executed)                                     \
+    STAT ("total_shading_time", float, OIIO::Timer::seconds(m_stat_total_shading_time_ticks))       \
+    STAT ("master_load_time", float, m_stat_master_load_time)                                       \
+    STAT ("optimization_time", float, m_stat_optimization_time)                                     \
+    STAT ("opt_locking_time", float, m_stat_opt_locking_time)                                       \
+    STAT ("specialization_time", float, m_stat_specialization_time)                                 \
+    STAT ("opt_bblock_time", float, m_stat_opt_bblock_time)                                         \
+    STAT ("opt_fold_time", float, m_stat_opt_fold_time)                                             \
+    STAT ("opt_lifetime_time", float, m_stat_opt_lifetime_time)                                     \
+    STAT ("opt_cleanup_time", float, m_stat_opt_cleanup_time)                                       \
+    STAT ("opt_passes_run", long long, m_stat_opt_passes)                                           \
+    STAT ("opt_ops_visited", long long, m_stat_opt_ops_visited)                                     \
+    STAT ("opt_ops_skipped", long long, m_stat_opt_ops_skipped)                                     \
+    STAT ("opt_parallel_layers", long long, m_stat_opt_parallel_layers)                             \
+    STAT ("opt_native_folds", long long, m_stat_opt_native_folds)                                   \
+    STAT ("total_llvm_time", float, m_stat_total_llvm_time)                                         \
+    STAT ("llvm_setup_time", float, m_stat_llvm_setup_time)                                         \
+    STAT ("llvm_irgen_time", float, m_stat_llvm_irgen_time)                                         \
+    STAT ("llvm_opt_time", float, m_stat_llvm_opt_time)                                             \
+    STAT ("llvm_jit_time", float, m_stat_llvm_jit_time)                                             \
+    STAT ("llvm_code_size", long long, m_stat_llvm_code_size)                                       \
+    STAT ("groups_partitioned", int, m_stat_groups_partitioned)                                     \
+    STAT ("partitioned_llvm_wall_time", float, m_stat_partitioned_wall_time)                        \
+    STAT ("partitioned_llvm_cpu_time", float, m_stat_partitioned_cpu_time)                          \
+    STAT ("single_module_llvm_time", float, m_stat_single_module_time)                              \
+    STAT ("jit_evictions", int, m_stat_jit_evictions)                                               \
+    STAT ("jit_rejits", int, m_stat_jit_rejits)                                                     \
+    STAT ("rejit_time", float, m_stat_rejit_time)                                                   \
+    STAT ("max_llvm_local_mem", int, m_stat_max_llvm_local_mem)                                     \
+    STAT ("inst_merge_time", float, m_stat_inst_merge_time)                                         \
+    STAT ("max_group_merge_time", float, m_stat_max_group_merge_time)                               \
+    STAT ("getattribute_calls", long long, m_stat_getattribute_calls)                               \
+    STAT ("getattribute_time", float, m_stat_getattribute_time)                                     \
+    STAT ("getattribute_fail_time", float, m_stat_getattribute_fail_time)                           \
+    STAT ("get_userdata_calls", long long, m_stat_get_userdata_calls)                               \
+    STAT ("noise_calls", long long, m_stat_noise_calls)                                             \
+    STAT ("pointcloud_searches", long long, m_stat_pointcloud_searches)                             \
+    STAT ("pointcloud_gets", long long, m_stat_pointcloud_gets)                                     \
+    STAT ("pointcloud_writes", long long, m_stat_pointcloud_writes)                                 \
+    STAT ("pointcloud_searches_total_results", long long, m_stat_pointcloud_searches_total_results) \
+    STAT ("pointcloud_max_results", int, m_stat_pointcloud_max_results)                             \
+    STAT ("pointcloud_failures", int, m_stat_pointcloud_failures)                                   \
+    STAT ("memory_current", long long, m_stat_memory.current())                                     \
+    STAT ("memory_peak", long long, m_stat_memory.peak())                                           \
+    STAT ("mem_master_current", long long, m_stat_mem_master.current())                             \
+    STAT ("mem_master_peak", long long, m_stat_mem_master.peak())                                   \
+    STAT ("mem_master_ops_current", long long, m_stat_mem_master_ops.current())                     \
+    STAT ("mem_master_ops_peak", long long, m_stat_mem_master_ops.peak())                           \
+    STAT ("mem_master_args_current", long long, m_stat_mem_master_args.current())                   \
+    STAT ("mem_master_args_peak", long long, m_stat_mem_master_args.peak())                         \
+    STAT ("mem_master_syms_current", long long, m_stat_mem_master_syms.current())                   \
+    STAT ("mem_master_syms_peak", long long, m_stat_mem_master_syms.peak())                         \
+    STAT ("mem_master_defaults_current", long long, m_stat_mem_master_defaults.current())           \
+    STAT ("mem_master_defaults_peak", long long, m_stat_mem_master_defaults.peak())                 \
+    STAT ("mem_master_consts_current", long long, m_stat_mem_master_consts.current())               \
+    STAT ("mem_master_consts_peak", long long, m_stat_mem_master_consts.peak())                     \
+    STAT ("mem_inst_current", long long, m_stat_mem_inst.current())                                 \
+    STAT ("mem_inst_peak", long long, m_stat_mem_inst.peak())                                       \
+    STAT ("mem_inst_syms_current", long long, m_stat_mem_inst_syms.current())                       \
+    STAT ("mem_inst_syms_peak", long long, m_stat_mem_inst_syms.peak())                             \
+    STAT ("mem_inst_paramvals_current", long long, m_stat_mem_inst_paramvals.current())             \
+    STAT ("mem_inst_paramvals_peak", long long, m_stat_mem_inst_paramvals.peak())                   \
+    STAT ("mem_inst_connections_current", long long, m_stat_mem_inst_connections.current())         \
+    STAT ("mem_inst_connections_peak", long long, m_stat_mem_inst_connections.peak())
+
+
+
 bool
 ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
                                  void *val)
@@ -1269,6 +1473,7 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("lazy_userdata", int, m_lazy_userdata);
     ATTR_DECODE ("userdata_isconnected", int, m_userdata_isconnected);
     ATTR_DECODE ("clearmemory", int, m_clearmemory);
+    ATTR_DECODE ("load_osob", int, m_load_osob);
     ATTR_DECODE ("debug_nan", int, m_debugnan);
     ATTR_DECODE ("debugnan", int, m_debugnan);  // back-compatible alias
     ATTR_DECODE ("debug_uninit", int, m_debug_uninit);
@@ -1288,8 +1493,16 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("opt_merge_instances_with_userdata", int, m_opt_merge_instances_with_userdata);
     ATTR_DECODE ("opt_fold_getattribute", int, m_opt_fold_getattribute);
     ATTR_DECODE ("opt_middleman", int, m_opt_middleman);
+    ATTR_DECODE ("opt_uniform_layers", int, m_opt_uniform_layers);
+    ATTR_DECODE ("opt_share_groups", int, m_opt_share_groups);
+    ATTR_DECODE ("opt_share_layers", int, m_opt_share_layers);
+    ATTR_DECODE ("opt_respecialize", int, m_opt_respecialize);
+    ATTR_DECODE ("opt_raytype_variants", int, m_opt_raytype_variants);
+    ATTR_DECODE ("opt_noderivs_raytypes", int, m_opt_noderivs_raytypes);
     ATTR_DECODE ("opt_texture_handle", int, m_opt_texture_handle);
     ATTR_DECODE ("opt_seed_bblock_aliases", int, m_opt_seed_bblock_aliases);
+    ATTR_DECODE ("opt_skip_untouched_ops", int, m_opt_skip_untouched_ops);
+    ATTR_DECODE ("opt_layer_threads", int, m_opt_layer_threads);
     ATTR_DECODE ("opt_passes", int, m_opt_passes);
     ATTR_DECODE ("optimize_nondebug", int, m_optimize_nondebug);
     ATTR_DECODE ("llvm_optimize", int, m_llvm_optimize);
@@ -1298,6 +1511,14 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("llvm_debug_layers", int, m_llvm_debug_layers);
     ATTR_DECODE ("llvm_debug_ops", int, m_llvm_debug_ops);
     ATTR_DECODE ("llvm_output_bitcode", int, m_llvm_output_bitcode);
+    ATTR_DECODE ("llvm_report_calls", int, m_llvm_report_calls);
+    ATTR_DECODE ("jit_fma", int, m_jit_fma);
+    ATTR_DECODE ("jit_perf_map", int, m_jit_perf_map);
+    ATTR_DECODE ("jit_gdb", int, m_jit_gdb);
+    ATTR_DECODE ("llvm_jit_partitions", int, m_llvm_jit_partitions);
+    ATTR_DECODE ("llvm_jit_partition_minops", int, m_llvm_jit_partition_minops);
+    ATTR_DECODE ("llvm_jit_partitions_compare", int, m_llvm_jit_partitions_compare);
+    ATTR_DECODE ("jit_memory_budget", int, m_jit_memory_budget);
     ATTR_DECODE ("strict_messages", int, m_strict_messages);
     ATTR_DECODE ("error_repeats", int, m_error_repeats);
     ATTR_DECODE ("range_checking", int, m_range_checking);
@@ -1305,6 +1526,7 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("connection_error", int, m_connection_error);
     ATTR_DECODE ("greedyjit", int, m_greedyjit);
     ATTR_DECODE ("countlayerexecs", int, m_countlayerexecs);
+    ATTR_DECODE ("pgo_instrument", int, m_pgo_instrument);
     ATTR_DECODE ("relaxed_param_typecheck", int, m_relaxed_param_typecheck);
     ATTR_DECODE ("max_warnings_per_thread", int, m_max_warnings_per_thread);
     ATTR_DECODE_STRING ("commonspace", m_commonspace_synonym);
@@ -1315,6 +1537,8 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE_STRING ("only_groupname", m_only_groupname);
     ATTR_DECODE_STRING ("archive_groupname", m_archive_groupname);
     ATTR_DECODE_STRING ("archive_filename", m_archive_filename);
+    ATTR_DECODE_STRING ("compile_trace", m_compile_trace);
+    ATTR_DECODE_STRING ("jit_target", m_jit_target);
     ATTR_DECODE ("max_local_mem_KB", int, m_max_local_mem_KB);
     ATTR_DECODE ("compile_report", int, m_compile_report);
     ATTR_DECODE ("buffer_printf", int, m_buffer_printf);
@@ -1323,70 +1547,18 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("force_derivs", int, m_force_derivs);
     ATTR_DECODE ("allow_shader_replacement", int, m_allow_shader_replacement);
     ATTR_DECODE ("exec_repeat", int, m_exec_repeat);
+    ATTR_DECODE ("fast_math", int, m_fast_math);
     ATTR_DECODE ("opt_warnings", int, m_opt_warnings);
     ATTR_DECODE ("gpu_opt_error", int, m_gpu_opt_error);
 
-    ATTR_DECODE ("stat:masters", int, m_stat_shaders_loaded);
-    ATTR_DECODE ("stat:groups", int, m_stat_groups);
-    ATTR_DECODE ("stat:instances_compiled", int, m_stat_instances_compiled);
-    ATTR_DECODE ("stat:groups_compiled", int, m_stat_groups_compiled);
-    ATTR_DECODE ("stat:empty_instances", int, m_stat_empty_instances);
-    ATTR_DECODE ("stat:merged_inst", int, m_stat_merged_inst);
-    ATTR_DECODE ("stat:merged_inst_opt", int, m_stat_merged_inst_opt);
-    ATTR_DECODE ("stat:empty_groups", int, m_stat_empty_groups);
-    ATTR_DECODE ("stat:instances", int, m_stat_groupinstances);
-    ATTR_DECODE ("stat:regexes", int, m_stat_regexes);
-    ATTR_DECODE ("stat:preopt_syms", int, m_stat_preopt_syms);
-    ATTR_DECODE ("stat:postopt_syms", int, m_stat_postopt_syms);
-    ATTR_DECODE ("stat:syms_with_derivs", int, m_stat_syms_with_derivs);
-    ATTR_DECODE ("stat:preopt_ops", int, m_stat_preopt_ops);
-    ATTR_DECODE ("stat:postopt_ops", int, m_stat_postopt_ops);
-    ATTR_DECODE ("stat:middlemen_eliminated", int, m_stat_middlemen_eliminated);
-    ATTR_DECODE ("stat:const_connections", int, m_stat_const_connections);
-    ATTR_DECODE ("stat:global_connections", int, m_stat_global_connections);
-    ATTR_DECODE ("stat:tex_calls_codegened", int, m_stat_tex_calls_codegened);
-    ATTR_DECODE ("stat:tex_calls_as_handles", int, m_stat_tex_calls_as_handles);
-    ATTR_DECODE ("stat:master_load_time", float, m_stat_master_load_time);
-    ATTR_DECODE ("stat:optimization_time", float, m_stat_optimization_time);
-    ATTR_DECODE ("stat:opt_locking_time", float, m_stat_opt_locking_time);
-    ATTR_DECODE ("stat:specialization_time", float, m_stat_specialization_time);
-    ATTR_DECODE ("stat:total_llvm_time", float, m_stat_total_llvm_time);
-    ATTR_DECODE ("stat:llvm_setup_time", float, m_stat_llvm_setup_time);
-    ATTR_DECODE ("stat:llvm_irgen_time", float, m_stat_llvm_irgen_time);
-    ATTR_DECODE ("stat:llvm_opt_time", float, m_stat_llvm_opt_time);
-    ATTR_DECODE ("stat:llvm_jit_time", float, m_stat_llvm_jit_time);
-    ATTR_DECODE ("stat:inst_merge_time", float, m_stat_inst_merge_time);
-    ATTR_DECODE ("stat:getattribute_calls", long long, m_stat_getattribute_calls);
-    ATTR_DECODE ("stat:get_userdata_calls", long long, m_stat_get_userdata_calls);
-    ATTR_DECODE ("stat:noise_calls", long long, m_stat_noise_calls);
-    ATTR_DECODE ("stat:pointcloud_searches", long long, m_stat_pointcloud_searches);
-    ATTR_DECODE ("stat:pointcloud_gets", long long, m_stat_pointcloud_gets);
-    ATTR_DECODE ("stat:pointcloud_writes", long long, m_stat_pointcloud_writes);
-    ATTR_DECODE ("stat:pointcloud_searches_total_results", long long, m_stat_pointcloud_searches_total_results);
-    ATTR_DECODE ("stat:pointcloud_max_results", int, m_stat_pointcloud_max_results);
-    ATTR_DECODE ("stat:pointcloud_failures", int, m_stat_pointcloud_failures);
-    ATTR_DECODE ("stat:memory_current", long long, m_stat_memory.current());
-    ATTR_DECODE ("stat:memory_peak", long long, m_stat_memory.peak());
-    ATTR_DECODE ("stat:mem_master_current", long long, m_stat_mem_master.current());
-    ATTR_DECODE ("stat:mem_master_peak", long long, m_stat_mem_master.peak());
-    ATTR_DECODE ("stat:mem_master_ops_current", long long, m_stat_mem_master_ops.current());
-    ATTR_DECODE ("stat:mem_master_ops_peak", long long, m_stat_mem_master_ops.peak());
-    ATTR_DECODE ("stat:mem_master_args_current", long long, m_stat_mem_master_args.current());
-    ATTR_DECODE ("stat:mem_master_args_peak", long long, m_stat_mem_master_args.peak());
-    ATTR_DECODE ("stat:mem_master_syms_current", long long, m_stat_mem_master_syms.current());
-    ATTR_DECODE ("stat:mem_master_syms_peak", long long, m_stat_mem_master_syms.peak());
-    ATTR_DECODE ("stat:mem_master_defaults_current", long long, m_stat_mem_master_defaults.current());
-    ATTR_DECODE ("stat:mem_master_defaults_peak", long long, m_stat_mem_master_defaults.peak());
-    ATTR_DECODE ("stat:mem_master_consts_current", long long, m_stat_mem_master_consts.current());
-    ATTR_DECODE ("stat:mem_master_consts_peak", long long, m_stat_mem_master_consts.peak());
-    ATTR_DECODE ("stat:mem_inst_current", long long, m_stat_mem_inst.current());
-    ATTR_DECODE ("stat:mem_inst_peak", long long, m_stat_mem_inst.peak());
-    ATTR_DECODE ("stat:mem_inst_syms_current", long long, m_stat_mem_inst_syms.current());
-    ATTR_DECODE ("stat:mem_inst_syms_peak", long long, m_stat_mem_inst_syms.peak());
-    ATTR_DECODE ("stat:mem_inst_paramvals_current", long long, m_stat_mem_inst_paramvals.current());
-    ATTR_DECODE ("stat:mem_inst_paramvals_peak", long long, m_stat_mem_inst_paramvals.peak());
-    ATTR_DECODE ("stat:mem_inst_connections_current", long long, m_stat_mem_inst_connections.current());
-    ATTR_DECODE ("stat:mem_inst_connections_peak", long long, m_stat_mem_inst_connections.peak());
+#define STAT_DECODE(_name,_ctype,_src) ATTR_DECODE ("stat:" _name, _ctype, _src)
+    OSL_SHADINGSYS_STATS (STAT_DECODE)
+#undef STAT_DECODE
+    if (name == "stat:jit_target" && type == TypeDesc::STRING) {
+        spin_lock stat_lock (m_stat_mutex);
+        *(const char **)(val) = ustring(m_stat_jit_target).c_str();
+        return true;
+    }
 
     if (name == "colorsystem" && type.basetype == TypeDesc::PTR) {
         *(void**)val = &colorsystem();
@@ -1438,10 +1610,21 @@ ShadingSystemImpl::attribute (ShaderGroup *group, string_view name,
         group->m_exec_repeat = *(const int *)val;
         return true;
     }
+    if (name == "fast_math" && type == TypeDesc::TypeInt) {
+        group->m_fast_math = *(const int *)val;
+        return true;
+    }
     if (name == "groupname" && type == TypeDesc::TypeString) {
         group->name (ustring(((const char **)val)[0]));
         return true;
     }
+    if (name == "pgo_profile" && type == TypeDesc::TypeString) {
+        auto profile = std::make_shared<ShaderGroup::Profile>();
+        if (! read_group_profile (*profile, ((const char **)val)[0]))
+            return false;
+        group->m_pgo_profile = profile;
+        return true;
+    }
     return false;
 }
 
@@ -1453,6 +1636,11 @@ ShadingSystemImpl::getattribute (ShaderGroup *group, string_view name,
 {
     if (! group)
         return false;
+    // Report on the specialization that actually runs, holding on to it
+    // so that a concurrent ReParameter can't free it while we look.
+    ShaderGroupRef spec = group->current_respecialization ();
+    if (spec)
+        group = spec.get();
 
     if (name == "groupname" && type == TypeDesc::TypeString) {
         *(ustring *)val = group->name();
@@ -1484,6 +1672,10 @@ ShadingSystemImpl::getattribute (ShaderGroup *group, string_view name,
         *(int *)val = group->raytype_queries();
         return true;
     }
+    if (name == "llvm_code_size" && type == TypeDesc::TypeInt) {
+        *(int *)val = (int) group->llvm_code_size();
+        return true;
+    }
     if (name == "num_entry_layers" && type.basetype == TypeDesc::INT) {
         int n = 0;
         for (int i = 0;  i < group->nlayers();  ++i)
@@ -1535,6 +1727,10 @@ ShadingSystemImpl::getattribute (ShaderGroup *group, string_view name,
         *(int *)val = group->m_exec_repeat;
         return true;
     }
+    if (name == "fast_math" && type == TypeDesc::TypeInt) {
+        *(int *)val = group->m_fast_math;
+        return true;
+    }
     if (name == "ptx_compiled_version" && type.basetype == TypeDesc::PTR) {
         bool exists = !group->m_llvm_ptx_compiled_version.empty();
         *(std::string *)val = exists ? group->m_llvm_ptx_compiled_version : "";
@@ -1551,6 +1747,22 @@ ShadingSystemImpl::getattribute (ShaderGroup *group, string_view name,
         destroy_thread_info (threadinfo);
     }
 
+    if (name == "shared_from" && type == TypeDesc::TypeInt) {
+        *(int *)val = group->shared_from();
+        return true;
+    }
+    if (name == "num_raytype_variants" && type == TypeDesc::TypeInt) {
+        *(int *)val = group->num_raytype_variants();
+        return true;
+    }
+    if (name == "inst_merge_time" && type == TypeDesc::TypeFloat) {
+        *(float *)val = (float) group->inst_merge_time();
+        return true;
+    }
+    if (name == "num_uniform_layers" && type == TypeDesc::TypeInt) {
+        *(int *)val = group->num_uniform_layers();
+        return true;
+    }
     if (name == "num_textures_needed" && type == TypeDesc::TypeInt) {
         *(int *)val = (int)group->m_textures_needed.size();
         return true;
@@ -1770,12 +1982,22 @@ ShadingSystemImpl::getstats (int level) const
     BOOLOPT (llvm_debug_layers);
     BOOLOPT (llvm_debug_ops);
     BOOLOPT (llvm_output_bitcode);
+    BOOLOPT (llvm_report_calls);
+    STROPT (jit_target);
+    BOOLOPT (jit_fma);
+    BOOLOPT (jit_perf_map);
+    BOOLOPT (jit_gdb);
+    INTOPT (llvm_jit_partitions);
+    INTOPT (llvm_jit_partition_minops);
+    BOOLOPT (llvm_jit_partitions_compare);
+    INTOPT (jit_memory_budget);
     BOOLOPT (lazylayers);
     BOOLOPT (lazyglobals);
     BOOLOPT (lazyunconnected);
     BOOLOPT (lazy_userdata);
     BOOLOPT (userdata_isconnected);
     BOOLOPT (clearmemory);
+    BOOLOPT (load_osob);
     BOOLOPT (debugnan);
     BOOLOPT (debug_uninit);
     BOOLOPT (lockgeom_default);
@@ -1784,6 +2006,7 @@ ShadingSystemImpl::getstats (int level) const
     BOOLOPT (range_checking);
     BOOLOPT (greedyjit);
     BOOLOPT (countlayerexecs);
+    BOOLOPT (pgo_instrument);
     BOOLOPT (opt_simplify_param);
     BOOLOPT (opt_constant_fold);
     BOOLOPT (opt_stale_assign);
@@ -1797,20 +2020,30 @@ ShadingSystemImpl::getstats (int level) const
     BOOLOPT (opt_merge_instances_with_userdata);
     BOOLOPT (opt_fold_getattribute);
     BOOLOPT (opt_middleman);
+    BOOLOPT (opt_uniform_layers);
+    BOOLOPT (opt_share_groups);
+    BOOLOPT (opt_share_layers);
+    BOOLOPT (opt_respecialize);
+    BOOLOPT (opt_raytype_variants);
+    INTOPT  (opt_noderivs_raytypes);
     BOOLOPT (opt_texture_handle);
     BOOLOPT (opt_seed_bblock_aliases);
+    BOOLOPT (opt_skip_untouched_ops);
+    INTOPT  (opt_layer_threads);
     INTOPT  (opt_passes);
     INTOPT (no_noise);
     INTOPT (no_pointcloud);
     INTOPT (force_derivs);
     INTOPT (allow_shader_replacement);
     INTOPT (exec_repeat);
+    BOOLOPT (fast_math);
     INTOPT (opt_warnings);
     INTOPT (gpu_opt_error);
     STROPT (debug_groupname);
     STROPT (debug_layername);
     STROPT (archive_groupname);
     STROPT (archive_filename);
+    STROPT (compile_trace);
 #undef BOOLOPT
 #undef INTOPT
 #undef STROPT
@@ -1818,7 +2051,10 @@ ShadingSystemImpl::getstats (int level) const
 
     out << "  Shaders:\n";
     out << "    Requested: " << m_stat_shaders_requested << "\n";
-    out << "    Loaded:    " << m_stat_shaders_loaded << "\n";
+    out << "    Loaded:    " << m_stat_shaders_loaded;
+    if (m_stat_shaders_loaded_osob)
+        out << " (" << m_stat_shaders_loaded_osob << " from .osob)";
+    out << "\n";
     out << "    Masters:   " << m_stat_shaders_loaded << "\n";
     out << "    Instances: " << m_stat_instances << "\n";
     out << "  Time loading masters: "
@@ -1851,10 +2087,38 @@ ShadingSystemImpl::getstats (int level) const
 
     out << "  Compiled " << m_stat_groups_compiled << " groups, "
         << m_stat_instances_compiled << " instances\n";
+    if (m_stat_groups_shared)
+        out << "  Shared compiled code among " << m_stat_groups_shared
+            << " identical groups\n";
+    if (m_opt_share_layers)
+        out << "  Shared layer functions: " << m_stat_shared_layer_funcs
+            << " compiled, called by " << m_stat_layers_shared
+            << " other layers\n";
+    if (m_stat_pgo_hot_params || m_stat_pgo_weighted_branches)
+        out << "  Profile-guided compilation: " << m_stat_pgo_hot_params
+            << " params laid out by use, " << m_stat_pgo_weighted_branches
+            << " branches weighted\n";
+    if (m_stat_respecializations)
+        out << "  Re-specialized groups " << m_stat_respecializations
+            << " times after ReParameter, in "
+            << Strutil::timeintervalformat (m_stat_respecialize_time, 2)
+            << " (" << m_stat_respecialize_kept << " layers kept)\n";
+    if (m_stat_raytype_variants)
+        out << "  Compiled " << m_stat_raytype_variants
+            << " raytype variants of groups (" << m_stat_noderivs_variants
+            << " without derivatives)\n";
+    if (m_stat_output_subsets)
+        out << "  Compiled " << m_stat_output_subsets
+            << " output subsets of groups\n";
     out << "  Merged " << (m_stat_merged_inst+m_stat_merged_inst_opt)
         << " instances (" << m_stat_merged_inst << " initial, "
         << m_stat_merged_inst_opt << " after opt) in "
         << Strutil::timeintervalformat (m_stat_inst_merge_time, 2) << "\n";
+    if (m_stat_max_group_merge_time > 0)
+        out << "    Slowest group to merge: "
+            << (m_stat_max_group_merge_name.size() ? m_stat_max_group_merge_name.c_str() : "<unnamed group>")
+            << " (" << Strutil::timeintervalformat (m_stat_max_group_merge_time, 2)
+            << ")\n";
     if (m_stat_instances_compiled > 0)
         out << "  After optimization, " << m_stat_empty_instances
             << " empty instances ("
@@ -1878,6 +2142,17 @@ ShadingSystemImpl::getstats (int level) const
                             (int)m_stat_global_connections);
     out << Strutil::sprintf ("  Middlemen eliminated: %d\n",
                             (int)m_stat_middlemen_eliminated);
+    if (m_range_checking)
+        out << Strutil::sprintf ("  Range checks eliminated: %d\n",
+                                (int)m_stat_range_checks_eliminated);
+    if (m_opt_uniform_layers) {
+        out << Strutil::sprintf ("  Uniform layers: %d\n",
+                                (int)m_stat_uniform_layers);
+        if (m_profile)
+            out << Strutil::sprintf ("    per-object cache hits: %lld, misses: %lld\n",
+                                    (long long)m_stat_uniform_cache_hits,
+                                    (long long)m_stat_uniform_cache_misses);
+    }
     out << Strutil::sprintf ("  Derivatives needed on %d / %d symbols (%.1f%%)\n",
                             (int)m_stat_syms_with_derivs, (int)m_stat_postopt_syms,
                             (100.0*(int)m_stat_syms_with_derivs)/std::max((int)m_stat_postopt_syms,1));
@@ -1887,6 +2162,26 @@ ShadingSystemImpl::getstats (int level) const
         << Strutil::timeintervalformat (m_stat_opt_locking_time, 2) << "\n";
     out << "    runtime specialization:    "
         << Strutil::timeintervalformat (m_stat_specialization_time, 2) << "\n";
+    if (m_stat_opt_passes) {
+        out << "      basic blocks:            "
+            << Strutil::timeintervalformat (m_stat_opt_bblock_time, 2) << "\n";
+        out << "      optimize ops:            "
+            << Strutil::timeintervalformat (m_stat_opt_fold_time, 2) << "\n";
+        out << "      lifetimes:               "
+            << Strutil::timeintervalformat (m_stat_opt_lifetime_time, 2) << "\n";
+        out << "      middleman/unused params: "
+            << Strutil::timeintervalformat (m_stat_opt_cleanup_time, 2) << "\n";
+        out << Strutil::sprintf ("      %lld passes, %lld ops optimized, %lld skipped (%.1f%%)\n",
+                                 m_stat_opt_passes, m_stat_opt_ops_visited,
+                                 m_stat_opt_ops_skipped,
+                                 100.0 * m_stat_opt_ops_skipped / std::max (m_stat_opt_ops_visited + m_stat_opt_ops_skipped, 1LL));
+        if (m_stat_opt_parallel_layers)
+            out << "      layers run concurrently: "
+                << m_stat_opt_parallel_layers << "\n";
+        if (m_stat_opt_native_folds)
+            out << "      ops folded natively:     "
+                << m_stat_opt_native_folds << "\n";
+    }
     if (m_stat_total_llvm_time > 0.0) {
         out << "    LLVM setup:                "
             << Strutil::timeintervalformat (m_stat_llvm_setup_time, 2) << "\n";
@@ -1896,6 +2191,40 @@ ShadingSystemImpl::getstats (int level) const
             << Strutil::timeintervalformat (m_stat_llvm_opt_time, 2) << "\n";
         out << "    LLVM JIT:                  "
             << Strutil::timeintervalformat (m_stat_llvm_jit_time, 2) << "\n";
+        if (m_stat_groups_partitioned) {
+            out << "    Partitioned JIT:           " << m_stat_groups_partitioned
+                << " groups, " << Strutil::timeintervalformat (m_stat_partitioned_wall_time, 2)
+                << " wall, " << Strutil::timeintervalformat (m_stat_partitioned_cpu_time, 2)
+                << " total\n";
+            if (m_stat_single_module_time > 0.0)
+                out << "      as single modules:       "
+                    << Strutil::timeintervalformat (m_stat_single_module_time, 2) << "\n";
+        }
+        out << "  JITed code size: "
+            << Strutil::memformat (m_stat_llvm_code_size) << "\n";
+        if (m_jit_memory_budget)
+            out << "  JIT memory budget " << m_jit_memory_budget << " KB: "
+                << m_stat_jit_evictions << " evictions, "
+                << m_stat_jit_rejits << " re-JITs ("
+                << Strutil::timeintervalformat (m_stat_rejit_time, 2) << ")\n";
+    }
+    {
+        spin_lock stat_lock (m_stat_mutex);
+        if (m_stat_jit_target.size())
+            out << "  JIT target: " << m_stat_jit_target << "\n";
+        if (m_stat_calls_not_inlined.size()) {
+            std::vector<std::pair<int,std::string>> calls;
+            for (auto &c : m_stat_calls_not_inlined)
+                calls.emplace_back (c.second, c.first);
+            std::sort (calls.begin(), calls.end(),
+                       [](const std::pair<int,std::string> &a,
+                          const std::pair<int,std::string> &b) {
+                           return a.first > b.first;
+                       });
+            out << "  Calls not inlined (" << calls.size() << " functions):\n";
+            for (size_t i = 0; i < std::min (calls.size(), size_t(10)); ++i)
+                out << "    " << calls[i].second << " " << calls[i].first << "\n";
+        }
     }
 
     out << "  Texture calls compiled: "
@@ -1945,13 +2274,25 @@ ShadingSystemImpl::getstats (int level) const
             << Strutil::timeintervalformat(OIIO::Timer::seconds(m_stat_total_shading_time_ticks), 2)
             << " (sum of all threads)\n";
         // Account for times of any groups that haven't yet been destroyed
-        {
-            spin_lock lock (m_all_shader_groups_mutex);
-            for (auto&& grp : m_all_shader_groups) {
-                if (ShaderGroupRef g = grp.lock()) {
-                    long long ticks = g->m_stat_total_shading_time_ticks;
+        for (auto&& g : m_group_registry->groups()) {
+            // Time spent running a group's re-specializations counts as
+            // time running the group...
+            std::vector<ShaderGroupRef> specs;
+            {
+                lock_guard lock (g->m_mutex);
+                specs = g->m_respecializations;
+            }
+            specs.push_back (g);
+            for (auto&& spec : specs) {
+                // ...as does time running any of their raytype variants.
+                std::vector<ShaderGroup *> runs (1, spec.get());
+                for (int i = 0, n = spec->num_raytype_variants();  i < n;  ++i)
+                    runs.push_back (spec->raytype_variant (i));
+                for (auto&& r : runs) {
+                    long long ticks = r->m_stat_total_shading_time_ticks;
+                    spin_lock lock (m_stat_mutex);
                     m_group_profile_times[g->name()] += ticks;
-                    g->m_stat_total_shading_time_ticks -= ticks;
+                    r->m_stat_total_shading_time_ticks -= ticks;
                 }
             }
         }
@@ -1981,6 +2322,195 @@ ShadingSystemImpl::getstats (int level) const
 
 
 
+// Return s as a quoted JSON string.
+static std::string
+json_string (string_view s)
+{
+    std::string r ("\"");
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            (r += '\\') += c;
+        else if ((unsigned char)c < 0x20)
+            r += Strutil::sprintf ("\\u%04x", (int)c);
+        else
+            r += c;
+    }
+    return r + '"';
+}
+
+
+
+// Return x as a JSON number.  JSON has no way to spell NaN or Inf, so
+// those (e.g. a time ratio over an empty interval) are written as null.
+template<typename T>
+static std::string
+json_number (T x)
+{
+    if (std::is_floating_point<T>::value && ! std::isfinite (double(x)))
+        return "null";
+    std::ostringstream s;
+    s.imbue (std::locale::classic());  // force C locale
+    s << x;
+    return s.str();
+}
+
+
+
+std::string
+ShadingSystemImpl::getstats_json (int level) const
+{
+    if (level <= 0)
+        return "{}";
+    std::ostringstream out;
+    out.imbue (std::locale::classic());  // force C locale
+    out << "{\n";
+    out << "  \"version\": " << json_string(OSL_LIBRARY_VERSION_STRING) << ",\n";
+    out << "  \"llvm_version\": " << json_string(OSL_LLVM_FULL_VERSION) << ",\n";
+
+    // The counters are atomics or guarded by the stats lock, which is only
+    // ever held briefly, so this doesn't stall any shading threads.
+    std::map<ustring,long long> profile_times;
+    {
+        spin_lock stat_lock (m_stat_mutex);
+        out << "  \"stats\": {";
+        const char *sep = "\n";
+#define STAT_JSON(_name,_ctype,_src)                                    \
+        out << sep << "    \"" _name "\": "                             \
+            << json_number((_ctype)(_src));                             \
+        sep = ",\n";
+        OSL_SHADINGSYS_STATS (STAT_JSON)
+#undef STAT_JSON
+        out << "\n  },\n";
+        out << "  \"jit_target\": " << json_string(m_stat_jit_target) << ",\n";
+        // Shadeop calls left in the JIT'd code (see llvm_report_calls)
+        out << "  \"calls_not_inlined\": {";
+        sep = "\n";
+        for (auto&& c : m_stat_calls_not_inlined) {
+            out << sep << "    " << json_string(c.first) << ": " << c.second;
+            sep = ",\n";
+        }
+        out << (m_stat_calls_not_inlined.size() ? "\n  },\n" : "},\n");
+        profile_times = m_group_profile_times;
+    }
+    out << "  \"llvm_jit_memory\": "
+        << (long long)LLVM_Util::total_jit_memory_held();
+
+    // Shading time of groups no longer around (or already tallied by
+    // getstats), by group name.
+    if (profile_times.size()) {
+        out << ",\n  \"group_profile_times\": {";
+        const char *sep = "\n";
+        for (auto&& t : profile_times) {
+            out << sep << "    " << json_string(t.first) << ": "
+                << json_number(OIIO::Timer::seconds(t.second));
+            sep = ",\n";
+        }
+        out << "\n  }";
+    }
+
+    if (level >= 2) {
+        // Per-group breakdowns.  Only groups that are done optimizing
+        // report their layers and ops, since those don't change after.
+        out << ",\n  \"groups\": [";
+        const char *sep = "\n";
+        for (auto&& g : m_group_registry->groups()) {
+            // Hold on to the current specialization, so that a concurrent
+            // ReParameter can't free it while we read it.
+            ShaderGroupRef specref = g->current_respecialization ();
+            ShaderGroup &spec (specref ? *specref : *g);
+            out << sep << "    {\n";
+            sep = ",\n";
+            out << "      \"name\": " << json_string(g->name()) << ",\n";
+            out << "      \"id\": " << g->id() << ",\n";
+            out << "      \"optimized\": "
+                << (spec.optimized() ? "true" : "false") << ",\n";
+            if (spec.optimized()) {
+                int nlayers = 0, nops = 0, nsyms = 0;
+                for (int i = 0, n = spec.nlayers();  i < n;  ++i) {
+                    const ShaderInstance *inst = spec[i];
+                    if (inst->unused())
+                        continue;
+                    ++nlayers;
+                    nops += (int) inst->ops().size();
+                    nsyms += (int) inst->symbols().size();
+                }
+                out << "      \"shared_from\": " << spec.shared_from() << ",\n";
+                out << "      \"layers\": " << nlayers << ",\n";
+                out << "      \"ops\": " << nops << ",\n";
+                out << "      \"symbols\": " << nsyms << ",\n";
+                out << "      \"optimize_time\": " << json_number(spec.m_stat_optimize_time) << ",\n";
+                out << "      \"llvm_time\": " << json_number(spec.m_stat_llvm_time) << ",\n";
+                out << "      \"inst_merge_time\": " << json_number(spec.inst_merge_time()) << ",\n";
+                out << "      \"llvm_code_size\": " << spec.llvm_code_size() << ",\n";
+                out << "      \"groupdata_size\": " << spec.llvm_groupdata_size() << ",\n";
+                out << "      \"uniform_layers\": " << spec.num_uniform_layers() << ",\n";
+            }
+            // Running the group's current specialization or any of its
+            // raytype variants counts as running the group.
+            std::vector<const ShaderGroup *> runs { g.get() };
+            if (&spec != g.get())
+                runs.push_back (&spec);
+            for (int i = 0, n = spec.num_raytype_variants();  i < n;  ++i)
+                runs.push_back (spec.raytype_variant (i));
+            long long executions = 0, ticks = 0;
+            for (auto&& r : runs) {
+                executions += r->executions();
+                ticks += r->m_stat_total_shading_time_ticks;
+            }
+            out << "      \"raytype_variants\": " << spec.num_raytype_variants() << ",\n";
+            out << "      \"executions\": " << executions << ",\n";
+            out << "      \"shading_time\": " << json_number(OIIO::Timer::seconds(ticks)) << "\n";
+            out << "    }";
+        }
+        out << "\n  ]";
+    }
+    out << "\n}\n";
+    return out.str();
+}
+
+
+
+void
+ShadingSystemImpl::trace_event (const char *name, ustring arg,
+                                long long begin, long long end)
+{
+    static std::atomic<int> next_tid (0);
+    thread_local int tid = ++next_tid;
+    spin_lock lock (m_trace_mutex);
+    m_trace_events.push_back (TraceEvent { name, arg, tid, begin, end });
+}
+
+
+
+void
+ShadingSystemImpl::write_compile_trace ()
+{
+    std::ofstream out;
+    OIIO::Filesystem::open (out, m_compile_trace.string());
+    if (! out.good()) {
+        errorf ("Could not open compile trace file \"%s\"", m_compile_trace);
+        return;
+    }
+    out.imbue (std::locale::classic());  // force C locale
+    // Chrome's trace event format ("X" events are complete spans), which
+    // chrome://tracing and Perfetto can load.
+    spin_lock lock (m_trace_mutex);
+    out << "{\"traceEvents\": [";
+    const char *sep = "\n";
+    for (auto&& e : m_trace_events) {
+        out << sep << "{\"name\": \"" << e.name << "\", \"cat\": \"osl\", "
+            << "\"ph\": \"X\", \"pid\": 1, \"tid\": " << e.tid
+            << ", \"ts\": " << e.begin << ", \"dur\": " << e.end - e.begin;
+        if (e.arg)
+            out << ", \"args\": {\"name\": " << json_string(e.arg) << "}";
+        out << "}";
+        sep = ",\n";
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+
+
 void
 ShadingSystemImpl::printstats () const
 {
@@ -1995,7 +2525,8 @@ bool
 ShadingSystemImpl::Parameter (string_view name, TypeDesc t, const void *val,
                               bool lockgeom)
 {
-    return Parameter (*m_curgroup, name, t, val, lockgeom);
+    ShaderGroupRef group = std::atomic_load (&m_curgroup);
+    return Parameter (*group, name, t, val, lockgeom);
 }
 
 
@@ -2023,13 +2554,14 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname)
 {
     ShaderGroupRef group (new ShaderGroup(groupname));
     group->m_exec_repeat = m_exec_repeat;
-    {
-        // Record the group in the SS's census of all extant groups
-        spin_lock lock (m_all_shader_groups_mutex);
-        m_all_shader_groups.push_back (group);
-        ++m_groups_to_compile_count;
-        m_curgroup = group;
-    }
+    group->m_fast_math = m_fast_math;
+    // Record the group in the SS's census of all extant groups. This only
+    // locks one shard of the registry, so threads building different
+    // groups at the same time don't contend.
+    group->m_registry = m_group_registry;
+    m_group_registry->add (group);
+    ++m_groups_to_compile_count;
+    std::atomic_store (&m_curgroup, group);
     return group;
 }
 
@@ -2038,13 +2570,13 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname)
 bool
 ShadingSystemImpl::ShaderGroupEnd (void)
 {
-    if (! m_curgroup) {
+    // Take the current group, leaving no currently active group
+    ShaderGroupRef group = std::atomic_exchange (&m_curgroup, ShaderGroupRef());
+    if (! group) {
         error ("ShaderGroupEnd() was called without ShaderGroupBegin()");
         return false;
     }
-    bool ok = ShaderGroupEnd (*m_curgroup);
-    m_curgroup.reset();  // no currently active group
-    return ok;
+    return ShaderGroupEnd (*group);
 }
 
 
@@ -2052,36 +2584,39 @@ ShadingSystemImpl::ShaderGroupEnd (void)
 bool
 ShadingSystemImpl::ShaderGroupEnd (ShaderGroup& group)
 {
-    // Lock just in case we do something not thread-safe within
-    // ShaderGroupEnd. This may be overly cautious, but unless it shows
-    // up as a major bottleneck, I'm inclined to play it safe.
-    lock_guard lock (m_mutex);
-
-    // Mark the layers that can be run lazily
-    if (! group.m_group_use.empty()) {
-        int nlayers = group.nlayers ();
-        for (int layer = 0;  layer < nlayers;  ++layer) {
-            ShaderInstance *inst = group[layer];
-            if (! inst)
-                continue;
-            inst->last_layer (layer == nlayers-1);
-        }
+    // Everything here only touches this group (and thread-safe stats), so
+    // only the group itself is locked, and threads building different
+    // groups never wait for each other.
+    {
+        lock_guard lock (group.m_mutex);
+
+        // Mark the layers that can be run lazily
+        if (! group.m_group_use.empty()) {
+            int nlayers = group.nlayers ();
+            for (int layer = 0;  layer < nlayers;  ++layer) {
+                ShaderInstance *inst = group[layer];
+                if (! inst)
+                    continue;
+                inst->last_layer (layer == nlayers-1);
+            }
 
-        // Merge instances now if they really want it bad, otherwise wait
-        // until we optimize the group.
-        if (m_opt_merge_instances >= 2)
-            merge_instances (group);
-    }
+            // Merge instances now if they really want it bad, otherwise wait
+            // until we optimize the group.
+            if (m_opt_merge_instances >= 2)
+                merge_instances (group);
+        }
 
-    // Merge the raytype_queries of all the individual layers
-    group.m_raytype_queries = 0;
-    for (int layer = 0, n = group.nlayers(); layer < n; ++layer) {
-        if (ShaderInstance *inst = group[layer])
-            group.m_raytype_queries |= inst->master()->raytype_queries();
+        // Merge the raytype_queries of all the individual layers
+        group.m_raytype_queries = 0;
+        for (int layer = 0, n = group.nlayers(); layer < n; ++layer) {
+            if (ShaderInstance *inst = group[layer])
+                group.m_raytype_queries |= inst->master()->raytype_queries();
+        }
+        // std::cout << "Group " << group.name() << " ray query bits "
+        //         << group.m_raytype_queries << "\n";
     }
-    // std::cout << "Group " << group.name() << " ray query bits "
-    //         << group.m_raytype_queries << "\n";
 
+    // Archiving serializes the group, which takes the group's lock itself.
     ustring groupname = group.name();
     if (groupname.size() && groupname == m_archive_groupname) {
         std::string filename = m_archive_filename.string();
@@ -2102,11 +2637,11 @@ ShadingSystemImpl::Shader (string_view shaderusage,
                            string_view layername)
 {
     // Make sure we have a current attrib state
-    bool singleton = (! m_curgroup);
-    if (singleton)
-        ShaderGroupBegin ("");
+    ShaderGroupRef group = std::atomic_load (&m_curgroup);
+    if (! group)
+        group = ShaderGroupBegin ("");
 
-    return Shader (*m_curgroup, shaderusage, shadername, layername);
+    return Shader (*group, shaderusage, shadername, layername);
 }
 
 
@@ -2169,11 +2704,12 @@ bool
 ShadingSystemImpl::ConnectShaders (string_view srclayer, string_view srcparam,
                                    string_view dstlayer, string_view dstparam)
 {
-    if (! m_curgroup) {
+    ShaderGroupRef group = std::atomic_load (&m_curgroup);
+    if (! group) {
         error ("ConnectShaders can only be called within ShaderGroupBegin/End");
         return false;
     }
-    return ConnectShaders (*m_curgroup, srclayer, srcparam, dstlayer, dstparam);
+    return ConnectShaders (*group, srclayer, srcparam, dstlayer, dstparam);
 }
 
 
@@ -2568,25 +3104,74 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname,
 
 
 
+/// Set the named parameter of an unoptimized layer, whose symbols are
+/// still numbered like its master's.  Return false if it has no such
+/// parameter of a matching type.
+static bool
+set_pristine_param (ShaderInstance &inst, ustring name, TypeDesc type,
+                    const void *val)
+{
+    int i = inst.findparam (name);
+    const Symbol *sym = inst.mastersymbol (i);
+    if (! sym || ! equivalent (sym->typespec(), type))
+        return false;
+    void *dst = inst.param_storage (i);
+    if (! dst)
+        return false;
+    memcpy (dst, val, type.size());
+    return true;
+}
+
+
+
+/// Set the named parameter of an optimized layer, whose symbols are
+/// numbered its own way.  Return false if it has no such parameter of a
+/// matching type (for example, if it was optimized away).
+static bool
+set_optimized_param (ShaderInstance &inst, ustring name, TypeDesc type,
+                     const void *val)
+{
+    Symbol *sym = inst.symbol (inst.findparam (name));
+    if (! sym || sym->name() != name || ! equivalent (sym->typespec(), type))
+        return false;
+    memcpy (sym->data(), val, type.size());
+    return true;
+}
+
+
+
 bool
-ShadingSystemImpl::ReParameter (ShaderGroup &group, string_view layername_,
+ShadingSystemImpl::ReParameter (ShaderGroup &origgroup, string_view layername_,
                                 string_view paramname,
                                 TypeDesc type, const void *val)
 {
+    // If the group has been re-specialized, it's the parameters of the
+    // current specialization that are used when it runs.  Hold on to it,
+    // so that a concurrent ReParameter can't free it under us.
+    ShaderGroupRef spec = origgroup.current_respecialization ();
+    ShaderGroup &group (spec ? *spec : origgroup);
+
     // Find the named layer
     ustring layername (layername_);
     ShaderInstance *layer = NULL;
+    int layerindex = -1;
     for (int i = 0, e = group.nlayers();  i < e;  ++i) {
         if (group[i]->layername() == layername) {
             layer = group[i];
+            layerindex = i;
             break;
         }
     }
     if (! layer)
         return false;   // could not find the named layer
 
-    // Find the named parameter within the layer
-    int paramindex = layer->findparam (ustring(paramname));
+    // Find the named parameter within the layer.  N.B. optimization
+    // renumbers the symbols of each layer it makes (and a variant or
+    // subset of the group may drop different ones), so the parameter's
+    // index is only good for this layer; everywhere else it must be
+    // looked up by name.
+    ustring name (paramname);
+    int paramindex = layer->findparam (name);
     if (paramindex < 0)
         return false;   // could not find the named parameter
 
@@ -2596,23 +3181,224 @@ ShadingSystemImpl::ReParameter (ShaderGroup &group, string_view layername_,
         OSL_DASSERT(layer->mastersymbol(paramindex) && "No symbol for paramindex");
         return false;
     }
+    if (sym->name() != name)
+        return false;   // the master's index of a param optimized away
 
     // Check for mismatch versus previously-declared type
     if (!equivalent(sym->typespec(), type))
         return false;
 
     // Can't change param value if the group has already been optimized,
-    // unless that parameter is marked lockgeom=0.
+    // unless that parameter is marked lockgeom=0, or we can make a new
+    // specialization of the group with the new value.
     if (group.optimized() && sym->lockgeom())
-        return false;
+        return respecialize (origgroup, layerindex, name, type, val);
 
     // Do the deed
     memcpy (sym->data(), val, type.size());
+    group.bump_param_generation ();
+
+    // The same parameter of any raytype variants of the group must change
+    // too, as must the unoptimized layers that later re-specializations
+    // and variants will be made from.
+    {
+        lock_guard lock (group.m_mutex);
+        for (int i = 0, n = group.num_raytype_variants();  i < n;  ++i) {
+            ShaderGroup &variant (*group.raytype_variant(i));
+            if (set_optimized_param (*variant.layer(layerindex), name, type, val))
+                variant.bump_param_generation ();
+        }
+        if (group.m_pristine_layers.size())
+            set_pristine_param (*group.m_pristine_layers[layerindex], name,
+                                type, val);
+    }
+    {
+        lock_guard lock (origgroup.m_mutex);
+        for (auto&& subset : origgroup.m_output_subsets)
+            if (layerindex < subset.second->nlayers() &&
+                set_optimized_param (*subset.second->layer(layerindex),
+                                     name, type, val))
+                subset.second->bump_param_generation ();
+    }
+    if (&origgroup != &group) {
+        lock_guard lock (origgroup.m_mutex);
+        if (origgroup.m_pristine_layers.size())
+            set_pristine_param (*origgroup.m_pristine_layers[layerindex],
+                                name, type, val);
+    }
+    return true;
+}
+
+
+
+std::string
+ShadingSystemImpl::codegen_signature () const
+{
+    // Every option that changes how layers are optimized or what code
+    // is generated for them.
+    std::ostringstream out;
+    out.imbue (std::locale::classic());  // force C locale
+    out << "codegen " << m_optimize << ' ' << m_llvm_optimize << ' '
+        << m_range_checking << ' ' << m_debugnan << ' ' << m_debug_uninit
+        << ' ' << m_jit_target << ' ' << m_jit_fma << ' '
+        << m_llvm_jit_partitions << ' ' << m_llvm_jit_partition_minops
+        << " ;\n";
+    out << "exec " << m_lazylayers << m_lazyglobals << m_lazyunconnected
+        << m_lazy_userdata << m_userdata_isconnected << m_clearmemory
+        << m_countlayerexecs << m_pgo_instrument << m_lockgeom_default
+        << m_strict_messages << m_no_noise << m_no_pointcloud
+        << m_force_derivs << ' ' << m_llvm_debug_layers << ' '
+        << m_llvm_debug_ops << ' ' << m_max_local_mem_KB << " ;\n";
+    out << "opt " << m_opt_simplify_param << m_opt_constant_fold
+        << m_opt_stale_assign << m_opt_elide_useless_ops
+        << m_opt_elide_unconnected_outputs << m_opt_peephole
+        << m_opt_coalesce_temps << m_opt_assign << m_opt_mix
+        << int(m_opt_merge_instances) << m_opt_merge_instances_with_userdata
+        << m_opt_fold_getattribute << m_opt_middleman
+        << m_opt_uniform_layers << m_opt_texture_handle
+        << m_opt_seed_bblock_aliases << m_opt_skip_untouched_ops
+        << m_optimize_nondebug << ' ' << m_opt_passes << ' '
+        << m_opt_layername << ' ' << m_debug_groupname << ' '
+        << m_debug_layername << " ;\n";
+    if (m_opt_uniform_layers) {
+        out << "uniform";
+        for (auto&& a : m_uniform_attributes)
+            out << ' ' << a;
+        out << " ;\n";
+    }
+    return out.str();
+}
+
+
+
+bool
+ShadingSystemImpl::respecialize (ShaderGroup &group, int layer,
+                                 ustring paramname, TypeDesc type,
+                                 const void *val)
+{
+    if (! m_opt_respecialize || renderer()->supports ("OptiX"))
+        return false;
+
+    OIIO::Timer timer;
+    // Apply the change to the unoptimized layers and copy them under the
+    // group's lock, so that concurrent changes to the same group are
+    // applied in order, each copy including all the changes before it.
+    // The (slow) optimizing and JITing happens without the lock.
+    // Only the changed layer and those downstream of it need to be made
+    // again; the new specialization keeps the others just as the current
+    // one optimized and JITed them (see ShaderGroup::respecialization).
+    // We hold on to the current one while we build on it.
+    ShaderGroupRef spec, base;
+    int seq = 0;
+    {
+        lock_guard lock (group.m_mutex);
+        if (group.m_pristine_layers.empty())
+            return false;   // optimized without opt_respecialize
+        if (! set_pristine_param (*group.m_pristine_layers[layer], paramname,
+                                  type, val))
+            return false;
+        base = group.current_respecialization ();
+        const ShaderGroup &current (base ? *base : group);
+        if (reusable_layers (current))
+            spec = group.respecialization (&current, layer);
+        else
+            spec = group.respecialization ();
+        seq = ++group.m_respecialize_seq;
+    }
+
+    // Optimize and JIT the new layers of the specialization.  This goes
+    // through all the usual machinery, so a specialization made entirely
+    // anew that is identical to one we've already made (for example, when
+    // a value is set back to one it had before) is shared rather than
+    // recompiled.
+    ++m_groups_to_compile_count;
+    optimize_group (*spec, nullptr);
+    if (! spec->optimized()) {
+        // The layers made again no longer fit the code of the kept ones
+        // (see BackendLLVM::pin_kept_layers), so make them all again.
+        {
+            lock_guard lock (group.m_mutex);
+            spec = group.respecialization ();
+        }
+        ++m_groups_to_compile_count;
+        optimize_group (*spec, nullptr);
+    }
+    int nkept = 0;
+    for (int i = 0, e = spec->nlayers();  i < e;  ++i)
+        nkept += spec->kept_layer (i);
+
+    // Publish the new specialization: executions that start after this
+    // use it in its entirety (code, group data layout, and symbols), while
+    // any still running the old one are unaffected, since it is kept.  If
+    // a later change was published while we compiled, ours (which it
+    // includes) is already out of date.
+    lock_guard lock (group.m_mutex);
+    if (seq < group.m_respecialize_published)
+        return true;
+    group.m_respecialize_published = seq;
+    group.m_respecializations.push_back (spec);
+    group.m_current_specialization.store (spec.get());
+    // (The new specialization has its own id, but anything keyed on the
+    // group itself must not outlive the change either.)
+    group.bump_param_generation ();
+    // Output subsets made before now keep the old value; forget them so
+    // that asking again makes fresh ones.
+    group.m_output_subsets.clear ();
+    free_retired_specializations (group);
+
+    if (m_compile_report)
+        infof ("Re-specialized shader group \"%s\" (%d of %d layers kept)",
+               group.name(), nkept, spec->nlayers());
+    m_stat_respecializations += 1;
+    m_stat_respecialize_kept += nkept;
+    spin_lock stat_lock (m_stat_mutex);
+    m_stat_respecialize_time += timer();
     return true;
 }
 
 
 
+void
+ShadingSystemImpl::free_retired_specializations (ShaderGroup &group)
+{
+    // The new specialization was published before we look, so a context
+    // that starts using an older one after our look is sure to notice
+    // that it's no longer current, and move on (see
+    // ShadingContext::execute_init).  Any older one still in use is kept
+    // until a later re-specialization finds it no longer is.
+    ShaderGroup *current = &group.current_specialization();
+    std::vector<ShaderGroupRef> retired;
+    {
+        spin_lock ctx_lock (m_contexts_mutex);
+        auto &specs (group.m_respecializations);
+        for (size_t i = 0;  i < specs.size();  ) {
+            ShaderGroup *spec = specs[i].get();
+            bool inuse = (spec == current);
+            for (size_t c = 0;  c < m_contexts.size() && ! inuse;  ++c)
+                inuse = m_contexts[c]->using_specialization (spec);
+            if (inuse) {
+                ++i;
+            } else {
+                retired.push_back (specs[i]);
+                specs.erase (specs.begin() + i);
+            }
+        }
+    }
+
+    // Its executions and shading time still count as the group's.
+    for (auto&& spec : retired) {
+        std::vector<ShaderGroup *> runs (1, spec.get());
+        for (int i = 0, n = spec->num_raytype_variants();  i < n;  ++i)
+            runs.push_back (spec->raytype_variant (i));
+        for (auto&& r : runs) {
+            group.m_executions += r->executions();
+            group.m_stat_total_shading_time_ticks += r->m_stat_total_shading_time_ticks;
+        }
+    }
+}
+
+
+
 PerThreadInfo *
 ShadingSystemImpl::create_thread_info()
 {
@@ -2657,6 +3443,8 @@ ShadingSystemImpl::release_context (ShadingContext *ctx)
     if (! ctx)
         return;
     ctx->process_errors ();
+    ctx->forget_specialization ();
+    ctx->clear_uniform_cache ();
     ctx->thread_info()->context_pool.push (ctx);
 }
 
@@ -2847,6 +3635,9 @@ ShadingSystemImpl::is_renderer_output (ustring layername, ustring paramname,
             if (std::find(aovs.begin(), aovs.end(), name2) != aovs.end())
                 return true;
         }
+        // An output subset computes its own outputs and nothing else.
+        if (group->m_is_output_subset)
+            return false;
     }
     const std::vector<ustring> &aovs (m_renderer_outputs);
     if (aovs.size() > 0) {
@@ -2869,6 +3660,8 @@ ShadingSystemImpl::group_post_jit_cleanup (ShaderGroup &group)
     off_t symmem = 0;
     size_t connectionmem = 0;
     for (int layer = 0;  layer < group.nlayers();  ++layer) {
+        if (group.kept_layer (layer))
+            continue;  // still in use by the group it was kept from
         ShaderInstance *inst = group[layer];
         // We no longer needs ops and args -- create empty vectors and
         // swap with the ones in the instance.
@@ -2897,6 +3690,145 @@ ShadingSystemImpl::group_post_jit_cleanup (ShaderGroup &group)
 
 
 
+void
+ShadingSystemImpl::keep_pristine_layers (ShaderGroup &group)
+{
+    if (group.m_pristine_layers.size() || renderer()->supports ("OptiX"))
+        return;
+    // Not possible if its layers were taken from an optimized group.
+    for (int i = 0, e = group.nlayers();  i < e;  ++i)
+        if (group[i]->symbols().size())
+            return;
+    for (int i = 0, e = group.nlayers();  i < e;  ++i)
+        group.m_pristine_layers.push_back (group[i]->unoptimized_copy());
+}
+
+
+
+bool
+ShadingSystemImpl::reusable_layers (const ShaderGroup &group) const
+{
+    // Only for re-specializations (or the groups they're made from) of
+    // groups whose code stays where it was JITed, laid out without a
+    // profile.
+    return m_opt_respecialize && ! m_jit_memory_budget && ! m_pgo_instrument &&
+           (group.m_pristine_layers.size() || group.m_is_respecialization) &&
+           ! group.m_is_raytype_variant && ! group.m_is_output_subset &&
+           ! group.m_pgo_profile && ! renderer()->supports ("OptiX");
+}
+
+
+
+ShaderGroup &
+ShadingSystemImpl::raytype_variant (ShaderGroup &group, int raytype,
+                                    bool noderivs)
+{
+    // Only the ray types that the group queries, and that weren't already
+    // fixed by set_raytypes, make any difference to its code.
+    int queries = 0;
+    if (m_opt_raytype_variants)
+        queries = group.raytype_queries()
+                & ~(group.raytypes_on() | group.raytypes_off());
+    if ((! queries && ! noderivs) || group.m_is_raytype_variant ||
+          ! group.nlayers())
+        return group;
+    int raytypes = raytype & queries;
+    if (ShaderGroup *variant = group.find_raytype_variant (raytypes, noderivs))
+        return *variant;
+
+    // First time we've seen this combination of ray types -- make a copy
+    // of the unoptimized group, specialize it for them, and compile it.
+    lock_guard lock (group.m_mutex);
+    if (ShaderGroup *variant = group.find_raytype_variant (raytypes, noderivs))
+        return *variant;   // another thread compiled it while we waited
+    if (group.num_raytype_variants() >= ShaderGroup::max_raytype_variants)
+        return group;
+    if (! group.optimized())
+        keep_pristine_layers (group);
+    ShaderGroupRef variant = group.respecialization ();
+    if (! variant)
+        return group;   // optimized before opt_raytype_variants was set
+    variant->m_is_raytype_variant = true;
+    variant->m_no_derivs = noderivs;
+    variant->set_raytypes (group.raytypes_on() | raytypes,
+                           group.raytypes_off() | (queries & ~raytypes));
+    ++m_groups_to_compile_count;
+    optimize_group (*variant, nullptr);
+    group.add_raytype_variant (raytypes, noderivs, variant);
+    m_stat_raytype_variants += 1;
+    if (noderivs)
+        m_stat_noderivs_variants += 1;
+    if (m_compile_report)
+        infof ("Compiled variant of shader group \"%s\" for raytypes %d of %d%s",
+               group.name(), raytypes, queries,
+               noderivs ? " without derivatives" : "");
+    return *variant;
+}
+
+
+
+ShaderGroupRef
+ShadingSystemImpl::output_subset (ShaderGroup &group, cspan<ustring> outputs)
+{
+    // The cache key is the set of names, in a canonical order.
+    std::vector<ustring> names (outputs.begin(), outputs.end());
+    std::sort (names.begin(), names.end(),
+               [](ustring a, ustring b){ return a.c_str() < b.c_str(); });
+    names.erase (std::unique (names.begin(), names.end()), names.end());
+
+    lock_guard lock (group.m_mutex);
+    for (auto&& subset : group.m_output_subsets)
+        if (subset.first == names)
+            return subset.second;
+    if (! group.optimized())
+        keep_pristine_layers (group);
+
+    // Find the last layer with any of the outputs.  Connections only run
+    // from earlier layers to later ones, so none of the layers after it
+    // can contribute, and the variant simply ends there.
+    auto is_output = [](const ShaderInstance *layer, ustring name) {
+        size_t dot = name.find ('.');
+        if (dot != ustring::npos) {
+            if (ustring (name, 0, dot) != layer->layername())
+                return false;
+            name = ustring (name, dot+1);
+        }
+        int p = layer->findparam (name);
+        return p >= 0 && layer->mastersymbol(p)->symtype() == SymTypeOutputParam;
+    };
+    int last = -1;
+    for (int i = 0, e = (int)group.m_pristine_layers.size();  i < e;  ++i)
+        for (auto&& name : names)
+            if (is_output (group.m_pristine_layers[i].get(), name))
+                last = i;
+    ShaderGroupRef variant;
+    if (last >= 0)
+        variant = group.respecialization ();
+    if (! variant)
+        return variant;
+
+    // Making the requested outputs the variant's only renderer outputs
+    // lets the optimizer eliminate everything, in every layer, that
+    // doesn't contribute to them.
+    variant->m_layers.resize (last+1);
+    variant->m_layers.back()->last_layer (true);
+    variant->clear_entry_layers ();
+    variant->m_renderer_outputs = names;
+    variant->m_is_output_subset = true;
+    ++m_groups_to_compile_count;
+    optimize_group (*variant, nullptr);
+    group.m_output_subsets.emplace_back (names, variant);
+    m_stat_output_subsets += 1;
+    if (m_compile_report)
+        infof ("Compiled subset of shader group \"%s\" for %d outputs "
+               "(%d of %d layers, %d bytes of code)", group.name(),
+               (int)names.size(), last+1, group.nlayers(),
+               (int)variant->llvm_code_size());
+    return variant;
+}
+
+
+
 void
 ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
 {
@@ -2904,7 +3836,23 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
         return;    // already optimized
 
     OIIO::Timer timer;
+
+    // Identical groups may share a single specialization and JIT. (N.B.
+    // computing the signature needs the group lock itself, so do it first.
+    // The PTX for OptiX is named per group, so it is never shared, nor
+    // is anything while debugging groups by name, or when groups may
+    // drop their code to stay within the JIT memory budget.  Nor is a
+    // re-specialization that keeps optimized layers, which the signature
+    // can't describe.)
+    std::string signature;
+    if (m_opt_share_groups && m_debug_groupname.empty() &&
+        ! m_pgo_instrument && ! m_jit_memory_budget &&
+        ! group.has_kept_layers() && ! renderer()->supports ("OptiX"))
+        signature = group.specialization_signature () + codegen_signature ();
+
+    CompileTraceSpan trace (*this, "group_lock_wait", group.name());
     lock_guard lock (group.m_mutex);
+    trace.next ("optimize_group");
     if (group.optimized()) {
         // The group was somehow optimized by another thread between the
         // time we checked group.optimized() and now that we have the lock.
@@ -2922,7 +3870,7 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
         // and also as optimized so nobody locks on it again, and record
         // how long we waited for the lock.
         group.does_nothing (true);
-        group.m_optimized = true;
+        group.optimized (true);
         spin_lock stat_lock (m_stat_mutex);
         double t = timer();
         m_stat_optimization_time += t;
@@ -2932,6 +3880,41 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
 
     double locking_time = timer();
 
+    // Keep copies of the layers as they are now, before optimization
+    // changes them, in case ReParameter needs to re-specialize the group
+    // or we need to make variants of it for particular ray types.
+    if (((m_opt_respecialize && ! group.m_is_respecialization) ||
+         m_opt_raytype_variants || m_opt_noderivs_raytypes) &&
+        ! group.m_is_raytype_variant)
+        keep_pristine_layers (group);
+
+    size_t sighash = 0;
+    if (signature.size()) {
+        sighash = std::hash<std::string>()(signature);
+        ShaderGroupRef shared;
+        {
+            spin_lock lock (m_specializations_mutex);
+            auto range = m_specializations.equal_range (sighash);
+            for (auto i = range.first;  i != range.second && ! shared;  ++i)
+                if (i->second.first == signature)
+                    shared = i->second.second.lock();
+        }
+        if (shared) {
+            group.share_specialization (*shared);
+            if (m_compile_report)
+                infof ("Shader group \"%s\" shares the optimized code of \"%s\"",
+                       group.name(), shared->name());
+            group.m_stat_optimize_time = timer();
+            group.optimized (true);
+            spin_lock stat_lock (m_stat_mutex);
+            m_stat_optimization_time += group.m_stat_optimize_time;
+            m_stat_opt_locking_time += locking_time;
+            m_stat_groups_shared += 1;
+            m_groups_to_compile_count -= 1;
+            return;
+        }
+    }
+
     bool ctx_allocated = false;
     PerThreadInfo *thread_info = nullptr;
     if (! ctx) {
@@ -2973,22 +3956,99 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
         group.m_attributes_needed.push_back (f.name);
         group.m_attribute_scopes.push_back (f.scope);
     }
+    if (group.m_kept_from) {
+        // The kept layers' ops are gone, so add what the specialization
+        // they came from needed (which may be a little more than they do).
+        auto merge = [](std::vector<ustring> &to, const std::vector<ustring> &from) {
+            for (auto&& f : from)
+                if (std::find (to.begin(), to.end(), f) == to.end())
+                    to.push_back (f);
+        };
+        const ShaderGroup &base (*group.m_kept_from);
+        merge (group.m_textures_needed, base.m_textures_needed);
+        merge (group.m_closures_needed, base.m_closures_needed);
+        merge (group.m_globals_needed, base.m_globals_needed);
+        for (size_t i = 0, e = base.m_attributes_needed.size();  i < e;  ++i) {
+            bool found = false;
+            for (size_t j = 0, n = group.m_attributes_needed.size();  j < n;  ++j)
+                found |= (group.m_attributes_needed[j] == base.m_attributes_needed[i] &&
+                          group.m_attribute_scopes[j] == base.m_attribute_scopes[i]);
+            if (! found) {
+                group.m_attributes_needed.push_back (base.m_attributes_needed[i]);
+                group.m_attribute_scopes.push_back (base.m_attribute_scopes[i]);
+            }
+        }
+        group.m_unknown_textures_needed |= base.m_unknown_textures_needed;
+        group.m_unknown_closures_needed |= base.m_unknown_closures_needed;
+        group.m_unknown_attributes_needed |= base.m_unknown_attributes_needed;
+    }
 
     BackendLLVM lljitter (*this, group, ctx);
-    lljitter.run ();
+    if (group.m_kept_from && ! lljitter.pin_kept_layers ()) {
+        // Leave it unoptimized: respecialize will make it all again.
+        if (ctx_allocated) {
+            release_context(ctx);
+            destroy_thread_info(thread_info);
+        }
+        m_groups_to_compile_count -= 1;
+        return;
+    }
+    int nparts = lljitter.jit_partitions ();
+    if (nparts > 1)
+        lljitter.run_partitioned (nparts);
+    else
+        lljitter.run ();
 
-    group_post_jit_cleanup (group);
+    // Under a JIT memory budget, keep the instances' code, from which to
+    // JIT the group again if its machine code is ever dropped.
+    if (m_jit_memory_budget)
+        group.m_jit_resident_bytes = group.m_jit_memory.size()
+            ? (long long)group.m_llvm_code_size : 0;
+    else
+        group_post_jit_cleanup (group);
+    group.m_kept_from = nullptr;
 
     if (ctx_allocated) {
         release_context(ctx);
         destroy_thread_info(thread_info);
     }
 
-    group.m_optimized = true;
+    if (signature.size()) {
+        // Offer this group's specialization to later identical groups,
+        // pruning any whose groups have since been destroyed.
+        spin_lock lock (m_specializations_mutex);
+        auto range = m_specializations.equal_range (sighash);
+        for (auto i = range.first;  i != range.second; ) {
+            if (i->second.second.expired())
+                i = m_specializations.erase (i);
+            else
+                ++i;
+        }
+        m_specializations.emplace (sighash,
+            std::make_pair (std::move(signature),
+                            std::weak_ptr<ShaderGroup>(group.shared_from_this())));
+    }
+
+    group.m_stat_optimize_time = timer();
+    group.m_stat_llvm_time = lljitter.m_stat_total_llvm_time;
+    group.m_jit_last_used = ++m_jit_epoch;
+    if (group.m_jit_resident_bytes && group.m_registry)
+        group.m_registry->jit_resident (group);
+    group.optimized (true);
+    enforce_jit_memory_budget (&group);
     spin_lock stat_lock (m_stat_mutex);
-    m_stat_optimization_time += timer();
+    m_stat_optimization_time += group.m_stat_optimize_time;
     m_stat_opt_locking_time += locking_time + rop.m_stat_opt_locking_time;
     m_stat_specialization_time += rop.m_stat_specialization_time;
+    m_stat_opt_bblock_time += rop.m_stat_opt_bblock_time;
+    m_stat_opt_fold_time += rop.m_stat_opt_fold_time;
+    m_stat_opt_lifetime_time += rop.m_stat_opt_lifetime_time;
+    m_stat_opt_cleanup_time += rop.m_stat_opt_cleanup_time;
+    m_stat_opt_passes += rop.m_stat_opt_passes;
+    m_stat_opt_ops_visited += rop.m_stat_opt_ops_visited;
+    m_stat_opt_ops_skipped += rop.m_stat_opt_ops_skipped;
+    m_stat_opt_parallel_layers += rop.m_stat_opt_parallel_layers;
+    m_stat_opt_native_folds += rop.m_stat_opt_native_folds;
     m_stat_total_llvm_time += lljitter.m_stat_total_llvm_time;
     m_stat_llvm_setup_time += lljitter.m_stat_llvm_setup_time;
     m_stat_llvm_irgen_time += lljitter.m_stat_llvm_irgen_time;
@@ -2996,13 +4056,121 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
     m_stat_llvm_jit_time += lljitter.m_stat_llvm_jit_time;
     m_stat_max_llvm_local_mem = std::max (m_stat_max_llvm_local_mem,
                                           lljitter.m_llvm_local_mem);
+    m_stat_llvm_code_size += group.m_llvm_code_size;
+    if (lljitter.m_stat_partitions) {
+        m_stat_groups_partitioned += 1;
+        m_stat_partitioned_wall_time += lljitter.m_stat_total_llvm_time;
+        m_stat_partitioned_cpu_time += lljitter.m_stat_partition_cpu_time;
+        m_stat_single_module_time += lljitter.m_stat_single_module_time;
+    }
     m_stat_groups_compiled += 1;
-    m_stat_instances_compiled += group.nlayers();
+    for (int i = 0, e = group.nlayers();  i < e;  ++i)
+        m_stat_instances_compiled += ! group.kept_layer (i);
     m_groups_to_compile_count -= 1;
 }
 
 
 
+void
+ShadingSystemImpl::rejit_group (ShaderGroup &group)
+{
+    OIIO::Timer timer;
+    {
+        CompileTraceSpan trace (*this, "group_lock_wait", group.name());
+        lock_guard lock (group.m_mutex);
+        trace.next ("rejit_group");
+        if (! group.m_jit_evicted.load())
+            return;    // another thread JITed it while we waited
+        PerThreadInfo *thread_info = create_thread_info();
+        ShadingContext *ctx = get_context (thread_info);
+        BackendLLVM lljitter (*this, group, ctx);
+        int nparts = lljitter.jit_partitions ();
+        if (nparts > 1)
+            lljitter.run_partitioned (nparts);
+        else
+            lljitter.run ();
+        release_context (ctx);
+        destroy_thread_info (thread_info);
+        group.m_jit_resident_bytes = group.m_jit_memory.size()
+            ? (long long)group.m_llvm_code_size : 0;
+        group.m_jit_last_used = ++m_jit_epoch;
+        if (group.m_jit_resident_bytes && group.m_registry)
+            group.m_registry->jit_resident (group);
+        // Only now that the code is there again may others run it.
+        group.m_jit_evicted.store (false);
+    }
+    {
+        spin_lock stat_lock (m_stat_mutex);
+        m_stat_jit_rejits += 1;
+        m_stat_rejit_time += timer();
+    }
+    enforce_jit_memory_budget (&group);
+}
+
+
+
+void
+ShadingSystemImpl::enforce_jit_memory_budget (const ShaderGroup *keep)
+{
+    long long budget = (long long)m_jit_memory_budget * 1024;
+    if (budget <= 0)
+        return;
+
+    // The registry keeps the groups whose code is in memory of its own in
+    // LRU order, so we need only look at as many of the least recently
+    // executed as it takes to get back within the budget.
+    long long resident = m_group_registry->jit_resident_bytes ();
+    if (resident <= budget)
+        return;
+    std::vector<ShaderGroupRef> candidates =
+        m_group_registry->jit_least_recent (resident - budget, keep);
+
+    for (auto&& c : candidates) {
+        if (resident <= budget)
+            break;
+        ShaderGroup &g (*c);
+        // Don't wait on a group that's busy being compiled.
+        std::unique_lock<mutex> lock (g.m_mutex, std::try_to_lock);
+        if (! lock.owns_lock())
+            continue;
+        long long bytes = g.m_jit_resident_bytes.load();
+        if (! bytes)
+            continue;
+        // Announce the eviction first, then look for contexts that may be
+        // running the group's code.  A context that starts running it
+        // after our look is sure to see the announcement, and will JIT
+        // the group again (see ShadingContext::execute_init).
+        g.m_jit_evicted.store (true);
+        bool running = false;
+        {
+            spin_lock ctx_lock (m_contexts_mutex);
+            for (auto ctx : m_contexts)
+                if (ctx->executing (&g)) {
+                    running = true;
+                    break;
+                }
+        }
+        if (running) {
+            g.m_jit_evicted.store (false);
+            continue;
+        }
+        g.m_llvm_compiled_version = nullptr;
+        g.m_llvm_compiled_init = nullptr;
+        g.m_llvm_compiled_uniform = nullptr;
+        std::fill (g.m_llvm_compiled_layers.begin(),
+                   g.m_llvm_compiled_layers.end(), nullptr);
+        std::fill (g.m_llvm_layer_funcs.begin(),
+                   g.m_llvm_layer_funcs.end(), nullptr);
+        g.m_jit_memory.clear ();
+        m_group_registry->jit_dropped (g);
+        g.m_jit_resident_bytes = 0;
+        resident -= bytes;
+        m_stat_jit_evictions += 1;
+    }
+}
+
+
+
 static void optimize_all_groups_wrapper (ShadingSystemImpl *ss, int mythread, int totalthreads)
 {
     ss->optimize_all_groups (1, mythread, totalthreads);
@@ -3031,22 +4199,14 @@ ShadingSystemImpl::optimize_all_groups (int nthreads, int mythread, int totalthr
     }
 
     // And here's the single thread case
-    size_t ngroups = 0;
-    {
-        spin_lock lock (m_all_shader_groups_mutex);
-        ngroups = m_all_shader_groups.size();
-    }
     PerThreadInfo* threadinfo = create_thread_info();
     ShadingContext* ctx = get_context(threadinfo);
-    for (size_t i = 0;  i < ngroups;  ++i) {
-        // Assign to threads based on mod of totalthreads
-        if ((i % totalthreads) == (unsigned)mythread) {
-            ShaderGroupRef group;
-            {
-                spin_lock lock (m_all_shader_groups_mutex);
-                group = m_all_shader_groups[i].lock();
-            }
-            if (group && group->m_complete)
+    for (auto&& group : m_group_registry->groups()) {
+        // Assign to threads based on mod of totalthreads. Each thread
+        // takes its own snapshot of the registry, so go by group id, which
+        // doesn't depend on the order of the snapshot.
+        if ((unsigned(group->id()) % totalthreads) == (unsigned)mythread) {
+            if (group->m_complete)
                 optimize_group (*group, ctx);
         }
     }
@@ -3056,6 +4216,62 @@ ShadingSystemImpl::optimize_all_groups (int nthreads, int mythread, int totalthr
 
 
 
+void *
+ShadingSystemImpl::find_shared_layer_func (const std::string &signature,
+                                           ShaderGroup &user)
+{
+    size_t hash = std::hash<std::string>()(signature);
+    std::shared_ptr<SharedLayerFunc> found;
+    {
+        spin_lock lock (m_shared_layer_funcs_mutex);
+        auto range = m_shared_layer_funcs.equal_range (hash);
+        for (auto i = range.first;  i != range.second && ! found;  ++i) {
+            std::shared_ptr<SharedLayerFunc> f = i->second.lock();
+            if (f && f->signature == signature)
+                found = std::move (f);
+        }
+    }
+    if (! found)
+        return NULL;
+    user.m_shared_layer_funcs.push_back (found);
+    return found->func;
+}
+
+
+
+void
+ShadingSystemImpl::add_shared_layer_func (const std::string &signature,
+                                          void *func,
+                                          const ShaderInstanceRef &inst,
+                                          ShaderGroup &owner)
+{
+    size_t hash = std::hash<std::string>()(signature);
+    std::shared_ptr<SharedLayerFunc> f (new SharedLayerFunc);
+    f->signature = signature;
+    f->func = func;
+    f->inst = inst;
+    owner.m_shared_layer_funcs.push_back (f);
+    spin_lock lock (m_shared_layer_funcs_mutex);
+    // Another thread may have compiled the same layer at the same time;
+    // either version will do, so keep the first.  Prune any whose groups
+    // have since been destroyed.
+    auto range = m_shared_layer_funcs.equal_range (hash);
+    for (auto i = range.first;  i != range.second; ) {
+        if (i->second.expired()) {
+            i = m_shared_layer_funcs.erase (i);
+            continue;
+        }
+        std::shared_ptr<SharedLayerFunc> other = i->second.lock();
+        if (other && other->signature == signature)
+            return;
+        ++i;
+    }
+    m_shared_layer_funcs.emplace (hash, std::weak_ptr<SharedLayerFunc>(f));
+    m_stat_shared_layer_funcs += 1;
+}
+
+
+
 int
 ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
 {
@@ -3078,13 +4294,16 @@ ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
     // general shading and lookdev approach of the studio.  But it was
     // very helpful for us in many cases.
     //
-    // The basic loop below looks very inefficient, O(n^2) in number of
-    // instances in the group. But it's really not -- a few seconds (sum
-    // of all threads) for even our very complex scenes. This is because
-    // most potential pairs have a very fast rejection case if they are
-    // not using the same master.  Since there's no appreciable cost to
-    // the brute force approach, it seems silly to have a complex scheme
-    // to try to reduce the number of pairings.
+    // Comparing every pair of layers is O(n^2) in the number of
+    // instances in the group, which gets expensive for groups with
+    // thousands of layers even though most pairs are quickly rejected
+    // for not using the same master. So instead we visit the layers in
+    // order, bucketing them by ShaderInstance::merge_hash(), and only
+    // compare each layer against the earlier survivors with the same
+    // hash. A layer's hash depends on its incoming connections, which
+    // only come from earlier layers, so by the time we reach a layer all
+    // the merges that could rewire its connections have already been
+    // done and its hash is final.
 
     if (! m_opt_merge_instances || optimize() < 1)
         return 0;
@@ -3100,66 +4319,79 @@ ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
         if (! group[layer]->unused())
             group[layer]->evaluate_writes_globals_and_userdata_params ();
 
+    // Earlier layers that may be kept, bucketed by their merge hash.
+    std::unordered_map<size_t, std::vector<int>> buckets;
+
     // Loop over all layers...
-    for (int a = 0;  a < nlayers-1;  ++a) {
-        if (group[a]->unused() || group[a]->entry_layer()) // Don't merge a layer that's not used
-            continue;                                      // or if it's an entry layer
-        // Check all later layers...
-        for (int b = a+1;  b < nlayers;  ++b) {
-            if (group[b]->unused())    // Don't merge a layer that's not used
-                continue;
-            if (b == nlayers-1)   // Don't merge the last layer -- causes
-                continue;         // many tears because it's the group entry
+    for (int b = 0;  b < nlayers-1;  ++b) {
+        // N.B. Don't merge the last layer -- causes many tears because
+        // it's the group entry.
+        if (group[b]->unused())    // Don't merge a layer that's not used
+            continue;
+        std::vector<int> &bucket (buckets[group[b]->merge_hash()]);
+
+        // See if any earlier layer with the same hash is mergeable
+        // (identical).  All the heavy lifting is done by
+        // ShaderInstance::mergeable().
+        int a = -1;
+        for (int candidate : bucket) {
+            if (group[candidate]->mergeable (*group[b], group)) {
+                a = candidate;
+                break;
+            }
+        }
+        if (a < 0) {
+            // Nothing to merge with, so b is a candidate to be kept --
+            // unless it's an entry layer, which we don't merge into.
+            if (! group[b]->entry_layer())
+                bucket.push_back (b);
+            continue;
+        }
 
-            // Now we have two used layers, a and b, to examine.
-            // See if they are mergeable (identical).  All the heavy
-            // lifting is done by ShaderInstance::mergeable().
-            if (! group[a]->mergeable (*group[b], group))
+        // The two nodes a and b are mergeable, so merge them.
+        ShaderInstance *A = group[a];
+        ShaderInstance *B = group[b];
+        ++merges;
+
+        // We'll keep A, get rid of B.  For all layers later than B,
+        // check its incoming connections and replace all references
+        // to B with references to A.
+        for (int j = b+1;  j < nlayers;  ++j) {
+            ShaderInstance *inst = group[j];
+            if (inst->unused())  // don't bother if it's unused
                 continue;
-
-            // The two nodes a and b are mergeable, so merge them.
-            ShaderInstance *A = group[a];
-            ShaderInstance *B = group[b];
-            ++merges;
-
-            // We'll keep A, get rid of B.  For all layers later than B,
-            // check its incoming connections and replace all references
-            // to B with references to A.
-            for (int j = b+1;  j < nlayers;  ++j) {
-                ShaderInstance *inst = group[j];
-                if (inst->unused())  // don't bother if it's unused
-                    continue;
-                for (int c = 0, ce = inst->nconnections();  c < ce;  ++c) {
-                    Connection &con = inst->connection(c);
-                    if (con.srclayer == b) {
-                        con.srclayer = a;
-                        A->outgoing_connections (true);
-                        if (A->symbols().size() && B->symbols().size()) {
-                            OSL_DASSERT (A->symbol(con.src.param)->name() ==
-                                         B->symbol(con.src.param)->name());
-                        }
+            for (int c = 0, ce = inst->nconnections();  c < ce;  ++c) {
+                Connection &con = inst->connection(c);
+                if (con.srclayer == b) {
+                    con.srclayer = a;
+                    A->outgoing_connections (true);
+                    if (A->symbols().size() && B->symbols().size()) {
+                        OSL_DASSERT (A->symbol(con.src.param)->name() ==
+                                     B->symbol(con.src.param)->name());
                     }
                 }
             }
-
-            // Mark parameters of B as no longer connected
-            for (int p = B->firstparam();  p < B->lastparam();  ++p) {
-                if (B->symbols().size())
-                    B->symbol(p)->connected_down(false);
-                if (B->m_instoverrides.size())
-                    B->instoverride(p)->connected_down(false);
-            }
-            // B won't be used, so mark it as having no outgoing
-            // connections and clear its incoming connections (which are
-            // no longer used).
-            OSL_DASSERT (B->merged_unused() == false);
-            B->outgoing_connections (false);
-            connectionmem += B->clear_connections ();
-            B->m_merged_unused = true;
-            OSL_DASSERT (B->unused());
         }
-    }
 
+        // Mark parameters of B as no longer connected
+        for (int p = B->firstparam();  p < B->lastparam();  ++p) {
+            if (B->symbols().size())
+                B->symbol(p)->connected_down(false);
+            if (B->m_instoverrides.size())
+                B->instoverride(p)->connected_down(false);
+        }
+        // B won't be used, so mark it as having no outgoing
+        // connections and clear its incoming connections (which are
+        // no longer used).
+        OSL_DASSERT (B->merged_unused() == false);
+        B->outgoing_connections (false);
+        connectionmem += B->clear_connections ();
+        B->m_merged_unused = true;
+        OSL_DASSERT (B->unused());
+    }
+
+    double merge_time = timer();
+    group.m_stat_inst_merge_time += merge_time;
     {
         // Adjust stats
         spin_lock lock (m_stat_mutex);
@@ -3170,7 +4402,11 @@ ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
             m_stat_merged_inst_opt += merges;
         else
             m_stat_merged_inst += merges;
-        m_stat_inst_merge_time += timer();
+        m_stat_inst_merge_time += merge_time;
+        if (group.m_stat_inst_merge_time > m_stat_max_group_merge_time) {
+            m_stat_max_group_merge_time = group.m_stat_inst_merge_time;
+            m_stat_max_group_merge_name = group.name();
+        }
     }
 
     return merges;
@@ -3333,11 +4569,82 @@ ShadingSystemImpl::archive_shadergroup (ShaderGroup& group, string_view filename
 
     OIIO::Filesystem::remove_all (tmpdir);
 
+    // If the group ran instrumented code, keep its profile next to the
+    // archive, so that renders of the archived group can compile with it.
+    ShaderGroupRef spec = group.current_respecialization ();
+    if (ok && (spec ? *spec : group).m_pgo_counters.size())
+        ok = write_group_profile (group, Strutil::sprintf ("%s.profile",
+                                                           filename));
+
     return ok;
 }
 
 
 
+bool
+ShadingSystemImpl::write_group_profile (ShaderGroup& group,
+                                        string_view filename)
+{
+    // Sum the counts of the specialization that runs and its raytype
+    // variants, whose counters are keyed the same way.
+    ShaderGroupRef specref = group.current_respecialization ();
+    ShaderGroup &spec (specref ? *specref : group);
+    ShaderGroup::Profile profile;
+    {
+        std::lock_guard<ShaderGroup> lock (spec);
+        std::vector<const ShaderGroup *> groups { &spec };
+        for (int i = 0, n = spec.num_raytype_variants();  i < n;  ++i)
+            groups.push_back (spec.raytype_variant(i));
+        for (auto g : groups)
+            for (size_t c = 0;  c < g->m_pgo_counters.size();  ++c)
+                profile[g->m_pgo_counter_names[c]] += g->m_pgo_counters[c];
+    }
+
+    std::ofstream out;
+    OIIO::Filesystem::open (out, filename);
+    if (! out.good()) {
+        errorf ("Could not open profile file \"%s\"", filename);
+        return false;
+    }
+    out.imbue (std::locale::classic());  // force C locale
+    out << "# OSL group profile: " << group.name() << "\n";
+    for (auto&& p : profile)
+        out << p.first << ' ' << p.second << "\n";
+    return out.good();
+}
+
+
+
+bool
+ShadingSystemImpl::read_group_profile (std::map<std::string,long long> &profile,
+                                       string_view filename)
+{
+    std::ifstream in;
+    OIIO::Filesystem::open (in, filename);
+    if (! in.good()) {
+        errorf ("Could not open profile file \"%s\"", filename);
+        return false;
+    }
+    in.imbue (std::locale::classic());  // force C locale
+    std::string line;
+    while (std::getline (in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        // Each line is a counter name (which may contain spaces) followed
+        // by its count.
+        size_t space = line.find_last_of (' ');
+        if (space == std::string::npos || space == 0) {
+            errorf ("Malformed profile file \"%s\": %s", filename, line);
+            return false;
+        }
+        profile[line.substr (0, space)] += strtoll (line.c_str()+space+1,
+                                                    nullptr, 10);
+    }
+    return true;
+}
+
+
+
 void
 ClosureRegistry::register_closure (string_view name, int id,
                                    const ClosureParam *params,
@@ -123,6 +123,7 @@ struct GaborParams {
     float lambda;
     float sqrt_lambda_inv;
     float radius, radius2, radius3, radius_inv;
+    bool fast_math;   // approximate math in the kernels too (fast_math)
 
     OSL_HOSTDEVICE
     GaborParams (const NoiseParams &opt) :
@@ -131,13 +132,11 @@ struct GaborParams {
         do_filter(opt.do_filter),
         weight(Gabor_Impulse_Weight),
         bandwidth(hostdevice::clamp(opt.bandwidth,0.01f,100.0f)),
-        periodic(false)
+        periodic(false),
+        fast_math(opt.fast_math != 0)
     {
-#if OSL_FAST_MATH
-        float TWO_to_bandwidth = OIIO::fast_exp2(bandwidth);
-#else
-        float TWO_to_bandwidth = exp2f(bandwidth);
-#endif
+        float TWO_to_bandwidth = (OSL_FAST_MATH || fast_math)
+                               ? OIIO::fast_exp2(bandwidth) : exp2f(bandwidth);
 
 #ifndef __CUDA_ARCH__
         static const float SQRT_PI_OVER_LN2 = sqrtf (M_PI / M_LN2);
@@ -168,15 +167,19 @@ struct GaborParams {
 //   \param  bandwidth   width of the gaussian envelope (called 'a'
 //                          in [Lagae09].
 //   \param  x           the position being sampled
+//   \param  fast        use the approximate exp and cos
 template <class VEC>   // VEC should be Vec3 or Vec2
 inline Dual2<float> OSL_HOSTDEVICE
 gabor_kernel (const Dual2<float> &weight, const VEC &omega,
-              const Dual2<float> &phi, float bandwidth, const Dual2<VEC> &x)
+              const Dual2<float> &phi, float bandwidth, const Dual2<VEC> &x,
+              bool fast)
 {
     // see Equation 1
-    Dual2<float> g = exp (float(-M_PI) * (bandwidth * bandwidth) * dot(x,x));
-    Dual2<float> h = cos (float(M_TWO_PI) * dot(omega,x) + phi);
-    return weight * g * h;
+    Dual2<float> e = float(-M_PI) * (bandwidth * bandwidth) * dot(x,x);
+    Dual2<float> t = float(M_TWO_PI) * dot(omega,x) + phi;
+    if (fast)
+        return weight * fast_exp (e) * fast_cos (t);
+    return weight * exp (e) * cos (t);
 }
 
 
@@ -184,10 +187,12 @@ gabor_kernel (const Dual2<float> &weight, const VEC &omega,
 inline OSL_HOSTDEVICE void
 slice_gabor_kernel_3d (const Dual2<float> &d, float w, float a,
                        const Vec3 &omega, float phi,
-                       Dual2<float> &w_s, Vec2 &omega_s, Dual2<float> &phi_s)
+                       Dual2<float> &w_s, Vec2 &omega_s, Dual2<float> &phi_s,
+                       bool fast)
 {
     // Equation 6
-    w_s = w * exp(float(-M_PI) * (a*a)*(d*d));
+    Dual2<float> e = float(-M_PI) * (a*a)*(d*d);
+    w_s = w * (fast ? fast_exp(e) : exp(e));
     omega_s[0] = omega[0];
     omega_s[1] = omega[1];
     phi_s = phi - float(M_TWO_PI) * d * omega[2];
@@ -242,22 +247,20 @@ gabor_sample (GaborParams &gp, const Vec3 &/*x_c*/, fast_rng &rng,
         float cos_omega_p = OIIO::lerp(-1.0f, 1.0f, rng());
         float sin_omega_p = sqrtf (std::max (0.0f, 1.0f - cos_omega_p*cos_omega_p));
         float sin_omega_t, cos_omega_t;
-#if OSL_FAST_MATH
-        OIIO::fast_sincos (omega_t, &sin_omega_t, &cos_omega_t);
-#else
-        OIIO::sincos (omega_t, &sin_omega_t, &cos_omega_t);
-#endif
+        if (OSL_FAST_MATH || gp.fast_math)
+            OIIO::fast_sincos (omega_t, &sin_omega_t, &cos_omega_t);
+        else
+            OIIO::sincos (omega_t, &sin_omega_t, &cos_omega_t);
         omega = Vec3 (cos_omega_t*sin_omega_p, sin_omega_t*sin_omega_p, cos_omega_p).normalized();
     } else {
         // otherwise hybrid
         float omega_r = gp.omega.length();
         float omega_t =  float(M_TWO_PI) * rng();
         float sin_omega_t, cos_omega_t;
-#if OSL_FAST_MATH
-        OIIO::fast_sincos (omega_t, &sin_omega_t, &cos_omega_t);
-#else
-        OIIO::sincos (omega_t, &sin_omega_t, &cos_omega_t);
-#endif
+        if (OSL_FAST_MATH || gp.fast_math)
+            OIIO::fast_sincos (omega_t, &sin_omega_t, &cos_omega_t);
+        else
+            OIIO::sincos (omega_t, &sin_omega_t, &cos_omega_t);
         omega = omega_r * Vec3(cos_omega_t, sin_omega_t, 0.0f);
     }
     phi = float(M_TWO_PI) * rng();
@@ -317,7 +320,8 @@ gabor_cell (GaborParams &gp, const Vec3 &c_i, const Dual2<Vec3> &x_c_i,
                 // needed in that case anyway, so just don't filter.
                 // This seems to only come up when the filter region is
                 // tiny.
-                sum += gabor_kernel (gp.weight, omega_i, phi_i, gp.a, x_k_i);  // 3D
+                sum += gabor_kernel (gp.weight, omega_i, phi_i, gp.a, x_k_i,
+                                     gp.fast_math);  // 3D
             } else {
                 // Transform the impulse's anisotropy into tangent space
                 Vec3 omega_i_t;
@@ -330,7 +334,8 @@ gabor_cell (GaborParams &gp, const Vec3 &c_i, const Dual2<Vec3> &x_c_i,
                 Dual2<float> phi_i_t_s;
                 slice_gabor_kernel_3d (d_i, gp.weight, gp.a,
                                        omega_i_t, phi_i,
-                                       w_i_t_s, omega_i_t_s, phi_i_t_s);
+                                       w_i_t_s, omega_i_t_s, phi_i_t_s,
+                                       gp.fast_math);
 
                 // Filter the 2D kernel
                 Dual2<float> w_i_t_s_f;
@@ -343,11 +348,12 @@ gabor_cell (GaborParams &gp, const Vec3 &c_i, const Dual2<Vec3> &x_c_i,
                 Dual2<Vec3> xkit;
                 multMatrix (gp.local, x_k_i, xkit);
                 Dual2<Vec2> x_k_i_t = make_Vec2 (comp_x(xkit), comp_y(xkit));
-                Dual2<float> gk = gabor_kernel (w_i_t_s_f, omega_i_t_s_f, phi_i_t_s_f, a_i_t_s_f, x_k_i_t); // 2D
+                Dual2<float> gk = gabor_kernel (w_i_t_s_f, omega_i_t_s_f, phi_i_t_s_f, a_i_t_s_f, x_k_i_t, gp.fast_math); // 2D
                 if (! OIIO::isfinite(gk.val())) {
                     // Numeric failure of the filtered version.  Fall
                     // back on the unfiltered.
-                    gk = gabor_kernel (gp.weight, omega_i, phi_i, gp.a, x_k_i);  // 3D
+                    gk = gabor_kernel (gp.weight, omega_i, phi_i, gp.a, x_k_i,
+                                       gp.fast_math);  // 3D
                 }
                 sum += gk;
             }
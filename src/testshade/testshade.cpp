@@ -27,12 +27,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 
+#include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <locale>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <OpenImageIO/imageio.h>
@@ -71,14 +74,19 @@ static bool debug1 = false;
 static bool debug2 = false;
 static bool verbose = false;
 static bool runstats = false;
+static bool runstats_json = false;
 static bool saveptx = false;
 static bool warmup = false;
+static int loadbench = 0;
+static int groupbench = 0;
+static int groupcopies = 0;
 static bool profile = false;
 static bool O0 = false, O1 = false, O2 = false;
 static bool pixelcenters = false;
 static bool debugnan = false;
 static bool debug_uninit = false;
 static bool use_group_outputs = false;
+static bool use_output_subset = false;
 static bool do_oslquery = false;
 static bool inbuffer = false;
 static bool use_shade_image = false;
@@ -103,7 +111,9 @@ static std::string texoptions;
 static OSL::Matrix44 Mshad;  // "shader" space to "common" space matrix
 static OSL::Matrix44 Mobj;   // "object" space to "common" space matrix
 static ShaderGroupRef shadergroup;
+static std::vector<ShaderGroupRef> shadergroup_copies;
 static std::string archivegroup;
+static std::string pgoprofile;
 static int exprcount = 0;
 static bool shadingsys_options_set = false;
 static float uscale = 1, vscale = 1;
@@ -470,10 +480,14 @@ getargs (int argc, const char *argv[])
                 "--debug", &debug1, "Lots of debugging info",
                 "--debug2", &debug2, "Even more debugging info",
                 "--runstats", &runstats, "Print run statistics",
+                "--runstats-json", &runstats_json, "Print run statistics as JSON",
                 "--stats", &runstats, "",  // DEPRECATED 1.7
                 "--profile", &profile, "Print profile information",
                 "--saveptx", &saveptx, "Save the generated PTX (OptiX mode only)",
                 "--warmup", &warmup, "Perform a warmup launch",
+                "--loadbench %d", &loadbench, "Time loading the shader masters N times from .oso and from .osob (using -t threads)",
+                "--groupbench %d", &groupbench, "Time building N shader groups on 1 thread and on -t threads",
+                "--groupcopies %d", &groupcopies, "Also build N more copies of the group (without its group outputs or entry layers) and shade them after it",
                 "--path %s", &shaderpath, "Specify oso search path",
                 "--res %d %d", &xres, &yres, "Make an W x H image",
                 "-g %d %d", &xres, &yres, "", // synonym for -res
@@ -499,7 +513,9 @@ getargs (int argc, const char *argv[])
                 "--group %@ %s", stash_shader_arg, NULL,
                         "Specify a full group command",
                 "--archivegroup %s", &archivegroup,
-                        "Archive the group to a given filename",
+                        "Archive the group to a given filename (with its profile, if instrumented)",
+                "--pgoprofile %s", &pgoprofile,
+                        "Compile the group with the given profile",
                 "--raytype %s", &raytype, "Set the raytype",
                 "--raytype_opt", &raytype_opt, "Specify ray type mask for optimization",
                 "--iters %d", &iters, "Number of iterations",
@@ -512,6 +528,7 @@ getargs (int argc, const char *argv[])
                 "--debugnan", &debugnan, "Turn on 'debug_nan' mode",
                 "--debuguninit", &debug_uninit, "Turn on 'debug_uninit' mode",
                 "--groupoutputs", &use_group_outputs, "Specify group outputs, not global outputs",
+                "--outputsubset", &use_output_subset, "Shade with a variant of the group that computes only the -o outputs",
                 "--oslquery", &do_oslquery, "Test OSLQuery at runtime",
                 "--inbuffer", &inbuffer, "Compile osl source from and to buffer",
                 "--shadeimage", &use_shade_image, "Use shade_image utility",
@@ -626,6 +643,10 @@ setup_shaderglobals (ShaderGlobals &sg, ShadingSystem *shadingsys,
     // different for each object.
     sg.object2common = OSL::TransformationPtr (&Mobj);
 
+    // The whole patch is a single object, so give all shades the same
+    // object identity.
+    sg.objdata = &Mobj;
+
     // Just make it look like all shades are the result of 'raytype' rays.
     sg.raytype = shadingsys->raytype_bit (ustring (raytype));
 
@@ -986,7 +1007,7 @@ shade_region (SimpleRenderer *rend, ShaderGroup *shadergroup,
             setup_shaderglobals (shaderglobals, shadingsys, x, y);
 
             // Actually run the shader for this point
-            if (entrylayer_index.empty()) {
+            if (entrylayer_index.empty() || shadergroup != ::shadergroup.get()) {
                 // Sole entry point for whole group, default behavior
                 shadingsys->execute (*ctx, *shadergroup, shaderglobals);
             } else {
@@ -1017,6 +1038,117 @@ shade_region (SimpleRenderer *rend, ShaderGroup *shadergroup,
 }
 
 
+// Time loading the masters of all the (on-disk) shaders named on the
+// command line, loadbench times each into a fresh ShadingSystem, first
+// from the .oso text and then from the binary .osob if oslc wrote them.
+// Each of the -t threads builds its own group using all the shaders
+// (starting at a different one), as a renderer's scene loading threads
+// would, so masters are requested concurrently and repeatedly.
+static void
+benchmark_loading (RendererServices *rend, TextureSystem *texturesys)
+{
+    int nthreads = num_threads > 0 ? num_threads
+                                   : OIIO::Sysutil::hardware_concurrency();
+    for (int osob = 0;  osob <= 1;  ++osob) {
+        double walltime = 0;
+        float loadtime = 0;
+        int nosob = 0;
+        for (int i = 0;  i < loadbench;  ++i) {
+            ShadingSystem *ss = new ShadingSystem (rend, texturesys, &errhandler);
+            if (! shaderpath.empty())
+                ss->attribute ("searchpath:shader", shaderpath);
+            ss->attribute ("load_osob", osob);
+            OIIO::Timer timer;
+            auto load_all = [&](int t) {
+                ShaderGroupRef group = ss->ShaderGroupBegin ();
+                for (size_t n = 0, e = shadernames.size();  n < e;  ++n)
+                    ss->Shader (*group, "surface", shadernames[(n+t) % e], "");
+            };
+            std::vector<std::thread> threads;
+            for (int t = 0;  t < nthreads;  ++t)
+                threads.emplace_back (load_all, t);
+            for (auto&& t : threads)
+                t.join ();
+            walltime += timer();
+            float t = 0;
+            int n = 0;
+            ss->getattribute ("stat:master_load_time", t);
+            ss->getattribute ("stat:masters_osob", n);
+            loadtime += t;
+            nosob += n;
+            delete ss;
+        }
+        std::cout << "Loaded " << shadernames.size() << " masters x "
+                  << loadbench << " on " << nthreads << " threads"
+                  << " with load_osob=" << osob << " ("
+                  << nosob << " from .osob) in "
+                  << OIIO::Strutil::timeintervalformat (walltime, 3)
+                  << " (" << OIIO::Strutil::timeintervalformat (loadtime, 3)
+                  << " parsing, sum of all threads)\n";
+    }
+}
+
+
+
+// Time building groupbench groups, each using all the shaders named on
+// the command line, into a fresh ShadingSystem, first on one thread and
+// then split among the -t threads, as a renderer's scene loading threads
+// would.  The masters are loaded before timing starts, so this measures
+// only group construction (and then destruction) -- how well it scales
+// depends on building different groups not contending for any locks.
+static void
+benchmark_groups (RendererServices *rend, TextureSystem *texturesys)
+{
+    int maxthreads = num_threads > 0 ? num_threads
+                                     : OIIO::Sysutil::hardware_concurrency();
+    for (int nthreads = 1;  ;  nthreads = maxthreads) {
+        ShadingSystem *ss = new ShadingSystem (rend, texturesys, &errhandler);
+        if (! shaderpath.empty())
+            ss->attribute ("searchpath:shader", shaderpath);
+        {
+            ShaderGroupRef group = ss->ShaderGroupBegin ();
+            for (auto&& name : shadernames)
+                ss->Shader (*group, "surface", name, "");
+            ss->ShaderGroupEnd (*group);
+        }
+        std::vector<std::vector<ShaderGroupRef>> groups (nthreads);
+        auto build = [&](int t) {
+            for (int i = t;  i < groupbench;  i += nthreads) {
+                ShaderGroupRef group = ss->ShaderGroupBegin (
+                              OIIO::Strutil::sprintf ("bench_%d", i));
+                for (auto&& name : shadernames)
+                    ss->Shader (*group, "surface", name, "");
+                ss->ShaderGroupEnd (*group);
+                groups[t].push_back (group);
+            }
+        };
+        auto release = [&](int t) { groups[t].clear(); };
+        auto run = [&](const std::function<void(int)> &f) {
+            OIIO::Timer timer;
+            std::vector<std::thread> threads;
+            for (int t = 0;  t < nthreads;  ++t)
+                threads.emplace_back (f, t);
+            for (auto&& t : threads)
+                t.join ();
+            return timer();
+        };
+        double buildtime = run (build);
+        double releasetime = run (release);
+        std::cout << "Built " << groupbench << " groups of "
+                  << shadernames.size() << " layers on " << nthreads
+                  << (nthreads == 1 ? " thread in " : " threads in ")
+                  << OIIO::Strutil::timeintervalformat (buildtime, 3)
+                  << " (" << OIIO::Strutil::sprintf ("%.0f", groupbench / std::max (buildtime, 1e-9))
+                  << " groups/s), released in "
+                  << OIIO::Strutil::timeintervalformat (releasetime, 3) << "\n";
+        delete ss;
+        if (nthreads == maxthreads)
+            break;
+    }
+}
+
+
+
 static void synchio() {
     // Synch all writes to stdout & stderr now (mostly for Windows)
     std::cout.flush();
@@ -1025,6 +1157,34 @@ static void synchio() {
     fflush(stderr);
 }
 
+
+
+// Make the connections given on the command line in shadergroup,
+// announcing each if verbose.
+static bool
+connect_layers (bool verbose)
+{
+    for (size_t i = 0;  i < connections.size();  i += 4) {
+        if (i+3 < connections.size()) {
+            if (verbose) {
+                std::cout << "Connect "
+                          << connections[i] << "." << connections[i+1]
+                          << " to " << connections[i+2] << "." << connections[i+3]
+                          << "\n";
+                synchio();
+            }
+            bool ok = shadingsys->ConnectShaders (*shadergroup,
+                                                  connections[i],
+                                                  connections[i+1],
+                                                  connections[i+2],
+                                                  connections[i+3]);
+            if (!ok)
+                return false;
+        }
+    }
+    return true;
+}
+
 extern "C" OSL_DLL_EXPORT int
 test_shade (int argc, const char *argv[])
 {
@@ -1145,27 +1305,45 @@ test_shade (int argc, const char *argv[])
         shadingsys->attribute (shadergroup.get(), "groupname", groupname);
 
     // Now set up the connections
-    for (size_t i = 0;  i < connections.size();  i += 4) {
-        if (i+3 < connections.size()) {
-            std::cout << "Connect " 
-                      << connections[i] << "." << connections[i+1]
-                      << " to " << connections[i+2] << "." << connections[i+3]
-                      << "\n";
-            synchio();
-            bool ok = shadingsys->ConnectShaders (*shadergroup,
-                                                  connections[i],
-                                                  connections[i+1],
-                                                  connections[i+2],
-                                                  connections[i+3]);
-            if (!ok) {
-                return EXIT_FAILURE;
-            }
-        }
-    }
+    if (! connect_layers (true))
+        return EXIT_FAILURE;
 
     // End the group
     shadingsys->ShaderGroupEnd (*shadergroup);
 
+    // Build any copies of the group the same way (but quietly), each a
+    // separate group.
+    for (int c = 0;  c < groupcopies;  ++c) {
+        ShaderGroupRef original = shadergroup;
+        shadergroup = shadingsys->ShaderGroupBegin (groupname);
+        connections.clear ();
+        reparams.clear ();
+        process_shader_setup_args ((int)shader_setup_args.size(),
+                                   shader_setup_args.data());
+        if (! connect_layers (false))
+            return EXIT_FAILURE;
+        shadingsys->ShaderGroupEnd (*shadergroup);
+        shadergroup_copies.push_back (shadergroup);
+        shadergroup = original;
+    }
+
+    if (pgoprofile.size())
+        shadingsys->attribute (shadergroup.get(), "pgo_profile", pgoprofile);
+
+    if (use_output_subset && outputvars.size()) {
+        std::vector<ustring> names (outputvars.begin(), outputvars.end());
+        ShaderGroupRef subset = shadingsys->output_subset (shadergroup.get(), names);
+        if (subset)
+            shadergroup = subset;
+        else
+            std::cout << "Could not make an output subset of the group\n";
+    }
+
+    if (loadbench > 0)
+        benchmark_loading (rend, texturesys);
+    if (groupbench > 0)
+        benchmark_groups (rend, texturesys);
+
     if (verbose || do_oslquery) {
         std::string pickle;
         shadingsys->getattribute (shadergroup.get(), "pickle", pickle);
@@ -1196,7 +1374,11 @@ test_shade (int argc, const char *argv[])
         }
         std::cout << "\n";
     }
-    if (archivegroup.size())
+    // Instrumented groups are archived after they run, along with the
+    // profile of that run.
+    int pgo_instrument = 0;
+    shadingsys->getattribute ("pgo_instrument", pgo_instrument);
+    if (archivegroup.size() && ! pgo_instrument)
         shadingsys->archive_shadergroup (shadergroup.get(), archivegroup);
 
     if (outputfiles.size() != 0)
@@ -1251,6 +1433,10 @@ test_shade (int argc, const char *argv[])
             OIIO::ImageBufAlgo::parallel_image (roi, num_threads,
                                                 std::bind (shade_region, rend, shadergroup.get(), std::placeholders::_1, save));
 #endif
+            // Then the copies, one after another, whose outputs aren't saved
+            for (auto&& copy : shadergroup_copies)
+                OIIO::ImageBufAlgo::parallel_image (roi, num_threads,
+                                                    std::bind (shade_region, rend, copy.get(), std::placeholders::_1, false));
         }
 
         // If any reparam was requested, do it now
@@ -1265,6 +1451,9 @@ test_shade (int argc, const char *argv[])
     }
     double runtime = timer.lap();
 
+    if (archivegroup.size() && pgo_instrument)
+        shadingsys->archive_shadergroup (shadergroup.get(), archivegroup);
+
     if (outputfiles.size() == 0)
         std::cout << "\n";
 
@@ -1321,12 +1510,15 @@ test_shade (int argc, const char *argv[])
             std::cout << texturesys->getstats (5) << "\n";
         std::cout << ustring::getstats() << "\n";
     }
+    if (runstats_json)
+        std::cout << shadingsys->getstats_json (2);
 
     // Give the renderer a chance to do initial cleanup while everything is still alive
     rend->clear();
 
     // We're done with the shading system now, destroy it
     shadergroup.reset ();  // Must release this before destroying shadingsys
+    shadergroup_copies.clear ();
 
     delete shadingsys;
     int retcode = EXIT_SUCCESS;
@@ -0,0 +1,26 @@
+#!/usr/bin/env python
+
+# Parse a compile trace strictly as JSON in Chrome's trace event format,
+# and print the parts of it that don't depend on timing.
+
+from __future__ import print_function
+import json
+import sys
+
+def reject_constant (c) :
+    raise ValueError ("not valid JSON: " + c)
+
+trace = json.load (open(sys.argv[1]), parse_constant=reject_constant)
+events = trace["traceEvents"]
+print ("parsed")
+print ("complete spans:",
+       all (e["ph"] == "X" and e["dur"] >= 0 for e in events))
+
+names = set (e["name"] for e in events)
+for name in [ "master_load", "optimize_group", "optimize_layer",
+              "llvm_setup", "llvm_irgen", "llvm_opt", "llvm_jit" ] :
+    print (name, "present" if name in names else "MISSING")
+
+layers = set (e["args"]["name"] for e in events
+              if e["name"] == "optimize_layer")
+print ("optimized layers:", " ".join(sorted(layers)))
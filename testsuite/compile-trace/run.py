@@ -0,0 +1,8 @@
+#!/usr/bin/env python
+
+# The compile trace is written when the ShadingSystem is destroyed.
+command += testshade("-g 1 1 --options compile_trace=trace.json "
+                     + "-layer uplayer up -layer downlayer down "
+                     + "--connect uplayer f downlayer f")
+command += (sys.executable + " " + os.path.join(test_source_dir, "checktrace.py")
+            + " trace.json >> out.txt 2>&1 ;\n")
@@ -0,0 +1,12 @@
+#!/usr/bin/env python
+
+# The natively folded results must match the unoptimized ones.
+command += testshade("-g 1 1 -O0 test")
+command += testshade("-g 1 1 -O2 test")
+
+# And at -O2 they must actually have been folded natively.
+for opt in [ "-O0", "-O2" ] :
+    command += (osl_app("testshade") + "-g 1 1 " + opt + " test --runstats-json "
+                + "| grep \"\\\"opt_native_folds\\\"\" "
+                + "| awk '{ print ($2+0 > 0) ? \"" + opt + ": folded natively\" : \""
+                + opt + ": not folded natively\" }' >> out.txt 2>&1 ;\n")
@@ -0,0 +1,42 @@
+#!/usr/bin/env python
+
+# Compare the noises printed by a precise run of noises.osl (first file)
+# with those of a fast_math run (second file).  The fast perlin and gabor
+# noises must differ from the precise ones, which shows they were used,
+# but stay within a tolerance of them.  Cell noise must be unchanged.
+# Only pass/fail is printed, since the differences depend on the build.
+
+from __future__ import print_function
+import sys
+
+# The largest difference expected for each noise.  For perlin this is the
+# worst case of the cheaper fade (about 0.17 for signed 3D noise).
+tolerance = { "perlin" : 0.2, "uperlin" : 0.1, "pperlin" : 0.2,
+              "generic" : 0.2, "gabor" : 0.05, "cell" : 0.0 }
+
+def read_noises (filename) :
+    noises = {}
+    for line in open(filename) :
+        words = line.split()
+        if len(words) == 2 and words[0] in tolerance :
+            noises.setdefault (words[0], []).append (float(words[1]))
+    return noises
+
+precise = read_noises (sys.argv[1])
+fast = read_noises (sys.argv[2])
+
+for name in [ "perlin", "uperlin", "pperlin", "generic", "gabor", "cell" ] :
+    p = precise.get (name, [])
+    f = fast.get (name, [])
+    if not p or len(p) != len(f) :
+        print (name + ": MISSING")
+        continue
+    diff = max (abs(a - b) for a, b in zip(p, f))
+    if diff > tolerance[name] :
+        print (name + ": difference", diff, "exceeds tolerance", tolerance[name])
+    elif tolerance[name] == 0 :
+        print (name + ": unchanged")
+    elif diff == 0 :
+        print (name + ": fast version not used")
+    else :
+        print (name + ": fast version within tolerance")
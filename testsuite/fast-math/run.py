@@ -0,0 +1,14 @@
+#!/usr/bin/env python
+
+# The transcendentals must stay within tolerance both in the default mode
+# and with the fast_math option on.
+command += testshade("-t 1 -g 1 1 test")
+command += testshade("-t 1 -g 1 1 --options fast_math=1 test")
+
+# The noises must change with fast_math, but only by so much.  This also
+# shows the fast_math group really was compiled differently.
+for fm in [ "0", "1" ] :
+    command += (osl_app("testshade") + "-t 1 -g 4 4 --options fast_math=" + fm
+                + " noises > noises" + fm + ".txt 2>&1 ;\n")
+command += (sys.executable + " " + os.path.join(test_source_dir, "checknoise.py")
+            + " noises0.txt noises1.txt >> out.txt 2>&1 ;\n")
@@ -0,0 +1,21 @@
+#!/usr/bin/env python
+
+# Four groups (the original and three copies) are shaded in turn, twice,
+# with a budget smaller than any one group's code: each one JITed evicts
+# the one before it, so each run of the second pass must JIT its group
+# again, yet print the same.
+command += (osl_app("testshade") + "-g 1 1 --groupcopies 3 -iters 2 "
+            + "--options jit_memory_budget=1 -param scale 2 test --runstats-json "
+            + "| grep \"scale =\\|jit_evictions\\|jit_rejits\" >> out.txt 2>&1 ;\n")
+
+# Without a budget, nothing is evicted.
+command += (osl_app("testshade") + "-g 1 1 --groupcopies 3 -iters 2 "
+            + "-param scale 2 test --runstats-json "
+            + "| grep \"scale =\\|jit_evictions\\|jit_rejits\" >> out.txt 2>&1 ;\n")
+
+# Variants of a group are evicted and JITed again just like the group:
+# here only the no-derivatives variant of each group is ever compiled.
+command += (osl_app("testshade") + "-g 1 1 --groupcopies 3 -iters 2 "
+            + "--options jit_memory_budget=1,opt_noderivs_raytypes=16 "
+            + "--raytype diffuse -param scale 2 test --runstats-json "
+            + "| grep \"scale =\\|jit_evictions\\|jit_rejits\\|noderivs_variants\" >> out.txt 2>&1 ;\n")
@@ -0,0 +1,20 @@
+#!/usr/bin/env python
+
+# A chain of five layers, JITed first as one module and then split into
+# four (with llvm_jit_partition_minops=1, even this small group is big
+# enough to split).  The results must be the same either way.
+groupsetup = ""
+for i in range(5) :
+    groupsetup += ("-layer L%d -param name L%d -param id %d " % (i, i, i+1))
+    if i == 4 :
+        groupsetup += "-param report 1 "
+    groupsetup += "chain "
+    if i > 0 :
+        groupsetup += ("-connect L%d out L%d in " % (i-1, i))
+
+command += (osl_app("testshade") + "-t 1 -g 2 2 " + groupsetup
+            + "--runstats-json | grep \"^L\\|groups_partitioned\" >> out.txt 2>&1 ;\n")
+command += (osl_app("testshade") + "-t 1 -g 2 2 "
+            + "--options llvm_jit_partitions=4,llvm_jit_partition_minops=1 "
+            + groupsetup
+            + "--runstats-json | grep \"^L\\|groups_partitioned\" >> out.txt 2>&1 ;\n")
@@ -0,0 +1,13 @@
+#!/usr/bin/env python
+
+# With jit_perf_map, the group's init and layer functions must show up in
+# /tmp/perf-<pid>.map under their readable names.  The shell records its
+# pid and then becomes testshade, so we know which map file to look in.
+command += ("sh -c 'echo $$ > pid.txt ; exec " + osl_app("testshade")
+            + "-g 1 1 --groupname perfmap --options jit_perf_map=1 "
+            + "-layer shadelayer test' >> out.txt 2>&1 ;\n")
+command += ("grep -c \" osl:perfmap:init$\" /tmp/perf-`cat pid.txt`.map "
+            + ">> out.txt 2>&1 ;\n")
+command += ("grep -c \" osl:perfmap:shadelayer(test)$\" /tmp/perf-`cat pid.txt`.map "
+            + ">> out.txt 2>&1 ;\n")
+command += "rm -f /tmp/perf-`cat pid.txt`.map ;\n"
@@ -0,0 +1,11 @@
+#!/usr/bin/env python
+
+# Without jit_fma (the default), code JITed for the generic baseline and
+# for the host CPU computes the same results, and the stats say what the
+# JIT target was.
+command += (osl_app("testshade") + "-g 1 1 --options jit_target=generic test "
+            + "--runstats-json | grep \"r =\\|sin =\\|\\\"jit_target\\\"\" >> out.txt 2>&1 ;\n")
+command += (osl_app("testshade") + "-g 1 1 --options jit_target=host test "
+            + "| grep \"r =\\|sin =\" >> out.txt 2>&1 ;\n")
+command += (osl_app("testshade") + "-g 1 1 --options jit_target=host test "
+            + "--runstats-json | grep -c \"\\\"jit_target\\\": \\\".* (llvm_ops \" >> out.txt 2>&1 ;\n")
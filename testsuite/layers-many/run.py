@@ -0,0 +1,25 @@
+#!/usr/bin/env python
+
+# A chain of 70 lazy layers, each adding its id to what the one before it
+# computed, so that their "layer_run" flags span three words.  Layers L40
+# and L69 (the last) report what they computed.  Whether they run lazily
+# or as entry layers, and whether or not group data is cleared first (for
+# which only what might be read uninitialized is zeroed), the results
+# must be the same.
+nlayers = 70
+groupsetup = ""
+for i in range(nlayers) :
+    groupsetup += ("-layer L%d -param name L%d -param id %d " % (i, i, i))
+    if i == 40 or i == nlayers-1 :
+        groupsetup += "-param report 1 "
+    groupsetup += "chain "
+    if i > 0 :
+        groupsetup += ("-connect L%d out L%d in " % (i-1, i))
+
+entries = "-entry L40 -entry L%d " % (nlayers-1)
+
+# (Only the reports, not the 69 "Connect" lines of each run.)
+for clear in (0, 1) :
+    for e in ("", entries) :
+        command += (osl_app("testshade") + "-g 1 1 --options clearmemory=%d " % clear
+                    + groupsetup + e + "| grep \"^L\" >> out.txt 2>&1 ;\n")
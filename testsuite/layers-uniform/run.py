@@ -0,0 +1,24 @@
+#!/usr/bin/env python
+
+# Layer a is the same for every point, so with opt_uniform_layers it runs
+# only for the first of the four points (all on the same object), whose
+# results are reused for the other three; without, it runs for each.
+# Either way, c sees the same values.
+command += (osl_app("testshade") + "-t 1 -g 2 2 --options opt_uniform_layers=1 "
+            + "-layer alayer a -layer clayer c "
+            + "--connect alayer f_out clayer f_in --connect alayer c_out clayer c_in "
+            + "--runstats-json | grep \"c: \\|uniform\" >> out.txt 2>&1 ;\n")
+command += (osl_app("testshade") + "-t 1 -g 2 2 --options opt_uniform_layers=0 "
+            + "-layer alayer a -layer clayer c "
+            + "--connect alayer f_out clayer f_in --connect alayer c_out clayer c_in "
+            + "--runstats-json | grep \"c: \\|uniform\" >> out.txt 2>&1 ;\n")
+
+# Layer b reads an attribute with getattribute, so it's only uniform if
+# the renderer lists it among the "uniform_attributes".  (Folding it at
+# optimize time would leave nothing to run.)
+for uniformattrs in [ ",uniform_attributes=camera:fov", "" ] :
+    command += (osl_app("testshade") + "-t 1 -g 2 2 "
+                + "--options opt_uniform_layers=1,opt_fold_getattribute=0"
+                + uniformattrs + " -layer blayer b -layer clayer c "
+                + "--connect blayer f_out clayer f_in "
+                + "--runstats-json | grep \"c: \\|uniform\" >> out.txt 2>&1 ;\n")
@@ -0,0 +1,22 @@
+#!/usr/bin/env python
+
+# Print what the shaders printed before testshade's --runstats-json
+# output, then how many instances were merged, and whether the group's
+# own merge time was reported (it's a time, so only check that it's sane).
+
+from __future__ import print_function
+import json
+import sys
+
+lines = open(sys.argv[1]).read().split("\n")
+start = lines.index("{")
+for line in lines[:start] :
+    if line.startswith ("a:") or line.startswith ("b:") :
+        print (line)
+stats = json.loads ("\n".join(lines[start:]))
+print ("merged:", stats["stats"]["merged_inst"] + stats["stats"]["merged_inst_opt"])
+total = stats["stats"]["inst_merge_time"]
+for g in stats["groups"] :
+    t = g["inst_merge_time"]
+    print ("group", g["name"], "inst_merge_time reported:",
+           isinstance(t, (int, float)) and 0 <= t <= total + 1e-6)
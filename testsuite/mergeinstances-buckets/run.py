@@ -0,0 +1,24 @@
+#!/usr/bin/env python
+
+# Instance merging only compares the layers whose signature hashes match.
+# Here a1 and a2 are identical, as are a3 and a4, but the two pairs differ
+# (by Kd), so they land in different buckets, and each pair is merged.
+# The per-group merge time must be reported too.
+layers = ("-param Kd 0.5 -layer a1 a -param Kd 0.5 -layer a2 a "
+          + "-param Kd 0.25 -layer a3 a -param Kd 0.25 -layer a4 a "
+          + "-layer blayer b "
+          + "-connect a1 Cout blayer C1 -connect a2 Cout blayer C2 "
+          + "-connect a3 Cout blayer C3 -connect a4 Cout blayer C4 ")
+command += (osl_app("testshade") + "--groupname mergegroup " + layers
+            + "--runstats-json > stats.json 2>&1 ;\n")
+command += (sys.executable + " " + os.path.join(test_source_dir, "checkmerge.py")
+            + " stats.json >> out.txt 2>&1 ;\n")
+
+# The layers of each pair still hash the same if they have userdata, but
+# with opt_merge_instances_with_userdata=0 they must not be merged: the
+# hash is only a hint, and a collision must still be told apart.
+command += (osl_app("testshade") + "--groupname mergegroup "
+            + "--options opt_merge_instances_with_userdata=0 " + layers
+            + "--runstats-json > stats2.json 2>&1 ;\n")
+command += (sys.executable + " " + os.path.join(test_source_dir, "checkmerge.py")
+            + " stats2.json >> out.txt 2>&1 ;\n")
@@ -0,0 +1,6 @@
+#!/usr/bin/env python
+
+# Diffuse rays (raytype bit 16) run a variant compiled without any
+# derivatives, camera rays the normal group.
+command += testshade("--options opt_noderivs_raytypes=16 --raytype diffuse test")
+command += testshade("--options opt_noderivs_raytypes=16 --raytype camera test")
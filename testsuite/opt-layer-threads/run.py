@@ -0,0 +1,19 @@
+#!/usr/bin/env python
+
+# Layers s1 and s2 don't depend on each other, so with opt_layer_threads
+# they are optimized concurrently, before comb.  The results must match
+# optimizing the layers one at a time.
+groupsetup = ("-param scale 2 -layer s1 src " +
+              "-param scale 3 -layer s2 src " +
+              "-layer comb comb " +
+              "-connect s1 f_out comb a -connect s1 c_out comb ca " +
+              "-connect s2 f_out comb b -connect s2 c_out comb cb ")
+
+command += testshade("-g 1 1 --options opt_layer_threads=1 " + groupsetup)
+command += testshade("-g 1 1 --options opt_layer_threads=4 " + groupsetup)
+command += testshade("-g 1 1 --options opt_layer_threads=0 " + groupsetup)
+
+# Check that s1 and s2 really were optimized concurrently.
+command += (osl_app("testshade") + "-g 1 1 --options opt_layer_threads=4 "
+            + groupsetup + "--runstats-json "
+            + "| grep opt_parallel_layers >> out.txt 2>&1 ;\n")
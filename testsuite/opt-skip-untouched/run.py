@@ -0,0 +1,22 @@
+#!/usr/bin/env python
+
+# Same results with and without skipping the ops untouched by the last
+# optimization pass.
+command += testshade("-g 1 1 --options opt_skip_untouched_ops=0 test")
+command += testshade("-g 1 1 --options opt_skip_untouched_ops=1 test")
+command += testshade("-g 1 1 -O0 test")
+
+# Skipping must leave exactly as many ops as revisiting every op does,
+# while actually skipping some.
+for w in [ "0", "1" ] :
+    command += (osl_app("testshade") + "-g 1 1 --options opt_skip_untouched_ops=" + w
+                + " test --runstats-json | grep \"\\\"postopt_ops\\\"\" > postopt_ops" + w
+                + ".txt 2>&1 ;\n")
+command += ("(test -s postopt_ops0.txt "
+            + "&& cmp -s postopt_ops0.txt postopt_ops1.txt "
+            + "&& echo \"postopt_ops same\" || echo \"postopt_ops differ\") "
+            + ">> out.txt ;\n")
+command += (osl_app("testshade") + "-g 1 1 --options opt_skip_untouched_ops=1 test "
+            + "--runstats-json | grep \"\\\"opt_ops_skipped\\\"\" "
+            + "| awk '{ print ($2+0 > 0) ? \"ops skipped\" : \"no ops skipped\" }' "
+            + ">> out.txt 2>&1 ;\n")
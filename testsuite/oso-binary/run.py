@@ -0,0 +1,17 @@
+#!/usr/bin/env python
+
+# Compile with --binary to also write test.osob, then make sure the shader
+# behaves identically whether it's loaded from the .oso or the .osob, and
+# that it really was loaded from the .osob only when that's allowed.
+oslcargs = "-Wall --binary"
+
+command += (osl_app("testshade") + "-g 1 1 --options load_osob=0 test "
+            + "--runstats-json | grep \"f=\\|sum=\\|masters\" >> out.txt 2>&1 ;\n")
+command += (osl_app("testshade") + "-g 1 1 --options load_osob=1 test "
+            + "--runstats-json | grep \"f=\\|sum=\\|masters\" >> out.txt 2>&1 ;\n")
+
+# A damaged .osob (whose header still looks right) is passed over for the
+# .oso without any error.
+command += "head -c 64 test.osob > short.osob && mv short.osob test.osob ;\n"
+command += (osl_app("testshade") + "-g 1 1 --options load_osob=1 test "
+            + "--runstats-json | grep \"f=\\|sum=\\|masters\\|ERROR\" >> out.txt 2>&1 ;\n")
@@ -0,0 +1,45 @@
+#!/usr/bin/env python
+
+# This test verifies that an output subset of a group runs only what its
+# outputs need.  The group looks like this:
+#
+#     layer A   (no connections)
+#     layer B   (connected downstream to E)
+#     layer C   (no connections)
+#     layer D   (no connections)
+#     layer E   (connected upstream to B, downstream to F and G)
+#     layer F   (connected upstream to E)
+#     layer G   (connected upstream to E, and it's the last layer)
+#
+# A subset for just E.out needs only E and the B that E pulls, and a
+# subset for just D.out only D, even though neither is the last layer.
+
+groupsetup = ("-layer A -param name A -param id 1 -param in 1.0 node " +
+              "-layer B -param name B -param id 2 -param in 2.0 node " +
+              "-layer C -param name C -param id 3 -param in 3.0 node " +
+              "-layer D -param name D -param id 4 -param in 4.0 node " +
+              "-layer E -param name E -param id 5 -param in 5.0 node -connect B out E in " +
+              "-layer F -param name F -param id 6 -param in 6.0 node -connect E out F in " +
+              "-layer G -param name G -param id 7 -param in 7.0 node -connect E out G in " +
+              "--options llvm_debug_layers=1 "
+              )
+
+def echoCmd(msg) :
+    if (platform.system () == 'Windows'):
+        return 'echo %s>> out.txt 2>&1 ;\n' % (msg)
+    return 'echo "%s" >> out.txt 2>&1 ;\n' % (msg)
+
+command += echoCmd('---') + echoCmd('subset for E.out:')
+command += testshade(groupsetup +
+                     "-groupoutputs -o E.out out.exr --outputsubset ")
+
+command += echoCmd('---') + echoCmd('subset for D.out:')
+command += testshade(groupsetup +
+                     "-groupoutputs -o D.out out.exr --outputsubset ")
+
+# Changing a lockgeom=0 param must reach the subset, which numbers its
+# symbols its own way.
+command += echoCmd('---') + echoCmd('reparam in subset for D.out:')
+command += testshade(groupsetup +
+                     "-groupoutputs -o D.out out.exr --outputsubset " +
+                     "-iters 2 -reparam D id 40 ")
@@ -0,0 +1,11 @@
+#!/usr/bin/env python
+
+# An instrumented run saves the group's profile next to its archive, and a
+# second run compiles the group with that profile, with the same results,
+# but with its three (lockgeom=0) params laid out by use and its two
+# branches weighted.
+command += testshade("-t 1 -g 2 2 --center --options pgo_instrument=1 " +
+                     "--archivegroup pgo.tar.gz test")
+command += 'grep "^branch\\|^taken" pgo.profile >> out.txt 2>&1 ;\n'
+command += (osl_app("testshade") + "-t 1 -g 2 2 --center --pgoprofile pgo.profile test "
+            + "--runstats-json | grep \"u = \\|pgo_\" >> out.txt 2>&1 ;\n")
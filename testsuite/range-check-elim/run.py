@@ -0,0 +1,7 @@
+#!/usr/bin/env python
+
+# All three indexed reads are provably in range, so none of them should
+# be range checked at runtime.
+command += testshade("-g 1 1 test")
+command += (osl_app("testshade") + "-g 1 1 --runstats-json test "
+            + "| grep range_checks_eliminated >> out.txt 2>&1 ;\n")
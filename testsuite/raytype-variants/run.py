@@ -0,0 +1,13 @@
+#!/usr/bin/env python
+
+# Each ray type runs its own lazily compiled variant of the group
+command += testshade("--options opt_raytype_variants=1 --raytype glossy test")
+command += testshade("--options opt_raytype_variants=1 --raytype camera test")
+
+# The camera variant drops otherscale, so k is numbered differently in it
+# than in the group; changing k after the variant is built must still
+# change k in the variant.
+command += testshade("-g 1 1 -iters 2 --options opt_raytype_variants=1 --raytype camera --layer lay -param k 5 reparam -reparam lay k 15")
+command += (osl_app("testshade") + "-g 1 1 -iters 2 --options opt_raytype_variants=1 "
+            + "--raytype camera --layer lay -param k 5 reparam -reparam lay k 15 "
+            + "--runstats-json | grep raytype_variants >> out.txt 2>&1 ;\n")
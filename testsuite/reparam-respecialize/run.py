@@ -0,0 +1,23 @@
+#!/usr/bin/env python
+
+# Change a parameter whose value was optimized into the code: with
+# opt_respecialize the second iteration sees the new value, without it the
+# change is refused.
+command += testshade("-g 1 1 -iters 2 --options opt_respecialize=1 --layer testlay -param scale 5.0 test -reparam testlay scale 15.0")
+command += testshade("-g 1 1 -iters 2 --layer testlay -param scale 5.0 test -reparam testlay scale 15.0")
+
+# The optimizer drops the unused first params, so the changed param has a
+# different index in the optimized layer than in the unoptimized one that
+# the new specialization is made from.
+command += testshade("-g 1 1 -iters 2 --options opt_respecialize=1 --layer testlay -param scale 5.0 unusedfirst -reparam testlay scale 15.0")
+
+# Re-specializing over and over frees the older specializations once no
+# execution uses them any more, without disturbing the ones that follow.
+command += (osl_app("testshade") + "-g 1 1 -iters 4 --options opt_respecialize=1 "
+            + "--layer testlay -param scale 5.0 test -reparam testlay scale 15.0 "
+            + "--runstats-json | grep \"scale=\\|respecializations\" >> out.txt 2>&1 ;\n")
+
+# With two layers, changing the downstream one keeps the upstream layer's
+# code, and changing the upstream one redoes both.
+command += testshade("-g 1 1 -iters 2 --options opt_respecialize=1 --layer up -param scale 2.0 upstream --layer testlay test --connect up out testlay scale -reparam testlay count 4")
+command += testshade("-g 1 1 -iters 2 --options opt_respecialize=1 --layer up -param scale 2.0 upstream --layer testlay test --connect up out testlay scale -reparam up scale 3.0")
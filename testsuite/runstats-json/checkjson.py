@@ -0,0 +1,31 @@
+#!/usr/bin/env python
+
+# Parse the --runstats-json output of testshade (which follows anything
+# else testshade printed) strictly as JSON, and print the parts of it
+# that don't depend on timing or on the machine.
+
+from __future__ import print_function
+import json
+import sys
+
+def reject_constant (c) :
+    raise ValueError ("not valid JSON: " + c)
+
+lines = open(sys.argv[1]).read().split("\n")
+start = lines.index("{")
+stats = json.loads ("\n".join(lines[start:]), parse_constant=reject_constant)
+print ("parsed")
+
+for key in [ "version", "llvm_version", "stats", "jit_target",
+             "llvm_jit_memory", "calls_not_inlined", "groups" ] :
+    print (key, "present" if key in stats else "MISSING")
+
+numeric = all (v is None or isinstance(v, (int, float))
+               for v in stats["stats"].values())
+print ("stats numeric:", numeric)
+for key in [ "masters", "groups", "groups_compiled", "instances" ] :
+    print (key + ":", stats["stats"][key])
+
+for g in stats["groups"] :
+    print ("group", g["name"], "optimized:", g["optimized"],
+           "layers:", g["layers"] > 0, "raytype_variants:", g["raytype_variants"])
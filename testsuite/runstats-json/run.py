@@ -0,0 +1,10 @@
+#!/usr/bin/env python
+
+# The --runstats-json output must parse as strict JSON (no NaN or Inf
+# spelled out, which the json module would otherwise let through).
+command += (osl_app("testshade") + "-g 2 2 --groupname statsgroup "
+            + "-layer uplayer up -layer downlayer down "
+            + "--connect uplayer f downlayer f "
+            + "--runstats-json > stats.json 2>&1 ;\n")
+command += (sys.executable + " " + os.path.join(test_source_dir, "checkjson.py")
+            + " stats.json >> out.txt 2>&1 ;\n")
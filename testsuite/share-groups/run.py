@@ -0,0 +1,22 @@
+#!/usr/bin/env python
+
+# The two copies of the group are identical, so the second shares the
+# first's optimized code; the original differs from them by its group
+# outputs, so it shares with neither.
+command += (osl_app("testshade") + "-g 1 1 --groupcopies 2 "
+            + "--options opt_share_groups=1 -param scale 2 test "
+            + "-groupoutputs -o Cout out.exr --runstats-json "
+            + "| grep \"scale =\\|groups_shared\" >> out.txt 2>&1 ;\n")
+
+# The copy shares the original's code, but re-specializing the original
+# must not change the copy.
+command += (osl_app("testshade") + "-g 1 1 --groupcopies 1 -iters 2 "
+            + "--options opt_share_groups=1,opt_respecialize=1 "
+            + "--layer lay -param scale 2 test "
+            + "-reparam lay scale 5 --runstats-json "
+            + "| grep \"scale =\\|groups_shared\\|respecializations\" >> out.txt 2>&1 ;\n")
+
+# By default, nothing is shared.
+command += (osl_app("testshade") + "-g 1 1 --groupcopies 2 "
+            + "-param scale 2 test --runstats-json "
+            + "| grep \"scale =\\|groups_shared\" >> out.txt 2>&1 ;\n")
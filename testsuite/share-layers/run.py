@@ -0,0 +1,12 @@
+#!/usr/bin/env python
+
+# The "up" layer of the copy is identical to that of the original group,
+# so with opt_share_layers the copy calls the original's compiled function
+# for it rather than JITing its own.
+groupsetup = ("-param scale 2 -layer up src -layer down sink " +
+              "-connect up f_out down f_in ")
+for share in [ "1", "0" ] :
+    command += (osl_app("testshade") + "-g 1 1 --groupcopies 1 "
+                + "--options opt_share_groups=0,opt_share_layers=" + share + " "
+                + groupsetup + "--runstats-json "
+                + "| grep \"f_in =\\|layers_shared\\|shared_layer_funcs\" >> out.txt 2>&1 ;\n")